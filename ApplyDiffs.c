@@ -2,7 +2,7 @@
  *
  *  Program:      ApplyDiffs.c
  *
- *  Version:      2.5 (22.11.2001)
+ *  Version:      2.6 (19.10.2026)
  *
  *  Purpose:      Applies diffs to a listfile
  *
@@ -11,7 +11,9 @@
  *                AMIGA-Commandline-Options:
  *
  *                   LISTDIR/A   path of the listfiles
- *                   DIFFDIR/A   path of the diffiles (diffiles must end with .list)
+ *                   DIFFDIR/A/M path of the diffiles (diffiles must end with .list)
+ *                               or tar-archive (.tar, .tar.gz, .tgz)
+ *                               several paths are applied in the given order
  *                   CHECKCRC/S  check crc of listfile before applying
  *                   FORCE/S     skip wrong/corrupted diffs, but apply all others
  *                   KEEP/S      keep a copy of the old list- and diffile even
@@ -19,12 +21,46 @@
  *                   NOSTATS/S   don't print statistics
  *                   QUIET/S     don't show progress
  *                   LOGFILE/N   name of logfile
+ *                   UNDO/K      path where the reverse diffs are written to
+ *                   REVERT/S    the diffiles are reverse diffs (undo-paths,
+ *                               newest first). Listfiles that did not exist
+ *                               before are removed.
+ *                   VERIFY/S    check if the diffs can be applied, but don't
+ *                               change any file
+ *                   TRANSACTION/S change the listfiles only if the diffs of
+ *                               all listfiles can be applied
+ *                   CHECKPOINT/S save the state from time to time, so an
+ *                               interrupted run can be continued
+ *                   BINARY/K    path where binary diffs (*.bdiff) of the
+ *                               applied diffs are written to
+ *                   KEYED/K     path where key-addressed diffs (*.kdiff) of
+ *                               the applied diffs are written to
+ *                   FUZZY/S     search hunks of original and hashed diffs
+ *                               near their line number, if the listfile has
+ *                               been changed locally
+ *                   DELTA/K     path where delta-files (*.delta) of the new
+ *                               listfiles are written to (see ReplayDelta)
+ *                   PIPELINE/S  check and apply one listfile after the
+ *                               other; the next listfile is checked while
+ *                               one is patched. Listfiles that fail the
+ *                               check are skipped, the others are applied.
+ *                   WORKERS/K/N number of listfiles that are checked at
+ *                               the same time before the diffs are applied
+ *                   DEVLIMIT/K/N number of WORKERS reading from the same
+ *                               device (default: 1 for disks, more for
+ *                               SSDs)
+ *                   MEMORY/K/N  memory budget of all file-buffers in KB;
+ *                               buffers get smaller and fewer listfiles
+ *                               are checked at the same time if it is
+ *                               used up
  *
  *
  *                UNIX-Commandline-Options:
  *
  *                   <listdir>   path of the listfiles
  *                   <diffdir>   path of the diffiles (diffiles must end with .list)
+ *                               or tar-archive (.tar, .tar.gz, .tgz)
+ *                               several paths are applied in the given order
  *                  optional:
  *                   -checkcrc   check crc of listfile before applying
  *                   -force      skip wrong/corrupted diffs, but apply all others
@@ -33,6 +69,38 @@
  *                   -nostats    don't print statistics
  *                   -quiet      don't show progress
  *                   -logfile    name of logfile
+ *                   -undo       path where the reverse diffs are written to
+ *                   -revert     the diffiles are reverse diffs (undo-paths,
+ *                               newest first). Listfiles that did not exist
+ *                               before are removed.
+ *                   -verify     check if the diffs can be applied, but don't
+ *                               change any file
+ *                   -transaction change the listfiles only if the diffs of
+ *                               all listfiles can be applied
+ *                   -checkpoint save the state from time to time, so an
+ *                               interrupted run can be continued
+ *                   -binary     path where binary diffs (*.bdiff) of the
+ *                               applied diffs are written to
+ *                   -keyed      path where key-addressed diffs (*.kdiff) of
+ *                               the applied diffs are written to
+ *                   -fuzzy      search hunks of original and hashed diffs
+ *                               near their line number, if the listfile has
+ *                               been changed locally
+ *                   -delta      path where delta-files (*.delta) of the new
+ *                               listfiles are written to (see ReplayDelta)
+ *                   -pipeline   check and apply one listfile after the
+ *                               other; the next listfile is checked while
+ *                               one is patched. Listfiles that fail the
+ *                               check are skipped, the others are applied.
+ *                   -workers    number of listfiles that are checked at
+ *                               the same time before the diffs are applied
+ *                   -devlimit   number of workers reading from the same
+ *                               device (default: 1 for disks, more for
+ *                               SSDs)
+ *                   -memory     memory budget of all file-buffers in KB;
+ *                               buffers get smaller and fewer listfiles
+ *                               are checked at the same time if it is
+ *                               used up
  *
  *
  *  Author:       Andre Bernhardt <ab@imdb.com>
@@ -77,11 +145,14 @@
 /*#define IMDB_DEBUG*/
 
 /* 2.3 Packer & options -> Makefile */
+/* 2.6 with IMDB_ZLIB compressed listfiles are patched directly (zlib) */
+#ifndef IMDB_ZLIB
 #define IMDB_GZIP
 #define IMDBV_FILE_PACKER_NAME      "gzip"
 #define IMDBV_FILE_PACKER_EXT       ".gz"
 #define IMDBV_FILE_PACKER_PACK      "-4"
 #define IMDBV_FILE_PACKER_UNPACK    "-d"
+#endif
 
 /* ************************* */
 
@@ -98,6 +169,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#ifdef IMDB_THREADS
+#include <pthread.h>
+#endif
 
 #ifdef NEXT
 #include <sys/dir.h>
@@ -107,7 +181,7 @@
 
 #endif /* SYS_UNIX*/
 
-#define VERSION "ApplyDiffs 2.5 (22.11.01)"
+#define VERSION "ApplyDiffs 2.6 (19.10.26)"
 static const char version[] ="$VER: "VERSION;
 
 /* Return values */
@@ -119,6 +193,21 @@ static const char version[] ="$VER: "VERSION;
 #define ADV_BUFFER_SIZE    512 * 1024
 #define ADV_MAX_LINESIZE     8 * 1024
 
+/* max. number of diff-directories (weeks) applied in one go */
+#define ADV_MAX_WEEKS       52
+
+/* CHECKPOINT: bytes of output between two checkpoints */
+#ifndef ADV_CHECKPOINT_SIZE
+#define ADV_CHECKPOINT_SIZE 16 * 1024 * 1024
+#endif
+
+/* FUZZY: lines a hunk is searched in front of and behind its line number, */
+/* and removed lines compared to find it */
+#ifndef ADV_FUZZY_WINDOW
+#define ADV_FUZZY_WINDOW   100
+#endif
+#define ADV_FUZZY_BLOCK      8
+
 /* Information on a diff */
 #define STATUS_OK       0  /* No error */
 #define STATUS_UNKNOWN -1  /* unknown statuts (e.g. file is gzipped) */ /*2.3*/
@@ -127,11 +216,15 @@ static const char version[] ="$VER: "VERSION;
 #define STATUS_VER      3  /* wrong file-diffile-combination */
 #define STATUS_SYN      4  /* Syntax-Error in Diff-File */
 #define STATUS_NEW      5  /* New file */
+#define STATUS_ABORT    8  /* not applied, because another listfile failed (TRANSACTION) */
 
 /* types */
 #define DIFF_TYPE_UNKNOWN     0
 #define DIFF_TYPE_ORIGINAL    1
 #define DIFF_TYPE_STRIPPED    2
+#define DIFF_TYPE_BINARY      3
+#define DIFF_TYPE_HASHED      4
+#define DIFF_TYPE_KEYED       5
 
 typedef struct DIFFINFO
  {
@@ -142,6 +235,12 @@ typedef struct DIFFINFO
   LONG  status;
   LONG  add;
   LONG  delete;
+  LONG  week;                      /* index of diff-directory */
+  struct DIFFINFO *next_week;      /* diffs of the same listfile for the following week */
+  LONG  nb_lines;                  /* number of lines of the patched listfile */
+  BOOL  f_packed;                  /* listfile has to be compressed again */
+  LONG  offset;                    /* position of diffs in tar-archive or -1 */
+  LONG  size;                      /* size of diffs in tar-archive */
  } DiffInfo;
 
 typedef struct
@@ -154,9 +253,29 @@ typedef struct
   LONG  f_nostats;
   LONG  f_quiet;
   char *p_logfile;
+  char *p_undodir;
+  LONG  f_revert;
+  LONG  f_verify;
+  LONG  f_transaction;
+  LONG  f_checkpoint;
+  char *p_bindir;
+  char *p_keydir;
+  LONG  f_fuzzy;
+  char *p_deltadir;
+  LONG  f_pipeline;
+  LONG *p_workers;
+  LONG *p_devlimit;
+  LONG *p_memory;
+  /* not part of the AMIGA-template */
+  LONG  nb_diffdirs;
+  char *p_diffdirs[ADV_MAX_WEEKS]; /* diff-directories in the order of application */
+  IMDB_Buffer *p_archives[ADV_MAX_WEEKS]; /* diff-directory is a tar-archive */
+  LONG  nb_workers;                /* listfiles tested at the same time */
+  LONG  dev_limit;                 /* workers per device, 0: depends on the device */
+  LONG  memory;                    /* memory budget in KB, 0: none */
  } AD_Commands;
 
-  AD_Commands  ad_cmds  = {NULL, NULL, FALSE, FALSE, FALSE, FALSE, FALSE, NULL};
+  AD_Commands  ad_cmds  = {NULL, NULL, FALSE, FALSE, FALSE, FALSE, FALSE, NULL, NULL, FALSE, FALSE, FALSE, FALSE, NULL, NULL, FALSE, NULL, FALSE, NULL, NULL, NULL, 0};
 
 /******************************************************************************
  * Functions dealing with CRC-sum
@@ -165,10 +284,6 @@ typedef struct
 
  /* global variable for tab */
  ULONG *pCrcTab = NULL;
- ULONG nCrc = 0xFFFFFFFFL;
- int nIndex;
- static char old_crc[16];
- static char new_crc[16];
 
 /*-----------------------------------------------------------------------------
  * Procedure:   init_crc
@@ -261,6 +376,8 @@ u_long *InitCRC(void)
 
 void calc_crc (char *str, ULONG *nCrc)
  {
+  int nIndex;
+
   while (*str)
    {
     nIndex = (int) ((*nCrc ^ *str++) & 0x000000FFL);
@@ -273,269 +390,1632 @@ void calc_crc (char *str, ULONG *nCrc)
  }
 
 /******************************************************************************
+ * Diff-Files
  *
+ * A DIFFDIR is either a directory or a tar-archive (*.tar, *.tar.gz, *.tgz)
+ * as found on the FTP-servers. Archives are not unpacked, the diffs are
+ * read from the archive directly. With IMDB_ZLIB single diff-files may be
+ * gzip-compressed (*.list.gz, *.diff.gz).
  ******************************************************************************
  */
 
 /*-----------------------------------------------------------------------------
- * Procedure:   checkfile_match
- *
- * Parameters:  listfile, diffile
+ * Procedure:   StrHasSuffix
  *
- * Comments:
+ * Returns:     TRUE, if p_str ends with p_suffix
  *-----------------------------------------------------------------------------
  */
 
-int checkfile_match(char *listfile, char *diffile, BOOL flag_verbose, DiffInfo *diffinfo)
+BOOL StrHasSuffix (char *p_str, char *p_suffix)
  {
-  IMDB_Buffer *list_buffer = NULL;
-  IMDB_Buffer *diff_buffer = NULL;
-  char        *p_diff_line;
-  char        *p_list_line;
-  LONG         status      = STATUS_OK;
+  LONG len = strlen (p_str);
+  LONG len_suffix = strlen (p_suffix);
 
-  /* open diff-file */
-  if (NULL == (diff_buffer = IMDBOpenBuffer (diffile, IMDBV_FILE_READ , ADV_BUFFER_SIZE)))
-   {
-    diffinfo->status = STATUS_IO;
-    if (flag_verbose)
-     printf ("Error: Can't open Diff-File\n");
-    return (RET_ERROR);
-   }
-
-  /* open old listfile */
-  if (IMDBExistFile(listfile))
-   {
-    list_buffer = IMDBOpenBuffer (listfile, IMDBV_FILE_READ, ADV_BUFFER_SIZE);
-   }
-
-  if (DIFF_TYPE_ORIGINAL == diffinfo->type)
-/****** Original Diff-File *********/
-   {
-    /* if this file does not exist, check if the diffs contains only data that */
-    /* adds something -> new file */
-    /* check if the diff-version matches the listfile */
-    if (NULL == list_buffer)
-     {/* new file ? */
-      /* check if the diff-file contains no line starting with '<' */
-      status = STATUS_NEW;
-      while (0 == IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-       {
-        if (*p_diff_line == '<')
-         {
-          status = STATUS_VER;
-          if (flag_verbose)
-           printf ("Error: Missing Listfile\n");
-          break;
-         }
-       }
-      if ((flag_verbose) && (STATUS_NEW == status))
-       printf ("New Listfile\n");
-     }
-    else
-     {
-      /* check if the diff-version matches the listfile */
-      /* get the 2nd line in the diff-file and compare it with the 1st line in listfile */
-      if ((0 == IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-        &&(0 == IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE)) /* 2nd line */
-        &&(0 == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
-       {
-        if (0 != strcmp (p_diff_line+2, p_list_line))
-         {
-          status = STATUS_VER;
-          if (flag_verbose)
-           printf ("Error: Unsuitable Diff-File\n");
-         }
-        else
-         if (flag_verbose)
-          printf ("OK.\n");
-       }
-      else
-       status = STATUS_IO;
-     }
-   }
-/****** Stripped Diff-File *********/
-  else
-   {
-    /* if the listfile does not exist, check if the diffs contains only data that */
-    /* adds something -> new file */
-    /* check if the diff-version matches the listfile */
-    if (NULL == list_buffer)
-     {/* new file ? */
-      IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE);
-      if (0 == strcmp(p_diff_line, "Apply on: ---"))
-       {
-        status = STATUS_NEW;
-        if (flag_verbose)
-        printf ("New Listfile\n");
-       }
-      else
-       {
-        status = STATUS_VER;
-        if (flag_verbose)
-         printf ("Error: Missing Listfile\n");
-       }
-     }
-    else
-     {
-      /* check if the diff-version matches the listfile */
-      /* get the 1st line in the diff-file and compare it with the 1st line in listfile */
-      if ((0 == IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-        &&(0 == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
-       {
-        if (0 != strcmp (p_diff_line+10, p_list_line))
-         {
-          status = STATUS_VER;
-          if (flag_verbose)
-           printf ("Error: Unsuitable Diff-File\n");
-         }
-        else
-         if (flag_verbose)
-          printf ("OK.\n");
-       }
-      else
-       status = STATUS_IO;
-     }
-   }
+  if (len <= len_suffix)
+   return (FALSE);
+#ifdef SYS_AMIGA
+  return ((BOOL) (0 == strnicmp (&p_str[len-len_suffix], p_suffix, len_suffix)));
+#else
+  return ((BOOL) (0 == strncmp (&p_str[len-len_suffix], p_suffix, len_suffix)));
+#endif
+ }
 
+/*-----------------------------------------------------------------------------
+ * Procedure:   IsGzipName, IsArchiveName, IsDiffName
+ *
+ * Purpose:     check filenames
+ *-----------------------------------------------------------------------------
+ */
 
-  /* Close Buffer */
-  IMDBCloseBuffer (diff_buffer);
-  if (list_buffer)
-   IMDBCloseBuffer (list_buffer);
+BOOL IsGzipName (char *p_name)
+ {
+#ifdef IMDB_ZLIB
+  return ((BOOL) ((StrHasSuffix (p_name, ".gz")) || (StrHasSuffix (p_name, ".tgz"))));
+#else
+  return (FALSE);
+#endif
+ }
 
-  if (diffinfo)
-   diffinfo->status = status;
+BOOL IsArchiveName (char *p_name)
+ {
+  return ((BOOL) ((StrHasSuffix (p_name, ".tar"))
+                ||((IsGzipName (p_name)) && ((StrHasSuffix (p_name, ".tar.gz")) || (StrHasSuffix (p_name, ".tgz"))))));
+ }
 
-  return (RET_OK);
+BOOL IsDiffName (char *p_name)
+ {
+  if ((StrHasSuffix (p_name, ".list")) || (StrHasSuffix (p_name, ".diff")) || (StrHasSuffix (p_name, ".bdiff"))
+    ||(StrHasSuffix (p_name, ".hdiff")) || (StrHasSuffix (p_name, ".kdiff")))
+   return (TRUE);
+  return ((BOOL) ((IsGzipName (p_name)) && ((StrHasSuffix (p_name, ".list.gz")) || (StrHasSuffix (p_name, ".diff.gz"))
+                                          ||(StrHasSuffix (p_name, ".bdiff.gz")) || (StrHasSuffix (p_name, ".hdiff.gz"))
+                                          ||(StrHasSuffix (p_name, ".kdiff.gz")))));
  }
 
 /*-----------------------------------------------------------------------------
- * Procedure:   checkfile_crc
- *
- * Parameters:  listfile
+ * Procedure:   GetManifestName, IsChunkedList, ListfileFlags
  *
- * Comments:
+ * Purpose:     A listfile can be stored as chunk-files with a manifest
+ *              (movies.list.chunks, see ChunkList). If there is no plain
+ *              listfile but a manifest, the listfile is read through the
+ *              manifest and only the changed chunks are written.
  *-----------------------------------------------------------------------------
  */
 
-int checkfile_crc(char *listfile, BOOL flag_verbose)
+void GetManifestName (char *p_name, char *listfile, char *p_suffix)
  {
-  IMDB_Buffer *list_buffer = NULL;
-  char        *p_list_line;
-  LONG         status      = STATUS_OK;
-  LONG         progress    = 0;
-  LONG         tprogress   = 0;
+  sprintf (p_name, "%.236s" IMDBV_CHUNKS_EXT "%s", listfile, p_suffix);
+ }
 
-  /* Reset CRC */
-  nCrc = 0xFFFFFFFFL;
-  new_crc [0] = '\0';
-  old_crc [0] = '\0';
+BOOL IsChunkedList (char *listfile)
+ {
+  char fname [256];
 
-  /* open old listfile */
-  if ((list_buffer = IMDBOpenBuffer (listfile, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE, ADV_BUFFER_SIZE))
-    &&(0 == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
-   {
-    if (0 == strncmp (p_list_line, "CRC: ", strlen("CRC: ")))
-     {
-      strncpy (old_crc, p_list_line, 15);
+  if (IMDBExistFile (listfile))
+   return (FALSE);
+  GetManifestName (fname, listfile, "");
+  return (IMDBExistFile (fname));
+ }
 
-      /* calculate CRC */
-      while (0 == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE))
-       {
-        if ((flag_verbose) && (progress != (tprogress = (list_buffer->filepos*100/list_buffer->filesize))))
-         {
-          progress = tprogress;
-          printf ("\b\b\b\b\b\b(%03i%%)", progress);
-          fflush (stdout);
-         }
+LONG ListfileFlags (char *listfile)
+ {
+  if (IsGzipName (listfile))
+   return (IMDBV_FILE_GZIP);
+  if (IsChunkedList (listfile))
+   return (IMDBV_FILE_CHUNKS);
+  return (0);
+ }
 
-        /* calculate CRC for next line */
-        calc_crc (p_list_line, &nCrc);
-       }
+/*-----------------------------------------------------------------------------
+ * Procedure:   GetDiffName
+ *
+ * Purpose:     build the full filename of a diff-file
+ *-----------------------------------------------------------------------------
+ */
 
-      /* compare CRC */
-      sprintf(new_crc, "CRC: 0x%08X", nCrc);
-      if (0 == strcmp (old_crc, new_crc))
-       {
-        if (flag_verbose)
-         printf ("\b\b\b\b\b\b- CRC-Checksum O.K.\n");
-       }
-      else
-       {
-        if (flag_verbose)
-         printf ("\b\b\b\b\b\b- CRC-Checksum Error\n");
-        status = STATUS_CRC;
-       }
-     }
+void GetDiffName (char *p_name, DiffInfo *diffinfo)
+ {
+  strcpy (p_name, ad_cmds.p_diffdirs[diffinfo->week]);
+  strncat(p_name, diffinfo->fname_diff, 255-strlen(p_name));
+ }
 
-    /* Close Buffer */
-    IMDBCloseBuffer (list_buffer);
-   }
+/*-----------------------------------------------------------------------------
+ * Procedure:   OpenDiffBuffer
+ *
+ * Purpose:     open the diffs of a DiffInfo, from a file, a compressed file
+ *              or from a tar-archive
+ *
+ * Parameters:  diffinfo
+ *              flags     IMDBV_FILE_READ, IMDBV_FILE_GETSIZE, IMDBV_FILE_THREAD
+ *
+ * Returns:     buffer or NULL if failed
+ *-----------------------------------------------------------------------------
+ */
 
-  return (status);
+IMDB_Buffer *OpenDiffBuffer (DiffInfo *diffinfo, LONG flags)
+ {
+  char diffname [256];
+
+  if (ad_cmds.p_archives[diffinfo->week])
+   return (IMDBOpenBufferSection (ad_cmds.p_archives[diffinfo->week], diffinfo->offset, diffinfo->size, ADV_BUFFER_SIZE));
+
+  GetDiffName (diffname, diffinfo);
+  if (IsGzipName (diffname))
+   flags |= IMDBV_FILE_GZIP;
+  return (IMDBOpenBuffer (diffname, flags, ADV_BUFFER_SIZE));
  }
 
 /******************************************************************************
+ *  Binary diffs
+ ******************************************************************************
  *
+ * A binary diff (*.bdiff) holds the same changes as a stripped diff, but
+ * nothing has to be parsed when it is applied: the hunk-headers are
+ * numbers, every added line comes with its length and is handed on where
+ * it is in the buffer, and size, number of lines and CRC of the patched
+ * listfile are known before the first line is read.
+ *
+ * Binary diffs are written with the option BINARY while original or
+ * stripped diffs (of one or several weeks) are applied:
+ *
+ *   IMDB-BinaryDiff 1\n              magic
+ *   <size><lines><crc>               patched listfile: size in bytes, number
+ *                                    of lines and CRC, 4 bytes each, most
+ *                                    significant byte first
+ *   Apply on: <first line>\n         as in stripped diffs
+ *   <copy><delete><add><bytes>       hunk: lines to copy, to delete and to
+ *                                    add, size of the added lines
+ *   <len><line>\0                    added line
+ *   ...
+ *   <0><0><0><0>                     end of diffs
+ *
+ * All numbers but those of the header are varints: 7 bits per byte, lowest
+ * first, the highest bit is set if another byte follows.
  ******************************************************************************
  */
 
+#define BINDIFF_MAGIC     "IMDB-BinaryDiff 1"
+#define BINDIFF_EXT       ".bdiff"
+
 /*-----------------------------------------------------------------------------
- * Procedure:  StrChangeSuffix
+ * Procedure:   put_varint, put_ulong, get_ulong
  *
- * Purpose:    replace suffix of a string by another string.
+ * Purpose:     store and fetch the numbers of a binary diff
  *-----------------------------------------------------------------------------
  */
 
-void StrChangeSuffix (char* p_str, char* p_suffix)
+static LONG put_varint (UBYTE *p_mem, ULONG value)
  {
-  LONG len;
+  LONG len = 0;
 
+  while (value >= 0x80)
+   {
+    p_mem[len++] = (UBYTE) (value | 0x80);
+    value >>= 7;
+   }
+  p_mem[len++] = (UBYTE) value;
+  return (len);
+ }
 
-  len = strlen (p_str);
-  while ((len>10) && (p_str[len-1]!='.'))
-   len--;
-
-  if (len > 10)
-   p_str[len-1] = '\0';
+static void put_ulong (UBYTE *p_mem, ULONG value)
+ {
+  p_mem[0] = (UBYTE) (value >> 24);
+  p_mem[1] = (UBYTE) (value >> 16);
+  p_mem[2] = (UBYTE) (value >>  8);
+  p_mem[3] = (UBYTE) value;
+ }
 
-  strcat (p_str, p_suffix);
+static ULONG get_ulong (UBYTE *p_mem)
+ {
+  return (((ULONG) p_mem[0] << 24) | ((ULONG) p_mem[1] << 16) | ((ULONG) p_mem[2] << 8) | (ULONG) p_mem[3]);
  }
 
 /*-----------------------------------------------------------------------------
- * Procedure:  GetPatch
+ * Procedure:   ReadVarint
  *
- * Purpose:    Parse a patchline
+ * Purpose:     read a number of a binary diff
+ *
+ * Parameters:  diff_buffer  binary diff
+ *              p_value      number (0 ... 2^31-1)
+ *
+ * Returns:     IMDBE_NO_ERROR, IMDBE_FILE_EOF or IMDBE_FILE_READ
  *-----------------------------------------------------------------------------
  */
 
- struct TypPatch
-  {
-   char cmd;
-   LONG i_start;
-   LONG i_end;
-   LONG o_start;
-   LONG o_end;
-  };
-
-void GetPatch(struct TypPatch *patch, char *buffer)
+LONG ReadVarint (IMDB_Buffer *diff_buffer, LONG *p_value)
  {
-  char *c;
-  char cmd;
-
-  patch -> cmd     = '\0';
-  patch -> i_start = 0;
-  patch -> i_end   = 0;
-  patch -> o_start = 0;
-  patch -> o_end   = 0;
+  UBYTE *p_byte;
+  ULONG  value = 0;
+  LONG   shift;
 
-  if (buffer)
+  for (shift = 0; shift < 32; shift += 7)
    {
-    /* erster Teil */
-    c = buffer;
-    while (isdigit(*buffer)) buffer ++;
-    cmd = *buffer;
+    if (1 != IMDBReadBuffer (diff_buffer, &p_byte, 1))
+     return ((shift) ? IMDBE_FILE_READ : IMDBE_FILE_EOF);
+    value |= ((ULONG) (*p_byte & 0x7F)) << shift;
+    if (0 == (*p_byte & 0x80))
+     {
+      if (value > 0x7FFFFFFFL)
+       return (IMDBE_FILE_READ);
+      *p_value = (LONG) value;
+      return (IMDBE_NO_ERROR);
+     }
+   }
+  return (IMDBE_FILE_READ);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ReadBinDiffHeader
+ *
+ * Purpose:     check the magic of a binary diff and get the data of the
+ *              patched listfile. The "Apply on:"-line is read next.
+ *
+ * Parameters:  diff_buffer  binary diff
+ *              p_size       size of the patched listfile in bytes
+ *              p_lines      number of lines of the patched listfile
+ *              p_crc        CRC of the patched listfile
+ *
+ * Returns:     IMDBE_NO_ERROR or IMDBE_FILE_READ
+ *-----------------------------------------------------------------------------
+ */
+
+LONG ReadBinDiffHeader (IMDB_Buffer *diff_buffer, LONG *p_size, LONG *p_lines, ULONG *p_crc)
+ {
+  char  *p_diff_line;
+  UBYTE *p_data;
+
+  if ((IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
+    ||(0 != strcmp (p_diff_line, BINDIFF_MAGIC))
+    ||(12 != IMDBReadBuffer (diff_buffer, &p_data, 12)))
+   return (IMDBE_FILE_READ);
+
+  *p_size  = (LONG) get_ulong (p_data);
+  *p_lines = (LONG) get_ulong (p_data + 4);
+  *p_crc   = get_ulong (p_data + 8);
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Binary diffs are written like the reverse diffs of the undo-log: they get
+ * every line of the new listfile together with the information whether it
+ * has been copied from the old listfile, and every line removed from the
+ * old listfile. Size, lines and CRC are filled in when the file is closed.
+ *-----------------------------------------------------------------------------
+ */
+
+typedef struct
+ {
+  IMDB_Buffer *buffer;             /* binary diff-file */
+  char *fname;                     /* filename of binary diff-file */
+  LONG  nb_copy;                   /* lines copied since the last hunk */
+  LONG  nb_delete;                 /* removed lines of the current hunk */
+  LONG  nb_insert;                 /* added lines of the current hunk */
+  UBYTE *text;                     /* added lines of the current hunk */
+  LONG  textsize;                  /* size of memory for text */
+  LONG  textlen;                   /* bytes used of text */
+  BOOL  f_header;                  /* "Apply on:"-line written? */
+  LONG  error;                     /* IMDBE_xxx */
+ } BinDiffLog;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   OpenBinDiff
+ *
+ * Purpose:     create the binary diff-file for a listfile
+ *
+ * Parameters:  fname   name of the binary diff-file
+ *
+ * Returns:     pointer to BinDiffLog or NULL if failed
+ *-----------------------------------------------------------------------------
+ */
+
+BinDiffLog *OpenBinDiff (char *fname)
+ {
+  BinDiffLog *bindiff;
+  UBYTE       header[12];
+
+  if (bindiff = IMDBAllocMemory (sizeof (BinDiffLog)))
+   {
+    bindiff->fname     = NULL;
+    bindiff->text      = NULL;
+    bindiff->textsize  = 16 * 1024;
+    if ((NULL == (bindiff->fname  = IMDBAllocMemory (strlen (fname) + 1)))
+     || (NULL == (bindiff->text   = IMDBAllocMemory (bindiff->textsize)))
+     || (NULL == (bindiff->buffer = IMDBOpenBuffer (fname, IMDBV_FILE_WRITE, ADV_BUFFER_SIZE))))
+     {
+      if (bindiff->fname)
+       IMDBFreeMemory (bindiff->fname);
+      if (bindiff->text)
+       IMDBFreeMemory (bindiff->text);
+      IMDBFreeMemory (bindiff);
+      return (NULL);
+     }
+    strcpy (bindiff->fname, fname);
+    bindiff->nb_copy   = 0;
+    bindiff->nb_delete = 0;
+    bindiff->nb_insert = 0;
+    bindiff->textlen   = 0;
+    bindiff->f_header  = FALSE;
+    bindiff->error     = IMDBE_NO_ERROR;
+
+    /* the data of the new listfile is filled in at the end */
+    memset (header, 0, sizeof (header));
+    if ((IMDBWriteBuffer (bindiff->buffer, BINDIFF_MAGIC "\n", strlen (BINDIFF_MAGIC) + 1))
+      ||(IMDBWriteBuffer (bindiff->buffer, header, sizeof (header))))
+     bindiff->error = IMDBE_FILE_WRITE;
+   }
+
+  return (bindiff);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   bindiff_write
+ *
+ * Purpose:     write data of any size to the binary diff-file
+ *-----------------------------------------------------------------------------
+ */
+
+static void bindiff_write (BinDiffLog *bindiff, APTR p_data, LONG size)
+ {
+  UBYTE *p_mem = p_data;
+  LONG   len;
+
+  while ((size > 0) && (IMDBE_NO_ERROR == bindiff->error))
+   {
+    len = (size > ADV_BUFFER_SIZE / 2) ? ADV_BUFFER_SIZE / 2 : size;
+    bindiff->error = IMDBWriteBuffer (bindiff->buffer, p_mem, len);
+    p_mem += len;
+    size  -= len;
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   bindiff_header
+ *
+ * Purpose:     write the "Apply on:"-line with the first line of the old
+ *              listfile, or "---" for a new listfile (p_line is NULL)
+ *-----------------------------------------------------------------------------
+ */
+
+static void bindiff_header (BinDiffLog *bindiff, char *p_line)
+ {
+  if (!bindiff->f_header)
+   {
+    bindiff_write (bindiff, "Apply on: ", 10);
+    if (p_line)
+     bindiff_write (bindiff, p_line, strlen (p_line));
+    else
+     bindiff_write (bindiff, "---", 3);
+    bindiff_write (bindiff, "\n", 1);
+    bindiff->f_header = TRUE;
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   bindiff_flush
+ *
+ * Purpose:     write the current hunk of the binary diff
+ *-----------------------------------------------------------------------------
+ */
+
+static void bindiff_flush (BinDiffLog *bindiff)
+ {
+  UBYTE hunk[20];
+  LONG  len;
+
+  if ((0 == bindiff->nb_delete) && (0 == bindiff->nb_insert))
+   return;
+
+  len  = put_varint (hunk, bindiff->nb_copy);
+  len += put_varint (&hunk[len], bindiff->nb_delete);
+  len += put_varint (&hunk[len], bindiff->nb_insert);
+  len += put_varint (&hunk[len], bindiff->textlen);
+  bindiff_write (bindiff, hunk, len);
+  bindiff_write (bindiff, bindiff->text, bindiff->textlen);
+
+  bindiff->nb_copy   = 0;
+  bindiff->nb_delete = 0;
+  bindiff->nb_insert = 0;
+  bindiff->textlen   = 0;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   BinDiffNewLine
+ *
+ * Purpose:     account for a line of the new listfile
+ *
+ * Parameters:  bindiff  binary diff
+ *              p_line   line
+ *              f_old    TRUE, if the line has been copied from the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void BinDiffNewLine (BinDiffLog *bindiff, char *p_line, BOOL f_old)
+ {
+  LONG   len;
+  UBYTE *p_text;
+
+  if (f_old)
+   {
+    bindiff_header (bindiff, p_line);
+    bindiff_flush (bindiff);
+    bindiff->nb_copy++;
+    return;
+   }
+
+  /* length, line and '\0' */
+  len = strlen (p_line);
+  if (bindiff->textlen + len + 6 > bindiff->textsize)
+   {
+    while (bindiff->textlen + len + 6 > bindiff->textsize)
+     bindiff->textsize *= 2;
+    if (NULL == (p_text = IMDBAllocMemory (bindiff->textsize)))
+     {
+      bindiff->error = IMDBE_MEMORY;
+      return;
+     }
+    memcpy (p_text, bindiff->text, bindiff->textlen);
+    IMDBFreeMemory (bindiff->text);
+    bindiff->text = p_text;
+   }
+
+  bindiff->textlen += put_varint (&bindiff->text[bindiff->textlen], len);
+  memcpy (&bindiff->text[bindiff->textlen], p_line, len + 1);
+  bindiff->textlen += len + 1;
+  bindiff->nb_insert++;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   BinDiffOldLine
+ *
+ * Purpose:     account for a line that has been removed from the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void BinDiffOldLine (BinDiffLog *bindiff, char *p_line)
+ {
+  bindiff_header (bindiff, p_line);
+  bindiff->nb_delete++;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   CloseBinDiff
+ *
+ * Purpose:     finish the binary diff-file and fill in the data of the
+ *              new listfile
+ *
+ * Parameters:  bindiff  binary diff
+ *              f_keep   FALSE, if the diffs could not be applied. The
+ *                       binary diff-file is removed then.
+ *              size     size of the new listfile in bytes
+ *              lines    number of lines of the new listfile
+ *              crc      CRC of the new listfile
+ *
+ * Returns:     error-code
+ *-----------------------------------------------------------------------------
+ */
+
+LONG CloseBinDiff (BinDiffLog *bindiff, BOOL f_keep, LONG size, LONG lines, ULONG crc)
+ {
+  UBYTE header[12];
+  FILE *fp;
+  LONG  ret;
+
+  if (f_keep)
+   {
+    bindiff_header (bindiff, NULL);
+    bindiff_flush (bindiff);
+    memset (header, 0, 4);
+    bindiff_write (bindiff, header, 4);
+   }
+  if ((IMDBE_NO_ERROR != IMDBCloseBuffer (bindiff->buffer)) && (IMDBE_NO_ERROR == bindiff->error))
+   bindiff->error = IMDBE_FILE_WRITE;
+
+  if ((f_keep) && (IMDBE_NO_ERROR == bindiff->error))
+   {
+    put_ulong (header,     (ULONG) size);
+    put_ulong (header + 4, (ULONG) lines);
+    put_ulong (header + 8, crc & 0xFFFFFFFFL);
+    if (NULL == (fp = fopen (bindiff->fname, "r+b")))
+     bindiff->error = IMDBE_FILE_OPEN;
+    else
+     {
+      if ((fseek (fp, strlen (BINDIFF_MAGIC) + 1, SEEK_SET))
+        ||(1 != fwrite (header, sizeof (header), 1, fp)))
+       bindiff->error = IMDBE_FILE_WRITE;
+      if ((fclose (fp)) && (IMDBE_NO_ERROR == bindiff->error))
+       bindiff->error = IMDBE_FILE_WRITE;
+     }
+   }
+  if ((!f_keep) || (IMDBE_NO_ERROR != bindiff->error))
+   remove (bindiff->fname);
+
+  ret = bindiff->error;
+  IMDBFreeMemory (bindiff->text);
+  IMDBFreeMemory (bindiff->fname);
+  IMDBFreeMemory (bindiff);
+  return (ret);
+ }
+
+/******************************************************************************
+ *  Hashed diffs
+ *
+ * A hashed diff (*.hdiff) is a stripped diff that still allows to check the
+ * deleted lines: instead of the line itself it contains its length and a
+ * 64-bit hash (see IMDBHashLine), one line per deleted line:
+ *
+ *   Apply on: <first line>         as in stripped diffs
+ *   12,14c12,13                    hunk-header
+ *   <len>:<hash>                   deleted line: length and hash, hex
+ *   ...
+ *   <line>                         added line
+ *   ...
+ *
+ * Hashed diffs are made with SquashDiffs (option HASHED).
+ ******************************************************************************
+ */
+
+#define HASHDIFF_EXT      ".hdiff"
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   CheckLineHash
+ *
+ * Purpose:     check a line of the listfile against a line of a hashed diff
+ *
+ * Comment:     The length is compared first, so the hash is only calculated
+ *              for lines of the right length.
+ *
+ * Parameters:  p_hash_line  line of the hashed diff
+ *              p_line       line of the listfile
+ *
+ * Returns:     TRUE if the line matches
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL CheckLineHash (char *p_hash_line, char *p_line)
+ {
+  char  *p_end;
+  char   hash[20];
+  ULONG  a_hash[2];
+  LONG   len;
+
+  len = strtol (p_hash_line, &p_end, 16);
+  if ((p_end == p_hash_line) || (':' != *p_end) || (len != (LONG) strlen (p_line)))
+   return (FALSE);
+
+  IMDBHashLine (p_line, len, a_hash);
+  sprintf (hash, "%08lX%08lX", a_hash[0], a_hash[1]);
+  return ((BOOL) (0 == strcmp (p_end + 1, hash)));
+ }
+
+/******************************************************************************
+ *  Key-addressed diffs
+ *
+ * The listfiles are sorted by name or title, so a record can be found by its
+ * first line (the key) as well as by its line number. A key-addressed diff
+ * (*.kdiff) addresses every hunk by the nearest key in front of it, so lines
+ * inserted or removed elsewhere in the listfile (e.g. local corrections) do
+ * not move the hunk:
+ *
+ *   Apply on: <first line>         as in stripped diffs
+ *   @<copy> <delete> <add> <key>   hunk: search the next line equal to <key>,
+ *                                  copy <copy> lines starting with the key,
+ *                                  then delete and add lines
+ *   @<copy> <delete> <add>         hunk without key: copy <copy> lines
+ *                                  following the previous hunk
+ *   - <line>                       removed line, must match
+ *   + <line>                       added line
+ *
+ * A key is a line that starts a record: it is neither empty nor starts with
+ * a blank or tab. Hunks without key are only written if there is no key
+ * between them and the previous hunk. Key-addressed diffs are written with
+ * the option KEYED while original or stripped diffs are applied.
+ ******************************************************************************
+ */
+
+#define KEYDIFF_EXT       ".kdiff"
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   IsKeyLine
+ *
+ * Purpose:     check if a line can address a hunk of a key-addressed diff
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL IsKeyLine (char *p_line)
+ {
+  return ((BOOL) ((p_line[0]) && (' ' != p_line[0]) && ('\t' != p_line[0])));
+ }
+
+/*-----------------------------------------------------------------------------
+ * Key-addressed diffs are written like binary diffs. The removed and added
+ * lines of a hunk are collected until the next line is copied from the old
+ * listfile, then the hunk is written with the key of the copied lines in
+ * front of it.
+ *
+ * A hunk is found at the first line with the text of its key after the
+ * previous hunk. So a line is only taken as key, if its text has not been
+ * copied since the previous hunk (e.g. not the "-----" between two records
+ * of biographies.list); the texts are remembered by their hash. Otherwise
+ * the earlier key is kept and more lines are copied behind it.
+ *-----------------------------------------------------------------------------
+ */
+
+#define KEYDIFF_SEEN_SIZE  1024          /* first size of the table of copied keys */
+#define KEYDIFF_SEEN_MAX   (1L << 20)    /* most keys remembered between two hunks */
+
+typedef struct
+ {
+  IMDB_Buffer *buffer;             /* key-addressed diff-file */
+  char *fname;                     /* filename of key-addressed diff-file */
+  char *key;                       /* last key copied since the last hunk or "" */
+  LONG  nb_copy;                   /* lines copied since the key (or the last hunk) */
+  ULONG *seen;                     /* hashes of the keys copied since the last hunk */
+  LONG  seen_size;                 /* number of entries of seen (power of 2) */
+  LONG  nb_seen;                   /* entries used since the last hunk */
+  ULONG seen_gen;                  /* entries of older hunks have another generation */
+  LONG  nb_delete;                 /* removed lines of the current hunk */
+  LONG  nb_insert;                 /* added lines of the current hunk */
+  char *del_text;                  /* removed lines of the current hunk */
+  LONG  del_size;                  /* size of memory for del_text */
+  LONG  del_len;                   /* bytes used of del_text */
+  char *add_text;                  /* added lines of the current hunk */
+  LONG  add_size;                  /* size of memory for add_text */
+  LONG  add_len;                   /* bytes used of add_text */
+  BOOL  f_header;                  /* "Apply on:"-line written? */
+  LONG  error;                     /* IMDBE_xxx */
+ } KeyDiffLog;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   OpenKeyDiff
+ *
+ * Purpose:     create the key-addressed diff-file for a listfile
+ *
+ * Parameters:  fname   name of the key-addressed diff-file
+ *
+ * Returns:     pointer to KeyDiffLog or NULL if failed
+ *-----------------------------------------------------------------------------
+ */
+
+KeyDiffLog *OpenKeyDiff (char *fname)
+ {
+  KeyDiffLog *keydiff;
+
+  if (keydiff = IMDBAllocMemory (sizeof (KeyDiffLog)))
+   {
+    keydiff->fname    = NULL;
+    keydiff->key      = NULL;
+    keydiff->seen     = NULL;
+    keydiff->del_text = NULL;
+    keydiff->add_text = NULL;
+    keydiff->del_size = 16 * 1024;
+    keydiff->add_size = 16 * 1024;
+    keydiff->seen_size= KEYDIFF_SEEN_SIZE;
+    if ((NULL == (keydiff->fname    = IMDBAllocMemory (strlen (fname) + 1)))
+     || (NULL == (keydiff->key      = IMDBAllocMemory (ADV_MAX_LINESIZE + 1)))
+     || (NULL == (keydiff->seen     = IMDBAllocMemory (keydiff->seen_size * 3 * sizeof (ULONG))))
+     || (NULL == (keydiff->del_text = IMDBAllocMemory (keydiff->del_size)))
+     || (NULL == (keydiff->add_text = IMDBAllocMemory (keydiff->add_size)))
+     || (NULL == (keydiff->buffer   = IMDBOpenBuffer (fname, IMDBV_FILE_WRITE, ADV_BUFFER_SIZE))))
+     {
+      if (keydiff->fname)
+       IMDBFreeMemory (keydiff->fname);
+      if (keydiff->key)
+       IMDBFreeMemory (keydiff->key);
+      if (keydiff->seen)
+       IMDBFreeMemory (keydiff->seen);
+      if (keydiff->del_text)
+       IMDBFreeMemory (keydiff->del_text);
+      if (keydiff->add_text)
+       IMDBFreeMemory (keydiff->add_text);
+      IMDBFreeMemory (keydiff);
+      return (NULL);
+     }
+    strcpy (keydiff->fname, fname);
+    memset (keydiff->seen, 0, keydiff->seen_size * 3 * sizeof (ULONG));
+    keydiff->key[0]    = '\0';
+    keydiff->nb_copy   = 0;
+    keydiff->nb_seen   = 0;
+    keydiff->seen_gen  = 1;
+    keydiff->nb_delete = 0;
+    keydiff->nb_insert = 0;
+    keydiff->del_len   = 0;
+    keydiff->add_len   = 0;
+    keydiff->f_header  = FALSE;
+    keydiff->error     = IMDBE_NO_ERROR;
+   }
+
+  return (keydiff);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   keydiff_write
+ *
+ * Purpose:     write data of any size to the key-addressed diff-file
+ *-----------------------------------------------------------------------------
+ */
+
+static void keydiff_write (KeyDiffLog *keydiff, char *p_data, LONG size)
+ {
+  LONG len;
+
+  while ((size > 0) && (IMDBE_NO_ERROR == keydiff->error))
+   {
+    len = (size > ADV_BUFFER_SIZE / 2) ? ADV_BUFFER_SIZE / 2 : size;
+    keydiff->error = IMDBWriteBuffer (keydiff->buffer, p_data, len);
+    p_data += len;
+    size   -= len;
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   keydiff_store
+ *
+ * Purpose:     append a removed or added line ("- " or "+ ") to the text of
+ *              the current hunk
+ *-----------------------------------------------------------------------------
+ */
+
+static void keydiff_store (KeyDiffLog *keydiff, char **pp_text, LONG *p_size, LONG *p_len, char *p_prefix, char *p_line)
+ {
+  LONG  len = strlen (p_line);
+  char *p_text;
+
+  if (*p_len + len + 3 > *p_size)
+   {
+    while (*p_len + len + 3 > *p_size)
+     *p_size *= 2;
+    if (NULL == (p_text = IMDBAllocMemory (*p_size)))
+     {
+      keydiff->error = IMDBE_MEMORY;
+      return;
+     }
+    memcpy (p_text, *pp_text, *p_len);
+    IMDBFreeMemory (*pp_text);
+    *pp_text = p_text;
+   }
+
+  memcpy (&(*pp_text)[*p_len], p_prefix, 2);
+  memcpy (&(*pp_text)[*p_len + 2], p_line, len);
+  (*pp_text)[*p_len + len + 2] = '\n';
+  *p_len += len + 3;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   keydiff_seen
+ *
+ * Purpose:     check if the text of a key has been copied since the last
+ *              hunk, and remember it
+ *
+ * Comment:     Equal hashes count as equal texts, and if there is no room
+ *              for another key, every key counts as copied before. Both
+ *              only keep an earlier key.
+ *
+ * Returns:     TRUE, if the line can't be the key of the next hunk
+ *-----------------------------------------------------------------------------
+ */
+
+static BOOL keydiff_seen (KeyDiffLog *keydiff, char *p_line)
+ {
+  ULONG *p_entry;
+  ULONG *seen;
+  ULONG  hash[2];
+  LONG   size;
+  LONG   i, j;
+
+  /* the table is half full: twice as big, with the keys of this hunk only */
+  if (2 * (keydiff->nb_seen + 1) > keydiff->seen_size)
+   {
+    size = 2 * keydiff->seen_size;
+    if ((size > 2 * KEYDIFF_SEEN_MAX) || (NULL == (seen = IMDBAllocMemory (size * 3 * sizeof (ULONG)))))
+     return (TRUE);
+    memset (seen, 0, size * 3 * sizeof (ULONG));
+    for (i = 0; i < keydiff->seen_size; i++)
+     {
+      p_entry = &keydiff->seen[3 * i];
+      if (p_entry[2] == keydiff->seen_gen)
+       {
+        for (j = p_entry[0] & (size - 1); seen[3 * j + 2]; j = (j + 1) & (size - 1))
+         ;
+        memcpy (&seen[3 * j], p_entry, 3 * sizeof (ULONG));
+       }
+     }
+    IMDBFreeMemory (keydiff->seen);
+    keydiff->seen      = seen;
+    keydiff->seen_size = size;
+   }
+
+  IMDBHashLine (p_line, strlen (p_line), hash);
+  for (i = hash[0] & (keydiff->seen_size - 1); ; i = (i + 1) & (keydiff->seen_size - 1))
+   {
+    p_entry = &keydiff->seen[3 * i];
+    if (p_entry[2] != keydiff->seen_gen)
+     break;
+    if ((p_entry[0] == hash[0]) && (p_entry[1] == hash[1]))
+     return (TRUE);
+   }
+  p_entry[0] = hash[0];
+  p_entry[1] = hash[1];
+  p_entry[2] = keydiff->seen_gen;
+  keydiff->nb_seen++;
+  return (FALSE);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   keydiff_header
+ *
+ * Purpose:     write the "Apply on:"-line with the first line of the old
+ *              listfile, or "---" for a new listfile (p_line is NULL)
+ *-----------------------------------------------------------------------------
+ */
+
+static void keydiff_header (KeyDiffLog *keydiff, char *p_line)
+ {
+  if (!keydiff->f_header)
+   {
+    keydiff_write (keydiff, "Apply on: ", 10);
+    if (p_line)
+     keydiff_write (keydiff, p_line, strlen (p_line));
+    else
+     keydiff_write (keydiff, "---", 3);
+    keydiff_write (keydiff, "\n", 1);
+    keydiff->f_header = TRUE;
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   keydiff_flush
+ *
+ * Purpose:     write the current hunk of the key-addressed diff
+ *-----------------------------------------------------------------------------
+ */
+
+static void keydiff_flush (KeyDiffLog *keydiff)
+ {
+  char patch[100];
+
+  if ((0 == keydiff->nb_delete) && (0 == keydiff->nb_insert))
+   return;
+
+  keydiff_write (keydiff, patch, sprintf (patch, "@%li %li %li", keydiff->nb_copy, keydiff->nb_delete, keydiff->nb_insert));
+  if (keydiff->key[0])
+   {
+    keydiff_write (keydiff, " ", 1);
+    keydiff_write (keydiff, keydiff->key, strlen (keydiff->key));
+   }
+  keydiff_write (keydiff, "\n", 1);
+  keydiff_write (keydiff, keydiff->del_text, keydiff->del_len);
+  keydiff_write (keydiff, keydiff->add_text, keydiff->add_len);
+
+  keydiff->key[0]    = '\0';
+  keydiff->nb_copy   = 0;
+  keydiff->nb_delete = 0;
+  keydiff->nb_insert = 0;
+  keydiff->del_len   = 0;
+  keydiff->add_len   = 0;
+
+  /* the next hunk is searched from here: all keys are new again */
+  keydiff->nb_seen   = 0;
+  if (0 == ++keydiff->seen_gen)
+   {
+    memset (keydiff->seen, 0, keydiff->seen_size * 3 * sizeof (ULONG));
+    keydiff->seen_gen = 1;
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   KeyDiffNewLine
+ *
+ * Purpose:     account for a line of the new listfile
+ *
+ * Parameters:  keydiff  key-addressed diff
+ *              p_line   line
+ *              f_old    TRUE, if the line has been copied from the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void KeyDiffNewLine (KeyDiffLog *keydiff, char *p_line, BOOL f_old)
+ {
+  if (!f_old)
+   {
+    keydiff_store (keydiff, &keydiff->add_text, &keydiff->add_size, &keydiff->add_len, "+ ", p_line);
+    keydiff->nb_insert++;
+    return;
+   }
+
+  keydiff_header (keydiff, p_line);
+  keydiff_flush (keydiff);
+
+  /* only the first line with the text of a key is found */
+  if ((IsKeyLine (p_line)) && (strlen (p_line) <= ADV_MAX_LINESIZE) && (!keydiff_seen (keydiff, p_line)))
+   {
+    strcpy (keydiff->key, p_line);
+    keydiff->nb_copy = 1;
+   }
+  else
+   keydiff->nb_copy++;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   KeyDiffOldLine
+ *
+ * Purpose:     store a line that has been removed from the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void KeyDiffOldLine (KeyDiffLog *keydiff, char *p_line)
+ {
+  keydiff_header (keydiff, p_line);
+  keydiff_store (keydiff, &keydiff->del_text, &keydiff->del_size, &keydiff->del_len, "- ", p_line);
+  keydiff->nb_delete++;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   CloseKeyDiff
+ *
+ * Purpose:     finish the key-addressed diff-file
+ *
+ * Parameters:  keydiff  key-addressed diff
+ *              f_keep   FALSE, if the diffs could not be applied. The
+ *                       key-addressed diff-file is removed then.
+ *
+ * Returns:     error-code
+ *-----------------------------------------------------------------------------
+ */
+
+LONG CloseKeyDiff (KeyDiffLog *keydiff, BOOL f_keep)
+ {
+  LONG ret;
+
+  if (f_keep)
+   {
+    keydiff_header (keydiff, NULL);
+    keydiff_flush (keydiff);
+   }
+  if ((IMDBE_NO_ERROR != IMDBCloseBuffer (keydiff->buffer)) && (IMDBE_NO_ERROR == keydiff->error))
+   keydiff->error = IMDBE_FILE_WRITE;
+  if ((!f_keep) || (IMDBE_NO_ERROR != keydiff->error))
+   remove (keydiff->fname);
+
+  ret = keydiff->error;
+  IMDBFreeMemory (keydiff->add_text);
+  IMDBFreeMemory (keydiff->del_text);
+  IMDBFreeMemory (keydiff->key);
+  IMDBFreeMemory (keydiff->seen);
+  IMDBFreeMemory (keydiff->fname);
+  IMDBFreeMemory (keydiff);
+  return (ret);
+ }
+
+/******************************************************************************
+ *
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   checkfile_match
+ *
+ * Parameters:  listfile, diffinfo
+ *
+ * Comments:
+ *-----------------------------------------------------------------------------
+ */
+
+int checkfile_match(char *listfile, BOOL flag_verbose, DiffInfo *diffinfo)
+ {
+  IMDB_Buffer *list_buffer = NULL;
+  IMDB_Buffer *diff_buffer = NULL;
+  char        *p_diff_line;
+  char        *p_list_line;
+  LONG         status      = STATUS_OK;
+  LONG         size, lines;
+  ULONG        crc;
+
+  /* open diff-file */
+  if (NULL == (diff_buffer = OpenDiffBuffer (diffinfo, IMDBV_FILE_READ)))
+   {
+    diffinfo->status = STATUS_IO;
+    if (flag_verbose)
+     printf ("Error: Can't open Diff-File\n");
+    return (RET_ERROR);
+   }
+
+  /* open old listfile */
+  if ((IMDBExistFile(listfile)) || (IsChunkedList (listfile)))
+   {
+    list_buffer = IMDBOpenBuffer (listfile, IMDBV_FILE_READ | ListfileFlags (listfile), ADV_BUFFER_SIZE);
+   }
+
+  if (DIFF_TYPE_ORIGINAL == diffinfo->type)
+/****** Original Diff-File *********/
+   {
+    /* if this file does not exist, check if the diffs contains only data that */
+    /* adds something -> new file */
+    /* check if the diff-version matches the listfile */
+    if (NULL == list_buffer)
+     {/* new file ? */
+      /* check if the diff-file contains no line starting with '<' */
+      status = STATUS_NEW;
+      while (0 == IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
+       {
+        if (*p_diff_line == '<')
+         {
+          status = STATUS_VER;
+          if (flag_verbose)
+           printf ("Error: Missing Listfile\n");
+          break;
+         }
+       }
+      if ((flag_verbose) && (STATUS_NEW == status))
+       printf ("New Listfile\n");
+     }
+    else
+     {
+      /* check if the diff-version matches the listfile */
+      /* get the 2nd line in the diff-file and compare it with the 1st line in listfile */
+      if ((0 == IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
+        &&(0 == IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE)) /* 2nd line */
+        &&(0 == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
+       {
+        if (0 != strcmp (p_diff_line+2, p_list_line))
+         {
+          status = STATUS_VER;
+          if (flag_verbose)
+           printf ("Error: Unsuitable Diff-File\n");
+         }
+        else
+         if (flag_verbose)
+          printf ("OK.\n");
+       }
+      else
+       status = STATUS_IO;
+     }
+   }
+/****** Binary Diff-File: header first, then as stripped *********/
+  else
+  if ((DIFF_TYPE_BINARY == diffinfo->type)
+    &&(ReadBinDiffHeader (diff_buffer, &size, &lines, &crc)))
+   {
+    status = STATUS_SYN;
+    if (flag_verbose)
+     printf ("Error: Damaged binary Diff-File\n");
+   }
+/****** Stripped Diff-File *********/
+  else
+   {
+    /* if the listfile does not exist, check if the diffs contains only data that */
+    /* adds something -> new file */
+    /* check if the diff-version matches the listfile */
+    if (NULL == list_buffer)
+     {/* new file ? */
+      IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE);
+      if (0 == strcmp(p_diff_line, "Apply on: ---"))
+       {
+        status = STATUS_NEW;
+        if (flag_verbose)
+        printf ("New Listfile\n");
+       }
+      else
+       {
+        status = STATUS_VER;
+        if (flag_verbose)
+         printf ("Error: Missing Listfile\n");
+       }
+     }
+    else
+     {
+      /* check if the diff-version matches the listfile */
+      /* get the 1st line in the diff-file and compare it with the 1st line in listfile */
+      if ((0 == IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
+        &&(0 == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
+       {
+        if (0 != strcmp (p_diff_line+10, p_list_line))
+         {
+          status = STATUS_VER;
+          if (flag_verbose)
+           printf ("Error: Unsuitable Diff-File\n");
+         }
+        else
+         if (flag_verbose)
+          printf ("OK.\n");
+       }
+      else
+       status = STATUS_IO;
+     }
+   }
+
+
+  /* Close Buffer */
+  IMDBCloseBuffer (diff_buffer);
+  if (list_buffer)
+   IMDBCloseBuffer (list_buffer);
+
+  if (diffinfo)
+   diffinfo->status = status;
+
+  return (RET_OK);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   checkfile_crc
+ *
+ * Parameters:  listfile
+ *
+ * Comments:
+ *-----------------------------------------------------------------------------
+ */
+
+int checkfile_crc(char *listfile, BOOL flag_verbose)
+ {
+  IMDB_Buffer *list_buffer = NULL;
+  char        *p_list_line;
+  LONG         status      = STATUS_OK;
+  LONG         progress    = 0;
+  LONG         tprogress   = 0;
+  ULONG        nCrc;
+  char         old_crc[16];
+  char         new_crc[16];
+
+  /* Reset CRC */
+  nCrc = 0xFFFFFFFFL;
+  new_crc [0] = '\0';
+  old_crc [0] = '\0';
+
+  /* open old listfile */
+  if ((list_buffer = IMDBOpenBuffer (listfile, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE|ListfileFlags (listfile), ADV_BUFFER_SIZE))
+    &&(0 == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
+   {
+    if (0 == strncmp (p_list_line, "CRC: ", strlen("CRC: ")))
+     {
+      strncpy (old_crc, p_list_line, 15);
+
+      /* calculate CRC */
+      while (0 == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE))
+       {
+        if ((flag_verbose) && (list_buffer->filesize)
+          &&(progress != (tprogress = (list_buffer->filepos*100/list_buffer->filesize))))
+         {
+          progress = tprogress;
+          printf ("\b\b\b\b\b\b(%03i%%)", progress);
+          fflush (stdout);
+         }
+
+        /* calculate CRC for next line */
+        calc_crc (p_list_line, &nCrc);
+       }
+
+      /* compare CRC */
+      sprintf(new_crc, "CRC: 0x%08X", nCrc);
+      if (0 == strcmp (old_crc, new_crc))
+       {
+        if (flag_verbose)
+         printf ("\b\b\b\b\b\b- CRC-Checksum O.K.\n");
+       }
+      else
+       {
+        if (flag_verbose)
+         printf ("\b\b\b\b\b\b- CRC-Checksum Error\n");
+        status = STATUS_CRC;
+       }
+     }
+
+    /* Close Buffer */
+    IMDBCloseBuffer (list_buffer);
+   }
+
+  return (status);
+ }
+
+/******************************************************************************
+ *
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  StrChangeSuffix
+ *
+ * Purpose:    replace suffix of a string by another string.
+ *-----------------------------------------------------------------------------
+ */
+
+void StrChangeSuffix (char* p_str, char* p_suffix)
+ {
+  LONG len;
+
+
+  len = strlen (p_str);
+  while ((len>10) && (p_str[len-1]!='.'))
+   len--;
+
+  if (len > 10)
+   p_str[len-1] = '\0';
+
+  strcat (p_str, p_suffix);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  GetListName
+ *
+ * Purpose:    build the full filename of a listfile. With IMDB_ZLIB the
+ *             compressed listfile (*.list.gz) is taken if there is no
+ *             uncompressed one.
+ *-----------------------------------------------------------------------------
+ */
+
+void GetListName (char *p_name, DiffInfo *diffinfo)
+ {
+  strcpy (p_name, ad_cmds.p_listdir);
+  strncat(p_name, diffinfo->fname_list, 255-strlen(p_name));
+#ifdef IMDB_ZLIB
+  if ((FALSE == IMDBExistFile (p_name)) && (strlen (p_name) < 253))
+   {
+    strcat (p_name, ".gz");
+    if (FALSE == IMDBExistFile (p_name))
+     p_name[strlen(p_name)-3] = '\0';
+   }
+#endif
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  GetTempName
+ *
+ * Purpose:    name of the new/old/checkpoint-file of a listfile:
+ *             movies.list -> movies.new, movies.list.gz -> movies.list.gz.new
+ *-----------------------------------------------------------------------------
+ */
+
+void GetTempName (char *p_name, char *listfile, char *p_suffix)
+ {
+  strcpy (p_name, listfile);
+  if (IsGzipName (listfile))
+   strcat (p_name, p_suffix);
+  else
+   StrChangeSuffix (p_name, p_suffix);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  RemoveListfile, RenameListfile
+ *
+ * Purpose:    remove/rename a listfile. The block-index of a compressed
+ *             listfile (*.idx) goes with it; an old index is removed.
+ *-----------------------------------------------------------------------------
+ */
+
+void RemoveListfile (char *p_name)
+ {
+#ifdef IMDB_ZLIB
+  char idxname [256];
+
+  sprintf (idxname, "%.250s" IMDBV_FILE_INDEX_EXT, p_name);
+  remove (idxname);
+#endif
+  remove (p_name);
+ }
+
+void RenameListfile (char *p_from, char *p_to)
+ {
+#ifdef IMDB_ZLIB
+  char idxfrom [256];
+  char idxto [256];
+
+  sprintf (idxfrom, "%.250s" IMDBV_FILE_INDEX_EXT, p_from);
+  sprintf (idxto,   "%.250s" IMDBV_FILE_INDEX_EXT, p_to);
+  remove (idxto);
+  rename (idxfrom, idxto);
+#endif
+  rename (p_from, p_to);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ArchivesUsed
+ *
+ * Purpose:     are diffs read from tar-archives? Their sections are read
+ *              from the stream of the archive, so they can't be read by
+ *              two threads.
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL ArchivesUsed (void)
+ {
+  LONG week;
+
+  for (week = 0; week < ad_cmds.nb_diffdirs; week++)
+   if (ad_cmds.p_archives[week])
+    return (TRUE);
+  return (FALSE);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   CheckListfile
+ *
+ * Purpose:     test a listfile before the diffs are applied: do the diffs
+ *              match (not with FORCE or VERIFY) and is the CRC-sum correct
+ *              (CHECKCRC)
+ *
+ * Parameters:  listfile, flag_verbose, diffinfo
+ *
+ * Returns:     RET_OK, RET_ERROR or STATUS_CRC (as the first loop in main)
+ *-----------------------------------------------------------------------------
+ */
+
+int CheckListfile (char *listfile, BOOL flag_verbose, DiffInfo *diffinfo)
+ {
+  int ret_val = RET_OK;
+  int ret;
+
+#ifdef IMDB_GZIP
+  /* 2.3 File gzipped? */
+  if (FALSE == IMDBExistFile(listfile))
+   {
+    char t_listname[256];
+    strcpy (t_listname, listfile);
+    strcat (t_listname, IMDBV_FILE_PACKER_EXT);
+    if (IMDBExistFile(t_listname))
+     {
+      if (flag_verbose)
+       printf ("Skipping File %s - File is Compressed\n", diffinfo->fname_list);
+      diffinfo->status = STATUS_UNKNOWN;
+      return (RET_OK);
+     }
+   }
+#endif
+
+  /* Test if listfile and diffile match (VERIFY does it thoroughly later) */
+  if ((!ad_cmds.f_force) && (!ad_cmds.f_verify))
+   {
+    if (flag_verbose)
+     {
+      printf ("Test File %s - ", diffinfo->fname_list);
+      fflush (stdout);
+     }
+    if (ret = checkfile_match (listfile, flag_verbose, diffinfo))
+     ret_val = ret;
+   }
+
+  /* Check CRC */
+  if (ad_cmds.f_checkcrc)
+   {
+    if (flag_verbose)
+     {
+      printf ("Check CRC of File %s (000%%)", diffinfo->fname_list);
+      fflush (stdout);
+     }
+
+    if (ret = checkfile_crc (listfile, flag_verbose))
+     ret_val = ret;
+   }
+
+  return (ret_val);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   PrintListCheck
+ *
+ * Purpose:     show the result of CheckListfile, if it was quiet (checked
+ *              in the background)
+ *-----------------------------------------------------------------------------
+ */
+
+void PrintListCheck (DiffInfo *diffinfo, int ret)
+ {
+  if (STATUS_UNKNOWN == diffinfo->status)
+   {
+    printf ("Skipping File %s - File is Compressed\n", diffinfo->fname_list);
+    return;
+   }
+
+  if ((!ad_cmds.f_force) && (!ad_cmds.f_verify))
+   {
+    printf ("Test File %s - ", diffinfo->fname_list);
+    switch (diffinfo->status)
+     {
+      case STATUS_OK:
+       printf ("OK.\n");
+       break;
+      case STATUS_NEW:
+       printf ("New Listfile\n");
+       break;
+      case STATUS_VER:
+       printf ("Error: Unsuitable Diff-File\n");
+       break;
+      case STATUS_SYN:
+       printf ("Error: Damaged binary Diff-File\n");
+       break;
+      default:
+       printf ("Error: Can't read Listfile or Diff-File\n");
+       break;
+     }
+   }
+
+  if ((ad_cmds.f_checkcrc) && (STATUS_NEW != diffinfo->status))
+   printf ("Check CRC of File %s - %s\n", diffinfo->fname_list, (STATUS_CRC == ret) ? "CRC-Checksum Error" : "CRC-Checksum O.K.");
+ }
+
+/*-----------------------------------------------------------------------------
+ * Testing several listfiles at once (WORKERS, IMDB_THREADS)
+ *
+ * The first loop in main waits for the disk most of the time. With
+ * WORKERS n the listfiles are tested by n threads. The listfiles are
+ * scheduled per device (see IMDBOpenSchedule): a spinning disk is read by
+ * one worker only, an SSD by several, DEVLIMIT sets the number of workers
+ * per device. The biggest listfiles are tested first. The results are
+ * kept per listfile and shown in the usual order afterwards, so the
+ * output and the status of every listfile are the same as with one
+ * thread.
+ *-----------------------------------------------------------------------------
+ */
+
+typedef struct
+ {
+  DiffInfo      **list;            /* listfiles in the order of main */
+  char          (*listname)[256];  /* full filenames */
+  int            *ret;             /* result of CheckListfile */
+  LONG           *old_status;      /* status before the test */
+  LONG            nb_lists;
+ } CheckPool;
+
+static void check_job (APTR user_data, LONG job)
+ {
+  CheckPool *pool = (CheckPool *) user_data;
+
+  pool->ret[job] = CheckListfile (pool->listname[job], FALSE, pool->list[job]);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   CheckAllListfiles
+ *
+ * Purpose:     test all listfiles with nb_workers threads (see above)
+ *
+ * Comment:     The caller is one of the workers. As in the first loop of
+ *              main the results after a RET_ERROR are thrown away.
+ *
+ * Parameters:  diffinfo, nb_workers, dev_limit (0: depends on the device),
+ *              flag_verbose
+ *
+ * Returns:     RET_OK, RET_ERROR or STATUS_CRC (as the first loop in main)
+ *-----------------------------------------------------------------------------
+ */
+
+int CheckAllListfiles (DiffInfo *diffinfo, LONG nb_workers, LONG dev_limit, BOOL flag_verbose)
+ {
+  CheckPool      pool;
+  IMDB_Schedule *schedule = NULL;
+  DiffInfo      *t_diffinfo;
+  int            ret_val = RET_OK;
+  LONG           i;
+
+  pool.nb_lists = 0;
+  for (t_diffinfo = diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next)
+   pool.nb_lists++;
+  if (0 == pool.nb_lists)
+   return (RET_OK);
+
+  pool.list       = IMDBAllocMemory (pool.nb_lists * sizeof (DiffInfo *));
+  pool.listname   = IMDBAllocMemory (pool.nb_lists * 256);
+  pool.ret        = IMDBAllocMemory (pool.nb_lists * sizeof (int));
+  pool.old_status = IMDBAllocMemory (pool.nb_lists * sizeof (LONG));
+  if ((NULL == pool.list) || (NULL == pool.listname) || (NULL == pool.ret) || (NULL == pool.old_status)
+    ||(NULL == (schedule = IMDBOpenSchedule (pool.nb_lists, dev_limit))))
+   {
+    printf ("Can't allocate memory for the workers\n");
+    ret_val = RET_ERROR;
+   }
+  else
+   {
+    for (i = 0, t_diffinfo = diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next, i++)
+     {
+      pool.list[i]       = t_diffinfo;
+      pool.ret[i]        = RET_OK;
+      pool.old_status[i] = t_diffinfo->status;
+      GetListName (pool.listname[i], t_diffinfo);
+      IMDBScheduleJob (schedule, i, pool.listname[i]);
+     }
+
+    IMDBRunSchedule (schedule, nb_workers, check_job, &pool);
+
+    /* results in the order of the listfiles */
+    for (i = 0; i < pool.nb_lists; i++)
+     {
+      if (RET_ERROR == ret_val)
+       pool.list[i]->status = pool.old_status[i];  /* not tested */
+      else
+       {
+        if (flag_verbose)
+         PrintListCheck (pool.list[i], pool.ret[i]);
+        if (pool.ret[i])
+         ret_val = pool.ret[i];
+       }
+     }
+   }
+
+  IMDBCloseSchedule (schedule);
+  if (pool.list) IMDBFreeMemory (pool.list);
+  if (pool.listname) IMDBFreeMemory (pool.listname);
+  if (pool.ret) IMDBFreeMemory (pool.ret);
+  if (pool.old_status) IMDBFreeMemory (pool.old_status);
+  return (ret_val);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Checking in the background (PIPELINE, IMDB_THREADS)
+ *
+ * While a listfile is patched, the next one is checked by a thread, so
+ * the list is read into the cache just before it is patched. The thread
+ * only reads; it does not print anything.
+ *-----------------------------------------------------------------------------
+ */
+
+typedef struct
+ {
+  DiffInfo  *diffinfo;             /* listfile checked in the background */
+  char       listname[256];
+  int        ret;                  /* result of CheckListfile */
+  BOOL       f_running;
+#ifdef IMDB_THREADS
+  pthread_t  thread;
+#endif
+ } ListCheck;
+
+#ifdef IMDB_THREADS
+static void *check_thread (void *p_arg)
+ {
+  ListCheck *check = (ListCheck *) p_arg;
+
+  check->ret = CheckListfile (check->listname, FALSE, check->diffinfo);
+  return (NULL);
+ }
+#endif
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   StartListCheck, WaitListCheck
+ *
+ * Purpose:     check a listfile in the background / wait for the result
+ *
+ * Comment:     Not started if the memory budget is nearly used up, the
+ *              listfile is checked in the foreground then.
+ *
+ * Returns:     StartListCheck: TRUE if the thread is running
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL StartListCheck (ListCheck *check, DiffInfo *diffinfo)
+ {
+  check->diffinfo  = NULL;
+  check->f_running = FALSE;
+#ifdef IMDB_THREADS
+  if (IMDBMemoryLeft () < IMDBV_BUDGET_JOB)
+   return (FALSE);
+  GetListName (check->listname, diffinfo);
+  check->diffinfo = diffinfo;
+  if (0 == pthread_create (&check->thread, NULL, check_thread, check))
+   check->f_running = TRUE;
+  else
+   check->diffinfo = NULL;
+#endif
+  return (check->f_running);
+ }
+
+void WaitListCheck (ListCheck *check)
+ {
+#ifdef IMDB_THREADS
+  if (check->f_running)
+   pthread_join (check->thread, NULL);
+#endif
+  check->f_running = FALSE;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  GetPatch
+ *
+ * Purpose:    Parse a patchline
+ *-----------------------------------------------------------------------------
+ */
+
+ struct TypPatch
+  {
+   char cmd;
+   LONG i_start;
+   LONG i_end;
+   LONG o_start;
+   LONG o_end;
+  };
+
+void GetPatch(struct TypPatch *patch, char *buffer)
+ {
+  char *c;
+  char cmd;
+
+  patch -> cmd     = '\0';
+  patch -> i_start = 0;
+  patch -> i_end   = 0;
+  patch -> o_start = 0;
+  patch -> o_end   = 0;
+
+  if (buffer)
+   {
+    /* erster Teil */
+    c = buffer;
+    while (isdigit(*buffer)) buffer ++;
+    cmd = *buffer;
     *buffer = '\0';
     patch -> i_start = patch -> i_end = strtol (c, NULL, 10);
     if (cmd == ',')
@@ -548,554 +2028,2462 @@ void GetPatch(struct TypPatch *patch, char *buffer)
       patch -> i_end = strtol (c, NULL, 10);
      }
 
-    patch -> cmd = cmd;
+    patch -> cmd = cmd;
+
+    /* 2ter Teil */
+    buffer ++;
+    c = buffer;
+    while (isdigit(*buffer)) buffer ++;
+    cmd = *buffer;
+    *buffer = '\0';
+    patch -> o_start = patch -> o_end = strtol (c, NULL, 10);
+    if (cmd == ',')
+     {/* parse toline */
+      buffer ++;
+      c = buffer;
+      while (isdigit(*buffer)) buffer++;
+      cmd = *buffer;
+      *buffer = '\0';
+      patch -> o_end = strtol (c, NULL, 10);
+     }
+    *buffer = cmd;
+
+#ifdef IMDB_DEBUG
+   printf ("Patch-Hunk: cmd:%i is:%i ie:%i os:%i oe:%i\n", patch->cmd, patch->i_start, patch->i_end, patch->o_start, patch->o_end);
+#endif
+   }
+ }
+
+/******************************************************************************
+ *  Undo-Logs
+ ******************************************************************************
+ *
+ * While a listfile is patched, an undo-log writes the reverse diff (new
+ * listfile -> old listfile) as stripped diff. It gets every line removed
+ * from the old listfile and every line of the new listfile together with
+ * the information whether this line has been copied from the old listfile.
+ * Only the removed lines have to be stored, so the reverse diff is about
+ * as big as the changes and not as big as the listfile.
+ *
+ ******************************************************************************
+ */
+
+typedef struct
+ {
+  IMDB_Buffer *buffer;             /* reverse diff-file */
+  char *fname;                     /* filename of reverse diff-file */
+  LONG  new_line;                  /* lines of new listfile passed */
+  LONG  old_line;                  /* lines of old listfile passed */
+  LONG  nb_delete;                 /* added lines of the current hunk */
+  LONG  nb_insert;                 /* removed lines of the current hunk */
+  char *text;                      /* removed lines of the current hunk */
+  LONG  textsize;                  /* size of memory for text */
+  LONG  textlen;                   /* bytes used of text */
+  BOOL  f_header;                  /* "Apply on:"-line written? */
+  LONG  error;                     /* IMDBE_xxx */
+ } UndoLog;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   OpenUndoLog
+ *
+ * Purpose:     create the reverse diff-file for a listfile
+ *
+ * Parameters:  fname   name of the reverse diff-file
+ *
+ * Returns:     pointer to UndoLog or NULL if failed
+ *-----------------------------------------------------------------------------
+ */
+
+UndoLog *OpenUndoLog (char *fname)
+ {
+  UndoLog *undo;
+
+  if (undo = IMDBAllocMemory (sizeof (UndoLog)))
+   {
+    undo->fname     = NULL;
+    undo->text      = NULL;
+    undo->textsize  = 16 * 1024;
+    if ((NULL == (undo->fname  = IMDBAllocMemory (strlen (fname) + 1)))
+     || (NULL == (undo->text   = IMDBAllocMemory (undo->textsize)))
+     || (NULL == (undo->buffer = IMDBOpenBuffer (fname, IMDBV_FILE_WRITE, ADV_BUFFER_SIZE))))
+     {
+      if (undo->fname)
+       IMDBFreeMemory (undo->fname);
+      if (undo->text)
+       IMDBFreeMemory (undo->text);
+      IMDBFreeMemory (undo);
+      return (NULL);
+     }
+    strcpy (undo->fname, fname);
+    undo->new_line  = 0;
+    undo->old_line  = 0;
+    undo->nb_delete = 0;
+    undo->nb_insert = 0;
+    undo->textlen   = 0;
+    undo->f_header  = FALSE;
+    undo->error     = IMDBE_NO_ERROR;
+   }
+
+  return (undo);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   undo_write
+ *
+ * Purpose:     write data of any size to the reverse diff-file
+ *-----------------------------------------------------------------------------
+ */
+
+static void undo_write (UndoLog *undo, char *p_data, LONG size)
+ {
+  LONG len;
+
+  while ((size > 0) && (IMDBE_NO_ERROR == undo->error))
+   {
+    len = (size > ADV_BUFFER_SIZE / 2) ? ADV_BUFFER_SIZE / 2 : size;
+    undo->error = IMDBWriteBuffer (undo->buffer, p_data, len);
+    p_data += len;
+    size   -= len;
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   undo_flush
+ *
+ * Purpose:     write the current hunk of the reverse diff
+ *-----------------------------------------------------------------------------
+ */
+
+static void undo_flush (UndoLog *undo)
+ {
+  char patch[100];
+  LONG len;
+
+  if ((0 == undo->nb_delete) && (0 == undo->nb_insert))
+   return;
+
+  /* lines of the new listfile to be removed */
+  if (undo->nb_delete > 1)
+   len = sprintf (patch, "%li,%li", undo->new_line + 1, undo->new_line + undo->nb_delete);
+  else
+  if (undo->nb_delete)
+   len = sprintf (patch, "%li", undo->new_line + 1);
+  else
+   len = sprintf (patch, "%lia", undo->new_line);
+
+  /* lines of the old listfile to be restored */
+  if (undo->nb_delete)
+   len += sprintf (&patch[len], (undo->nb_insert) ? "c" : "d%li", undo->old_line);
+  if (undo->nb_insert > 1)
+   len += sprintf (&patch[len], "%li,%li", undo->old_line + 1, undo->old_line + undo->nb_insert);
+  else
+  if (undo->nb_insert)
+   len += sprintf (&patch[len], "%li", undo->old_line + 1);
+  patch[len++] = '\n';
+
+  undo_write (undo, patch, len);
+  undo_write (undo, undo->text, undo->textlen);
+
+  undo->new_line += undo->nb_delete;
+  undo->old_line += undo->nb_insert;
+  undo->nb_delete = 0;
+  undo->nb_insert = 0;
+  undo->textlen   = 0;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   UndoNewLine
+ *
+ * Purpose:     account for a line of the new listfile
+ *
+ * Parameters:  undo    undo-log
+ *              p_line  line
+ *              f_old   TRUE, if the line has been copied from the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void UndoNewLine (UndoLog *undo, char *p_line, BOOL f_old)
+ {
+  if (!undo->f_header)
+   {
+    undo_write (undo, "Apply on: ", 10);
+    undo_write (undo, p_line, strlen (p_line));
+    undo_write (undo, "\n", 1);
+    undo->f_header = TRUE;
+   }
+
+  if (f_old)
+   {
+    undo_flush (undo);
+    undo->new_line++;
+    undo->old_line++;
+   }
+  else
+   undo->nb_delete++;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   UndoOldLine
+ *
+ * Purpose:     store a line that has been removed from the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void UndoOldLine (UndoLog *undo, char *p_line)
+ {
+  LONG  len = strlen (p_line) + 1;
+  char *p_text;
+
+  if (undo->textlen + len > undo->textsize)
+   {
+    while (undo->textlen + len > undo->textsize)
+     undo->textsize *= 2;
+    if (NULL == (p_text = IMDBAllocMemory (undo->textsize)))
+     {
+      undo->error = IMDBE_MEMORY;
+      return;
+     }
+    memcpy (p_text, undo->text, undo->textlen);
+    IMDBFreeMemory (undo->text);
+    undo->text = p_text;
+   }
+
+  memcpy (&undo->text[undo->textlen], p_line, len - 1);
+  undo->text[undo->textlen + len - 1] = '\n';
+  undo->textlen += len;
+  undo->nb_insert++;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   CloseUndoLog
+ *
+ * Purpose:     finish the reverse diff-file
+ *
+ * Parameters:  undo    undo-log
+ *              f_keep  FALSE, if the diffs could not be applied. The
+ *                      reverse diff-file is removed then.
+ *
+ * Returns:     error-code
+ *-----------------------------------------------------------------------------
+ */
+
+LONG CloseUndoLog (UndoLog *undo, BOOL f_keep)
+ {
+  LONG ret;
+
+  if (f_keep)
+   {
+    if (!undo->f_header)
+     undo_write (undo, "Apply on: ---\n", 14);
+    undo_flush (undo);
+   }
+  if ((IMDBE_NO_ERROR != IMDBCloseBuffer (undo->buffer)) && (IMDBE_NO_ERROR == undo->error))
+   undo->error = IMDBE_FILE_WRITE;
+  if ((!f_keep) || (IMDBE_NO_ERROR != undo->error))
+   remove (undo->fname);
+
+  ret = undo->error;
+  IMDBFreeMemory (undo->text);
+  IMDBFreeMemory (undo->fname);
+  IMDBFreeMemory (undo);
+  return (ret);
+ }
+
+/******************************************************************************
+ *  Delta-files
+ ******************************************************************************
+ *
+ * A delta-file (see IMDB.h) follows the new listfile like the undo-log. It
+ * counts the bytes of every line of the old listfile, copied or removed:
+ * copied lines that follow each other in the old listfile make one range,
+ * added lines are collected behind it. A range is written as soon as a
+ * copied line doesn't continue it or follows added lines.
+ *
+ ******************************************************************************
+ */
+
+typedef struct
+ {
+  IMDB_Buffer *buffer;             /* delta-file */
+  char *fname;                     /* filename of delta-file */
+  LONG  old_pos;                   /* bytes of the old listfile passed */
+  LONG  copy_from;                 /* start of the current range */
+  LONG  copy_len;                  /* bytes of the current range */
+  char *text;                      /* added lines behind the current range */
+  LONG  textsize;                  /* size of memory for text */
+  LONG  textlen;                   /* bytes used of text */
+  LONG  error;                     /* IMDBE_xxx */
+ } DeltaLog;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   OpenDeltaLog
+ *
+ * Purpose:     create the delta-file for a listfile
+ *
+ * Parameters:  fname   name of the delta-file
+ *
+ * Returns:     pointer to DeltaLog or NULL if failed
+ *-----------------------------------------------------------------------------
+ */
+
+DeltaLog *OpenDeltaLog (char *fname)
+ {
+  DeltaLog *delta;
+  UBYTE     header[16];
+
+  if (delta = IMDBAllocMemory (sizeof (DeltaLog)))
+   {
+    delta->fname     = NULL;
+    delta->text      = NULL;
+    delta->textsize  = 16 * 1024;
+    if ((NULL == (delta->fname  = IMDBAllocMemory (strlen (fname) + 1)))
+     || (NULL == (delta->text   = IMDBAllocMemory (delta->textsize)))
+     || (NULL == (delta->buffer = IMDBOpenBuffer (fname, IMDBV_FILE_WRITE, ADV_BUFFER_SIZE))))
+     {
+      if (delta->fname)
+       IMDBFreeMemory (delta->fname);
+      if (delta->text)
+       IMDBFreeMemory (delta->text);
+      IMDBFreeMemory (delta);
+      return (NULL);
+     }
+    strcpy (delta->fname, fname);
+    delta->old_pos   = 0;
+    delta->copy_from = 0;
+    delta->copy_len  = 0;
+    delta->textlen   = 0;
+    delta->error     = IMDBE_NO_ERROR;
+
+    /* the sizes and the CRC are filled in at the end */
+    memset (header, 0, sizeof (header));
+    if ((IMDBWriteBuffer (delta->buffer, IMDBV_DELTA_MAGIC "\n", strlen (IMDBV_DELTA_MAGIC) + 1))
+      ||(IMDBWriteBuffer (delta->buffer, header, sizeof (header))))
+     delta->error = IMDBE_FILE_WRITE;
+   }
+
+  return (delta);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   delta_write
+ *
+ * Purpose:     write data of any size to the delta-file
+ *-----------------------------------------------------------------------------
+ */
+
+static void delta_write (DeltaLog *delta, APTR p_data, LONG size)
+ {
+  UBYTE *p_mem = p_data;
+  LONG   len;
+
+  while ((size > 0) && (IMDBE_NO_ERROR == delta->error))
+   {
+    len = (size > ADV_BUFFER_SIZE / 2) ? ADV_BUFFER_SIZE / 2 : size;
+    delta->error = IMDBWriteBuffer (delta->buffer, p_mem, len);
+    p_mem += len;
+    size  -= len;
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   delta_flush
+ *
+ * Purpose:     write the current range and the added lines behind it
+ *-----------------------------------------------------------------------------
+ */
+
+static void delta_flush (DeltaLog *delta)
+ {
+  UBYTE range[15];
+  LONG  len;
+
+  if ((0 == delta->copy_len) && (0 == delta->textlen))
+   return;
+
+  len  = put_varint (range, (delta->copy_len) ? delta->copy_from : 0);
+  len += put_varint (&range[len], delta->copy_len);
+  len += put_varint (&range[len], delta->textlen);
+  delta_write (delta, range, len);
+  delta_write (delta, delta->text, delta->textlen);
+
+  delta->copy_len = 0;
+  delta->textlen  = 0;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   DeltaNewLine
+ *
+ * Purpose:     account for a line of the new listfile
+ *
+ * Parameters:  delta   delta-file
+ *              p_line  line
+ *              f_old   TRUE, if the line has been copied from the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void DeltaNewLine (DeltaLog *delta, char *p_line, BOOL f_old)
+ {
+  LONG  len = strlen (p_line) + 1;
+  char *p_text;
+
+  if (f_old)
+   {
+    if ((delta->textlen) || ((delta->copy_len) && (delta->copy_from + delta->copy_len != delta->old_pos)))
+     delta_flush (delta);
+    if (0 == delta->copy_len)
+     delta->copy_from = delta->old_pos;
+    delta->copy_len += len;
+    delta->old_pos  += len;
+    return;
+   }
+
+  if (delta->textlen + len > delta->textsize)
+   {
+    while (delta->textlen + len > delta->textsize)
+     delta->textsize *= 2;
+    if (NULL == (p_text = IMDBAllocMemory (delta->textsize)))
+     {
+      delta->error = IMDBE_MEMORY;
+      return;
+     }
+    memcpy (p_text, delta->text, delta->textlen);
+    IMDBFreeMemory (delta->text);
+    delta->text = p_text;
+   }
+
+  memcpy (&delta->text[delta->textlen], p_line, len - 1);
+  delta->text[delta->textlen + len - 1] = '\n';
+  delta->textlen += len;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   DeltaOldLine
+ *
+ * Purpose:     account for a line that has been removed from the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void DeltaOldLine (DeltaLog *delta, char *p_line)
+ {
+  delta->old_pos += strlen (p_line) + 1;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   CloseDeltaLog
+ *
+ * Purpose:     finish the delta-file and fill in the sizes and the CRC
+ *
+ * Parameters:  delta   delta-file
+ *              f_keep  FALSE, if the diffs could not be applied. The
+ *                      delta-file is removed then.
+ *              size    size of the new listfile in bytes
+ *              lines   number of lines of the new listfile
+ *              crc     CRC of the new listfile
+ *
+ * Returns:     error-code
+ *-----------------------------------------------------------------------------
+ */
+
+LONG CloseDeltaLog (DeltaLog *delta, BOOL f_keep, LONG size, LONG lines, ULONG crc)
+ {
+  UBYTE header[16];
+  FILE *fp;
+  LONG  ret;
+
+  if (f_keep)
+   {
+    delta_flush (delta);
+    memset (header, 0, 3);
+    delta_write (delta, header, 3);
+   }
+  if ((IMDBE_NO_ERROR != IMDBCloseBuffer (delta->buffer)) && (IMDBE_NO_ERROR == delta->error))
+   delta->error = IMDBE_FILE_WRITE;
+
+  if ((f_keep) && (IMDBE_NO_ERROR == delta->error))
+   {
+    put_ulong (header,      (ULONG) delta->old_pos);
+    put_ulong (header + 4,  (ULONG) size);
+    put_ulong (header + 8,  (ULONG) lines);
+    put_ulong (header + 12, crc & 0xFFFFFFFFL);
+    if (NULL == (fp = fopen (delta->fname, "r+b")))
+     delta->error = IMDBE_FILE_OPEN;
+    else
+     {
+      if ((fseek (fp, strlen (IMDBV_DELTA_MAGIC) + 1, SEEK_SET))
+        ||(1 != fwrite (header, sizeof (header), 1, fp)))
+       delta->error = IMDBE_FILE_WRITE;
+      if ((fclose (fp)) && (IMDBE_NO_ERROR == delta->error))
+       delta->error = IMDBE_FILE_WRITE;
+     }
+   }
+  if ((!f_keep) || (IMDBE_NO_ERROR != delta->error))
+   remove (delta->fname);
+
+  ret = delta->error;
+  IMDBFreeMemory (delta->text);
+  IMDBFreeMemory (delta->fname);
+  IMDBFreeMemory (delta);
+  return (ret);
+ }
+
+/******************************************************************************
+ *  Chunked listfiles
+ ******************************************************************************
+ *
+ * A chunked listfile (see ChunkList) is read like a plain listfile, the
+ * chunk-files are joined by IMDBOpenBuffer. The chunk-log follows the new
+ * listfile like the undo-log and writes only the chunks that are changed:
+ * a chunk whose lines are all copied, with no line added in between, goes
+ * into the new manifest as it is. A changed chunk is written to a new
+ * chunk-file, lines added after its last line belong to it. It is split
+ * when it grows to twice the size of a chunk, and joined with the next
+ * chunk when it shrinks below half of it.
+ *
+ * The new manifest (*.chunks.new) replaces the old one in CommitListfile,
+ * then the chunk-files that are not used anymore are removed.
+ *
+ ******************************************************************************
+ */
+
+typedef struct
+ {
+  char          *listfile;         /* name of the listfile */
+  IMDB_Manifest *old_manifest;     /* chunks of the old listfile */
+  IMDB_Manifest *new_manifest;     /* chunks of the new listfile */
+  LONG           chunk;            /* index of the current old chunk */
+  LONG           old_line;         /* lines of old listfile passed */
+  LONG           nb_copied;        /* lines of the current chunk copied so far */
+  BOOL           f_changed;        /* current chunk is written again */
+  IMDB_Buffer   *out;              /* chunk-file being written or NULL */
+  LONG           out_id;           /* number of this chunk-file */
+  LONG           out_lines;        /* lines written to it */
+  ULONG          out_crc;          /* CRC of these lines */
+  LONG           nb_written;       /* number of chunk-files written */
+  LONG           error;            /* IMDBE_xxx */
+ } ChunkLog;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   RemoveChunks
+ *
+ * Purpose:     remove the chunk-files of a manifest, that are not used by
+ *              one of two other manifests
+ *
+ * Parameters:  listfile, manifest, keep1, keep2 (may be NULL)
+ *-----------------------------------------------------------------------------
+ */
+
+void RemoveChunks (char *listfile, IMDB_Manifest *manifest, IMDB_Manifest *keep1, IMDB_Manifest *keep2)
+ {
+  char fname [256];
+  LONG i;
+
+  if (manifest)
+   for (i = 0; i < manifest->nb_chunks; i++)
+    if ((!IMDBFindChunk (keep1, manifest->chunks[i].id)) && (!IMDBFindChunk (keep2, manifest->chunks[i].id)))
+     {
+      IMDBChunkName (fname, listfile, manifest->chunks[i].id);
+      remove (fname);
+     }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   OpenChunkLog
+ *
+ * Purpose:     start the new manifest of a chunked listfile
+ *
+ * Parameters:  listfile  name of the listfile
+ *
+ * Returns:     pointer to ChunkLog or NULL if failed
+ *-----------------------------------------------------------------------------
+ */
+
+ChunkLog *OpenChunkLog (char *listfile)
+ {
+  ChunkLog *chunklog;
+  char      fname [256];
+
+  if (chunklog = IMDBAllocMemory (sizeof (ChunkLog)))
+   {
+    GetManifestName (fname, listfile, "");
+    chunklog->new_manifest = NULL;
+    if ((NULL == (chunklog->listfile = IMDBAllocMemory (strlen (listfile) + 1)))
+     || (NULL == (chunklog->old_manifest = IMDBReadManifest (fname)))
+     || (NULL == (chunklog->new_manifest = IMDBCreateManifest (chunklog->old_manifest->chunk_lines, chunklog->old_manifest->next_id))))
+     {
+      if (chunklog->listfile)
+       {
+        IMDBFreeManifest (chunklog->old_manifest);
+        IMDBFreeMemory (chunklog->listfile);
+       }
+      IMDBFreeMemory (chunklog);
+      return (NULL);
+     }
+    strcpy (chunklog->listfile, listfile);
+    chunklog->chunk      = 0;
+    chunklog->old_line   = 0;
+    chunklog->nb_copied  = 0;
+    chunklog->f_changed  = FALSE;
+    chunklog->out        = NULL;
+    chunklog->out_id     = 0;
+    chunklog->out_lines  = 0;
+    chunklog->out_crc    = 0;
+    chunklog->nb_written = 0;
+    chunklog->error      = IMDBE_NO_ERROR;
+   }
+
+  return (chunklog);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   chunk_close_file
+ *
+ * Purpose:     finish the chunk-file being written and add it to the new
+ *              manifest
+ *-----------------------------------------------------------------------------
+ */
+
+static void chunk_close_file (ChunkLog *chunklog)
+ {
+  char fname [256];
+  LONG size;
+
+  if (NULL == chunklog->out)
+   return;
+
+  size = chunklog->out->filepos;
+  IMDBChunkName (fname, chunklog->listfile, chunklog->out_id);
+  if (((IMDBE_NO_ERROR != IMDBCloseBuffer (chunklog->out)) || (IMDBSyncFile (fname)))
+    &&(IMDBE_NO_ERROR == chunklog->error))
+   chunklog->error = IMDBE_FILE_WRITE;
+  chunklog->out = NULL;
+
+  if (IMDBE_NO_ERROR == chunklog->error)
+   chunklog->error = IMDBAddChunk (chunklog->new_manifest, chunklog->out_id, chunklog->out_lines, size, chunklog->out_crc);
+  if (IMDBE_NO_ERROR != chunklog->error)
+   remove (fname);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   chunk_put
+ *
+ * Purpose:     write a line to the chunk-file being written, start a new
+ *              chunk-file if necessary
+ *-----------------------------------------------------------------------------
+ */
+
+static void chunk_put (ChunkLog *chunklog, char *p_line)
+ {
+  char fname [256];
+
+  if (IMDBE_NO_ERROR != chunklog->error)
+   return;
+
+  if (NULL == chunklog->out)
+   {
+    chunklog->out_id    = chunklog->new_manifest->next_id++;
+    chunklog->out_lines = 0;
+    chunklog->out_crc   = 0xFFFFFFFFL;
+    IMDBChunkName (fname, chunklog->listfile, chunklog->out_id);
+    if (NULL == (chunklog->out = IMDBOpenBuffer (fname, IMDBV_FILE_WRITE, ADV_BUFFER_SIZE)))
+     {
+      chunklog->error = IMDBE_FILE_OPEN;
+      return;
+     }
+    chunklog->nb_written++;
+   }
+
+  if ((IMDBWriteBuffer (chunklog->out, p_line, strlen (p_line)))
+    ||(IMDBWriteBuffer (chunklog->out, "\n", 1)))
+   chunklog->error = IMDBE_FILE_WRITE;
+  calc_crc (p_line, &chunklog->out_crc);
+  chunklog->out_lines++;
+
+  /* split a chunk that has grown too much */
+  if (chunklog->out_lines >= 2 * chunklog->old_manifest->chunk_lines)
+   chunk_close_file (chunklog);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   chunk_change
+ *
+ * Purpose:     the current chunk is changed: the lines copied so far are
+ *              read from the old chunk-file and written again
+ *-----------------------------------------------------------------------------
+ */
+
+static void chunk_change (ChunkLog *chunklog)
+ {
+  IMDB_Buffer *buffer;
+  char         fname [256];
+  char        *p_line;
+  LONG         i;
+
+  if (chunklog->f_changed)
+   return;
+  chunklog->f_changed = TRUE;
+
+  if (chunklog->nb_copied)
+   {
+    IMDBChunkName (fname, chunklog->listfile, chunklog->old_manifest->chunks[chunklog->chunk].id);
+    if (NULL == (buffer = IMDBOpenBuffer (fname, IMDBV_FILE_READ, ADV_BUFFER_SIZE)))
+     chunklog->error = IMDBE_FILE_READ;
+    else
+     {
+      for (i = 0; (i < chunklog->nb_copied) && (IMDBE_NO_ERROR == chunklog->error); i++)
+       if (IMDBReadBufferLine (buffer, &p_line, ADV_MAX_LINESIZE))
+        chunklog->error = IMDBE_FILE_READ;
+       else
+        chunk_put (chunklog, p_line);
+      IMDBCloseBuffer (buffer);
+     }
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   chunk_next
+ *
+ * Purpose:     all lines of the current chunk are passed, go on with the
+ *              next chunk
+ *-----------------------------------------------------------------------------
+ */
+
+static void chunk_next (ChunkLog *chunklog)
+ {
+  IMDB_Chunk *chunk = &chunklog->old_manifest->chunks[chunklog->chunk];
+
+  /* unchanged chunk: the chunk-file is used again */
+  if (!chunklog->f_changed)
+   {
+    if (IMDBE_NO_ERROR == chunklog->error)
+     chunklog->error = IMDBAddChunk (chunklog->new_manifest, chunk->id, chunk->lines, chunk->size, chunk->crc);
+   }
+  else
+  /* a small chunk is continued with the next one, which is changed then */
+  if ((chunklog->out) && (chunklog->out_lines < chunklog->old_manifest->chunk_lines / 2)
+    &&(chunklog->chunk + 1 < chunklog->old_manifest->nb_chunks))
+   ;
+  else
+   {
+    chunk_close_file (chunklog);
+    chunklog->f_changed = FALSE;
+   }
+
+  chunklog->nb_copied = 0;
+  chunklog->chunk++;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   chunk_old_line
+ *
+ * Purpose:     find the chunk of the next line of the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+static void chunk_old_line (ChunkLog *chunklog)
+ {
+  IMDB_Manifest *manifest = chunklog->old_manifest;
+
+  while ((chunklog->chunk < manifest->nb_chunks)
+       &&(chunklog->old_line >= manifest->chunks[chunklog->chunk].first - 1 + manifest->chunks[chunklog->chunk].lines))
+   chunk_next (chunklog);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ChunkNewLine
+ *
+ * Purpose:     account for a line of the new listfile
+ *
+ * Parameters:  chunklog  chunk-log
+ *              p_line    line
+ *              f_old     TRUE, if the line has been copied from the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void ChunkNewLine (ChunkLog *chunklog, char *p_line, BOOL f_old)
+ {
+  if (f_old)
+   {
+    chunk_old_line (chunklog);
+    if (chunklog->f_changed)
+     chunk_put (chunklog, p_line);
+    else
+     chunklog->nb_copied++;
+    chunklog->old_line++;
+   }
+  else
+   {
+    chunk_change (chunklog);
+    chunk_put (chunklog, p_line);
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ChunkOldLine
+ *
+ * Purpose:     a line has been removed from the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void ChunkOldLine (ChunkLog *chunklog)
+ {
+  chunk_old_line (chunklog);
+  chunk_change (chunklog);
+  chunklog->old_line++;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   CloseChunkLog
+ *
+ * Purpose:     write the new manifest (*.chunks.new)
+ *
+ * Parameters:  chunklog  chunk-log
+ *              f_keep    FALSE, if the diffs could not be applied. The
+ *                        new chunk-files are removed then.
+ *
+ * Returns:     error-code
+ *-----------------------------------------------------------------------------
+ */
+
+LONG CloseChunkLog (ChunkLog *chunklog, BOOL f_keep)
+ {
+  char fname [256];
+  LONG ret;
+
+  if (f_keep)
+   while (chunklog->chunk < chunklog->old_manifest->nb_chunks)
+    chunk_next (chunklog);
+  chunk_close_file (chunklog);
+
+  GetManifestName (fname, chunklog->listfile, ".new");
+  if ((f_keep) && (IMDBE_NO_ERROR == chunklog->error))
+   chunklog->error = IMDBWriteManifest (chunklog->new_manifest, fname);
+  if ((!f_keep) || (IMDBE_NO_ERROR != chunklog->error))
+   {
+    RemoveChunks (chunklog->listfile, chunklog->new_manifest, chunklog->old_manifest, NULL);
+    remove (fname);
+   }
+
+  ret = chunklog->error;
+  IMDBFreeManifest (chunklog->old_manifest);
+  IMDBFreeManifest (chunklog->new_manifest);
+  IMDBFreeMemory (chunklog->listfile);
+  IMDBFreeMemory (chunklog);
+  return (ret);
+ }
+
+/******************************************************************************
+ *  Patch-Stages
+ ******************************************************************************
+ *
+ * A patch-stage applies one diff-file to the lines it gets from its source.
+ * The source is either the listfile itself or the stage of the previous
+ * week. This way the diffs of several weeks can be applied in one go: the
+ * listfile is read once, each week's diff is applied on the fly (including
+ * the check of that week's CRC) and only the result of the last stage is
+ * written to disk.
+ *
+ * Lines are passed on by pointer. A line stays valid until the next line is
+ * requested from the same stage, so a chain of stages needs no buffers but
+ * those of the diff-files.
+ *
+ ******************************************************************************
+ */
+
+/* states of a patch-stage */
+#define STAGE_HEADER    0  /* check header of diff-file */
+#define STAGE_HUNK      1  /* read next hunk from diff-file */
+#define STAGE_COPY      2  /* copy lines up to the start of the hunk */
+#define STAGE_DELETE    3  /* delete lines of the hunk */
+#define STAGE_ADD       4  /* add lines of the hunk */
+#define STAGE_REST      5  /* copy the remaining lines */
+#define STAGE_EOF       6  /* all lines delivered */
+#define STAGE_SEEK      7  /* keyed diffs: copy lines up to the key of the hunk */
+
+/*-----------------------------------------------------------------------------
+ * With the option FUZZY a patch-stage of original or hashed diffs reads the
+ * lines around a hunk in advance into a window. If the removed lines are not
+ * found at the line number of the hunk (e.g. because the listfile has been
+ * corrected locally), they are searched in the window, nearest first, and
+ * all following hunks are moved by the same number of lines. Lines are
+ * compared by length and hash first.
+ *-----------------------------------------------------------------------------
+ */
+
+typedef struct
+ {
+  LONG   size;                     /* number of lines the window can hold */
+  LONG   first;                    /* index of the next line to deliver */
+  LONG   count;                    /* lines in the window */
+  BOOL   f_eof;                    /* all lines of the source read */
+  BOOL   f_search;                 /* the current hunk has to be searched */
+  char  *text;                     /* lines, ADV_MAX_LINESIZE+1 bytes each */
+  LONG  *len;                      /* length of the lines */
+  ULONG *hash;                     /* hash of the lines, 2 ULONGs each */
+  BOOL  *f_old;                    /* line is a line of the old listfile */
+  LONG   nb_block;                 /* removed lines of the hunk read in advance */
+  LONG   block_pos;                /* removed lines of them already deleted */
+  LONG   block_len[ADV_FUZZY_BLOCK];    /* their length */
+  ULONG  block_hash[2*ADV_FUZZY_BLOCK]; /* and their hash */
+ } FuzzyWindow;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   CloseFuzzyWindow, OpenFuzzyWindow
+ *
+ * Purpose:     free and create the window of a patch-stage (option FUZZY)
+ *-----------------------------------------------------------------------------
+ */
+
+void CloseFuzzyWindow (FuzzyWindow *fuzzy)
+ {
+  if (fuzzy->text)
+   IMDBFreeMemory (fuzzy->text);
+  if (fuzzy->len)
+   IMDBFreeMemory (fuzzy->len);
+  if (fuzzy->hash)
+   IMDBFreeMemory (fuzzy->hash);
+  if (fuzzy->f_old)
+   IMDBFreeMemory (fuzzy->f_old);
+  IMDBFreeMemory (fuzzy);
+ }
+
+FuzzyWindow *OpenFuzzyWindow (void)
+ {
+  FuzzyWindow *fuzzy;
+
+  if (fuzzy = IMDBAllocMemory (sizeof (FuzzyWindow)))
+   {
+    fuzzy->size     = 2 * ADV_FUZZY_WINDOW + ADV_FUZZY_BLOCK;
+    fuzzy->first    = 0;
+    fuzzy->count    = 0;
+    fuzzy->f_eof    = FALSE;
+    fuzzy->f_search = FALSE;
+    fuzzy->nb_block = 0;
+    fuzzy->block_pos= 0;
+    fuzzy->len      = NULL;
+    fuzzy->hash     = NULL;
+    fuzzy->f_old    = NULL;
+    if ((NULL == (fuzzy->text  = IMDBAllocMemory (fuzzy->size * (ADV_MAX_LINESIZE + 1))))
+     || (NULL == (fuzzy->len   = IMDBAllocMemory (fuzzy->size * sizeof (LONG))))
+     || (NULL == (fuzzy->hash  = IMDBAllocMemory (fuzzy->size * 2 * sizeof (ULONG))))
+     || (NULL == (fuzzy->f_old = IMDBAllocMemory (fuzzy->size * sizeof (BOOL)))))
+     {
+      CloseFuzzyWindow (fuzzy);
+      return (NULL);
+     }
+   }
+
+  return (fuzzy);
+ }
+
+typedef struct PATCHSTAGE
+ {
+  struct PATCHSTAGE *source;       /* stage of previous week or NULL */
+  IMDB_Buffer *list_buffer;        /* listfile, if there is no source-stage */
+  IMDB_Buffer *diff_buffer;        /* diff-file */
+  LONG  type;                      /* DIFF_TYPE_xxx */
+  LONG  week;                      /* index of the diff-directory */
+  LONG  state;                     /* STAGE_xxx */
+  struct TypPatch patch;           /* current hunk */
+  LONG  copy_to;                   /* copy lines until this line is reached */
+  LONG  count;                     /* number of lines left to delete/add */
+  LONG  list_line;                 /* number of next line from source */
+  LONG  out_line;                  /* number of lines delivered */
+  char *p_pending;                 /* line read from source in advance */
+  BOOL  f_pending_old;             /* p_pending is a line of the old listfile */
+  BOOL  f_src_old;                 /* last line from source is a line of the old listfile */
+  BOOL  f_old;                     /* last delivered line is a line of the old listfile */
+  UndoLog *undo;                   /* undo-log of the chain or NULL */
+  BinDiffLog *bindiff;             /* binary diff of the chain or NULL */
+  KeyDiffLog *keydiff;             /* key-addressed diff of the chain or NULL */
+  ChunkLog *chunklog;              /* chunk-log of a chunked listfile or NULL */
+  DeltaLog *delta;                 /* delta-file of the chain or NULL */
+  char *p_key;                     /* keyed diffs: key of the hunk (line of diff_buffer) */
+  FuzzyWindow *fuzzy;              /* FUZZY: lines read in advance or NULL */
+  LONG  offset;                    /* FUZZY: lines the hunks have been moved */
+  LONG  bytes;                     /* binary diffs: size of the lines left to add */
+  LONG  bin_size;                  /* binary diffs: size of the patched listfile */
+  LONG  bin_lines;                 /* binary diffs: lines of the patched listfile */
+  ULONG bin_crc;                   /* binary diffs: CRC of the patched listfile */
+  LONG  status;                    /* STATUS_xxx */
+  LONG  add;                       /* number of lines added */
+  LONG  delete;                    /* number of lines deleted */
+  ULONG crc;                       /* CRC of delivered lines */
+  char  old_crc[16];               /* CRC-line of delivered listfile */
+  BOOL  flag_verbose;
+ } PatchStage;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   OpenPatchStage
+ *
+ * Purpose:     Open diff-file and create a new patch-stage
+ *
+ * Parameters:  source       stage of the previous week or NULL
+ *              list_buffer  listfile (if source is NULL), NULL for new files
+ *              diffinfo     diff-file of this week
+ *
+ * Returns:     pointer to PatchStage or NULL if failed
+ *-----------------------------------------------------------------------------
+ */
+
+PatchStage *OpenPatchStage (PatchStage *source, IMDB_Buffer *list_buffer, DiffInfo *diffinfo, BOOL flag_verbose)
+ {
+  PatchStage *stage;
+
+  if (stage = IMDBAllocMemory (sizeof (PatchStage)))
+   {
+    if (NULL == (stage->diff_buffer = OpenDiffBuffer (diffinfo, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE|IMDBV_FILE_THREAD)))
+     {
+      IMDBFreeMemory (stage);
+      return (NULL);
+     }
+    /* binary diffs tell the size of the patched listfile in advance */
+    stage->bin_size     = 0;
+    stage->bin_lines    = 0;
+    stage->bin_crc      = 0;
+    if ((DIFF_TYPE_BINARY == diffinfo->type)
+      &&(ReadBinDiffHeader (stage->diff_buffer, &stage->bin_size, &stage->bin_lines, &stage->bin_crc)))
+     {
+      IMDBCloseBuffer (stage->diff_buffer);
+      IMDBFreeMemory (stage);
+      return (NULL);
+     }
+    stage->source       = source;
+    stage->list_buffer  = list_buffer;
+    stage->type         = diffinfo->type;
+    stage->week         = diffinfo->week;
+    stage->state        = STAGE_HEADER;
+    stage->copy_to      = 0;
+    stage->count        = 0;
+    stage->list_line    = 1;
+    stage->out_line     = 0;
+    stage->p_pending    = NULL;
+    stage->f_pending_old= FALSE;
+    stage->f_src_old    = FALSE;
+    stage->f_old        = FALSE;
+    stage->undo         = NULL;
+    stage->bindiff      = NULL;
+    stage->keydiff      = NULL;
+    stage->chunklog     = NULL;
+    stage->delta        = NULL;
+    stage->p_key        = NULL;
+    stage->fuzzy        = NULL;
+    stage->offset       = 0;
+    if ((ad_cmds.f_fuzzy) && ((DIFF_TYPE_ORIGINAL == stage->type) || (DIFF_TYPE_HASHED == stage->type))
+      &&(NULL == (stage->fuzzy = OpenFuzzyWindow ())))
+     {
+      IMDBCloseBuffer (stage->diff_buffer);
+      IMDBFreeMemory (stage);
+      return (NULL);
+     }
+    stage->bytes        = 0;
+    stage->status       = STATUS_OK;
+    stage->add          = 0;
+    stage->delete       = 0;
+    stage->crc          = 0xFFFFFFFFL;
+    stage->flag_verbose = flag_verbose;
+    memset (stage->old_crc, 0, sizeof (stage->old_crc));
+   }
+
+  return (stage);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ClosePatchStage
+ *
+ * Purpose:     Close a patch-stage together with all its source-stages.
+ *              The listfile is not closed.
+ *
+ * Parameters:  stage  last stage of chain
+ *
+ * Returns:     nothing
+ *-----------------------------------------------------------------------------
+ */
+
+void ClosePatchStage (PatchStage *stage)
+ {
+  PatchStage *t_stage;
+
+  while (stage)
+   {
+    t_stage = stage->source;
+    IMDBCloseBuffer (stage->diff_buffer);
+    if (stage->fuzzy)
+     CloseFuzzyWindow (stage->fuzzy);
+    IMDBFreeMemory (stage);
+    stage = t_stage;
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   stage_source_line
+ *
+ * Purpose:     get next line from the source of a patch-stage
+ *
+ * Returns:     IMDBE_NO_ERROR, IMDBE_FILE_EOF or IMDBE_FILE_READ
+ *-----------------------------------------------------------------------------
+ */
+
+LONG ReadPatchStageLine (PatchStage *stage, char **p_line);
+
+static LONG stage_read_source (PatchStage *stage, char **p_line)
+ {
+  if (stage->p_pending)
+   {
+    *p_line = stage->p_pending;
+    stage->p_pending = NULL;
+    stage->f_src_old = stage->f_pending_old;
+    return (IMDBE_NO_ERROR);
+   }
+
+  if (stage->source)
+   {
+    LONG ret = ReadPatchStageLine (stage->source, p_line);
+
+    stage->f_src_old = stage->source->f_old;
+    return (ret);
+   }
+
+  if (stage->list_buffer)
+   {
+    stage->f_src_old = TRUE;
+    return (IMDBReadBufferLine (stage->list_buffer, p_line, ADV_MAX_LINESIZE));
+   }
+
+  /* new listfile */
+  *p_line = NULL;
+  return (IMDBE_FILE_EOF);
+ }
+
+static LONG stage_source_line (PatchStage *stage, char **p_line)
+ {
+  FuzzyWindow *fuzzy = stage->fuzzy;
+
+  if (NULL == fuzzy)
+   return (stage_read_source (stage, p_line));
+
+  /* FUZZY: lines read in advance first */
+  if (0 == fuzzy->count)
+   {
+    *p_line = NULL;
+    if (fuzzy->f_eof)
+     return (IMDBE_FILE_EOF);
+    return (stage_read_source (stage, p_line));
+   }
+  *p_line          = &fuzzy->text[fuzzy->first * (ADV_MAX_LINESIZE + 1)];
+  stage->f_src_old = fuzzy->f_old[fuzzy->first];
+  fuzzy->first     = (fuzzy->first + 1) % fuzzy->size;
+  fuzzy->count--;
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   fuzzy_fill
+ *
+ * Purpose:     FUZZY: read lines from the source into the window, until it
+ *              holds the given number of lines or the source is exhausted
+ *
+ * Returns:     IMDBE_NO_ERROR or IMDBE_FILE_READ
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG fuzzy_fill (PatchStage *stage, LONG count)
+ {
+  FuzzyWindow *fuzzy = stage->fuzzy;
+  char        *p_line;
+  LONG         ret;
+  LONG         i;
+
+  if (count > fuzzy->size)
+   count = fuzzy->size;
+  while ((fuzzy->count < count) && (!fuzzy->f_eof))
+   {
+    if (IMDBE_FILE_EOF == (ret = stage_read_source (stage, &p_line)))
+     fuzzy->f_eof = TRUE;
+    else
+    if (ret)
+     return (IMDBE_FILE_READ);
+    else
+     {
+      i = (fuzzy->first + fuzzy->count) % fuzzy->size;
+      fuzzy->len[i] = strlen (p_line);
+      if (fuzzy->len[i] > ADV_MAX_LINESIZE)
+       return (IMDBE_FILE_READ);
+      memcpy (&fuzzy->text[i * (ADV_MAX_LINESIZE + 1)], p_line, fuzzy->len[i] + 1);
+      IMDBHashLine (p_line, fuzzy->len[i], &fuzzy->hash[2*i]);
+      fuzzy->f_old[i] = stage->f_src_old;
+      fuzzy->count++;
+     }
+   }
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   fuzzy_search
+ *
+ * Purpose:     FUZZY: read the first removed lines of the current hunk and
+ *              search them in the window, starting at the line number of
+ *              the hunk. The hunk and all following ones are moved to the
+ *              place where they are found.
+ *
+ * Parameters:  stage  patch-stage, the window starts ADV_FUZZY_WINDOW lines
+ *                     (or less) in front of the hunk
+ *
+ * Returns:     IMDBE_NO_ERROR, IMDBE_FILE_READ (see stage->status) or
+ *              IMDBE_NOTFOUND
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG fuzzy_search (PatchStage *stage)
+ {
+  FuzzyWindow     *fuzzy = stage->fuzzy;
+  struct TypPatch *patch = &stage->patch;
+  char            *p_diff_line;
+  char            *p_end;
+  LONG             nb_block;
+  LONG             dist, pos, i, j;
+
+  /* removed lines: "< <line>" or "<length>:<hash>" */
+  nb_block = patch->i_end - patch->i_start + 1;
+  if (nb_block > ADV_FUZZY_BLOCK)
+   nb_block = ADV_FUZZY_BLOCK;
+  for (i = 0; i < nb_block; i++)
+   {
+    if (IMDBReadBufferLine (stage->diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
+     {
+      stage->status = STATUS_IO;
+      return (IMDBE_FILE_READ);
+     }
+    if (DIFF_TYPE_ORIGINAL == stage->type)
+     {
+      if (strncmp (p_diff_line, "< ", 2))
+       {
+        stage->status = STATUS_SYN;
+        return (IMDBE_FILE_READ);
+       }
+      fuzzy->block_len[i] = strlen (p_diff_line + 2);
+      IMDBHashLine (p_diff_line + 2, fuzzy->block_len[i], &fuzzy->block_hash[2*i]);
+     }
+    else
+     {
+      fuzzy->block_len[i]      = strtol (p_diff_line, &p_end, 16);
+      fuzzy->block_hash[2*i]   = 0;
+      fuzzy->block_hash[2*i+1] = 0;
+      if ((':' != *p_end) || (16 != strlen (p_end + 1))
+        ||(2 != sscanf (p_end + 1, "%8lX%8lX", &fuzzy->block_hash[2*i], &fuzzy->block_hash[2*i+1])))
+       {
+        stage->status = STATUS_SYN;
+        return (IMDBE_FILE_READ);
+       }
+     }
+   }
+  fuzzy->nb_block  = nb_block;
+  fuzzy->block_pos = 0;
+
+  /* lines up to ADV_FUZZY_WINDOW behind the hunk */
+  if (fuzzy_fill (stage, stage->copy_to - stage->list_line + ADV_FUZZY_WINDOW + nb_block))
+   {
+    stage->status = STATUS_IO;
+    return (IMDBE_FILE_READ);
+   }
+
+  /* nearest place first: 0, +1, -1, +2, -2, ... */
+  for (dist = 0; dist <= 2 * ADV_FUZZY_WINDOW; dist++)
+   {
+    pos = (dist & 1) ? (dist + 1) / 2 : -(dist / 2);
+    i   = stage->copy_to + pos - stage->list_line;
+    if ((i < 0) || (i + nb_block > fuzzy->count))
+     continue;
+    for (j = 0; j < nb_block; j++)
+     {
+      LONG k = (fuzzy->first + i + j) % fuzzy->size;
+
+      if ((fuzzy->len[k] != fuzzy->block_len[j])
+        ||(fuzzy->hash[2*k] != fuzzy->block_hash[2*j]) || (fuzzy->hash[2*k+1] != fuzzy->block_hash[2*j+1]))
+       break;
+     }
+    if (j == nb_block)
+     {
+      if ((pos) && (stage->flag_verbose))
+       printf ("\b\b\b\b\b\b - Hunk at line %li moved by %+li lines\n(000%%)", patch->i_start - stage->offset, pos);
+      stage->offset  += pos;
+      stage->copy_to += pos;
+      patch->i_start += pos;
+      patch->i_end   += pos;
+      patch->o_start += pos;
+      patch->o_end   += pos;
+      return (IMDBE_NO_ERROR);
+     }
+   }
+
+  return (IMDBE_NOTFOUND);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   stage_deliver
+ *
+ * Purpose:     account for a line that is delivered by a patch-stage:
+ *              the first line holds the CRC, all others are added to the CRC
+ *
+ * Parameters:  stage   patch-stage
+ *              p_line  line
+ *              f_old   TRUE, if the line is a line of the old listfile
+ *-----------------------------------------------------------------------------
+ */
+
+static void stage_deliver (PatchStage *stage, char *p_line, BOOL f_old)
+ {
+  stage->f_old = f_old;
+  if (stage->out_line)
+   calc_crc (p_line, &stage->crc);
+  else
+   if (0 == strncmp (p_line, "CRC: ", strlen("CRC: ")))
+    strncpy (stage->old_crc, p_line, 15);
+  stage->out_line++;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   keyed_position
+ *
+ * Purpose:     keyed diffs: turn the line numbers of the current hunk into
+ *              absolute ones, as soon as the start of the hunk is known
+ *-----------------------------------------------------------------------------
+ */
+
+static void keyed_position (PatchStage *stage)
+ {
+  LONG o_line = stage->out_line + stage->copy_to - stage->list_line + 1;
+
+  stage->patch.i_start += stage->copy_to;
+  stage->patch.i_end   += stage->copy_to;
+  stage->patch.o_start += o_line;
+  stage->patch.o_end   += o_line;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ReadPatchStageLine
+ *
+ * Purpose:     get next line of the patched listfile
+ *
+ * Parameters:  stage   patch-stage
+ *              p_line  pointer that will be changed to the location of the
+ *                      line. Do not allocate or free!
+ *
+ * Returns:     IMDBE_NO_ERROR, IMDBE_FILE_EOF if all lines have been
+ *              delivered or IMDBE_FILE_READ if the diffs could not be
+ *              applied (see stage->status)
+ *
+ * Comments:
+ *
+ *              8,10c8,11 change lines 8-10 against 8-11
+ *              13d13     delete line 13
+ *              14a15     insert line after line 14
+ *-----------------------------------------------------------------------------
+ */
+
+LONG ReadPatchStageLine (PatchStage *stage, char **p_line)
+ {
+  struct TypPatch *patch = &stage->patch;
+  char            *p_diff_line;
+  char            *p_list_line;
+  LONG             ret;
+
+  while (STATUS_OK == stage->status)
+   {
+    switch (stage->state)
+     {
+      case STAGE_HEADER:
+       {
+        if (DIFF_TYPE_ORIGINAL != stage->type)
+         {
+          /* check if the diff-version matches the listfile */
+          if (IMDBReadBufferLine (stage->diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
+           {
+            stage->status = STATUS_IO;
+            break;
+           }
+          ret = stage_source_line (stage, &p_list_line);
+          if (IMDBE_FILE_EOF == ret)
+           {/* new file? */
+            if (0 != strcmp (p_diff_line, "Apply on: ---"))
+             {
+              stage->status = STATUS_VER;
+              if (stage->flag_verbose)
+               printf ("\b\b\b\b\b\b - Error: Missing Listfile\n");
+              break;
+             }
+           }
+          else
+          if (ret)
+           {
+            stage->status = STATUS_IO;
+            break;
+           }
+          else
+           {
+            if (0 != strcmp (p_diff_line+10, p_list_line))
+             {
+              stage->status = STATUS_VER;
+              if (stage->flag_verbose)
+               printf ("\b\b\b\b\b\b - Error: Unsuitable Diff-File\n");
+              break;
+             }
+            /* this line is still needed */
+            stage->p_pending     = p_list_line;
+            stage->f_pending_old = stage->f_src_old;
+           }
+         }
+        stage->state = STAGE_HUNK;
+        break;
+       }
+
+      case STAGE_HUNK:
+       {
+        if (DIFF_TYPE_BINARY == stage->type)
+         {
+          LONG copy, nb_delete, nb_add;
+
+          /* lines to copy, to delete and to add, size of the added lines */
+          if ((ReadVarint (stage->diff_buffer, &copy))
+            ||(ReadVarint (stage->diff_buffer, &nb_delete))
+            ||(ReadVarint (stage->diff_buffer, &nb_add))
+            ||(ReadVarint (stage->diff_buffer, &stage->bytes))
+            ||((0 == nb_add) != (0 == stage->bytes)))
+           {
+            if (stage->flag_verbose)
+             printf ("\b\b\b\b\b\b - Error: Damaged binary Diff-File\n");
+            stage->status = STATUS_SYN;
+            break;
+           }
+          if ((0 == nb_delete) && (0 == nb_add))
+           {
+            stage->state = STAGE_REST;
+            break;
+           }
+          stage->copy_to = stage->list_line + copy;
+          patch->cmd     = (nb_delete) ? ((nb_add) ? 'c' : 'd') : 'a';
+          patch->i_start = stage->copy_to;
+          patch->i_end   = stage->copy_to + nb_delete - 1;
+          patch->o_start = stage->out_line + copy + 1;
+          patch->o_end   = patch->o_start + nb_add - 1;
+          stage->state   = STAGE_COPY;
+          break;
+         }
+
+        ret = IMDBReadBufferLine (stage->diff_buffer, &p_diff_line, ADV_MAX_LINESIZE);
+        if (IMDBE_FILE_EOF == ret)
+         {
+          stage->state = STAGE_REST;
+          break;
+         }
+        if (ret)
+         {
+          stage->status = STATUS_IO;
+          break;
+         }
+
+        if (DIFF_TYPE_KEYED == stage->type)
+         {
+          LONG  copy      = 0;
+          LONG  nb_delete = 0;
+          LONG  nb_add    = 0;
+          char *p_end     = p_diff_line;
+
+          /* "@<copy> <delete> <add> <key>", the key is optional */
+          if ('@' == *p_diff_line)
+           {
+            copy      = strtol (p_diff_line + 1, &p_end, 10);
+            nb_delete = strtol (p_end, &p_end, 10);
+            nb_add    = strtol (p_end, &p_end, 10);
+           }
+          if (('@' != *p_diff_line) || ((' ' != *p_end) && (*p_end))
+            ||(copy < 0) || (nb_delete < 0) || (nb_add < 0) || ((0 == nb_delete) && (0 == nb_add))
+            ||((*p_end) && (copy < 1)))
+           {
+            if (stage->flag_verbose)
+             printf ("\b\b\b\b\b\b - Error: Damaged keyed Diff-File\n");
+            stage->status = STATUS_SYN;
+            break;
+           }
+          /* line numbers relative to the start of the hunk, until it is found */
+          patch->cmd     = (nb_delete) ? ((nb_add) ? 'c' : 'd') : 'a';
+          patch->i_start = 0;
+          patch->i_end   = nb_delete - 1;
+          patch->o_start = 0;
+          patch->o_end   = nb_add - 1;
+          stage->count   = copy;
+          if (*p_end)
+           {/* the line stays valid until the next line of the diff-file is read */
+            stage->p_key = p_end + 1;
+            stage->state = STAGE_SEEK;
+           }
+          else
+           {
+            stage->copy_to = stage->list_line + copy;
+            stage->state   = STAGE_COPY;
+            keyed_position (stage);
+           }
+          break;
+         }
+
+        /* parse command */
+        GetPatch (patch, p_diff_line);
+
+        /* FUZZY: the hunk is moved like the ones before */
+        if ((stage->fuzzy) && (stage->offset))
+         {
+          patch->i_start += stage->offset;
+          patch->i_end   += stage->offset;
+          patch->o_start += stage->offset;
+          patch->o_end   += stage->offset;
+         }
+
+        /* Es gibt hier einen Sonderfall, naemlich eine Einfuegung gleich am Anfang */
+        if ((0 == patch->i_start) && (patch->cmd == 'a'))
+         stage->copy_to = 1;
+        else
+         {
+          /* Error ??? */
+          if ((patch->i_start < stage->list_line) || (patch->i_start > patch->i_end)
+            ||(patch->o_start < stage->out_line)  || (patch->o_start > patch->o_end))
+           {
+            if (stage->flag_verbose)
+             printf ("\b\b\b\b\b\b - Confusion: cmd:%i is:%i ie:%i os:%i oe:%i\n", patch->cmd, patch->i_start, patch->i_end, patch->o_start, patch->o_end);
+            stage->status = STATUS_SYN;
+            break;
+           }
+
+          /* Beim Anfuegen wird die Zeile i_start noch kopiert */
+          if (patch->cmd == 'a')
+           stage->copy_to = patch->i_start + 1;
+          else
+           stage->copy_to = patch->i_start;
+         }
+        /* FUZZY: the removed lines are searched around copy_to */
+        if ((stage->fuzzy) && ('a' != patch->cmd))
+         stage->fuzzy->f_search = TRUE;
+        stage->state = STAGE_COPY;
+        break;
+       }
+
+      case STAGE_SEEK:
+       {
+        /* keyed diffs: copy lines up to and including the key */
+        if (ret = stage_source_line (stage, &p_list_line))
+         {
+          if (IMDBE_FILE_EOF == ret)
+           {
+            if (stage->flag_verbose)
+             printf ("\b\b\b\b\b\b - Error: Key not found: %.40s\n", stage->p_key);
+            stage->status = STATUS_VER;
+           }
+          else
+           stage->status = STATUS_IO;
+          break;
+         }
+        stage->list_line++;
+        stage_deliver (stage, p_list_line, stage->f_src_old);
+        if (0 == strcmp (p_list_line, stage->p_key))
+         {
+          stage->copy_to = stage->list_line + stage->count - 1;
+          stage->p_key   = NULL;
+          stage->state   = STAGE_COPY;
+          keyed_position (stage);
+         }
+        *p_line = p_list_line;
+        return (IMDBE_NO_ERROR);
+       }
+
+      case STAGE_COPY:
+       {
+        /* Alles klar, wir suchen jetzt diese Zeile(n) im listfile */
+        /* (FUZZY: the last ADV_FUZZY_WINDOW lines in front of it are kept) */
+        if (stage->list_line < stage->copy_to - (((stage->fuzzy) && (stage->fuzzy->f_search)) ? ADV_FUZZY_WINDOW : 0))
+         {
+          if (ret = stage_source_line (stage, &p_list_line))
+           {
+            if (IMDBE_FILE_EOF == ret)
+             {
+              if (stage->flag_verbose)
+               printf ("\b\b\b\b\b\b - Error before reaching line number: %i\n", patch->i_start);
+              stage->status = STATUS_SYN;
+             }
+            else
+             stage->status = STATUS_IO;
+            break;
+           }
+          stage->list_line++;
+          stage_deliver (stage, p_list_line, stage->f_src_old);
+          *p_line = p_list_line;
+          return (IMDBE_NO_ERROR);
+         }
+
+        /* FUZZY: search the hunk, then copy up to the place where it is found */
+        if ((stage->fuzzy) && (stage->fuzzy->f_search))
+         {
+          stage->fuzzy->f_search = FALSE;
+          if (IMDBE_NOTFOUND == fuzzy_search (stage))
+           {
+            stage->status = STATUS_VER;
+            if (stage->flag_verbose)
+             printf ("\b\b\b\b\b\b - Error: Lines do not match (%i).\n", patch->i_start);
+           }
+          break;
+         }
+
+        /* O.K. jetzt sind wir an der richtigen Stelle */
+        switch (patch->cmd)
+         {
+          case 'd': /* delete line */
+          case 'c': /* change line */
+           stage->count = patch->i_end - patch->i_start + 1;
+           stage->state = STAGE_DELETE;
+           break;
+          case 'a': /* add line */
+           stage->count = patch->o_end - patch->o_start + 1;
+           stage->state = STAGE_ADD;
+           break;
+          default:
+           if (stage->flag_verbose)
+            printf ("\b\b\b\b\b\b - Unknown command %i\n", patch->cmd);
+           stage->status = STATUS_SYN;
+           break;
+         }
+        break;
+       }
+
+      case STAGE_DELETE:
+       {
+        if (stage->count > 0)
+         {
+          /* FUZZY: the first lines have been read and found by fuzzy_search */
+          BOOL f_found = ((stage->fuzzy) && (stage->fuzzy->block_pos < stage->fuzzy->nb_block));
 
-    /* 2ter Teil */
-    buffer ++;
-    c = buffer;
-    while (isdigit(*buffer)) buffer ++;
-    cmd = *buffer;
-    *buffer = '\0';
-    patch -> o_start = patch -> o_end = strtol (c, NULL, 10);
-    if (cmd == ',')
-     {/* parse toline */
-      buffer ++;
-      c = buffer;
-      while (isdigit(*buffer)) buffer++;
-      cmd = *buffer;
-      *buffer = '\0';
-      patch -> o_end = strtol (c, NULL, 10);
-     }
-    *buffer = cmd;
+          if (f_found)
+           stage->fuzzy->block_pos++;
+          else
+          if (((DIFF_TYPE_ORIGINAL == stage->type) || (DIFF_TYPE_HASHED == stage->type) || (DIFF_TYPE_KEYED == stage->type))
+            &&(IMDBReadBufferLine (stage->diff_buffer, &p_diff_line, ADV_MAX_LINESIZE)))
+           {
+            stage->status = STATUS_IO;
+            break;
+           }
+          if (stage_source_line (stage, &p_list_line))
+           {
+            stage->status = STATUS_IO;
+            break;
+           }
+          /* original and keyed diffs contain the deleted lines, hashed diffs their hashes */
+          if ((!f_found)
+            &&(((DIFF_TYPE_ORIGINAL == stage->type) && (0 != strcmp (p_diff_line+2, p_list_line)))
+             ||((DIFF_TYPE_KEYED == stage->type) && (('-' != p_diff_line[0]) || (0 != strcmp (p_diff_line+2, p_list_line))))
+             ||((DIFF_TYPE_HASHED == stage->type) && (!CheckLineHash (p_diff_line, p_list_line)))))
+           {
+            stage->status = STATUS_VER;
+            if (stage->flag_verbose)
+             printf ("\b\b\b\b\b\b - Error: Lines do not match (%i).\n", stage->list_line);
+            break;
+           }
+          /* lines of the old listfile are needed for the reverse diff */
+          if ((stage->undo) && (stage->f_src_old))
+           UndoOldLine (stage->undo, p_list_line);
+          if ((stage->bindiff) && (stage->f_src_old))
+           BinDiffOldLine (stage->bindiff, p_list_line);
+          if ((stage->keydiff) && (stage->f_src_old))
+           KeyDiffOldLine (stage->keydiff, p_list_line);
+          if ((stage->chunklog) && (stage->f_src_old))
+           ChunkOldLine (stage->chunklog);
+          if ((stage->delta) && (stage->f_src_old))
+           DeltaOldLine (stage->delta, p_list_line);
+          stage->list_line++;
+          stage->delete++;
+          stage->count--;
+          break;
+         }
 
-#ifdef IMDB_DEBUG
-   printf ("Patch-Hunk: cmd:%i is:%i ie:%i os:%i oe:%i\n", patch->cmd, patch->i_start, patch->i_end, patch->o_start, patch->o_end);
-#endif
+        if (patch->cmd == 'c')
+         {
+          /* separator-line */
+          if (DIFF_TYPE_ORIGINAL == stage->type)
+           {
+            if (IMDBReadBufferLine (stage->diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
+             {
+              stage->status = STATUS_IO;
+              break;
+             }
+            if (0 != strncmp (p_diff_line, "---", 3))
+             {
+              if (stage->flag_verbose)
+               printf ("\b\b\b\b\b\b - Error: Can't find separator.\n");
+              stage->status = STATUS_VER;
+              break;
+             }
+           }
+
+          /* now add new lines */
+          stage->count = patch->o_end - patch->o_start + 1;
+          stage->state = STAGE_ADD;
+         }
+        else
+         stage->state = STAGE_HUNK;
+        break;
+       }
+
+      case STAGE_ADD:
+       {
+        if (stage->count > 0)
+         {
+          if (DIFF_TYPE_BINARY == stage->type)
+           {
+            LONG pos = stage->diff_buffer->filepos;
+            LONG len;
+
+            /* the line is used where it is in the buffer */
+            if ((ReadVarint (stage->diff_buffer, &len)) || (len >= ADV_MAX_LINESIZE)
+              ||(len + 1 != IMDBReadBuffer (stage->diff_buffer, &p_diff_line, len + 1))
+              ||(p_diff_line[len])
+              ||(0 > (stage->bytes -= stage->diff_buffer->filepos - pos)))
+             {
+              if (stage->flag_verbose)
+               printf ("\b\b\b\b\b\b - Error: Damaged binary Diff-File\n");
+              stage->status = STATUS_SYN;
+              break;
+             }
+           }
+          else
+          if (IMDBReadBufferLine (stage->diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
+           {
+            stage->status = STATUS_IO;
+            break;
+           }
+          if ((DIFF_TYPE_KEYED == stage->type) && ('+' != p_diff_line[0]))
+           {
+            if (stage->flag_verbose)
+             printf ("\b\b\b\b\b\b - Error: Missing added line (%i)\n", stage->list_line);
+            stage->status = STATUS_SYN;
+            break;
+           }
+          if ((DIFF_TYPE_ORIGINAL == stage->type) || (DIFF_TYPE_KEYED == stage->type))
+           p_diff_line += 2;
+          stage->add++;
+          stage->count--;
+          stage_deliver (stage, p_diff_line, FALSE);
+          *p_line = p_diff_line;
+          return (IMDBE_NO_ERROR);
+         }
+        /* the size of the hunk must fit */
+        if ((DIFF_TYPE_BINARY == stage->type) && (stage->bytes))
+         {
+          if (stage->flag_verbose)
+           printf ("\b\b\b\b\b\b - Error: Damaged binary Diff-File\n");
+          stage->status = STATUS_SYN;
+          break;
+         }
+        stage->state = STAGE_HUNK;
+        break;
+       }
+
+      case STAGE_REST:
+       {
+        /* Das restliche listfile kopieren */
+        ret = stage_source_line (stage, &p_list_line);
+        if (IMDBE_FILE_EOF == ret)
+         {
+          stage->state = STAGE_EOF;
+          break;
+         }
+        if (ret)
+         {
+          stage->status = STATUS_IO;
+          break;
+         }
+        stage->list_line++;
+        stage_deliver (stage, p_list_line, stage->f_src_old);
+        *p_line = p_list_line;
+        return (IMDBE_NO_ERROR);
+       }
+
+      default:
+       {
+        *p_line = NULL;
+        return (IMDBE_FILE_EOF);
+       }
+     }
    }
+
+  *p_line = NULL;
+  return (IMDBE_FILE_READ);
  }
 
 /*-----------------------------------------------------------------------------
- * Procedure:   patchfile
+ * Procedure:   CheckPatchStageCRC
  *
- * Parameters:  listfile, diffile
+ * Purpose:     compare CRC of the delivered lines with the CRC-line
  *
- * Comments:
+ * Parameters:  stage  patch-stage, all lines must have been delivered
  *
- *              8,10c8,11 change lines 8-10 against 8-11
- *              13d13     delete line 13
- *              14a15     insert line after line 14
+ * Returns:     TRUE if CRC is O.K.
  *-----------------------------------------------------------------------------
  */
 
-int patchfile_original(char *listfile, char *diffile, BOOL flag_keep, BOOL flag_verbose, DiffInfo *diffinfo)
+BOOL CheckPatchStageCRC (PatchStage *stage)
  {
-  static char     fname [256];
-  struct TypPatch patch;
-  IMDB_Buffer    *list_buffer = NULL;
-  IMDB_Buffer    *diff_buffer = NULL;
-  IMDB_Buffer    *out_buffer  = NULL;
-  char           *p_list_line;
-  char           *p_diff_line;
-  LONG            list_line   = 1;
-  LONG            out_line    = 0;
-  LONG            l_add       = 0;
-  LONG            l_delete    = 0;
-  LONG            status      = STATUS_OK;
-  LONG            progress    = 0;
-  LONG            tprogress   = 0;
-  LONG            i;
-  LONG            len;
+  char crc_str[16];
 
-  strcpy (fname, listfile);
-  StrChangeSuffix (fname, ".new");
+  /* binary diffs know lines and CRC of the patched listfile */
+  if ((DIFF_TYPE_BINARY == stage->type)
+    &&((stage->out_line != stage->bin_lines) || ((stage->crc & 0xFFFFFFFFL) != stage->bin_crc)))
+   return (FALSE);
 
-  /* reset CRC */
-  nCrc = 0xFFFFFFFFL;
-  new_crc [0] = '\0';
-  old_crc [0] = '\0';
+  sprintf (crc_str, "CRC: 0x%08lX", (ULONG) (stage->crc & 0xFFFFFFFFL));
+  return ((STAGE_EOF == stage->state) && (0 == strcmp (stage->old_crc, crc_str)));
+ }
 
-  /* open diff-file */
-  if (NULL == (diff_buffer = IMDBOpenBuffer (diffile, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE, ADV_BUFFER_SIZE)))
+/******************************************************************************
+ * Checkpoints
+ *
+ * With the option CHECKPOINT the state of all patch-stages is written to
+ * <listfile>.chk every ADV_CHECKPOINT_SIZE bytes of output, after the new
+ * listfile has been written to disk up to this point. If ApplyDiffs is
+ * interrupted, the next run checks the partial *.new file against the
+ * checkpoint and continues from there instead of starting again.
+ *
+ * The checkpoint is a textfile:
+ *
+ *   ApplyDiffs-Checkpoint 2
+ *   list <size of listfile> <position in listfile>
+ *   out <size of *.new>
+ *   stages <number of patch-stages>
+ *   stage <week> <size of diff> <position in diff> <state> ... (newest first)
+ *   line <last line written to *.new>
+ *   end
+ ******************************************************************************
+ */
+
+#define CHECKPOINT_MAGIC  "ApplyDiffs-Checkpoint 2"
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   WriteCheckpoint
+ *
+ * Purpose:     write the new listfile to disk and save the state of the
+ *              patch-stages
+ *
+ * Parameters:  chkname      name of checkpoint-file
+ *              stage        last stage of chain
+ *              list_buffer  listfile or NULL
+ *              out_buffer   new listfile
+ *              p_line       last line written to out_buffer
+ *
+ * Returns:     TRUE if the checkpoint has been written, FALSE if the stages
+ *              are not at a point where they can be saved
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL WriteCheckpoint (char *chkname, PatchStage *stage, IMDB_Buffer *list_buffer, IMDB_Buffer *out_buffer, char *p_line)
+ {
+  PatchStage *t_stage;
+  FILE       *fp;
+  LONG        nb_stages = 0;
+
+  /* a line read in advance (or the key of a keyed diff) can't be restored */
+  for (t_stage = stage; t_stage; t_stage = t_stage->source)
    {
-    diffinfo->status = STATUS_IO;
-    return (RET_ERROR);
+    if ((t_stage->p_pending) || (STAGE_HEADER == t_stage->state) || (STAGE_SEEK == t_stage->state))
+     return (FALSE);
+    nb_stages++;
    }
 
-  /* open old listfile */
-  if (IMDBExistFile(listfile))
+  /* everything up to here must be on the disk */
+  if ((IMDBFlushBuffer (out_buffer)) || (IMDBSyncFile (out_buffer->fname)))
+   return (FALSE);
+
+  if (NULL == (fp = fopen (chkname, "wb")))
+   return (FALSE);
+
+  fprintf (fp, "%s\n", CHECKPOINT_MAGIC);
+  if (list_buffer)
+   fprintf (fp, "list %li %li\n", list_buffer->filesize, list_buffer->filepos);
+  else
+   fprintf (fp, "list -1 0\n");
+  fprintf (fp, "out %li\n", out_buffer->filepos);
+  fprintf (fp, "stages %li\n", nb_stages);
+  for (t_stage = stage; t_stage; t_stage = t_stage->source)
+   fprintf (fp, "stage %li %li %li %li %i %li %li %li %li %li %li %li %li %i %i %li %li %li %li %lX %s\n",
+            t_stage->week, t_stage->diff_buffer->filesize, t_stage->diff_buffer->filepos,
+            t_stage->state, (int) t_stage->patch.cmd,
+            t_stage->patch.i_start, t_stage->patch.i_end, t_stage->patch.o_start, t_stage->patch.o_end,
+            t_stage->copy_to, t_stage->count, t_stage->list_line, t_stage->out_line,
+            (int) t_stage->f_src_old, (int) t_stage->f_old,
+            t_stage->status, t_stage->add, t_stage->delete, t_stage->bytes,
+            (ULONG) (t_stage->crc & 0xFFFFFFFFL),
+            (t_stage->old_crc[0]) ? &t_stage->old_crc[5] : "-");
+  fprintf (fp, "line %s\n", p_line);
+  fprintf (fp, "end\n");
+
+  if (fclose (fp))
    {
-    list_buffer = IMDBOpenBuffer (listfile, IMDBV_FILE_READ, ADV_BUFFER_SIZE);
+    remove (chkname);
+    return (FALSE);
    }
-  else
+  return (TRUE);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ResumeCheckpoint
+ *
+ * Purpose:     restore the state of the patch-stages from a checkpoint, if
+ *              it matches the listfile, the diff-files and the partial
+ *              new listfile. The new listfile is cut back to the checkpoint.
+ *
+ * Parameters:  chkname      name of checkpoint-file
+ *              newname      name of the partial new listfile
+ *              stage        last stage of chain (freshly opened)
+ *              list_buffer  listfile or NULL
+ *
+ * Returns:     size of the new listfile to continue with, 0 if the
+ *              checkpoint can't be used or -1 if the patch-stages could not
+ *              be restored
+ *-----------------------------------------------------------------------------
+ */
+
+LONG ResumeCheckpoint (char *chkname, char *newname, PatchStage *stage, IMDB_Buffer *list_buffer)
+ {
+  PatchStage  *t_stage;
+  PatchStage  *saved = NULL;
+  IMDB_Buffer *new_buffer;
+  FILE        *fp;
+  char        *p_text;
+  char        *p_data;
+  char         old_crc[16];
+  LONG         list_size, list_pos, out_pos, nb_stages, len, i;
+  LONG         diff_pos[ADV_MAX_WEEKS];
+  int          cmd, f_src_old, f_old;
+  BOOL         f_ok = FALSE;
+
+  if (NULL == (fp = fopen (chkname, "rb")))
+   return (0);
+  if (NULL == (p_text = IMDBAllocMemory (ADV_MAX_LINESIZE + 16)))
    {
-    /* Listfile does not exist. Maybe it's new? */
-    if (STATUS_OK == diffinfo->status) /* d.h. wenn option NOCHECK benutzt wird */
+    fclose (fp);
+    return (0);
+   }
+
+  /* header */
+  if ((fgets (p_text, ADV_MAX_LINESIZE + 16, fp))
+    &&(0 == strncmp (p_text, CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC)))
+    &&(2 == fscanf (fp, "list %li %li\n", &list_size, &list_pos))
+    &&(1 == fscanf (fp, "out %li\n", &out_pos))
+    &&(1 == fscanf (fp, "stages %li\n", &nb_stages))
+    &&(list_size == ((list_buffer) ? list_buffer->filesize : -1))
+    &&(out_pos > 0) && (nb_stages > 0) && (nb_stages <= ADV_MAX_WEEKS))
+   saved = IMDBAllocMemory (nb_stages * sizeof (PatchStage));
+
+  /* patch-stages, newest first */
+  if (saved)
+   {
+    f_ok = TRUE;
+    for (t_stage = stage, i = 0; (f_ok) && (t_stage); t_stage = t_stage->source, i++)
      {
-      /* check if the diff-file contains no line starting with '<' */
-      diffinfo->status = STATUS_NEW;
-      while ((STATUS_NEW == diffinfo->status) && (IMDBReadBufferLine(diff_buffer, &p_diff_line, ADV_MAX_LINESIZE)))
+      if ((i >= nb_stages)
+        ||(21 != fscanf (fp, "stage %li %li %li %li %i %li %li %li %li %li %li %li %li %i %i %li %li %li %li %lX %15s\n",
+                         &saved[i].week, &len, &diff_pos[i], &saved[i].state, &cmd,
+                         &saved[i].patch.i_start, &saved[i].patch.i_end, &saved[i].patch.o_start, &saved[i].patch.o_end,
+                         &saved[i].copy_to, &saved[i].count, &saved[i].list_line, &saved[i].out_line,
+                         &f_src_old, &f_old, &saved[i].status, &saved[i].add, &saved[i].delete,
+                         &saved[i].bytes, &saved[i].crc, old_crc))
+        ||(saved[i].week != t_stage->week) || (len != t_stage->diff_buffer->filesize)
+        ||(saved[i].state <= STAGE_HEADER) || (saved[i].state > STAGE_EOF)
+        ||(STATUS_OK != saved[i].status))
+       f_ok = FALSE;
+      else
        {
-        if (*p_diff_line == '<')
-         {
-          status = diffinfo->status = STATUS_VER;
-          if (flag_verbose)
-           printf ("\b\b\b\b\b\b - Error: Missing Listfile\n");
-         }
+        saved[i].patch.cmd = (char) cmd;
+        saved[i].f_src_old = (BOOL) f_src_old;
+        saved[i].f_old     = (BOOL) f_old;
+        memset (saved[i].old_crc, 0, sizeof (saved[i].old_crc));
+        if (strcmp (old_crc, "-"))
+         sprintf (saved[i].old_crc, "CRC: %.10s", old_crc);
        }
-      IMDBPositionBuffer (diff_buffer, 0);
      }
+    if (i != nb_stages)
+     f_ok = FALSE;
+   }
 
-    if (STATUS_NEW != diffinfo->status)
+  /* last line written, it must be found at the end of the partial listfile */
+  if ((f_ok)
+    &&(fgets (p_text, ADV_MAX_LINESIZE + 16, fp)) && (0 == strncmp (p_text, "line ", 5))
+    &&(fgets (old_crc, sizeof (old_crc), fp)) && (0 == strcmp (old_crc, "end\n")))
+   {
+    f_ok = FALSE;
+    len  = strlen (p_text) - 5;
+    if (new_buffer = IMDBOpenBuffer (newname, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE, ADV_MAX_LINESIZE + 16))
      {
-      if (STATUS_OK == diffinfo->status)
-       diffinfo->status = STATUS_IO;
-      IMDBCloseBuffer (diff_buffer);
-      return (RET_WARNING);
+      if ((new_buffer->filesize >= out_pos) && (out_pos >= len)
+        &&(IMDBE_NO_ERROR == IMDBPositionBuffer (new_buffer, out_pos - len))
+        &&(len == IMDBReadBuffer (new_buffer, &p_data, len))
+        &&(0 == memcmp (p_data, p_text + 5, len)))
+       f_ok = TRUE;
+      IMDBCloseBuffer (new_buffer);
      }
-    if (flag_verbose)
+   }
+  else
+   f_ok = FALSE;
+
+  /* everything matches: cut the new listfile and restore the patch-stages */
+  if ((f_ok) && (IMDBE_NO_ERROR == IMDBTruncateFile (newname, out_pos)))
+   {
+    for (t_stage = stage, i = 0; t_stage; t_stage = t_stage->source, i++)
      {
-      printf ("\b\b\b\b\b\b(new file) (000%%)");
-      fflush (stdout);
+      t_stage->state     = saved[i].state;
+      t_stage->patch     = saved[i].patch;
+      t_stage->copy_to   = saved[i].copy_to;
+      t_stage->count     = saved[i].count;
+      t_stage->list_line = saved[i].list_line;
+      t_stage->out_line  = saved[i].out_line;
+      t_stage->f_src_old = saved[i].f_src_old;
+      t_stage->f_old     = saved[i].f_old;
+      t_stage->add       = saved[i].add;
+      t_stage->delete    = saved[i].delete;
+      t_stage->bytes     = saved[i].bytes;
+      t_stage->crc       = saved[i].crc;
+      memcpy (t_stage->old_crc, saved[i].old_crc, sizeof (t_stage->old_crc));
+      if (IMDBPositionBuffer (t_stage->diff_buffer, diff_pos[i]))
+       out_pos = -1;
      }
+    if ((list_buffer) && (IMDBPositionBuffer (list_buffer, list_pos)))
+     out_pos = -1;
+   }
+  else
+   f_ok = FALSE;
+
+  if (saved)
+   IMDBFreeMemory (saved);
+  IMDBFreeMemory (p_text);
+  fclose (fp);
+  return ((f_ok) ? out_pos : 0);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   GetUndoName
+ *
+ * Purpose:     build the full filename of a reverse diff-file
+ *-----------------------------------------------------------------------------
+ */
+
+void GetUndoName (char *p_name, DiffInfo *diffinfo)
+ {
+  strcpy (p_name, ad_cmds.p_undodir);
+  strncat(p_name, diffinfo->fname_list, 255-strlen(p_name));
+  strcpy (&p_name[strlen(p_name)-4], "diff");
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   GetBinDiffName
+ *
+ * Purpose:     build the full filename of a binary diff-file
+ *-----------------------------------------------------------------------------
+ */
+
+void GetBinDiffName (char *p_name, DiffInfo *diffinfo)
+ {
+  strcpy (p_name, ad_cmds.p_bindir);
+  strncat(p_name, diffinfo->fname_list, 250-strlen(p_name));
+  strcpy (&p_name[strlen(p_name)-5], BINDIFF_EXT);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   GetKeyDiffName
+ *
+ * Purpose:     build the full filename of a key-addressed diff-file
+ *-----------------------------------------------------------------------------
+ */
+
+void GetKeyDiffName (char *p_name, DiffInfo *diffinfo)
+ {
+  strcpy (p_name, ad_cmds.p_keydir);
+  strncat(p_name, diffinfo->fname_list, 250-strlen(p_name));
+  strcpy (&p_name[strlen(p_name)-5], KEYDIFF_EXT);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   GetDeltaName
+ *
+ * Purpose:     build the full filename of a delta-file
+ *-----------------------------------------------------------------------------
+ */
+
+void GetDeltaName (char *p_name, DiffInfo *diffinfo)
+ {
+  strcpy (p_name, ad_cmds.p_deltadir);
+  strncat(p_name, diffinfo->fname_list, 250-strlen(p_name));
+  strcpy (&p_name[strlen(p_name)-5], IMDBV_DELTA_EXT);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   CommitChunks
+ *
+ * Purpose:     replace the manifest of a chunked listfile by the new one
+ *              (*.chunks.new) and remove the chunk-files that are not
+ *              used anymore. With KEEP the old manifest is kept as
+ *              *.chunks.old together with its chunk-files.
+ *
+ * Parameters:  listfile, flag_keep
+ *              f_remove  the new listfile is empty (REVERT of a new file)
+ *-----------------------------------------------------------------------------
+ */
+
+void CommitChunks (char *listfile, BOOL flag_keep, BOOL f_remove)
+ {
+  IMDB_Manifest *manifest;
+  IMDB_Manifest *new_manifest;
+  IMDB_Manifest *old_manifest;
+  char           fname [256];
+  char           newname [256];
+  char           oldname [256];
+
+  GetManifestName (fname,   listfile, "");
+  GetManifestName (newname, listfile, ".new");
+  GetManifestName (oldname, listfile, ".old");
+  if (NULL == (new_manifest = IMDBReadManifest (newname)))
+   return;
+  manifest     = IMDBReadManifest (fname);
+  old_manifest = IMDBReadManifest (oldname);
+
+  /* *.old manifest loeschen falls noch nicht geschehen */
+  RemoveChunks (listfile, old_manifest, manifest, new_manifest);
+  remove (oldname);
+  if ((flag_keep) && (manifest))
+   IMDBWriteManifest (manifest, oldname);
+
+  /* the new listfile is there with this rename */
+  rename (newname, fname);
+  if (!flag_keep)
+   RemoveChunks (listfile, manifest, new_manifest, NULL);
+
+  if (f_remove)
+   {
+    RemoveChunks (listfile, new_manifest, (flag_keep) ? manifest : NULL, NULL);
+    remove (fname);
+   }
+
+  IMDBFreeManifest (manifest);
+  IMDBFreeManifest (new_manifest);
+  IMDBFreeManifest (old_manifest);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   DiscardChunks
+ *
+ * Purpose:     remove the new manifest of a chunked listfile and its new
+ *              chunk-files (TRANSACTION aborted)
+ *-----------------------------------------------------------------------------
+ */
+
+void DiscardChunks (char *listfile)
+ {
+  IMDB_Manifest *manifest;
+  IMDB_Manifest *new_manifest;
+  char           fname [256];
+
+  GetManifestName (fname, listfile, "");
+  manifest = IMDBReadManifest (fname);
+  GetManifestName (fname, listfile, ".new");
+  if (new_manifest = IMDBReadManifest (fname))
+   RemoveChunks (listfile, new_manifest, manifest, NULL);
+  remove (fname);
+
+  IMDBFreeManifest (manifest);
+  IMDBFreeManifest (new_manifest);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   CommitListfile
+ *
+ * Purpose:     replace the listfile by the patched listfile (*.new) and
+ *              remove the diff-files that have been applied. A chunked
+ *              listfile gets its new manifest.
+ *
+ * Parameters:  listfile, flag_keep, diffinfo
+ *-----------------------------------------------------------------------------
+ */
+
+void CommitListfile (char *listfile, BOOL flag_keep, DiffInfo *diffinfo)
+ {
+  char      fname [256];
+  char      diffname [256];
+  DiffInfo *t_diffinfo;
+
+  /* chunked listfile: only the manifest is replaced */
+  if (IsChunkedList (listfile))
+   CommitChunks (listfile, flag_keep, (ad_cmds.f_revert) && (0 == diffinfo->nb_lines));
+  else
+   {
+    /* *.old file loeschen falls noch nicht geschehen und files umbenennen */
+    GetTempName (fname, listfile, ".old");
+    RemoveListfile (fname);
+
+    /* listfile umbenennen, bzw loeschen */
+    if (flag_keep)
+     RenameListfile (listfile, fname);
+    else
+     RemoveListfile (listfile);
+
+    /* neues Listfile umbenennen */
+    GetTempName (fname, listfile, ".new");
+    if ((ad_cmds.f_revert) && (0 == diffinfo->nb_lines))
+     RemoveListfile (fname);  /* listfile did not exist before */
+    else
+     RenameListfile (fname, listfile);
+
+#ifdef SYS_AMIGA
+    /* Protection Bits richtig setzen */
+    SetProtection (listfile, FIBF_EXECUTE);
+#endif
    }
 
-  /* open new listfile */
-  if (NULL == (out_buffer =  IMDBOpenBuffer (fname, IMDBV_FILE_WRITE, ADV_BUFFER_SIZE)))
+  /* diffiles loeschen (tar-archives are kept) */
+  if (!flag_keep)
+   for (t_diffinfo = diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next_week)
+    if (NULL == ad_cmds.p_archives[t_diffinfo->week])
+     {
+      GetDiffName (diffname, t_diffinfo);
+      remove (diffname);
+     }
+ }
+
+#ifdef IMDB_GZIP
+/*-----------------------------------------------------------------------------
+ * Procedure:   PackListfile
+ *
+ * Purpose:     compress a listfile that has been uncompressed for patching
+ *
+ * Parameters:  listname, diffinfo, flag_verbose
+ *
+ * Returns:     RET_OK or RET_WARNING
+ *-----------------------------------------------------------------------------
+ */
+
+int PackListfile (char *listname, DiffInfo *diffinfo, BOOL flag_verbose)
+ {
+  char command [255];
+
+  if (flag_verbose)
    {
-    IMDBCloseBuffer (diff_buffer);
-    IMDBCloseBuffer (list_buffer);
-    if (diffinfo)
-     diffinfo->status = STATUS_IO;
-    return (RET_ERROR);
+    printf ("Compressing File %s - ", diffinfo->fname_list);
+    fflush (stdout);
+   }
+  sprintf (command, IMDBV_FILE_PACKER_NAME " " IMDBV_FILE_PACKER_PACK " %s", listname);
+  if (system(command))
+   {/* Packen hat leider nicht geklappt */
+    diffinfo->status = STATUS_IO;
+    printf ("failed!\n");
+    return (RET_WARNING);
    }
+  printf ("OK\n");
+  return (RET_OK);
+ }
+#endif
 
-  /*** now patch the file ***/
-  /* get next line of diff */
-  while ((STATUS_OK == status) && (!IMDBReadBufferLine(diff_buffer, &p_diff_line, ADV_MAX_LINESIZE)))
+/*-----------------------------------------------------------------------------
+ * Procedure:   CommitTransaction
+ *
+ * Purpose:     TRANSACTION: the patched listfiles (*.new) are only renamed
+ *              if the diffs of all listfiles could be applied. Before the
+ *              first listfile is renamed, all new listfiles and reverse
+ *              diffs are written to the disk (one syncfs or one fsync per
+ *              file), so either the old or the new week is found after a
+ *              crash. If any listfile failed, all *.new files are removed.
+ *
+ * Parameters:  diffinfo, flag_keep, flag_verbose
+ *
+ * Returns:     RET_OK or RET_WARNING
+ *-----------------------------------------------------------------------------
+ */
+
+int CommitTransaction (DiffInfo *diffinfo, BOOL flag_keep, BOOL flag_verbose)
+ {
+  DiffInfo *t_diffinfo;
+  char      listname [256];
+  char      fname [256];
+  BOOL      f_commit = TRUE;
+  LONG      ret;
+  int       ret_val = RET_OK;
+
+  for (t_diffinfo = diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next)
+   if ((STATUS_OK != t_diffinfo->status) && (STATUS_NEW != t_diffinfo->status))
+    f_commit = FALSE;
+
+  /* write all new files to the disk before anything is renamed */
+  if (f_commit)
    {
-    /* show progress */
-    if ((flag_verbose) && (progress != (tprogress = (diff_buffer->filepos*100/diff_buffer->filesize))))
+    if (flag_verbose)
      {
-      progress = tprogress;
-      printf ("\b\b\b\b\b\b(%03i%%)", progress);
+      printf ("Writing listfiles to disk - ");
       fflush (stdout);
      }
-
-    /* parse command */
-    GetPatch(&patch, p_diff_line);
-
-    /* Es gibt hier einen Sonderfall, naemlich eine Einfuegung gleich am Anfang */
-    if ((0 == patch.i_start) && (patch.cmd == 'a'))
+    if (IMDBE_NOTFOUND == (ret = IMDBSyncFileSystem (ad_cmds.p_listdir)))
      {
-      /* Und jetzt einfuegen */
-      for (i = patch.o_start; i <= patch.o_end; i++)
+      ret = IMDBE_NO_ERROR;
+      for (t_diffinfo = diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next)
        {
-        if ((flag_verbose) && (progress != (tprogress = (diff_buffer->filepos*100/diff_buffer->filesize))))
-         {
-          progress = tprogress;
-          printf ("\b\b\b\b\b\b(%03i%%)", progress);
-          fflush (stdout);
-         }
-        if (IMDBE_FILE_READ == IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-         {
-          status = STATUS_IO;
-          break;
-         }
-        len = strlen(p_diff_line);
-        if ((IMDBWriteBuffer(out_buffer, p_diff_line+2, len-2))
-          ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
+        GetListName (listname, t_diffinfo);
+        if (IsChunkedList (listname))
+         GetManifestName (fname, listname, ".new");
+        else
+         GetTempName (fname, listname, ".new");
+        if (IMDBSyncFile (fname))
+         ret = IMDBE_FILE_WRITE;
+        if (ad_cmds.p_undodir)
          {
-          status = STATUS_IO;
-          break;
+          GetUndoName (fname, t_diffinfo);
+          if (IMDBSyncFile (fname))
+           ret = IMDBE_FILE_WRITE;
          }
-        /* calc CRC */
-        if (out_line)
-         calc_crc (p_diff_line+2, &nCrc);
-        else
-         if (0 == strncmp (p_diff_line+2, "CRC: ", strlen("CRC: ")))
-          strncpy (old_crc, p_diff_line+2, 15);
-        out_line++;
-        l_add++;
        }
-      continue;
      }
+    else
+    if ((IMDBE_NO_ERROR == ret) && (ad_cmds.p_undodir))
+     ret = IMDBSyncFileSystem (ad_cmds.p_undodir);
 
-    /* Sonderfall, dass es gar keine alte Liste gab */
-    if (NULL == list_buffer)
-     break;
-
-    /* Error ??? */
-    if ((patch.i_start < list_line) || (patch.i_start > patch.i_end)
-      ||(patch.o_start < out_line)  || (patch.o_start > patch.o_end))
+    if (ret)
      {
-      if (flag_verbose)
-        printf ("\b\b\b\b\b\b - Confusion: cmd:%i is:%i ie:%i os:%i oe:%i\n", patch.cmd, patch.i_start, patch.i_end, patch.o_start, patch.o_end);
-      status = STATUS_SYN;
-      break;
+      printf ("failed!\n");
+      f_commit = FALSE;
+      for (t_diffinfo = diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next)
+       t_diffinfo->status = STATUS_IO;
      }
+    else
+    if (flag_verbose)
+     printf ("OK\n");
+   }
 
-    /* Alles klar, wir suchen jetzt diese Zeile(n) im listfile */
-    while (patch.i_start != list_line)
-     {
-      if (IMDBE_FILE_READ == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE))
-       {
-        status = STATUS_IO;
-        break;
-       }
-      if ((IMDBWriteBuffer(out_buffer, p_list_line, strlen(p_list_line)))
-        ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
-       {
-        status = STATUS_IO;
-        break;
-       }
-      /* calc CRC */
-      if (out_line)
-       calc_crc (p_list_line, &nCrc);
-      else
-       if (0 == strncmp (p_list_line, "CRC: ", strlen("CRC: ")))
-        strncpy (old_crc, p_list_line, 15);
-      list_line++;
-      out_line++;
-     }
+  for (t_diffinfo = diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next)
+   {
+    GetListName (listname, t_diffinfo);
 
-    /* Error */
-    if (patch.i_start != list_line)
-     {
-      if (flag_verbose)
-       printf ("\b\b\b\b\b\b - Error before reaching line number: %i\n", patch.i_start);
-      status = STATUS_SYN;
-      break;
-     }
+    if (f_commit)
+     CommitListfile (listname, flag_keep, t_diffinfo);
     else
      {
-      /* O.K. jetzt sind wir an der richtigen Stelle */
-      switch (patch.cmd)
+      if ((STATUS_OK == t_diffinfo->status) || (STATUS_NEW == t_diffinfo->status)
+       || (STATUS_IO == t_diffinfo->status))
        {
-        case 'd': /* delete line */
-         {
-          for (i = patch.i_start; i <= patch.i_end; i++)
-           {
-            if ((IMDBReadBufferLine(diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-              ||(IMDBReadBufferLine(list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
-             {
-              status = STATUS_IO;
-              break;
-             }
-
-            if (0 != strcmp (p_diff_line+2, p_list_line))
-             {
-              status = STATUS_VER;
-              if (flag_verbose)
-               printf ("\b\b\b\b\b\b - Error: Lines do not match (%i).\n", i);
-              break;
-             }
-            list_line++;
-            l_delete++;
-           }
-          break;
-         }
-        case 'a': /* add line */
-         {
-          /* Beim Anfuegen brauchen wir die Zeile spaeter */
-          if(IMDBReadBufferLine(list_buffer, &p_list_line, ADV_MAX_LINESIZE))
-           {
-            status = STATUS_IO;
-            break;
-           }
-
-          if ((IMDBWriteBuffer(out_buffer, p_list_line, strlen(p_list_line)))
-            ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
-           {
-            status = STATUS_IO;
-            break;
-           }
-          /* calc CRC */
-          if (out_line)
-           calc_crc (p_list_line, &nCrc);
-          else
-           if (0 == strncmp (p_list_line, "CRC: ", strlen("CRC: ")))
-            strncpy (old_crc, p_list_line, 15);
-          list_line++;
-          out_line++;
-
-          /* Und jetzt einfuegen */
-          for (i = patch.o_start; i <= patch.o_end; i++)
-           {
-            if (IMDBReadBufferLine(diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-             {
-              status = STATUS_IO;
-              break;
-             }
-            len = strlen(p_diff_line);
-            if ((IMDBWriteBuffer(out_buffer, p_diff_line+2, len-2))
-              ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
-             {
-              status = STATUS_IO;
-              break;
-             }
-            /* calc CRC */
-            if (out_line)
-             calc_crc (p_diff_line+2, &nCrc);
-            else
-             if (0 == strncmp (p_diff_line+2, "CRC: ", strlen("CRC: ")))
-              strncpy (old_crc, p_diff_line+2, 15);
-            out_line++;
-            l_add++;
-           }
-          break;
-         }
-        case 'c': /* change line */
+        if (IsChunkedList (listname))
+         DiscardChunks (listname);
+        else
          {
-          /* First delete those lines that are discarded */
-          for (i = patch.i_start; i <= patch.i_end; i++)
-           {
-            if ((IMDBReadBufferLine(diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-              ||(IMDBReadBufferLine(list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
-             {
-              status = STATUS_IO;
-              break;
-             }
-            if (0 != strcmp (p_diff_line+2, p_list_line))
-             {
-              status = STATUS_VER;
-              if (flag_verbose)
-               printf ("\b\b\b\b\b\b - Error: Lines do not match (%i).\n", i);
-              break;
-             }
-            list_line++;
-            l_delete++;
-           }
-
-          /* separator-line */
-          if (IMDBReadBufferLine(diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-           {
-            status = STATUS_IO;
-            break;
-           }
-          if (0 != strncmp (p_diff_line, "---", 3))
-           {
-            if ((flag_verbose) && (STATUS_OK == status))
-             printf ("\b\b\b\b\b\b - Error: Can't find separator.\n");
-            status = STATUS_VER;
-            break;
-           }
-
-          /* now add new lines */
-          for (i = patch.o_start; i <= patch.o_end; i++)
-           {
-            if (IMDBReadBufferLine(diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-             {
-              status = STATUS_IO;
-              break;
-             }
-            len = strlen(p_diff_line);
-            if ((IMDBWriteBuffer(out_buffer, p_diff_line+2, len-2))
-              ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
-             {
-              status = STATUS_IO;
-              break;
-             }
-            /* calc CRC */
-            if (out_line)
-             calc_crc (p_diff_line+2, &nCrc);
-            else
-             if (0 == strncmp (p_diff_line+2, "CRC: ", strlen("CRC: ")))
-              strncpy (old_crc, p_diff_line+2, 15);
-            out_line++;
-            l_add++;
-           }
-          break;
+          GetTempName (fname, listname, ".new");
+          RemoveListfile (fname);
          }
-        default:
+        if (ad_cmds.p_undodir)
          {
-          if (flag_verbose)
-           printf ("\b\b\b\b\b\b - Unknown command %i\n", patch.cmd);
-          status = STATUS_SYN;
-          break;
+          GetUndoName (fname, t_diffinfo);
+          remove (fname);
          }
        }
+      if ((STATUS_OK == t_diffinfo->status) || (STATUS_NEW == t_diffinfo->status))
+       t_diffinfo->status = STATUS_ABORT;
+      t_diffinfo->add = 0;
+      t_diffinfo->delete = 0;
      }
-   }
-
-  /* Das restliche listfile kopieren falls nicht neue Liste */
-  if (list_buffer)
-   while ((STATUS_OK == status) && (!IMDBReadBufferLine(list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
-    {
-     if ((IMDBWriteBuffer(out_buffer, p_list_line, strlen(p_list_line)))
-       ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
-      {
-       status = STATUS_IO;
-       break;
-      }
-     /* calc CRC */
-     if (out_line)
-      calc_crc (p_list_line, &nCrc);
-     else
-      if (0 == strncmp (p_list_line, "CRC: ", strlen("CRC: ")))
-       strncpy (old_crc, p_list_line, 15);
-     list_line++;
-     out_line++;
-    }
 
-  /* Close Buffer */
-  IMDBCloseBuffer (out_buffer);
-  IMDBCloseBuffer (diff_buffer);
-  IMDBCloseBuffer (list_buffer);
+#ifdef IMDB_GZIP
+    if (t_diffinfo->f_packed)
+     if (PackListfile (listname, t_diffinfo, flag_verbose))
+      ret_val = RET_WARNING;
+#endif
+   }
 
-  /* compare CRC */
-  sprintf(new_crc, "CRC: 0x%08X", nCrc);
-  if (((STATUS_OK == status) || (STATUS_NEW == status)) &&
-      ((0 == strcmp (old_crc, new_crc)) || (ad_cmds.f_force == TRUE)))
+  if (f_commit)
    {
+    /* make the renames durable */
+    IMDBSyncFile (ad_cmds.p_listdir);
     if (flag_verbose)
-     printf ("\b\b\b\b\b\b- CRC-Checksum O.K.\n");
-
-    /* *.old file loeschen falls noch nicht geschehen und files umbenennen */
-    strcpy (fname, listfile);
-    StrChangeSuffix (fname, ".old");
-    remove (fname);
-
-    /* listfile umbenennen, bzw loeschen */
-    if (flag_keep)
-     rename (listfile, fname);
-    else
-     remove (listfile);
-
-    /* neues Listfile umbenennen */
-    strcpy (fname, listfile);
-    StrChangeSuffix (fname, ".new");
-    rename (fname, listfile);
-
-#ifdef SYS_AMIGA
-    /* Protection Bits richtig setzen */
-    SetProtection (listfile, FIBF_EXECUTE);
-#endif
-
-    /* diffile loeschen */
-    if (!flag_keep)
-     remove (diffile);
+     printf ("Transaction committed.\n\n");
    }
   else
    {
-    if ((STATUS_OK == status) || (STATUS_NEW == status))
-     { /* something went wrong! No changes */
-      if (flag_verbose)
-       printf ("\b\b\b\b\b\b- CRC-Checksum Error\n");
-      status = STATUS_CRC;
-     }
-    remove (fname);
-    l_add = 0;
-    l_delete = 0;
-   }
-
-  /* remember DiffInfo */
-  if (diffinfo)
-   {
-    if (STATUS_NEW != diffinfo->status)
-     diffinfo->status = status;
-    diffinfo->add = l_add;
-    diffinfo->delete = l_delete;
+    printf ("Transaction aborted - no listfile has been changed.\n\n");
+    ret_val = RET_WARNING;
    }
 
-  if (status)
-   return (RET_WARNING);
-  else
-   return (RET_OK);
+  return (ret_val);
  }
 
 /*-----------------------------------------------------------------------------
  * Procedure:   patchfile
  *
- * Parameters:  listfile, diffile
- *
- * Comments:
+ * Parameters:  listfile, diffinfo
  *
- *              8,10c8,11 change lines 8-10 against 8-11
- *              13d13     delete line 13
- *              14a15     insert line after line 14
+ * Comments:    applies the diff-file of diffinfo and those of the following
+ *              weeks (diffinfo->next_week) in a single pass over the listfile.
+ *              With option UNDO the reverse diff is written on the way,
+ *              with option BINARY the binary diff of all weeks and with
+ *              option KEYED the key-addressed diff of all weeks.
+ *              With option VERIFY the patched listfile goes to a null sink
+ *              and no file is changed. Of a chunked listfile only the
+ *              changed chunks are written (ChunkLog), the patched listfile
+ *              goes to the null sink as well.
  *-----------------------------------------------------------------------------
  */
 
-int patchfile_stripped(char *listfile, char *diffile, BOOL flag_keep, BOOL flag_verbose, DiffInfo *diffinfo)
+int patchfile(char *listfile, BOOL flag_keep, BOOL flag_verbose, DiffInfo *diffinfo)
  {
   static char     fname [256];
-  struct TypPatch patch;
+  char            diffname [256];
+  char            chkname [256];
+  DiffInfo       *t_diffinfo;
+  PatchStage     *stage       = NULL;
+  PatchStage     *t_stage     = NULL;
+  PatchStage     *failed      = NULL;
   IMDB_Buffer    *list_buffer = NULL;
-  IMDB_Buffer    *diff_buffer = NULL;
   IMDB_Buffer    *out_buffer  = NULL;
-  char           *p_list_line;
-  char           *p_diff_line;
-  LONG            list_line   = 1;
-  LONG            out_line    = 0;
+  UndoLog        *undo        = NULL;
+  BinDiffLog     *bindiff     = NULL;
+  KeyDiffLog     *keydiff     = NULL;
+  ChunkLog       *chunklog    = NULL;
+  DeltaLog       *delta       = NULL;
+  char           *p_line;
   LONG            l_add       = 0;
   LONG            l_delete    = 0;
   LONG            status      = STATUS_OK;
   LONG            progress    = 0;
   LONG            tprogress   = 0;
-  LONG            i;
-  LONG            len;
-
-  strcpy (fname, listfile);
-  StrChangeSuffix (fname, ".new");
-
-  /* reset CRC */
-  nCrc = 0xFFFFFFFFL;
-  new_crc [0] = '\0';
-  old_crc [0] = '\0';
-
-  /* open diff-file */
-  if (NULL == (diff_buffer = IMDBOpenBuffer (diffile, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE, ADV_BUFFER_SIZE)))
-   {
-    diffinfo->status = STATUS_IO;
-    return (RET_ERROR);
-   }
-
-  /* open old listfile */
-  if (IMDBExistFile(listfile))
+  LONG            out_pos     = 0;
+  LONG            out_size    = 0;
+  LONG            next_checkpoint = ADV_CHECKPOINT_SIZE;
+  LONG            nb_written  = 0;
+  LONG            nb_chunks   = 0;
+  LONG            gzip        = ((IsGzipName (listfile)) ? IMDBV_FILE_GZIP : 0);
+  BOOL            f_chunked   = IsChunkedList (listfile);
+  /* a compressed listfile can't be continued (no append on a gzip-stream) */
+  BOOL            f_checkpoint = ((ad_cmds.f_checkpoint) && (!ad_cmds.f_verify) && (!gzip) && (!f_chunked));
+
+  GetTempName (fname, listfile, ".new");
+  GetTempName (chkname, listfile, ".chk");
+
+  /* open old listfile (compressed listfiles are read as a stream) */
+  if ((IMDBExistFile(listfile)) || (f_chunked))
    {
-    /* check if diffs match */
-    if ((list_buffer = IMDBOpenBuffer (listfile, IMDBV_FILE_READ, ADV_BUFFER_SIZE))
-      &&(0 == IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-      &&(0 == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
+    if (NULL == (list_buffer = IMDBOpenBuffer (listfile, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE|IMDBV_FILE_THREAD|ListfileFlags (listfile), ADV_BUFFER_SIZE)))
      {
-      if (0 != strcmp (p_diff_line+10, p_list_line))
-       {
-        status = STATUS_VER;
-        if (flag_verbose)
-         printf ("Error: Unsuitable Diff-File\n");
-       }
-      IMDBPositionBuffer(list_buffer,0);
+      diffinfo->status = STATUS_IO;
+      return (RET_ERROR);
      }
-    else
-     status = STATUS_IO;
    }
   else
    {
     /* Listfile does not exist. Maybe it's new? */
     if (STATUS_OK == diffinfo->status) /* d.h. wenn option NOCHECK benutzt wird */
      {
-      IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE);
-      if (0 == strcmp(p_diff_line, "Apply on: ---"))
-       {
-        status = STATUS_NEW;
-        if (flag_verbose)
-        printf ("New Listfile\n");
-       }
-      else
-       {
-        status = STATUS_VER;
-        if (flag_verbose)
-         printf ("Error: Missing Listfile\n");
-       }
+      checkfile_match (listfile, FALSE, diffinfo);
      }
-    else
-     IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE); /* skip header */
 
     if (STATUS_NEW != diffinfo->status)
      {
+      if (flag_verbose)
+       printf ("\b\b\b\b\b\b - Error: Missing Listfile\n");
       if (STATUS_OK == diffinfo->status)
        diffinfo->status = STATUS_IO;
-      IMDBCloseBuffer (diff_buffer);
       return (RET_WARNING);
      }
     if (flag_verbose)
@@ -1105,317 +4493,491 @@ int patchfile_stripped(char *listfile, char *diffile, BOOL flag_keep, BOOL flag_
      }
    }
 
-  /* open new listfile */
-  if (NULL == (out_buffer =  IMDBOpenBuffer (fname, IMDBV_FILE_WRITE, ADV_BUFFER_SIZE)))
-   {
-    IMDBCloseBuffer (diff_buffer);
-    IMDBCloseBuffer (list_buffer);
-    if (diffinfo)
-     diffinfo->status = STATUS_IO;
-    return (RET_ERROR);
-   }
-
-  /*** now patch the file ***/
-  /* get next line of diff */
-  while ((STATUS_OK == status) && (!IMDBReadBufferLine(diff_buffer, &p_diff_line, ADV_MAX_LINESIZE)))
+  /* one patch-stage per week */
+  for (t_diffinfo = diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next_week)
    {
-    /* show progress */
-    if ((flag_verbose) && (progress != (tprogress = (diff_buffer->filepos*100/diff_buffer->filesize))))
-     {
-      progress = tprogress;
-      printf ("\b\b\b\b\b\b(%03i%%)", progress);
-      fflush (stdout);
-     }
-
-    /* parse command */
-    GetPatch(&patch, p_diff_line);
-
-    /* Es gibt hier einen Sonderfall, naemlich eine Einfuegung gleich am Anfang */
-    if ((0 == patch.i_start) && (patch.cmd == 'a'))
-     {
-      /* Und jetzt einfuegen */
-      for (i = patch.o_start; i <= patch.o_end; i++)
-       {
-        if ((flag_verbose) && (progress != (tprogress = (diff_buffer->filepos*100/diff_buffer->filesize))))
-         {
-          progress = tprogress;
-          printf ("\b\b\b\b\b\b(%03i%%)", progress);
-          fflush (stdout);
-         }
-        if (IMDBE_FILE_READ == IMDBReadBufferLine (diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-         {
-          status = STATUS_IO;
-          break;
-         }
-        len = strlen(p_diff_line);
-        if ((IMDBWriteBuffer(out_buffer, p_diff_line, len))
-          ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
-         {
-          status = STATUS_IO;
-          break;
-         }
-        /* calc CRC */
-        if (out_line)
-         calc_crc (p_diff_line, &nCrc);
-        else
-         if (0 == strncmp (p_diff_line, "CRC: ", strlen("CRC: ")))
-          strncpy (old_crc, p_diff_line, 15);
-        out_line++;
-        l_add++;
-       }
-      continue;
-     }
-
-    /* Sonderfall, dass es gar keine alte Liste gab */
-    if (NULL == list_buffer)
-     break;
-
-    /* Error ??? */
-    if ((patch.i_start < list_line) || (patch.i_start > patch.i_end)
-      ||(patch.o_start < out_line)  || (patch.o_start > patch.o_end))
+    if (NULL == (t_stage = OpenPatchStage (stage, (stage ? NULL : list_buffer), t_diffinfo, flag_verbose)))
      {
-      if (flag_verbose)
-       printf ("\b\b\b\b\b\b - Confusion: cmd:%i is:%i ie:%i os:%s oe:%s\n", patch.cmd, patch.i_start, patch.i_end, patch.o_start, patch.o_end);
-      status = STATUS_SYN;
+      status = STATUS_IO;
       break;
      }
+    stage = t_stage;
+   }
 
-    /* Alles klar, wir suchen jetzt diese Zeile(n) im listfile */
-    while (patch.i_start != list_line)
+  /* continue an interrupted run */
+  if ((STATUS_OK == status) && (f_checkpoint) && (IMDBExistFile (chkname)) && (IMDBExistFile (fname)))
+   {
+    if (0 > (out_pos = ResumeCheckpoint (chkname, fname, stage, list_buffer)))
+     status = STATUS_IO;
+    else
+    if (out_pos > 0)
      {
-      if (IMDBE_FILE_READ == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE))
-       {
-        status = STATUS_IO;
-        break;
-       }
-      if ((IMDBWriteBuffer(out_buffer, p_list_line, strlen(p_list_line)))
-        ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
+      if (NULL == (out_buffer = IMDBOpenBuffer (fname, IMDBV_FILE_APPEND|IMDBV_FILE_THREAD, ADV_BUFFER_SIZE)))
+       status = STATUS_IO;
+      else
        {
-        status = STATUS_IO;
-        break;
+        out_buffer->filepos = out_pos;
+        next_checkpoint = out_pos + ADV_CHECKPOINT_SIZE;
+        if (flag_verbose)
+         {
+          printf ("\b\b\b\b\b\b(resumed at line %li) (000%%)", stage->out_line);
+          fflush (stdout);
+         }
        }
-      /* calc CRC */
-      if (out_line)
-       calc_crc (p_list_line, &nCrc);
-      else
-       if (0 == strncmp (p_list_line, "CRC: ", strlen("CRC: ")))
-        strncpy (old_crc, p_list_line, 15);
-      list_line++;
-      out_line++;
      }
+   }
 
-    /* Error */
-    if (patch.i_start != list_line)
+  /* open new listfile (compressed again if the listfile was compressed) */
+  if ((STATUS_OK == status) && (NULL == out_buffer))
+   {
+    if (NULL == (out_buffer = IMDBOpenBuffer (fname, IMDBV_FILE_WRITE | IMDBV_FILE_THREAD | gzip | (((ad_cmds.f_verify) || (f_chunked)) ? IMDBV_FILE_NULL : 0), ADV_BUFFER_SIZE)))
+     status = STATUS_IO;
+    else
+    /* binary diffs: the size of the new listfile is known */
+    if ((DIFF_TYPE_BINARY == stage->type)
+      &&(IMDBE_FILE_WRITE == IMDBReserveBuffer (out_buffer, stage->bin_size)))
      {
       if (flag_verbose)
-       printf ("\b\b\b\b\b\b - Error before reaching line number: %i\n", patch.i_start);
-      status = STATUS_SYN;
-      break;
+       printf ("\b\b\b\b\b\b - Error: Not enough space for the new listfile\n");
+      status = STATUS_IO;
      }
+   }
+
+  /* open reverse diff-file (always a stripped diff) */
+  if ((STATUS_OK == status) && (ad_cmds.p_undodir) && (!ad_cmds.f_verify))
+   {
+    GetUndoName (diffname, diffinfo);
+    if (NULL == (undo = OpenUndoLog (diffname)))
+     status = STATUS_IO;
     else
-     {
-      /* O.K. jetzt sind wir an der richtigen Stelle */
-      switch (patch.cmd)
-       {
-        case 'd': /* delete line */
-         {
-          for (i = patch.i_start; i <= patch.i_end; i++)
-           {
-            if (IMDBReadBufferLine(list_buffer, &p_list_line, ADV_MAX_LINESIZE))
-             {
-              status = STATUS_IO;
-              break;
-             }
-            list_line++;
-            l_delete++;
-           }
-          break;
-         }
-        case 'a': /* add line */
-         {
-          /* Beim Anfuegen brauchen wir die Zeile spaeter */
-          if(IMDBReadBufferLine(list_buffer, &p_list_line, ADV_MAX_LINESIZE))
-           {
-            status = STATUS_IO;
-            break;
-           }
+     for (t_stage = stage; t_stage; t_stage = t_stage->source)
+      t_stage->undo = undo;
+   }
 
-          if ((IMDBWriteBuffer(out_buffer, p_list_line, strlen(p_list_line)))
-            ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
-           {
-            status = STATUS_IO;
-            break;
-           }
-          /* calc CRC */
-          if (out_line)
-           calc_crc (p_list_line, &nCrc);
-          else
-           if (0 == strncmp (p_list_line, "CRC: ", strlen("CRC: ")))
-            strncpy (old_crc, p_list_line, 15);
-          list_line++;
-          out_line++;
+  /* open binary diff-file (also with VERIFY, to convert diffs) */
+  if ((STATUS_OK == status) && (ad_cmds.p_bindir))
+   {
+    GetBinDiffName (diffname, diffinfo);
+    if (NULL == (bindiff = OpenBinDiff (diffname)))
+     status = STATUS_IO;
+    else
+     for (t_stage = stage; t_stage; t_stage = t_stage->source)
+      t_stage->bindiff = bindiff;
+   }
 
-          /* Und jetzt einfuegen */
-          for (i = patch.o_start; i <= patch.o_end; i++)
-           {
-            if (IMDBReadBufferLine(diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-             {
-              status = STATUS_IO;
-              break;
-             }
-            len = strlen(p_diff_line);
-            if ((IMDBWriteBuffer(out_buffer, p_diff_line, len))
-              ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
-             {
-              status = STATUS_IO;
-              break;
-             }
-            /* calc CRC */
-            if (out_line)
-             calc_crc (p_diff_line, &nCrc);
-            else
-             if (0 == strncmp (p_diff_line, "CRC: ", strlen("CRC: ")))
-              strncpy (old_crc, p_diff_line, 15);
-            out_line++;
-            l_add++;
-           }
-          break;
-         }
-        case 'c': /* change line */
-         {
-          /* First delete those lines that are discarded */
-          for (i = patch.i_start; i <= patch.i_end; i++)
-           {
-            if (IMDBReadBufferLine(list_buffer, &p_list_line, ADV_MAX_LINESIZE))
-             {
-              status = STATUS_IO;
-              break;
-             }
-            list_line++;
-            l_delete++;
-           }
+  /* open key-addressed diff-file (also with VERIFY, to convert diffs) */
+  if ((STATUS_OK == status) && (ad_cmds.p_keydir))
+   {
+    GetKeyDiffName (diffname, diffinfo);
+    if (NULL == (keydiff = OpenKeyDiff (diffname)))
+     status = STATUS_IO;
+    else
+     for (t_stage = stage; t_stage; t_stage = t_stage->source)
+      t_stage->keydiff = keydiff;
+   }
 
-          /* now add new lines */
-          for (i = patch.o_start; i <= patch.o_end; i++)
-           {
-            if (IMDBReadBufferLine(diff_buffer, &p_diff_line, ADV_MAX_LINESIZE))
-             {
-              status = STATUS_IO;
-              break;
-             }
-            len = strlen(p_diff_line);
-            if ((IMDBWriteBuffer(out_buffer, p_diff_line, len))
-              ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
-             {
-              status = STATUS_IO;
-              break;
-             }
-            /* calc CRC */
-            if (out_line)
-             calc_crc (p_diff_line, &nCrc);
-            else
-             if (0 == strncmp (p_diff_line, "CRC: ", strlen("CRC: ")))
-              strncpy (old_crc, p_diff_line, 15);
-            out_line++;
-            l_add++;
-           }
-          break;
-         }
-        default:
-         {
-          if (flag_verbose)
-           printf ("\b\b\b\b\b\b - Unknown command %i\n", patch.cmd);
-          status = STATUS_SYN;
-          break;
-         }
-       }
+  /* open delta-file (also with VERIFY, for the mirrors) */
+  if ((STATUS_OK == status) && (ad_cmds.p_deltadir))
+   {
+    GetDeltaName (diffname, diffinfo);
+    if (NULL == (delta = OpenDeltaLog (diffname)))
+     status = STATUS_IO;
+    else
+     for (t_stage = stage; t_stage; t_stage = t_stage->source)
+      t_stage->delta = delta;
+   }
+
+  /* open chunk-log (chunked listfile) */
+  if ((STATUS_OK == status) && (f_chunked) && (!ad_cmds.f_verify))
+   {
+    /* FUZZY reads removed lines of earlier weeks in advance */
+    if ((ad_cmds.f_fuzzy) && (diffinfo->next_week))
+     {
+      if (flag_verbose)
+       printf ("\b\b\b\b\b\b - Error: Fuzzy can't patch chunked listfiles with several weeks\n");
+      status = STATUS_IO;
      }
+    else
+    if (NULL == (chunklog = OpenChunkLog (listfile)))
+     status = STATUS_IO;
+    else
+     for (t_stage = stage; t_stage; t_stage = t_stage->source)
+      t_stage->chunklog = chunklog;
    }
 
-  /* Das restliche listfile kopieren falls nicht neue Liste*/
-  if (list_buffer)
-   while ((STATUS_OK == status) && (!IMDBReadBufferLine(list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
+  /*** now patch the file ***/
+  if (STATUS_OK == status)
+   while (IMDBE_NO_ERROR == ReadPatchStageLine (stage, &p_line))
     {
-     if ((IMDBWriteBuffer(out_buffer, p_list_line, strlen(p_list_line)))
+     /* show progress */
+     if ((flag_verbose) && (stage->diff_buffer->filesize)
+       &&(progress != (tprogress = (stage->diff_buffer->filepos*100/stage->diff_buffer->filesize))))
+      {
+       progress = tprogress;
+       printf ("\b\b\b\b\b\b(%03i%%)", progress);
+       fflush (stdout);
+      }
+
+     if ((IMDBWriteBuffer(out_buffer, p_line, strlen(p_line)))
        ||(IMDBWriteBuffer(out_buffer, "\n", 1)))
       {
        status = STATUS_IO;
        break;
       }
-     /* calc CRC */
-     if (out_line)
-      calc_crc (p_list_line, &nCrc);
-     else
-      if (0 == strncmp (p_list_line, "CRC: ", strlen("CRC: ")))
-       strncpy (old_crc, p_list_line, 15);
-     list_line++;
-     out_line++;
+
+     if (undo)
+      UndoNewLine (undo, p_line, stage->f_old);
+     if (bindiff)
+      BinDiffNewLine (bindiff, p_line, stage->f_old);
+     if (keydiff)
+      KeyDiffNewLine (keydiff, p_line, stage->f_old);
+     if (chunklog)
+      ChunkNewLine (chunklog, p_line, stage->f_old);
+     if (delta)
+      DeltaNewLine (delta, p_line, stage->f_old);
+
+     /* save the state from time to time */
+     if ((f_checkpoint) && (out_buffer->filepos >= next_checkpoint)
+       &&(WriteCheckpoint (chkname, stage, list_buffer, out_buffer, p_line)))
+      next_checkpoint = out_buffer->filepos + ADV_CHECKPOINT_SIZE;
+    }
+
+  /* check every week, the earliest error counts */
+  if (STATUS_OK == status)
+   for (t_stage = stage; t_stage; t_stage = t_stage->source)
+    {
+     /* compare CRC (reverting a new listfile leaves nothing to check) */
+     if ((STATUS_OK == t_stage->status) && (STAGE_EOF == t_stage->state)
+       &&((0 != t_stage->out_line) || (!ad_cmds.f_revert))
+       &&(!CheckPatchStageCRC (t_stage)) && (ad_cmds.f_force != TRUE))
+      t_stage->status = STATUS_CRC;
+
+     /* binary diffs: the new listfile must have the expected size */
+     if ((STATUS_OK == t_stage->status) && (t_stage == stage) && (DIFF_TYPE_BINARY == stage->type)
+       &&(out_buffer->filepos != stage->bin_size) && (ad_cmds.f_force != TRUE))
+      t_stage->status = STATUS_CRC;
+
+     if (STATUS_OK != t_stage->status)
+      {
+       status = t_stage->status;
+       failed = t_stage;
+      }
+     l_add    += t_stage->add;
+     l_delete += t_stage->delete;
     }
 
   /* Close Buffer */
+  if (out_buffer)
+   out_size = out_buffer->filepos;
   IMDBCloseBuffer (out_buffer);
-  IMDBCloseBuffer (diff_buffer);
   IMDBCloseBuffer (list_buffer);
+  if (f_checkpoint)
+   remove (chkname);
+
+  /* finish reverse diff-file, remove it if the diffs could not be applied */
+  if (undo)
+   if ((IMDBE_NO_ERROR != CloseUndoLog (undo, (STATUS_OK == status))) && (STATUS_OK == status))
+    {
+     if (flag_verbose)
+      printf ("\b\b\b\b\b\b- Error: Can't write reverse diff\n");
+     status = STATUS_IO;
+    }
+
+  /* finish binary diff-file */
+  if (bindiff)
+   if ((IMDBE_NO_ERROR != CloseBinDiff (bindiff, (STATUS_OK == status), out_size, stage->out_line, stage->crc)) && (STATUS_OK == status))
+    {
+     if (flag_verbose)
+      printf ("\b\b\b\b\b\b- Error: Can't write binary diff\n");
+     status = STATUS_IO;
+    }
+
+  /* finish key-addressed diff-file */
+  if (keydiff)
+   if ((IMDBE_NO_ERROR != CloseKeyDiff (keydiff, (STATUS_OK == status))) && (STATUS_OK == status))
+    {
+     if (flag_verbose)
+      printf ("\b\b\b\b\b\b- Error: Can't write keyed diff\n");
+     status = STATUS_IO;
+    }
+
+  /* finish delta-file */
+  if (delta)
+   if ((IMDBE_NO_ERROR != CloseDeltaLog (delta, (STATUS_OK == status), out_size, stage->out_line, stage->crc)) && (STATUS_OK == status))
+    {
+     if (flag_verbose)
+      printf ("\b\b\b\b\b\b- Error: Can't write delta-file\n");
+     status = STATUS_IO;
+    }
+
+  /* finish chunked listfile: write the new manifest */
+  if (chunklog)
+   {
+    nb_written = chunklog->nb_written;
+    nb_chunks  = chunklog->old_manifest->nb_chunks;
+    if ((IMDBE_NO_ERROR != CloseChunkLog (chunklog, (STATUS_OK == status))) && (STATUS_OK == status))
+     {
+      if (flag_verbose)
+       printf ("\b\b\b\b\b\b- Error: Can't write chunked listfile\n");
+      status = STATUS_IO;
+     }
+   }
 
-  /* compare CRC */
-  sprintf(new_crc, "CRC: 0x%08X", nCrc);
-  if (((STATUS_OK == status) || (STATUS_NEW == status)) &&
-      ((0 == strcmp (old_crc, new_crc)) || (ad_cmds.f_force == TRUE)))
+  if (stage)
+   diffinfo->nb_lines = stage->out_line;
+
+  if ((STATUS_OK == status) && (ad_cmds.f_verify))
+   {
+    if (flag_verbose)
+     printf ("\b\b\b\b\b\b- CRC-Checksum O.K. (verified)\n");
+   }
+  else
+  if (STATUS_OK == status)
    {
+    if ((flag_verbose) && (f_chunked))
+     printf ("\b\b\b\b\b\b- CRC-Checksum O.K. (%li of %li chunks written)\n", nb_written, nb_chunks);
+    else
     if (flag_verbose)
      printf ("\b\b\b\b\b\b- CRC-Checksum O.K.\n");
 
-    /* *.old file loeschen falls noch nicht geschehen und files umbenennen */
-    strcpy (fname, listfile);
-    StrChangeSuffix (fname, ".old");
-    remove (fname);
+    /* TRANSACTION: the new listfile is renamed by CommitTransaction */
+    if (!ad_cmds.f_transaction)
+     CommitListfile (listfile, flag_keep, diffinfo);
+   }
+  else
+   {
+    if ((flag_verbose) && (STATUS_CRC == status))
+     printf ("\b\b\b\b\b\b- CRC-Checksum Error\n");
+    if ((flag_verbose) && (failed) && (diffinfo->next_week))
+     printf ("Diffs from %s could not be applied.\n", ad_cmds.p_diffdirs[failed->week]);
+    if (!ad_cmds.f_verify)
+     RemoveListfile (fname);
+    l_add = 0;
+    l_delete = 0;
+   }
 
-    /* listfile umbenennen, bzw loeschen */
-    if (flag_keep)
-     rename (listfile, fname);
-    else
-     remove (listfile);
+  ClosePatchStage (stage);
 
-    /* neues Listfile umbenennen */
-    strcpy (fname, listfile);
-    StrChangeSuffix (fname, ".new");
-    rename (fname, listfile);
+  /* remember DiffInfo */
+  if ((STATUS_NEW != diffinfo->status) || (STATUS_OK != status))
+   diffinfo->status = status;
+  diffinfo->add = l_add;
+  diffinfo->delete = l_delete;
+
+  if (status)
+   return (RET_WARNING);
+  else
+   return (RET_OK);
+ }
+
+/******************************************************************************
+ *
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   AddDiffInfo
+ *
+ * Purpose:     Create and initialize DiffInfo for a diff-file. If diffs for
+ *              the same listfile have been found in the diff-directory of a
+ *              previous week, the new DiffInfo is appended to their chain.
+ *
+ * Parameters:  pp_diffinfo  pointer to the first DiffInfo
+ *              p_fname      filename of the diff-file
+ *              week         index of the diff-directory
+ *              offset       position of the diffs in a tar-archive or -1
+ *              size         size of the diffs in a tar-archive
+ *
+ * Returns:     RET_OK or RET_ERROR
+ *-----------------------------------------------------------------------------
+ */
+
+int AddDiffInfo (DiffInfo **pp_diffinfo, char *p_fname, LONG week, LONG offset, LONG size)
+ {
+  DiffInfo *a_diffinfo;
+  DiffInfo *t_diffinfo;
+  LONG      len;
 
+  /* Create and initialize DiffInfo */
+  if (NULL == (a_diffinfo = IMDBAllocMemory (sizeof (DiffInfo))))
+   {
+    printf("Can't allocate memory for DiffInfo\n");
+    return (RET_ERROR);
+   }
+
+  a_diffinfo->next = NULL;
+  strcpy (a_diffinfo->fname_list, p_fname);
+  strcpy (a_diffinfo->fname_diff, p_fname);
+#ifdef IMDB_DEBUG
+printf ("-> %s\n", a_diffinfo->fname_list);
+#endif
+  /* compressed diff-file */
+  if (IsGzipName (a_diffinfo->fname_list))
+   a_diffinfo->fname_list[strlen(a_diffinfo->fname_list)-3] = '\0';
+
+  len = strlen(a_diffinfo->fname_list);
 #ifdef SYS_AMIGA
-    /* Protection Bits richtig setzen */
-    SetProtection (listfile, FIBF_EXECUTE);
+  if (0 == strnicmp(&a_diffinfo->fname_list[len-5], ".list", 5))
+#else
+  if (0 == strncmp(&a_diffinfo->fname_list[len-5], ".list", 5))
 #endif
+   a_diffinfo->type = DIFF_TYPE_ORIGINAL;
+  else
+  if (StrHasSuffix (a_diffinfo->fname_list, BINDIFF_EXT))
+   {
+    a_diffinfo->type = DIFF_TYPE_BINARY;
+    strcpy (&a_diffinfo->fname_list[len-5], "list");
+   }
+  else
+  if (StrHasSuffix (a_diffinfo->fname_list, HASHDIFF_EXT))
+   {
+    a_diffinfo->type = DIFF_TYPE_HASHED;
+    strcpy (&a_diffinfo->fname_list[len-5], "list");
+   }
+  else
+  if (StrHasSuffix (a_diffinfo->fname_list, KEYDIFF_EXT))
+   {
+    a_diffinfo->type = DIFF_TYPE_KEYED;
+    strcpy (&a_diffinfo->fname_list[len-5], "list");
+   }
+  else
+   {
+    a_diffinfo->type = DIFF_TYPE_STRIPPED;
+    a_diffinfo->fname_list[len-4] = '\0';
+    strcat(a_diffinfo->fname_list, "list");
+   }
+  a_diffinfo->status = STATUS_OK;
+  a_diffinfo->add = 0;
+  a_diffinfo->delete = 0;
+  a_diffinfo->week = week;
+  a_diffinfo->next_week = NULL;
+  a_diffinfo->nb_lines = 0;
+  a_diffinfo->f_packed = FALSE;
+  a_diffinfo->offset = offset;
+  a_diffinfo->size = size;
+
+  /* diffs of a previous week for this listfile? */
+  for (t_diffinfo = *pp_diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next)
+   if (0 == strcmp(t_diffinfo->fname_list, a_diffinfo->fname_list))
+    {
+     while (t_diffinfo->next_week)
+      t_diffinfo = t_diffinfo->next_week;
+     if (t_diffinfo->week < week)
+      {
+       t_diffinfo->next_week = a_diffinfo;
+       return (RET_OK);
+      }
+     break;
+    }
 
-    /* diffile loeschen */
-    if (!flag_keep)
-     remove (diffile);
+  /* append to list */
+  if (t_diffinfo = *pp_diffinfo)
+   {
+    while (t_diffinfo->next)
+     t_diffinfo = t_diffinfo->next;
+    t_diffinfo->next = a_diffinfo;
    }
   else
+   *pp_diffinfo = a_diffinfo;
+
+  return (RET_OK);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   FreeDiffInfo
+ *
+ * Purpose:     Free DiffInfo together with the diffs of the following weeks
+ *-----------------------------------------------------------------------------
+ */
+
+void FreeDiffInfo (DiffInfo *diffinfo)
+ {
+  DiffInfo *t_diffinfo;
+
+  while (diffinfo)
    {
-    if ((STATUS_OK == status) || (STATUS_NEW == status))
-     { /* something went wrong! No changes */
-      if (flag_verbose)
-       printf ("\b\b\b\b\b\b- CRC-Checksum Error\n");
-      status = STATUS_CRC;
-     }
-    remove (fname);
-    l_add = 0;
-    l_delete = 0;
+    t_diffinfo = diffinfo->next_week;
+    IMDBFreeMemory (diffinfo);
+    diffinfo = t_diffinfo;
    }
+ }
 
-  /* remember DiffInfo */
-  if (diffinfo)
+/*-----------------------------------------------------------------------------
+ * Procedure:   ScanArchive
+ *
+ * Purpose:     Create a DiffInfo for every diff-file in a tar-archive. The
+ *              archive stays open, the diffs are read from it later.
+ *
+ * Parameters:  pp_diffinfo  pointer to the first DiffInfo
+ *              week         index of the diff-directory (the archive)
+ *
+ * Returns:     RET_OK or RET_ERROR
+ *-----------------------------------------------------------------------------
+ */
+
+int ScanArchive (DiffInfo **pp_diffinfo, LONG week)
+ {
+  IMDB_Buffer *archive;
+  char        *p_header;
+  char        *p_name;
+  char         name [101];
+  char         octal [13];
+  LONG         pos     = 0;
+  LONG         size;
+  LONG         nb;
+  int          ret_val = RET_OK;
+
+  if (NULL == (archive = IMDBOpenBuffer (ad_cmds.p_diffdirs[week], IMDBV_FILE_READ | ((IsGzipName (ad_cmds.p_diffdirs[week])) ? IMDBV_FILE_GZIP : 0), ADV_BUFFER_SIZE)))
    {
-    if (STATUS_NEW != diffinfo->status)
-     diffinfo->status = status;
-    diffinfo->add = l_add;
-    diffinfo->delete = l_delete;
+    printf("Can't open %s\n", ad_cmds.p_diffdirs[week]);
+    return (RET_ERROR);
    }
 
-  if (status)
-   return (RET_WARNING);
+  /* every file: 512 bytes header, data filled up to a multiple of 512 */
+  while (RET_OK == ret_val)
+   {
+    if (IMDBPositionBuffer (archive, pos))
+     nb = 0;
+    else
+     nb = IMDBReadBuffer (archive, &p_header, 512);
+    if ((0 == nb) || ('\0' == p_header[0]))
+     break; /* end of archive */
+    if ((512 != nb) || (p_header[124] & 0x80))
+     {
+      printf("%s is no tar-archive or damaged.\n", ad_cmds.p_diffdirs[week]);
+      ret_val = RET_ERROR;
+      break;
+     }
+
+    memcpy (name, p_header, 100);
+    name[100] = '\0';
+    memcpy (octal, &p_header[124], 12);
+    octal[12] = '\0';
+    size = strtol (octal, NULL, 8);
+
+    /* regular files only, directory-names are ignored */
+    p_name = (strrchr (name, '/')) ? strrchr (name, '/') + 1 : name;
+    if ((('0' == p_header[156]) || ('\0' == p_header[156])) && (IsDiffName (p_name)))
+     {
+      /* sections are read as they are, so diffs in the archive must not be compressed */
+      if (IsGzipName (p_name))
+       {
+        printf("%s in %s is compressed, the diffs in a tar-archive can't be.\n", name, ad_cmds.p_diffdirs[week]);
+        ret_val = RET_ERROR;
+        break;
+       }
+      ret_val = AddDiffInfo (pp_diffinfo, p_name, week, pos + 512, size);
+     }
+
+    pos += 512 + ((size + 511) / 512) * 512;
+   }
+
+  if (RET_OK == ret_val)
+   ad_cmds.p_archives[week] = archive;
   else
-   return (RET_OK);
+   IMDBCloseBuffer (archive);
+
+  return (ret_val);
  }
 
 
@@ -1453,8 +5015,9 @@ int main(int argc, char *argv[])
   /* Parse command line parameters */
 #ifdef SYS_AMIGA
   {
-   static const char Template[]    = "LISTDIR/A,DIFFDIR/A,CHECKCRC/S,FORCE/S,KEEP/S,NOSTATS/S,QUIET/S,LOGFILE/K";
-   AD_Commands       cmdlineparams = {NULL, NULL, FALSE, FALSE, FALSE, FALSE, FALSE, NULL};
+   static const char Template[]    = "LISTDIR/A,DIFFDIR/A/M,CHECKCRC/S,FORCE/S,KEEP/S,NOSTATS/S,QUIET/S,LOGFILE/K,UNDO/K,REVERT/S,VERIFY/S,TRANSACTION/S,CHECKPOINT/S,BINARY/K,KEYED/K,FUZZY/S,DELTA/K,PIPELINE/S,WORKERS/K/N,DEVLIMIT/K/N,MEMORY/K/N";
+   AD_Commands       cmdlineparams = {NULL, NULL, FALSE, FALSE, FALSE, FALSE, FALSE, NULL, NULL, FALSE, FALSE, FALSE, FALSE, NULL, NULL, FALSE, NULL, FALSE, NULL, NULL, NULL, 0};
+   char            **pp_diffdir;
    struct RDArgs    *rda;
    LONG              len;
    char              c;
@@ -1471,24 +5034,76 @@ int main(int argc, char *argv[])
        strcat (ad_cmds.p_listdir,"/");
      }
 
-   if (cmdlineparams.p_diffdir)
-    if (ad_cmds.p_diffdir = IMDBAllocMemory (2+(len = strlen(cmdlineparams.p_diffdir))))
+   /* DIFFDIR/M delivers an array of strings */
+   if (pp_diffdir = (char **) cmdlineparams.p_diffdir)
+    for (; (*pp_diffdir) && (ad_cmds.nb_diffdirs < ADV_MAX_WEEKS); pp_diffdir++)
+     if (ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs] = IMDBAllocMemory (2+(len = strlen(*pp_diffdir))))
+      {
+       strcpy(ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs], *pp_diffdir);
+       c = ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs][len-1];
+       if ((c != ':') && (c != '/') && (!IsArchiveName (*pp_diffdir)))
+        strcat (ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs],"/");
+       ad_cmds.nb_diffdirs++;
+      }
+   ad_cmds.p_diffdir = ad_cmds.p_diffdirs[0];
+
+   ad_cmds.f_checkcrc = cmdlineparams.f_checkcrc;
+   ad_cmds.f_force    = cmdlineparams.f_force   ;
+   ad_cmds.f_keep     = cmdlineparams.f_keep    ;
+   ad_cmds.f_nostats  = cmdlineparams.f_nostats ;
+   ad_cmds.f_quiet    = cmdlineparams.f_quiet   ;
+   ad_cmds.f_revert   = cmdlineparams.f_revert  ;
+   ad_cmds.f_verify   = cmdlineparams.f_verify  ;
+   ad_cmds.f_transaction = cmdlineparams.f_transaction;
+   ad_cmds.f_checkpoint  = cmdlineparams.f_checkpoint;
+   ad_cmds.f_fuzzy       = cmdlineparams.f_fuzzy;
+   ad_cmds.f_pipeline    = cmdlineparams.f_pipeline;
+   if (cmdlineparams.p_workers)
+    ad_cmds.nb_workers   = *cmdlineparams.p_workers;
+   if (cmdlineparams.p_devlimit)
+    ad_cmds.dev_limit    = *cmdlineparams.p_devlimit;
+   if (cmdlineparams.p_memory)
+    ad_cmds.memory       = *cmdlineparams.p_memory;
+
+   if (cmdlineparams.p_logfile)
+    if (ad_cmds.p_logfile = IMDBAllocMemory (1+ strlen(cmdlineparams.p_logfile)))
+     strcpy(ad_cmds.p_logfile, cmdlineparams.p_logfile);
+
+   if (cmdlineparams.p_undodir)
+    if (ad_cmds.p_undodir = IMDBAllocMemory (2+(len = strlen(cmdlineparams.p_undodir))))
+     {
+      strcpy(ad_cmds.p_undodir, cmdlineparams.p_undodir);
+      c = ad_cmds.p_undodir[len-1];
+      if ((c != ':') && (c != '/'))
+       strcat (ad_cmds.p_undodir,"/");
+     }
+
+   if (cmdlineparams.p_bindir)
+    if (ad_cmds.p_bindir = IMDBAllocMemory (2+(len = strlen(cmdlineparams.p_bindir))))
      {
-      strcpy(ad_cmds.p_diffdir, cmdlineparams.p_diffdir);
-      c = ad_cmds.p_diffdir[len-1];
+      strcpy(ad_cmds.p_bindir, cmdlineparams.p_bindir);
+      c = ad_cmds.p_bindir[len-1];
       if ((c != ':') && (c != '/'))
-       strcat (ad_cmds.p_diffdir,"/");
+       strcat (ad_cmds.p_bindir,"/");
      }
 
-   ad_cmds.f_checkcrc = cmdlineparams.f_checkcrc;
-   ad_cmds.f_force    = cmdlineparams.f_force   ;
-   ad_cmds.f_keep     = cmdlineparams.f_keep    ;
-   ad_cmds.f_nostats  = cmdlineparams.f_nostats ;
-   ad_cmds.f_quiet    = cmdlineparams.f_quiet   ;
+   if (cmdlineparams.p_keydir)
+    if (ad_cmds.p_keydir = IMDBAllocMemory (2+(len = strlen(cmdlineparams.p_keydir))))
+     {
+      strcpy(ad_cmds.p_keydir, cmdlineparams.p_keydir);
+      c = ad_cmds.p_keydir[len-1];
+      if ((c != ':') && (c != '/'))
+       strcat (ad_cmds.p_keydir,"/");
+     }
 
-   if (cmdlineparams.p_logfile)
-    if (ad_cmds.p_logfile = IMDBAllocMemory (1+ strlen(cmdlineparams.p_logfile)))
-     strcpy(ad_cmds.p_logfile, cmdlineparams.p_logfile);
+   if (cmdlineparams.p_deltadir)
+    if (ad_cmds.p_deltadir = IMDBAllocMemory (2+(len = strlen(cmdlineparams.p_deltadir))))
+     {
+      strcpy(ad_cmds.p_deltadir, cmdlineparams.p_deltadir);
+      c = ad_cmds.p_deltadir[len-1];
+      if ((c != ':') && (c != '/'))
+       strcat (ad_cmds.p_deltadir,"/");
+     }
 
    /* Free ReadArgs parameters */
    if (NULL == rda)
@@ -1503,7 +5118,7 @@ int main(int argc, char *argv[])
 
 #ifdef SYS_UNIX
   {
-   static const char Template[] = "usage: ApplyDiffs <listpath> <diffpath> [-checkcrc][-force][-keep][-nostats][-quiet][-logfile <filename>]";
+   static const char Template[] = "usage: ApplyDiffs <listpath> <diffpath> [<diffpath> ...] [-checkcrc][-force][-keep][-nostats][-quiet][-logfile <filename>][-undo <undopath>][-revert][-verify][-transaction][-checkpoint][-binary <binpath>][-keyed <keypath>][-fuzzy][-delta <deltapath>][-pipeline][-workers <n>][-devlimit <n>][-memory <kbytes>]";
    LONG              i;
 
    if (argc <3)
@@ -1520,18 +5135,25 @@ int main(int argc, char *argv[])
       strcat (ad_cmds.p_listdir,"/");
     }
 
-   /* diff-path */
-   if (ad_cmds.p_diffdir = IMDBAllocMemory (2 + strlen(argv[2])))
-    {
-     strcpy(ad_cmds.p_diffdir, argv[2]);
-     if ('/' != ad_cmds.p_diffdir[strlen(ad_cmds.p_diffdir)-1])
-      strcat (ad_cmds.p_diffdir,"/");
-    }
-
-
    /* Parse Command Line Parameters */
-   for (i=3; i < argc; i++)
+   for (i=2; i < argc; i++)
     {
+     if ('-' != argv[i][0])
+      {/* diff-path, one for each week */
+       if (ad_cmds.nb_diffdirs >= ADV_MAX_WEEKS)
+        {
+         printf ("Error: Too many diff-directories (max. %i)!\n", ADV_MAX_WEEKS);
+         exit (RET_ERROR);
+        }
+       if (ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs] = IMDBAllocMemory (2 + strlen(argv[i])))
+        {
+         strcpy(ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs], argv[i]);
+         if (('/' != argv[i][strlen(argv[i])-1]) && (!IsArchiveName (argv[i])))
+          strcat (ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs],"/");
+         ad_cmds.nb_diffdirs++;
+        }
+      }
+     else
      if (!strcmp(argv[i], "-checkcrc"))
       ad_cmds.f_checkcrc = TRUE;
      else
@@ -1552,12 +5174,80 @@ int main(int argc, char *argv[])
        if (ad_cmds.p_logfile = IMDBAllocMemory (2 + strlen(argv[++i])))
         strcpy(ad_cmds.p_logfile, argv[i]);
       }
+     else
+     if ((!strcmp(argv[i], "-undo")) && (i+1 < argc))
+      {
+       if (ad_cmds.p_undodir = IMDBAllocMemory (2 + strlen(argv[++i])))
+        {
+         strcpy(ad_cmds.p_undodir, argv[i]);
+         if ('/' != argv[i][strlen(argv[i])-1])
+          strcat (ad_cmds.p_undodir,"/");
+        }
+      }
+     else
+     if (!strcmp(argv[i], "-revert"))
+      ad_cmds.f_revert   = TRUE;
+     else
+     if (!strcmp(argv[i], "-verify"))
+      ad_cmds.f_verify   = TRUE;
+     else
+     if (!strcmp(argv[i], "-transaction"))
+      ad_cmds.f_transaction = TRUE;
+     else
+     if (!strcmp(argv[i], "-checkpoint"))
+      ad_cmds.f_checkpoint = TRUE;
+     else
+     if ((!strcmp(argv[i], "-binary")) && (i+1 < argc))
+      {
+       if (ad_cmds.p_bindir = IMDBAllocMemory (2 + strlen(argv[++i])))
+        {
+         strcpy(ad_cmds.p_bindir, argv[i]);
+         if ('/' != argv[i][strlen(argv[i])-1])
+          strcat (ad_cmds.p_bindir,"/");
+        }
+      }
+     else
+     if (!strcmp(argv[i], "-fuzzy"))
+      ad_cmds.f_fuzzy = TRUE;
+     else
+     if (!strcmp(argv[i], "-pipeline"))
+      ad_cmds.f_pipeline = TRUE;
+     else
+     if ((!strcmp(argv[i], "-workers")) && (i+1 < argc))
+      ad_cmds.nb_workers = atol (argv[++i]);
+     else
+     if ((!strcmp(argv[i], "-devlimit")) && (i+1 < argc))
+      ad_cmds.dev_limit = atol (argv[++i]);
+     else
+     if ((!strcmp(argv[i], "-memory")) && (i+1 < argc))
+      ad_cmds.memory = atol (argv[++i]);
+     else
+     if ((!strcmp(argv[i], "-keyed")) && (i+1 < argc))
+      {
+       if (ad_cmds.p_keydir = IMDBAllocMemory (2 + strlen(argv[++i])))
+        {
+         strcpy(ad_cmds.p_keydir, argv[i]);
+         if ('/' != argv[i][strlen(argv[i])-1])
+          strcat (ad_cmds.p_keydir,"/");
+        }
+      }
+     else
+     if ((!strcmp(argv[i], "-delta")) && (i+1 < argc))
+      {
+       if (ad_cmds.p_deltadir = IMDBAllocMemory (2 + strlen(argv[++i])))
+        {
+         strcpy(ad_cmds.p_deltadir, argv[i]);
+         if ('/' != argv[i][strlen(argv[i])-1])
+          strcat (ad_cmds.p_deltadir,"/");
+        }
+      }
      else
       {
        puts (Template);
        exit (10);
       }
     }
+   ad_cmds.p_diffdir = ad_cmds.p_diffdirs[0];
 
    if ((NULL == ad_cmds.p_listdir) || (NULL == ad_cmds.p_diffdir))
     {
@@ -1568,11 +5258,101 @@ int main(int argc, char *argv[])
 #endif
 
   /* Check Syntax */
-  if (0 == strcmp(ad_cmds.p_listdir, ad_cmds.p_diffdir))
-   {
-    printf("Error: Lists- and Diffs-Directory must be different!\n");
-    exit (RET_ERROR);
-   }
+  {
+   LONG week;
+
+   for (week = 0; week < ad_cmds.nb_diffdirs; week++)
+    if (0 == strcmp(ad_cmds.p_listdir, ad_cmds.p_diffdirs[week]))
+     {
+      printf("Error: Lists- and Diffs-Directory must be different!\n");
+      exit (RET_ERROR);
+     }
+    else
+    if ((ad_cmds.p_undodir) && (0 == strcmp(ad_cmds.p_undodir, ad_cmds.p_diffdirs[week])))
+     {
+      printf("Error: Undo- and Diffs-Directory must be different!\n");
+      exit (RET_ERROR);
+     }
+    else
+    if ((ad_cmds.p_bindir) && (0 == strcmp(ad_cmds.p_bindir, ad_cmds.p_diffdirs[week])))
+     {
+      printf("Error: Binary- and Diffs-Directory must be different!\n");
+      exit (RET_ERROR);
+     }
+    else
+    if ((ad_cmds.p_keydir) && (0 == strcmp(ad_cmds.p_keydir, ad_cmds.p_diffdirs[week])))
+     {
+      printf("Error: Keyed- and Diffs-Directory must be different!\n");
+      exit (RET_ERROR);
+     }
+    else
+    if ((ad_cmds.p_deltadir) && (0 == strcmp(ad_cmds.p_deltadir, ad_cmds.p_diffdirs[week])))
+     {
+      printf("Error: Delta- and Diffs-Directory must be different!\n");
+      exit (RET_ERROR);
+     }
+
+   if ((ad_cmds.p_bindir) && (0 == strcmp(ad_cmds.p_listdir, ad_cmds.p_bindir)))
+    {
+     printf("Error: Lists- and Binary-Directory must be different!\n");
+     exit (RET_ERROR);
+    }
+
+   if ((ad_cmds.p_bindir) && (ad_cmds.f_checkpoint))
+    {
+     printf("Error: Checkpoints can't be used together with Binary!\n");
+     exit (RET_ERROR);
+    }
+
+   if ((ad_cmds.p_keydir) && (0 == strcmp(ad_cmds.p_listdir, ad_cmds.p_keydir)))
+    {
+     printf("Error: Lists- and Keyed-Directory must be different!\n");
+     exit (RET_ERROR);
+    }
+
+   if ((ad_cmds.p_keydir) && (ad_cmds.f_checkpoint))
+    {
+     printf("Error: Checkpoints can't be used together with Keyed!\n");
+     exit (RET_ERROR);
+    }
+
+   if ((ad_cmds.p_deltadir) && (0 == strcmp(ad_cmds.p_listdir, ad_cmds.p_deltadir)))
+    {
+     printf("Error: Lists- and Delta-Directory must be different!\n");
+     exit (RET_ERROR);
+    }
+
+   if ((ad_cmds.p_deltadir) && (ad_cmds.f_checkpoint))
+    {
+     printf("Error: Checkpoints can't be used together with Delta!\n");
+     exit (RET_ERROR);
+    }
+
+   if ((ad_cmds.f_fuzzy) && (ad_cmds.f_checkpoint))
+    {
+     printf("Error: Checkpoints can't be used together with Fuzzy!\n");
+     exit (RET_ERROR);
+    }
+
+   /* the window of a week reads the removed lines of the weeks before too early */
+   if ((ad_cmds.f_fuzzy) && (ad_cmds.nb_diffdirs > 1) && ((ad_cmds.p_undodir) || (ad_cmds.p_bindir) || (ad_cmds.p_keydir) || (ad_cmds.p_deltadir)))
+    {
+     printf("Error: Fuzzy can't write Undo-, Binary-, Keyed- or Delta-Files of several weeks!\n");
+     exit (RET_ERROR);
+    }
+
+   if ((ad_cmds.p_undodir) && (0 == strcmp(ad_cmds.p_listdir, ad_cmds.p_undodir)))
+    {
+     printf("Error: Lists- and Undo-Directory must be different!\n");
+     exit (RET_ERROR);
+    }
+
+   if ((ad_cmds.p_undodir) && (ad_cmds.f_checkpoint))
+    {
+     printf("Error: Checkpoints can't be used together with Undo!\n");
+     exit (RET_ERROR);
+    }
+  }
 
 #ifdef IMDB_DEBUG
   printf ("Listdir: %s\nDiffdir: %s\ncheckcrc %i\nforce %i\nkeep %i\nnostats %i\nquiet %i\n", ad_cmds.p_listdir, ad_cmds.p_diffdir, ad_cmds.f_checkcrc, ad_cmds.f_force, ad_cmds.f_keep, ad_cmds.f_nostats, ad_cmds.f_quiet);
@@ -1582,6 +5362,10 @@ int main(int argc, char *argv[])
    printf ("Logfile: -none-\n");
 #endif
 
+  /* MEMORY: budget of all file-buffers */
+  if (ad_cmds.memory > 0)
+   IMDBSetMemoryBudget (ad_cmds.memory * 1024);
+
   /* Create CRC-Table */
   if (!(pCrcTab = InitCRC()))
    {
@@ -1589,70 +5373,48 @@ int main(int argc, char *argv[])
     exit (RET_ERROR);
    }
 
-  /* get all filenames in the diff-files-directory */
+  /* get all filenames in the diff-files-directories */
 #ifdef SYS_AMIGA
   {
    BPTR                  lock;
    struct FileInfoBlock *fib;
+   LONG                  week;
 
    if (fib = (struct FileInfoBlock *)AllocMem(sizeof(struct FileInfoBlock), MEMF_PUBLIC))
     {
-     if (lock = Lock(ad_cmds.p_diffdir,SHARED_LOCK))
+     for (week = 0; (week < ad_cmds.nb_diffdirs) && (ret_val != RET_ERROR); week++)
       {
-       if ((Examine(lock,fib))&&(fib->fib_DirEntryType > 0))
+       if (lock = Lock(ad_cmds.p_diffdirs[week],SHARED_LOCK))
         {
-         while ((ExNext(lock,fib)) && (ret_val != RET_ERROR))
+         if ((Examine(lock,fib))&&(fib->fib_DirEntryType > 0))
           {
-           if ((fib->fib_DirEntryType <= 0) && (strlen(fib->fib_FileName) > 5)
-            && ((0 == strnicmp(&fib->fib_FileName[strlen(fib->fib_FileName)-5], ".list", 5))
-              ||(0 == strnicmp(&fib->fib_FileName[strlen(fib->fib_FileName)-5], ".diff", 5))))
+           while ((ExNext(lock,fib)) && (ret_val != RET_ERROR))
             {
-             /* Create and initialize DiffInfo */
-             if (a_diffinfo = IMDBAllocMemory (sizeof (DiffInfo)))
-              {
-               a_diffinfo->next = NULL;
-               strcpy (a_diffinfo->fname_list, fib->fib_FileName);
-               strcpy (a_diffinfo->fname_diff, fib->fib_FileName);
-               if (0 == strnicmp(&a_diffinfo->fname_list[strlen(a_diffinfo->fname_list)-5], ".list", 5))
-                a_diffinfo->type = DIFF_TYPE_ORIGINAL;
-               else
-                {
-                 a_diffinfo->type = DIFF_TYPE_STRIPPED;
-                 a_diffinfo->fname_list[strlen(a_diffinfo->fname_list)-4] = '\0';
-                 strcat(a_diffinfo->fname_list, "list");
-                }
-               a_diffinfo->status = STATUS_OK;
-               a_diffinfo->add = 0;
-               a_diffinfo->delete = 0;
-
-              }
-             else
-              {
-               printf("Can't allocate memory for DiffInfo\n");
-               ret_val = RET_ERROR;
-              }
-             if (diffinfo)
+             if ((fib->fib_DirEntryType <= 0) && (IsDiffName (fib->fib_FileName)))
               {
-               t_diffinfo->next = a_diffinfo;
-               if (a_diffinfo)
-                t_diffinfo = a_diffinfo;
+               if (ret = AddDiffInfo (&diffinfo, fib->fib_FileName, week, -1, 0))
+                ret_val = ret;
               }
-             else
-              diffinfo = t_diffinfo = a_diffinfo;
             }
           }
+         else
+         if (IsArchiveName (ad_cmds.p_diffdirs[week]))
+          {
+           if (ret = ScanArchive (&diffinfo, week))
+            ret_val = ret;
+          }
+         else
+          {
+           printf("%s is no directory!\n", ad_cmds.p_diffdirs[week]);
+           ret_val = RET_ERROR;
+          }
+         UnLock(lock);
         }
        else
         {
-         printf("%s is no directory!\n", ad_cmds.p_diffdir);
+         printf("Can't get shared lock on %s\n", ad_cmds.p_diffdirs[week]);
          ret_val = RET_ERROR;
         }
-       UnLock(lock);
-      }
-     else
-      {
-       printf("Can't get shared lock on %s\n", ad_cmds.p_diffdir);
-       ret_val = RET_ERROR;
       }
      FreeMem(fib,sizeof(struct FileInfoBlock));
     }
@@ -1667,76 +5429,53 @@ int main(int argc, char *argv[])
 #ifdef SYS_UNIX
   {
    struct stat stbuf;
+   LONG        week;
 
-   if (-1 == stat(ad_cmds.p_diffdir, &stbuf))
-    {
-     printf("Can't access %s\n", ad_cmds.p_diffdir);
-     ret_val = RET_ERROR;
-    }
-   else
-   if (S_IFDIR != (stbuf.st_mode & S_IFMT))
-    {
-     printf("%s is no directory.\n", ad_cmds.p_diffdir);
-     ret_val = RET_ERROR;
-    }
-   else
+   for (week = 0; (week < ad_cmds.nb_diffdirs) && (ret_val != RET_ERROR); week++)
     {
-#ifdef NEXT
-     struct direct *dp;
-#else
-     struct dirent *dp;
-#endif /* NEXT */
-     DIR *dfd;
-
-     if (NULL == (dfd = opendir(ad_cmds.p_diffdir)))
+     if (-1 == stat(ad_cmds.p_diffdirs[week], &stbuf))
       {
-       printf("Can't open %s\n", ad_cmds.p_diffdir);
+       printf("Can't access %s\n", ad_cmds.p_diffdirs[week]);
        ret_val = RET_ERROR;
       }
      else
+     if ((S_IFREG == (stbuf.st_mode & S_IFMT)) && (IsArchiveName (ad_cmds.p_diffdirs[week])))
       {
-       while (dp = readdir(dfd))
-        {
-         if ((strlen (dp->d_name) <=8 ) || ((0 != strncmp(&dp->d_name[strlen(dp->d_name)-5], ".list", 5))
-                                          &&(0 != strncmp(&dp->d_name[strlen(dp->d_name)-5], ".diff", 5))))
-          continue;
+       if (ret = ScanArchive (&diffinfo, week))
+        ret_val = ret;
+      }
+     else
+     if (S_IFDIR != (stbuf.st_mode & S_IFMT))
+      {
+       printf("%s is no directory.\n", ad_cmds.p_diffdirs[week]);
+       ret_val = RET_ERROR;
+      }
+     else
+      {
+#ifdef NEXT
+       struct direct *dp;
+#else
+       struct dirent *dp;
+#endif /* NEXT */
+       DIR *dfd;
 
-         /* Create and initialize DiffInfo */
-         if (a_diffinfo = IMDBAllocMemory (sizeof (DiffInfo)))
-          {
-           a_diffinfo->next = NULL;
-           strcpy (a_diffinfo->fname_list, dp->d_name);
-           strcpy (a_diffinfo->fname_diff, dp->d_name);
-#ifdef IMDB_DEBUG
-printf ("-> %s\n", a_diffinfo->fname_list);
-#endif
-           if (0 == strncmp(&a_diffinfo->fname_list[strlen(a_diffinfo->fname_list)-5], ".list", 5))
-            a_diffinfo->type = DIFF_TYPE_ORIGINAL;
-           else
-            {
-             a_diffinfo->type = DIFF_TYPE_STRIPPED;
-             a_diffinfo->fname_list[strlen(a_diffinfo->fname_list)-4] = '\0';
-             strcat(a_diffinfo->fname_list, "list");
-            }
-           a_diffinfo->status = STATUS_OK;
-           a_diffinfo->add = 0;
-           a_diffinfo->delete = 0;
-          }
-         else
-          {
-           printf("Can't allocate memory for DiffInfo\n");
-           ret_val = RET_ERROR;
-          }
-         if (diffinfo)
+       if (NULL == (dfd = opendir(ad_cmds.p_diffdirs[week])))
+        {
+         printf("Can't open %s\n", ad_cmds.p_diffdirs[week]);
+         ret_val = RET_ERROR;
+        }
+       else
+        {
+         while (dp = readdir(dfd))
           {
-           t_diffinfo->next = a_diffinfo;
-           if (a_diffinfo)
-            t_diffinfo = a_diffinfo;
+           if ((strlen (dp->d_name) <=8 ) || (!IsDiffName (dp->d_name)))
+            continue;
+
+           if (ret = AddDiffInfo (&diffinfo, dp->d_name, week, -1, 0))
+            ret_val = ret;
           }
-         else
-          diffinfo = t_diffinfo = a_diffinfo;
+         closedir(dfd);
         }
-       closedir(dfd);
       }
     }
   }
@@ -1744,10 +5483,17 @@ printf ("-> %s\n", a_diffinfo->fname_list);
 
   /* sort filenames (= sort Diffinfo) */
   {
-   char t_fname[256];
-   LONG t_type;
+   char      t_fname[256];
+   LONG      t_type;
+   DiffInfo *t_next_week;
+   LONG      week;
+
+   /* tar-archives are read in their own order, so they are read only once */
+   for (week = 0; week < ad_cmds.nb_diffdirs; week++)
+    if (ad_cmds.p_archives[week])
+     break;
 
-   t_diffinfo = diffinfo;
+   t_diffinfo = (week < ad_cmds.nb_diffdirs) ? NULL : diffinfo;
    while (t_diffinfo)
     {
      a_diffinfo = t_diffinfo->next;
@@ -1765,6 +5511,12 @@ printf ("-> %s\n", a_diffinfo->fname_list);
          t_type           = t_diffinfo->type;
          t_diffinfo->type = a_diffinfo->type;
          a_diffinfo->type = t_type;
+         t_type           = t_diffinfo->week;
+         t_diffinfo->week = a_diffinfo->week;
+         a_diffinfo->week = t_type;
+         t_next_week           = t_diffinfo->next_week;
+         t_diffinfo->next_week = a_diffinfo->next_week;
+         a_diffinfo->next_week = t_next_week;
         }
        a_diffinfo = a_diffinfo->next;
       }
@@ -1778,62 +5530,27 @@ printf ("-> %s\n", a_diffinfo->fname_list);
   /* Sonderfall: Neues File wird eingefuehrt */
   /* 2.3 */ /* Erst wird getestet ob das Listfile gepackt ist. In diesem Fall wird erst mal */
   /* auf einen Test verzichtet */
-  if (RET_OK == ret_val)
+  /* 2.6 */ /* mit IMDB_ZLIB werden gepackte Listfiles direkt getestet */
+  /* PIPELINE: every listfile is checked just before it is patched */
+  /* WORKERS: several listfiles are checked at once (not from tar-archives) */
+  if ((RET_OK == ret_val) && (!ad_cmds.f_pipeline) && (ad_cmds.nb_workers > 1) && (!ArchivesUsed ()))
+   {
+    ret_val = CheckAllListfiles (diffinfo, ad_cmds.nb_workers, ad_cmds.dev_limit, !ad_cmds.f_quiet);
+    if (!ad_cmds.f_quiet)
+     printf ("\n");
+   }
+  else
+  if ((RET_OK == ret_val) && (!ad_cmds.f_pipeline))
    {
     t_diffinfo = diffinfo;
 
     while ((t_diffinfo) && (RET_ERROR != ret_val))
      {
       char listname[256];
-      char diffname[256];
-
-      strcpy (listname, ad_cmds.p_listdir);
-      strncat(listname, t_diffinfo->fname_list, 255-strlen(listname));
-      strcpy (diffname, ad_cmds.p_diffdir);
-      strncat(diffname, t_diffinfo->fname_diff, 255-strlen(diffname));
-
-#ifdef IMDB_GZIP
-      /* 2.3 File gzipped? */
-      if (FALSE == IMDBExistFile(listname))
-       {
-        char t_listname[256];
-        strcpy (t_listname, listname);
-        strcat (t_listname, IMDBV_FILE_PACKER_EXT);
-        if (IMDBExistFile(t_listname))
-         {
-          if (!ad_cmds.f_quiet)
-           printf ("Skipping File %s - File is Compressed\n", t_diffinfo->fname_list);
-          t_diffinfo->status = STATUS_UNKNOWN;
-          t_diffinfo = t_diffinfo->next;
-          continue; /* try next file */
-         }
-       }
-#endif
-
-      /* Test if listfile and diffile match */
-      if (!ad_cmds.f_force)
-       {
-        if (!ad_cmds.f_quiet)
-         {
-          printf ("Test File %s - ", t_diffinfo->fname_list);
-          fflush (stdout);
-         }
-        if (ret = checkfile_match (listname, diffname, !ad_cmds.f_quiet, t_diffinfo))
-         ret_val = ret;
-       }
-
-      /* Check CRC */
-      if (ad_cmds.f_checkcrc)
-       {
-        if (!ad_cmds.f_quiet)
-         {
-          printf ("Check CRC of File %s (000%%)", t_diffinfo->fname_list);
-          fflush (stdout);
-         }
 
-        if (ret = checkfile_crc (listname, !ad_cmds.f_quiet))
-         ret_val = ret;
-       }
+      GetListName (listname, t_diffinfo);
+      if (ret = CheckListfile (listname, !ad_cmds.f_quiet, t_diffinfo))
+       ret_val = ret;
 
       t_diffinfo = t_diffinfo->next;
      }
@@ -1856,21 +5573,61 @@ printf ("-> %s\n", a_diffinfo->fname_list);
   /* Sonderfall: Neues File wird eingefuehrt */
   if (RET_OK == ret_val)
    {
+    ListCheck check;
+    BOOL      f_background = ((ad_cmds.f_pipeline) && (!ArchivesUsed ()));
+
+    check.diffinfo  = NULL;
+    check.f_running = FALSE;
+
     t_diffinfo = diffinfo;
 
-    while ((t_diffinfo) && (RET_ERROR != ret_val))
+    while ((t_diffinfo) && ((RET_ERROR != ret_val) || (ad_cmds.f_transaction)))
      {
       char listname[256];
-      char diffname[256];
 #ifdef IMDB_GZIP
       BOOL  f_gzip = FALSE;
       t_diffinfo->status = STATUS_OK;
 #endif
 
-      strcpy (listname, ad_cmds.p_listdir);
-      strncat(listname, t_diffinfo->fname_list, 255-strlen(listname));
-      strcpy (diffname, ad_cmds.p_diffdir);
-      strncat(diffname, t_diffinfo->fname_diff, 255-strlen(diffname));
+      /* PIPELINE: this listfile has been checked while the last one was patched */
+      WaitListCheck (&check);
+
+      /* TRANSACTION: no need to go on after the first error */
+      if ((ad_cmds.f_transaction) && (!ad_cmds.f_verify) && (RET_OK != ret_val))
+       {
+        t_diffinfo->status = STATUS_ABORT;
+        t_diffinfo = t_diffinfo->next;
+        continue;
+       }
+
+      GetListName (listname, t_diffinfo);
+
+      /* PIPELINE: check the listfile now, skip it if it doesn't pass */
+      if (ad_cmds.f_pipeline)
+       {
+        if (check.diffinfo == t_diffinfo)
+         {
+          ret = check.ret;
+          if (!ad_cmds.f_quiet)
+           PrintListCheck (t_diffinfo, ret);
+         }
+        else
+         ret = CheckListfile (listname, !ad_cmds.f_quiet, t_diffinfo);
+
+        if (STATUS_CRC == ret)
+         t_diffinfo->status = STATUS_CRC;
+        if ((RET_OK != ret) || ((STATUS_OK != t_diffinfo->status) && (STATUS_NEW != t_diffinfo->status) && (STATUS_UNKNOWN != t_diffinfo->status)))
+         {
+          if (!ad_cmds.f_quiet)
+           printf ("Skipping File %s - Check failed\n\n", t_diffinfo->fname_list);
+          ret_val = (RET_ERROR == ret) ? RET_ERROR : RET_WARNING;
+          t_diffinfo = t_diffinfo->next;
+          continue;
+         }
+#ifdef IMDB_GZIP
+        t_diffinfo->status = STATUS_OK;
+#endif
+       }
 
 #ifdef IMDB_GZIP
 /* 2.3 unpack file if necessary */
@@ -1879,6 +5636,14 @@ printf ("-> %s\n", a_diffinfo->fname_list);
         char t_listname[256];
         strcpy (t_listname, listname);
         strcat (t_listname, IMDBV_FILE_PACKER_EXT);
+        if ((IMDBExistFile(t_listname)) && (ad_cmds.f_verify))
+         {/* verify must not change anything */
+          if (!ad_cmds.f_quiet)
+           printf ("Skipping File %s - File is Compressed\n", t_diffinfo->fname_list);
+          t_diffinfo->status = STATUS_UNKNOWN;
+          t_diffinfo = t_diffinfo->next;
+          continue;
+         }
         if (IMDBExistFile(t_listname))
          {
           char command [255];
@@ -1905,44 +5670,25 @@ printf ("-> %s\n", a_diffinfo->fname_list);
 
       if (!ad_cmds.f_quiet)
        {
-        printf ("Apply diffs on file %s (000%%)", t_diffinfo->fname_list);
+        printf ("%s diffs on file %s (000%%)", (ad_cmds.f_verify) ? "Verify" : "Apply", t_diffinfo->fname_list);
         fflush (stdout);
        }
 
-      switch (t_diffinfo->type)
-       {
-        case DIFF_TYPE_ORIGINAL:
-         if (ret = patchfile_original (listname, diffname, ad_cmds.f_keep, !ad_cmds.f_quiet, t_diffinfo))
-          ret_val = ret;
-         break;
-        case DIFF_TYPE_STRIPPED:
-         if (ret = patchfile_stripped (listname, diffname, ad_cmds.f_keep, !ad_cmds.f_quiet, t_diffinfo))
-          ret_val = ret;
-         break;
-        default:
-         puts ("Serious Error!");
-       }
+      /* PIPELINE: check the next listfile meanwhile */
+      if ((f_background) && (t_diffinfo->next))
+       StartListCheck (&check, t_diffinfo->next);
+
+      if (ret = patchfile (listname, ad_cmds.f_keep, !ad_cmds.f_quiet, t_diffinfo))
+       ret_val = ret;
 
 #ifdef IMDB_GZIP
 /* 2.3 pack file if it was packed before */
+      if ((f_gzip) && (ad_cmds.f_transaction) && (!ad_cmds.f_verify))
+       t_diffinfo->f_packed = TRUE;   /* packed by CommitTransaction */
+      else
       if (f_gzip)
-       {
-        char command [255];
-        if (!ad_cmds.f_quiet)
-         {
-          printf ("Compressing File %s - ", t_diffinfo->fname_list);
-          fflush (stdout);
-         }
-        sprintf (command, IMDBV_FILE_PACKER_NAME " " IMDBV_FILE_PACKER_PACK " %s", listname);
-        if (system(command))
-         {/* Packen hat leider nicht geklappt */
-          t_diffinfo->status = STATUS_IO;
-          ret_val = RET_WARNING;
-          printf ("failed!\n");
-         }
-        else
-         printf ("OK\n");
-       }
+       if (PackListfile (listname, t_diffinfo, !ad_cmds.f_quiet))
+        ret_val = RET_WARNING;
 #endif
 
       if (!ad_cmds.f_quiet)
@@ -1968,6 +5714,9 @@ printf ("-> %s\n", a_diffinfo->fname_list);
           case STATUS_NEW:
            printf ("New File\n");
            break;
+          case STATUS_ABORT:
+           printf ("Aborted\n");
+           break;
           default:
            printf ("%i", diffinfo->status);
            break;
@@ -1977,8 +5726,13 @@ printf ("-> %s\n", a_diffinfo->fname_list);
 
       t_diffinfo = t_diffinfo->next;
      }
+    WaitListCheck (&check);
     if (!ad_cmds.f_quiet)
      printf ("\n");
+
+    if ((ad_cmds.f_transaction) && (!ad_cmds.f_verify))
+     if ((ret = CommitTransaction (diffinfo, ad_cmds.f_keep, !ad_cmds.f_quiet)) && (RET_ERROR != ret_val))
+      ret_val = ret;
    }
 
 
@@ -2042,6 +5796,10 @@ printf ("-> %s\n", a_diffinfo->fname_list);
          printf ("New File    ");
          if (p_file) fprintf (p_file,"New File    ");
          break;
+        case STATUS_ABORT:
+         printf ("Aborted     ");
+         if (p_file) fprintf (p_file,"Aborted     ");
+         break;
         default:
          printf ("%i", diffinfo->status);
          if (p_file) fprintf (p_file,"%i", diffinfo->status);
@@ -2050,7 +5808,7 @@ printf ("-> %s\n", a_diffinfo->fname_list);
       printf (" %6li %6li %s\n", diffinfo->delete, diffinfo->add, diffinfo->fname_list);
       if (p_file) fprintf (p_file," %6li %6li %s\n", diffinfo->delete, diffinfo->add, diffinfo->fname_list);
       t_diffinfo = diffinfo->next;
-      IMDBFreeMemory (diffinfo);
+      FreeDiffInfo (diffinfo);
       diffinfo = t_diffinfo;
      }
 
@@ -2062,15 +5820,24 @@ printf ("-> %s\n", a_diffinfo->fname_list);
     while (diffinfo)
      {
       t_diffinfo = diffinfo->next;
-      IMDBFreeMemory (diffinfo);
+      FreeDiffInfo (diffinfo);
       diffinfo = t_diffinfo;
      }
    }
 
   /* Free memory */
   if (ad_cmds.p_listdir) IMDBFreeMemory(ad_cmds.p_listdir);
-  if (ad_cmds.p_diffdir) IMDBFreeMemory(ad_cmds.p_diffdir);
+  while (ad_cmds.nb_diffdirs)
+   {
+    if (ad_cmds.p_archives[--ad_cmds.nb_diffdirs])
+     IMDBCloseBuffer(ad_cmds.p_archives[ad_cmds.nb_diffdirs]);
+    IMDBFreeMemory(ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs]);
+   }
   if (ad_cmds.p_logfile) IMDBFreeMemory(ad_cmds.p_logfile);
+  if (ad_cmds.p_undodir) IMDBFreeMemory(ad_cmds.p_undodir);
+  if (ad_cmds.p_bindir) IMDBFreeMemory(ad_cmds.p_bindir);
+  if (ad_cmds.p_keydir) IMDBFreeMemory(ad_cmds.p_keydir);
+  if (ad_cmds.p_deltadir) IMDBFreeMemory(ad_cmds.p_deltadir);
 
   if (RET_OK != ret_val)
    printf ("\nWARNING: ApplyDiffs could not successfully apply all diffs.\n");
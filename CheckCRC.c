@@ -2,7 +2,7 @@
  *
  *  Program:      CheckCRC.c
  *
- *  Version:      1.5 (22.11.01)
+ *  Version:      1.6 (19.10.26)
  *
  *  Purpose:      Checks CRC of listfile(s)
  *
@@ -11,18 +11,36 @@
  *                AMIGA-Commandline-Options:
  *
  *                   LIST/A      path of the listfiles or filename of listfile
+ *                               (*.list or, with zlib, *.list.gz)
  *                   NOSTATS/S   don't print statistics
  *                   QUIET/S     don't show progress
  *                   LOGFILE/N   name of logfile
+ *                   FRAMES/S    check the frames of compressed listfiles
+ *                               instead of the CRC (needs block-index)
+ *                   WORKERS/K/N number of listfiles that are checked at
+ *                               the same time
+ *                   DEVLIMIT/K/N number of WORKERS reading from the same
+ *                               device (default: 1 for disks, more for
+ *                               SSDs)
+ *                   MEMORY/K/N  memory budget of all file-buffers in KB
  *
  *
  *                UNIX-Commandline-Options:
  *
  *                   <list>      path of the listfiles or filename of listfile
+ *                               (*.list or, with zlib, *.list.gz)
  *                  optional:
  *                   -nostats    don't print statistics
  *                   -quiet      don't show progress
  *                   -logfile    name of logfile
+ *                   -frames     check the frames of compressed listfiles
+ *                               instead of the CRC (needs block-index)
+ *                   -workers    number of listfiles that are checked at
+ *                               the same time
+ *                   -devlimit   number of workers reading from the same
+ *                               device (default: 1 for disks, more for
+ *                               SSDs)
+ *                   -memory     memory budget of all file-buffers in KB
  *
  *
  *  Author:       Andre Bernhardt <ab@imdb.com>
@@ -90,7 +108,7 @@
 
 #endif /* SYS_UNIX*/
 
-#define VERSION "CheckCRC 1.5 (22.11.01)"
+#define VERSION "CheckCRC 1.6 (19.10.26)"
 static const char version[] ="$VER: "VERSION;
 
 /* Return values */
@@ -123,6 +141,8 @@ typedef struct DIFFINFO
   char  filedate[40];
   LONG  filesize;
   LONG  status;
+  BOOL  f_frames;                  /* frames have been checked */
+  LONG  damaged;                   /* position of the damaged frame */
  } DiffInfo;
 
 typedef struct
@@ -131,6 +151,14 @@ typedef struct
   LONG  f_nostats;
   LONG  f_quiet;
   char *p_logfile;
+  LONG  f_frames;
+  LONG *p_workers;
+  LONG *p_devlimit;
+  LONG *p_memory;
+  /* not part of the AMIGA-template */
+  LONG  nb_workers;                /* listfiles checked at the same time */
+  LONG  dev_limit;                 /* workers per device, 0: depends on the device */
+  LONG  memory;                    /* memory budget in KB, 0: none */
  } AD_Commands;
 
 /******************************************************************************
@@ -140,10 +168,6 @@ typedef struct
 
  /* global variable for tab */
  ULONG *pCrcTab = NULL;
- ULONG nCrc = 0xFFFFFFFFL;
- int nIndex;
- static char old_crc[16];
- static char new_crc[16];
 
 
 /*-----------------------------------------------------------------------------
@@ -237,6 +261,8 @@ u_long *InitCRC(void)
 
 void calc_crc (char *str, ULONG *nCrc)
  {
+  int nIndex;
+
   while (*str)
    {
     nIndex = (int) ((*nCrc ^ *str++) & 0x000000FFL);
@@ -253,6 +279,43 @@ void calc_crc (char *str, ULONG *nCrc)
  ******************************************************************************
  */
 
+/*-----------------------------------------------------------------------------
+ * Procedure:   StrHasSuffix
+ *
+ * Returns:     TRUE, if p_str ends with p_suffix
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL StrHasSuffix (char *p_str, char *p_suffix)
+ {
+  LONG len = strlen (p_str);
+  LONG len_suffix = strlen (p_suffix);
+
+  if (len <= len_suffix)
+   return (FALSE);
+#ifdef SYS_AMIGA
+  return ((BOOL) (0 == strnicmp (&p_str[len-len_suffix], p_suffix, len_suffix)));
+#else
+  return ((BOOL) (0 == strncmp (&p_str[len-len_suffix], p_suffix, len_suffix)));
+#endif
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   IsListName
+ *
+ * Purpose:     TRUE for listfiles (*.list, with IMDB_ZLIB *.list.gz too)
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL IsListName (char *p_name)
+ {
+#ifdef IMDB_ZLIB
+  if (StrHasSuffix (p_name, ".list.gz"))
+   return (TRUE);
+#endif
+  return (StrHasSuffix (p_name, ".list"));
+ }
+
 /*-----------------------------------------------------------------------------
  * Procedure:   checkfile_crc
  *
@@ -264,7 +327,10 @@ void calc_crc (char *str, ULONG *nCrc)
 
 void checkfile_crc(char *p_path, DiffInfo *p_diffinfo, BOOL flag_verbose)
  {
-  static  char listfile[256];
+  char         listfile[256];
+  char         old_crc[16];
+  char         new_crc[16];
+  ULONG        nCrc;
   IMDB_Buffer *list_buffer = NULL;
   char        *p_list_line;
   char        *p_str;
@@ -289,7 +355,8 @@ CRC: 0x408ADC16  File: crazy-credits.list  Date: Fri Sep 27 01:00:00 1996
   old_crc [0] = '\0';
 
   /* open old listfile */
-  if ((list_buffer = IMDBOpenBuffer (listfile, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE, ADV_BUFFER_SIZE))
+  /* compressed listfiles are uncompressed on the fly (IMDB_ZLIB) */
+  if ((list_buffer = IMDBOpenBuffer (listfile, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE|((StrHasSuffix (listfile, ".gz")) ? IMDBV_FILE_GZIP : 0), ADV_BUFFER_SIZE))
     &&(0 == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE)))
    {
     p_diffinfo->filesize = list_buffer->filesize;
@@ -351,6 +418,172 @@ CRC: 0x408ADC16  File: crazy-credits.list  Date: Fri Sep 27 01:00:00 1996
   p_diffinfo->status = status;
  }
 
+/*-----------------------------------------------------------------------------
+ * Procedure:   checkfile_frames
+ *
+ * Parameters:  p_path, p_diffinfo, flag_verbose
+ *
+ * Returns:     FALSE if the listfile has no frames (not compressed or no
+ *              block-index), the CRC has to be checked then
+ *
+ * Comments:    The CRC32 of every frame is checked by several threads.
+ *              This is faster than the CRC of the listfile and tells
+ *              where a listfile is damaged.
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL checkfile_frames(char *p_path, DiffInfo *p_diffinfo, BOOL flag_verbose)
+ {
+  char         listfile[256];
+  IMDB_Buffer *list_buffer;
+  char        *p_list_line;
+  char        *p_str;
+  LONG         size = 0;
+  LONG         pos  = 0;
+  LONG         ret;
+
+  /* Filename */
+  if (p_path)
+   strcpy (listfile, p_path);
+  else
+   listfile[0] = '\0';
+  strncat(listfile, p_diffinfo->fname_list, 255-strlen(listfile));
+
+  if (IMDBE_NOTFOUND == (ret = IMDBCheckFrames (listfile, &size, &pos)))
+   return (FALSE);
+  p_diffinfo->f_frames = TRUE;
+
+  /* Merke Datum */
+  p_diffinfo->filesize = size;
+  strcpy(p_diffinfo->filedate, "---- not  available ----");
+  if (list_buffer = IMDBOpenBuffer (listfile, IMDBV_FILE_READ|IMDBV_FILE_GZIP, ADV_BUFFER_SIZE))
+   {
+    if ((0 == IMDBReadBufferLine (list_buffer, &p_list_line, ADV_MAX_LINESIZE))
+      &&(p_str = strstr(p_list_line, "Date: ")))
+     strncpy(p_diffinfo->filedate, p_str + 6, 39);
+    IMDBCloseBuffer (list_buffer);
+   }
+
+  if (IMDBE_NO_ERROR == ret)
+   {
+    if (flag_verbose)
+     printf ("\b\b\b\b\b\b- Frames O.K.\n");
+    p_diffinfo->status = STATUS_OK;
+   }
+  else
+   {
+    if (flag_verbose)
+     printf ("\b\b\b\b\b\b- Frame damaged at byte %li\n", pos);
+    p_diffinfo->status  = STATUS_CRC;
+    p_diffinfo->damaged = pos;
+   }
+  return (TRUE);
+ }
+
+/******************************************************************************
+ *  Checking several listfiles at once (WORKERS)
+ *
+ *  The listfiles are scheduled per device (see IMDBOpenSchedule): a
+ *  spinning disk is read by one worker only, an SSD by several. The
+ *  biggest listfiles are checked first. The results are shown in the
+ *  usual order afterwards.
+ ******************************************************************************
+ */
+
+typedef struct
+ {
+  DiffInfo **list;
+  char      *p_path;
+  BOOL       f_frames;
+ } CheckJobs;
+
+static void check_job (APTR user_data, LONG job)
+ {
+  CheckJobs *jobs = (CheckJobs *) user_data;
+
+  if ((!jobs->f_frames) || (!checkfile_frames (jobs->p_path, jobs->list[job], FALSE)))
+   checkfile_crc (jobs->p_path, jobs->list[job], FALSE);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   checkall_workers
+ *
+ * Parameters:  diffinfo, ad_cmds
+ *
+ * Returns:     RET_OK or RET_ERROR (no memory)
+ *
+ * Comments:    The messages are the same as with checkfile_crc and
+ *              checkfile_frames, without progress.
+ *-----------------------------------------------------------------------------
+ */
+
+int checkall_workers(DiffInfo *diffinfo, AD_Commands *ad_cmds)
+ {
+  IMDB_Schedule *schedule = NULL;
+  CheckJobs      jobs;
+  DiffInfo      *t_diffinfo;
+  char           listfile[256];
+  LONG           nb_lists = 0;
+  LONG           i;
+
+  for (t_diffinfo = diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next)
+   nb_lists++;
+  if (0 == nb_lists)
+   return (RET_OK);
+
+  jobs.p_path   = ad_cmds->p_list;
+  jobs.f_frames = ad_cmds->f_frames;
+  if ((NULL == (jobs.list = IMDBAllocMemory (nb_lists * sizeof (DiffInfo *))))
+    ||(NULL == (schedule = IMDBOpenSchedule (nb_lists, ad_cmds->dev_limit))))
+   {
+    printf("Can't allocate memory for the workers\n");
+    if (jobs.list) IMDBFreeMemory (jobs.list);
+    return (RET_ERROR);
+   }
+
+  for (i = 0, t_diffinfo = diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next, i++)
+   {
+    jobs.list[i] = t_diffinfo;
+    if (jobs.p_path)
+     strcpy (listfile, jobs.p_path);
+    else
+     listfile[0] = '\0';
+    strncat(listfile, t_diffinfo->fname_list, 255-strlen(listfile));
+    IMDBScheduleJob (schedule, i, listfile);
+   }
+
+  IMDBRunSchedule (schedule, ad_cmds->nb_workers, check_job, &jobs);
+
+  /* results in the order of the listfiles */
+  if (!ad_cmds->f_quiet)
+   for (i = 0; i < nb_lists; i++)
+    {
+     t_diffinfo = jobs.list[i];
+     printf ("Check CRC of File %s ", t_diffinfo->fname_list);
+     if (t_diffinfo->f_frames)
+      {
+       if (STATUS_OK == t_diffinfo->status)
+        printf ("- Frames O.K.\n");
+       else
+        printf ("- Frame damaged at byte %li\n", t_diffinfo->damaged);
+      }
+     else
+     if (STATUS_OK == t_diffinfo->status)
+      printf ("- CRC O.K.\n");
+     else
+     if (STATUS_CRC == t_diffinfo->status)
+      printf ("- CRC Error\n");
+     else
+      printf ("- CRC not available\n");
+     if (NULL == t_diffinfo->next)
+      printf ("\n");
+    }
+
+  IMDBCloseSchedule (schedule);
+  IMDBFreeMemory (jobs.list);
+  return (RET_OK);
+ }
+
 /******************************************************************************
  *  Main - Procedure
  ******************************************************************************
@@ -369,7 +602,7 @@ CRC: 0x408ADC16  File: crazy-credits.list  Date: Fri Sep 27 01:00:00 1996
 
 int main(int argc, char *argv[])
  {
-  AD_Commands  ad_cmds  = {NULL, FALSE, FALSE, NULL};
+  AD_Commands  ad_cmds  = {NULL, FALSE, FALSE, NULL, FALSE, NULL, NULL, NULL, 0, 0, 0};
   DiffInfo    *diffinfo = NULL;
   DiffInfo    *t_diffinfo = NULL;
   DiffInfo    *a_diffinfo = NULL;
@@ -387,8 +620,8 @@ int main(int argc, char *argv[])
   /* Parse command line parameters */
 #ifdef SYS_AMIGA
   {
-   static const char Template[]    = "LIST/A,NOSTATS/S,QUIET/S,LOGFILE/K";
-   AD_Commands       cmdlineparams = {NULL, FALSE, FALSE, NULL};
+   static const char Template[]    = "LIST/A,NOSTATS/S,QUIET/S,LOGFILE/K,FRAMES/S,WORKERS/K/N,DEVLIMIT/K/N,MEMORY/K/N";
+   AD_Commands       cmdlineparams = {NULL, FALSE, FALSE, NULL, FALSE, NULL, NULL, NULL, 0, 0, 0};
    struct RDArgs    *rda;
    LONG              len;
    char              c;
@@ -408,6 +641,13 @@ int main(int argc, char *argv[])
 
    ad_cmds.f_nostats  = cmdlineparams.f_nostats ;
    ad_cmds.f_quiet    = cmdlineparams.f_quiet   ;
+   ad_cmds.f_frames   = cmdlineparams.f_frames  ;
+   if (cmdlineparams.p_workers)
+    ad_cmds.nb_workers = *cmdlineparams.p_workers;
+   if (cmdlineparams.p_devlimit)
+    ad_cmds.dev_limit  = *cmdlineparams.p_devlimit;
+   if (cmdlineparams.p_memory)
+    ad_cmds.memory     = *cmdlineparams.p_memory;
 
    if (cmdlineparams.p_logfile)
     if (ad_cmds.p_logfile = IMDBAllocMemory (1+ strlen(cmdlineparams.p_logfile)))
@@ -426,7 +666,7 @@ int main(int argc, char *argv[])
 
 #ifdef SYS_UNIX
   {
-   static const char Template[] = "usage: CheckCRC <list(s)> [-nostats][-quiet][-logfile <filename>]";
+   static const char Template[] = "usage: CheckCRC <list(s)> [-nostats][-quiet][-logfile <filename>][-frames][-workers <n>][-devlimit <n>][-memory <kbytes>]";
    LONG              i;
 
    if (argc <2)
@@ -453,6 +693,18 @@ int main(int argc, char *argv[])
      if (!strcmp(argv[i], "-quiet"))
       ad_cmds.f_quiet    = TRUE;
      else
+     if (!strcmp(argv[i], "-frames"))
+      ad_cmds.f_frames   = TRUE;
+     else
+     if ((!strcmp(argv[i], "-workers")) && (i+1 < argc))
+      ad_cmds.nb_workers = atol (argv[++i]);
+     else
+     if ((!strcmp(argv[i], "-devlimit")) && (i+1 < argc))
+      ad_cmds.dev_limit  = atol (argv[++i]);
+     else
+     if ((!strcmp(argv[i], "-memory")) && (i+1 < argc))
+      ad_cmds.memory     = atol (argv[++i]);
+     else
      if (!strcmp(argv[i], "-logfile"))
       {
        if (ad_cmds.p_logfile = IMDBAllocMemory (2 + strlen(argv[++i])))
@@ -482,6 +734,10 @@ int main(int argc, char *argv[])
    printf ("Logfile: -none-\n");
 #endif
 
+  /* MEMORY: budget of all file-buffers */
+  if (ad_cmds.memory > 0)
+   IMDBSetMemoryBudget (ad_cmds.memory * 1024);
+
   /* Create CRC-Table */
   if (!(pCrcTab = InitCRC()))
    {
@@ -490,11 +746,7 @@ int main(int argc, char *argv[])
    }
 
   /* Do we want check a single file or a whole directory? */
-#ifdef SYS_AMIGA
-  if ((strlen(filename) > 5) && (0 == strnicmp(&filename[strlen(filename)-5], ".list", 5)))
-#else
-  if ((strlen(filename) > 5) && (0 == strncmp(&filename[strlen(filename)-5], ".list", 5)))
-#endif
+  if (IsListName (filename))
    {
     IMDB_Buffer *list_buffer;
 
@@ -509,6 +761,8 @@ int main(int argc, char *argv[])
         diffinfo->filesize = 0;
         diffinfo->filedate[0] = '\0';;
         diffinfo->status = STATUS_OK;
+        diffinfo->f_frames = FALSE;
+        diffinfo->damaged = 0;
        }
       ad_cmds.p_list = NULL; /* there is only one file with the complete pathname */ 
      }
@@ -535,8 +789,7 @@ int main(int argc, char *argv[])
         {
          while ((ExNext(lock,fib)) && (ret_val != RET_ERROR))
           {
-           if ((fib->fib_DirEntryType <= 0) && (strlen(fib->fib_FileName) > 5)
-            && (0 == strnicmp(&fib->fib_FileName[strlen(fib->fib_FileName)-5], ".list", 5)))
+           if ((fib->fib_DirEntryType <= 0) && (IsListName (fib->fib_FileName)))
             {
              /* Create and initialize DiffInfo */ 
              if (a_diffinfo = IMDBAllocMemory (sizeof (DiffInfo)))
@@ -546,6 +799,8 @@ int main(int argc, char *argv[])
                a_diffinfo->filesize = 0;
                a_diffinfo->filedate[0] = '\0';;
                a_diffinfo->status = STATUS_OK;
+               a_diffinfo->f_frames = FALSE;
+               a_diffinfo->damaged = 0;
               }
              else
               {
@@ -618,7 +873,7 @@ int main(int argc, char *argv[])
       {
        while (dp = readdir(dfd))
         {
-         if ((strlen (dp->d_name) <=5 ) || (0 != strncmp(&dp->d_name[strlen(dp->d_name)-5], ".list", 5)))
+         if (!IsListName (dp->d_name))
           continue;
                                   
          /* Create and initialize DiffInfo */ 
@@ -632,6 +887,8 @@ printf ("-> %s\n", a_diffinfo->fname_list);
            a_diffinfo->filesize = 0;
            a_diffinfo->filedate[0] = '\0';;
            a_diffinfo->status = STATUS_OK;
+           a_diffinfo->f_frames = FALSE;
+           a_diffinfo->damaged = 0;
           }
          else
           {
@@ -677,6 +934,11 @@ printf ("-> %s\n", a_diffinfo->fname_list);
  
   printf ("\n");
  
+  /* WORKERS: several listfiles are checked at once */
+  if ((RET_OK == ret_val) && (ad_cmds.nb_workers > 1))
+   ret_val = checkall_workers (diffinfo, &ad_cmds);
+  else
+
   /* check CRC-sum of the listfiles  */
   if (RET_OK == ret_val)
    {
@@ -690,7 +952,9 @@ printf ("-> %s\n", a_diffinfo->fname_list);
         printf ("Check CRC of File %s (000%%)", t_diffinfo->fname_list);
         fflush (stdout);
        }
-      checkfile_crc (ad_cmds.p_list, t_diffinfo, !ad_cmds.f_quiet);
+      /* FRAMES: compressed listfiles with block-index are checked frame by frame */
+      if ((!ad_cmds.f_frames) || (!checkfile_frames (ad_cmds.p_list, t_diffinfo, !ad_cmds.f_quiet)))
+       checkfile_crc (ad_cmds.p_list, t_diffinfo, !ad_cmds.f_quiet);
       t_diffinfo = t_diffinfo->next;
      }
     if (!ad_cmds.f_quiet)
@@ -0,0 +1,771 @@
+/*============================================================================
+ *
+ *  Program:      ChunkList.c
+ *
+ *  Version:      1.0 (19.10.26)
+ *
+ *  Purpose:      Stores a listfile as chunk-files with a manifest, so
+ *                ApplyDiffs only writes the chunks that are changed by
+ *                the diffs. Checks a chunked listfile or exports it as a
+ *                plain listfile again.
+ *
+ *                #define either SYS_AMIGA or SYS_UNIX (see below)
+ *
+ *                AMIGA-Commandline-Options:
+ *
+ *                   LIST/A       filename of the listfile (*.list or, with
+ *                                zlib, *.list.gz)
+ *                   EXPORT/K     write the chunked listfile to this file
+ *                   LINES/K/N    lines per chunk (default 20000)
+ *                   QUIET/S      don't show progress
+ *
+ *
+ *                UNIX-Commandline-Options:
+ *
+ *                   <list>       filename of the listfile (*.list or, with
+ *                                zlib, *.list.gz)
+ *                  optional:
+ *                   -export      write the chunked listfile to this file
+ *                   -lines       lines per chunk (default 20000)
+ *                   -quiet       don't show progress
+ *
+ *
+ *  Copyright:    (c) Internet MovieDatabase Limited 1990 - 2001
+ *
+ *       This file is part of the Internet MovieDatabase project.
+ *
+ *  The  MovieDatabase  FAQ contains more information on the whole project.
+ *  For   a   copy   send  an  e-mail   with  the  subject  "HELP  FAQ"  to
+ *  <mail-server@imdb.com>.
+ *
+ *  Permission  is  granted  to make and distribute verbatim copies of this
+ *  package  provided  the  copyright notice and this permission notice are
+ *  preserved  on  all  copies  and the package is distributed in unaltered
+ *  archive  form only.  It is not allowed to modify the source code and/or
+ *  redistribute  modified  copies  of  it  and/or  the executables without
+ *  written permission of the author.
+ *
+ *  If  you need to make a change to the source-code in order to be able to
+ *  use the package, you have to notify the author.
+ *
+ *  No guarantee of any kind is given that the programs and scripts in this
+ *  package  are  100%  reliable.  You are using this material at your  own
+ *  risk.   The  author  cannot be made responsible for any damage which is
+ *  caused by using these programs.
+ *
+ *  This  package  is  freely  distributable,  but still copyright by  IMDb
+ *  Ltd.
+ *
+ *  None  of  the programs or scripts nor the source code (nor parts of it)
+ *  may  be  included  or  used  in  commercial  programs unless by written
+ *  permission from the author.
+ *
+ *============================================================================
+ */
+
+/* some defines (specified by the Makefile) */
+/*#define SYS_AMIGA */
+/*#define SYS_UNIX  */
+/*#define IMDB_DEBUG*/
+
+/* ************************* */
+
+#include "IMDB.h"
+
+#ifdef SYS_AMIGA
+#include <clib/exec_protos.h>
+#include <dos/dos.h>
+#include <clib/dos_protos.h>
+#include <Exec/Memory.h>
+#endif /* SYS_AMIGA */
+
+#ifdef SYS_UNIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif /* SYS_UNIX*/
+
+#define VERSION "ChunkList 1.0 (19.10.26)"
+static const char version[] ="$VER: "VERSION;
+
+/* Return values */
+#define RET_OK              0
+#define RET_WARNING        10
+#define RET_ERROR          20
+
+/* buffer sizes */
+#define ADV_BUFFER_SIZE    512 * 1024
+#define ADV_MAX_LINESIZE     8 * 1024
+
+/* lines per chunk */
+#ifndef ADV_CHUNK_LINES
+#define ADV_CHUNK_LINES  20000
+#endif
+
+typedef struct
+ {
+  char *p_list;
+  char *p_export;
+  LONG *p_lines;
+  LONG  f_quiet;
+ } AD_Commands;
+
+AD_Commands ad_cmds = {NULL, NULL, NULL, FALSE};
+
+/******************************************************************************
+ * Functions dealing with CRC-sum
+ ******************************************************************************
+ */
+
+ /* global variable for tab */
+ ULONG *pCrcTab = NULL;
+ ULONG nCrc = 0xFFFFFFFFL;
+ int nIndex;
+
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   InitCRC
+ *
+ * Purpose:     This function initializes the CRC-32 algorithm by setting a private
+ *              pre  calculation  table  in the memory.  This table is used
+ *              for all further CRC-32 calculations.
+ *
+ * Parameters:  none
+ *
+ * Returns:     Pointer to CRC-Table
+ *-----------------------------------------------------------------------------
+ */
+
+u_long *InitCRC(void)
+{
+  u_long *p_crc_tab = NULL;
+  int i;
+  int j;
+
+  u_char ib[8];
+  u_char lb[32];
+
+
+  /* allocate memory for table */
+  if ((p_crc_tab = malloc(256*sizeof(u_long))))
+   {  
+    /* initialize table with calculated bits */
+    for (i=0; i<256; i++)
+     {
+       /* reset bits */
+       for (j=0; j<8;j++)
+	 ib[j]=(i>>(7-j))&1;
+       for (j=0; j<32;j++)
+	 lb[j]=0;
+
+       /* calculate values */
+       lb[31]=      ib[1]                              ^ib[7];
+       lb[30]=ib[0]^ib[1]                        ^ib[6]^ib[7];
+       lb[29]=ib[0]^ib[1]                  ^ib[5]^ib[6]^ib[7];
+       lb[28]=ib[0]                  ^ib[4]^ib[5]^ib[6];
+       lb[27]=      ib[1]      ^ib[3]^ib[4]^ib[5]      ^ib[7];
+       lb[26]=ib[0]^ib[1]^ib[2]^ib[3]^ib[4]      ^ib[6]^ib[7];
+       lb[25]=ib[0]^ib[1]^ib[2]^ib[3]      ^ib[5]^ib[6];
+       lb[24]=ib[0]      ^ib[2]      ^ib[4]^ib[5]      ^ib[7];
+       lb[23]=                  ib[3]^ib[4]      ^ib[6]^ib[7];
+       lb[22]=            ib[2]^ib[3]      ^ib[5]^ib[6];
+       lb[21]=            ib[2]      ^ib[4]^ib[5]      ^ib[7];
+       lb[20]=                  ib[3]^ib[4]      ^ib[6]^ib[7];
+       lb[19]=      ib[1]^ib[2]^ib[3]      ^ib[5]^ib[6]^ib[7];
+       lb[18]=ib[0]^ib[1]^ib[2]      ^ib[4]^ib[5]^ib[6];
+       lb[17]=ib[0]^ib[1]      ^ib[3]^ib[4]^ib[5];
+       lb[16]=ib[0]      ^ib[2]^ib[3]^ib[4];
+       lb[15]=            ib[2]^ib[3]                  ^ib[7];
+       lb[14]=      ib[1]^ib[2]                  ^ib[6];
+       lb[13]=ib[0]^ib[1]                  ^ib[5];
+       lb[12]=ib[0]                  ^ib[4];
+       lb[11]=                  ib[3];
+       lb[10]=            ib[2];
+       lb[ 9]=                                          ib[7];
+       lb[ 8]=      ib[1]                        ^ib[6]^ib[7];
+       lb[ 7]=ib[0]                        ^ib[5]^ib[6];
+       lb[ 6]=                        ib[4]^ib[5];
+       lb[ 5]=      ib[1]      ^ib[3]^ib[4]            ^ib[7];
+       lb[ 4]=ib[0]      ^ib[2]^ib[3]            ^ib[6];
+       lb[ 3]=      ib[1]^ib[2]            ^ib[5];
+       lb[ 2]=ib[0]^ib[1]            ^ib[4];
+       lb[ 1]=ib[0]            ^ib[3];
+       lb[ 0]=            ib[2];
+      
+       /* store value */
+       p_crc_tab[i]=0;
+       for (j=0; j<32;j++)
+	 p_crc_tab[i]|=lb[j]<<(31-j);
+     }
+   }
+  return (p_crc_tab);
+}
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   calc_crc
+ *
+ * Purpose:     calc crc of string. Automatically adds crc for '\n'
+ *
+ * Parameters:  
+ *
+ * Returns:     
+ *-----------------------------------------------------------------------------
+ */
+
+void calc_crc (char *str, ULONG *nCrc)
+ {
+  while (*str)
+   {
+    nIndex = (int) ((*nCrc ^ *str++) & 0x000000FFL);
+    *nCrc = ((*nCrc >> 8) & 0x00FFFFFFL) ^ pCrcTab[nIndex];
+   }
+
+  /* add '\n' */
+  nIndex = (int) ((*nCrc ^ '\n') & 0x000000FFL);
+  *nCrc = ((*nCrc >> 8) & 0x00FFFFFFL) ^ pCrcTab[nIndex];
+ }
+
+/******************************************************************************
+ *
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   StrHasSuffix
+ *
+ * Returns:     TRUE, if p_str ends with p_suffix
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL StrHasSuffix (char *p_str, char *p_suffix)
+ {
+  LONG len = strlen (p_str);
+  LONG len_suffix = strlen (p_suffix);
+
+  if (len <= len_suffix)
+   return (FALSE);
+#ifdef SYS_AMIGA
+  return ((BOOL) (0 == strnicmp (&p_str[len-len_suffix], p_suffix, len_suffix)));
+#else
+  return ((BOOL) (0 == strncmp (&p_str[len-len_suffix], p_suffix, len_suffix)));
+#endif
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   GzipFlag
+ *
+ * Returns:     IMDBV_FILE_GZIP for compressed files (with IMDB_ZLIB)
+ *-----------------------------------------------------------------------------
+ */
+
+LONG GzipFlag (char *p_name)
+ {
+#ifdef IMDB_ZLIB
+  if (StrHasSuffix (p_name, ".gz"))
+   return (IMDBV_FILE_GZIP);
+#endif
+  return (0);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   show_progress
+ *
+ * Purpose:     print (xxx%)
+ *-----------------------------------------------------------------------------
+ */
+
+static void show_progress (LONG pos, LONG size, LONG *p_progress)
+ {
+  LONG progress;
+
+  if ((!ad_cmds.f_quiet) && (size > 0)
+    &&(*p_progress != (progress = ((pos>>7)*100/((size>>7)+1)))))
+   {
+    *p_progress = progress;
+    printf ("\b\b\b\b\b\b(%03li%%)", progress);
+    fflush (stdout);
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   close_chunk
+ *
+ * Purpose:     finish a chunk-file and add it to the manifest
+ *
+ * Returns:     TRUE if O.K.
+ *-----------------------------------------------------------------------------
+ */
+
+static BOOL close_chunk (IMDB_Manifest *manifest, IMDB_Buffer *out, char *chunkname, LONG id, LONG lines, ULONG crc)
+ {
+  char fname [256];
+  LONG size = out->filepos;
+
+  IMDBChunkName (fname, chunkname, id);
+  return ((BOOL) ((IMDBE_NO_ERROR == IMDBCloseBuffer (out)) && (IMDBE_NO_ERROR == IMDBSyncFile (fname))
+                &&(IMDBE_NO_ERROR == IMDBAddChunk (manifest, id, lines, size, crc))));
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   remove_chunks
+ *
+ * Purpose:     remove all chunk-files of a manifest
+ *-----------------------------------------------------------------------------
+ */
+
+static void remove_chunks (IMDB_Manifest *manifest, char *chunkname)
+ {
+  char fname [256];
+  LONG i;
+
+  for (i = 0; i < manifest->nb_chunks; i++)
+   {
+    IMDBChunkName (fname, chunkname, manifest->chunks[i].id);
+    remove (fname);
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   SplitList
+ *
+ * Purpose:     write a listfile as chunk-files with a manifest and remove
+ *              the listfile. Nothing is changed if the CRC of the listfile
+ *              is wrong.
+ *
+ * Parameters:  listfile     filename of the listfile
+ *              chunkname    filename of the chunked listfile (without .gz)
+ *              chunk_lines  lines per chunk
+ *
+ * Returns:     RET_OK, RET_WARNING or RET_ERROR
+ *-----------------------------------------------------------------------------
+ */
+
+int SplitList (char *listfile, char *chunkname, LONG chunk_lines)
+ {
+  IMDB_Manifest *manifest;
+  IMDB_Buffer   *list_buffer;
+  IMDB_Buffer   *out      = NULL;
+  char           fname [256];
+  char           newname [256];
+  char           old_crc [16];
+  char           new_crc [16];
+  char          *p_line;
+  LONG           progress = 0;
+  LONG           lines    = 0;
+  LONG           out_id   = 0;
+  LONG           out_lines= 0;
+  ULONG          out_crc  = 0;
+  BOOL           f_ok     = TRUE;
+
+  sprintf (fname, "%.240s" IMDBV_CHUNKS_EXT, chunkname);
+  if (IMDBExistFile (fname))
+   {
+    printf ("\b\b\b\b\b\b- Error: %s exists already\n", fname);
+    return (RET_ERROR);
+   }
+  if (NULL == (manifest = IMDBCreateManifest (chunk_lines, 1)))
+   {
+    printf ("\b\b\b\b\b\b- Error: Not enough memory\n");
+    return (RET_ERROR);
+   }
+  if (NULL == (list_buffer = IMDBOpenBuffer (listfile, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE|GzipFlag (listfile), ADV_BUFFER_SIZE)))
+   {
+    printf ("\b\b\b\b\b\b- Error: Can't open %s\n", listfile);
+    IMDBFreeManifest (manifest);
+    return (RET_ERROR);
+   }
+
+  /* CRC of the listfile: all lines but the first */
+  nCrc = 0xFFFFFFFFL;
+  old_crc[0] = '\0';
+
+  while ((f_ok) && (0 == IMDBReadBufferLine (list_buffer, &p_line, ADV_MAX_LINESIZE)))
+   {
+    show_progress (list_buffer->filepos, list_buffer->filesize, &progress);
+
+    if (0 == lines++)
+     strncpy (old_crc, p_line, 15);
+    else
+     calc_crc (p_line, &nCrc);
+    old_crc[15] = '\0';
+
+    /* next chunk-file */
+    if (NULL == out)
+     {
+      out_id    = manifest->next_id;
+      out_lines = 0;
+      out_crc   = 0xFFFFFFFFL;
+      IMDBChunkName (newname, chunkname, out_id);
+      if (NULL == (out = IMDBOpenBuffer (newname, IMDBV_FILE_WRITE, ADV_BUFFER_SIZE)))
+       {
+        f_ok = FALSE;
+        break;
+       }
+     }
+    if ((IMDBWriteBuffer (out, p_line, strlen (p_line))) || (IMDBWriteBuffer (out, "\n", 1)))
+     f_ok = FALSE;
+    calc_crc (p_line, &out_crc);
+
+    if (++out_lines == chunk_lines)
+     {
+      if (!close_chunk (manifest, out, chunkname, out_id, out_lines, out_crc))
+       f_ok = FALSE;
+      out = NULL;
+     }
+   }
+  if ((out) && (!close_chunk (manifest, out, chunkname, out_id, out_lines, out_crc)))
+   f_ok = FALSE;
+  IMDBCloseBuffer (list_buffer);
+
+  if (!f_ok)
+   printf ("\b\b\b\b\b\b- Error: Can't write chunk-file\n");
+  else
+   {
+    /* don't split a damaged listfile */
+    sprintf (new_crc, "CRC: 0x%08lX", (ULONG) (nCrc & 0xFFFFFFFFL));
+    if (0 != strcmp (old_crc, new_crc))
+     {
+      printf ("\b\b\b\b\b\b- CRC Error\n");
+      f_ok = FALSE;
+     }
+    else
+     {
+      /* the manifest is renamed, so it is complete or not there */
+      sprintf (newname, "%.240s" IMDBV_CHUNKS_EXT ".new", chunkname);
+      if ((IMDBWriteManifest (manifest, newname)) || (rename (newname, fname)))
+       {
+        printf ("\b\b\b\b\b\b- Error: Can't write %s\n", fname);
+        remove (newname);
+        f_ok = FALSE;
+       }
+     }
+   }
+
+  if (f_ok)
+   {
+    if (!ad_cmds.f_quiet)
+     printf ("\b\b\b\b\b\b- CRC O.K., %li lines in %li chunks\n", lines, manifest->nb_chunks);
+    /* the listfile and its block-index are not needed anymore */
+    sprintf (newname, "%.240s" IMDBV_FILE_INDEX_EXT, listfile);
+    remove (newname);
+    remove (listfile);
+   }
+  else
+   remove_chunks (manifest, chunkname);
+
+  IMDBFreeManifest (manifest);
+  return ((f_ok) ? RET_OK : RET_WARNING);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ExportList
+ *
+ * Purpose:     check every chunk of a chunked listfile (lines, size and
+ *              CRC) and the CRC of the whole listfile. With EXPORT the
+ *              listfile is written as a plain file. If it is written to
+ *              the name of the listfile itself, the chunks are removed.
+ *
+ * Parameters:  chunkname  filename of the chunked listfile
+ *              p_export   filename of the plain listfile or NULL
+ *
+ * Returns:     RET_OK, RET_WARNING or RET_ERROR
+ *-----------------------------------------------------------------------------
+ */
+
+int ExportList (char *chunkname, char *p_export)
+ {
+  IMDB_Manifest *manifest;
+  IMDB_Chunk    *chunk;
+  IMDB_Buffer   *chunk_buffer;
+  IMDB_Buffer   *out      = NULL;
+  char           fname [256];
+  char           outname [256];
+  char           old_crc [16];
+  char           new_crc [16];
+  char          *p_line;
+  LONG           progress = 0;
+  LONG           total    = 0;
+  LONG           done     = 0;
+  LONG           lines    = 0;
+  LONG           size;
+  LONG           i;
+  ULONG          crc;
+  BOOL           f_ok     = TRUE;
+  BOOL           f_rejoin = (BOOL) ((p_export) && (0 == strcmp (p_export, chunkname)));
+
+  /* the listfile itself is written under a temporary name */
+  if (p_export)
+   sprintf (outname, (f_rejoin) ? "%.240s.new" : "%.250s", p_export);
+
+  sprintf (fname, "%.240s" IMDBV_CHUNKS_EXT, chunkname);
+  if (NULL == (manifest = IMDBReadManifest (fname)))
+   {
+    printf ("\b\b\b\b\b\b- Error: Can't read %s\n", fname);
+    return (RET_ERROR);
+   }
+  if ((p_export)
+    &&(NULL == (out = IMDBOpenBuffer (outname, IMDBV_FILE_WRITE|GzipFlag (p_export), ADV_BUFFER_SIZE))))
+   {
+    printf ("\b\b\b\b\b\b- Error: Can't open %s\n", p_export);
+    IMDBFreeManifest (manifest);
+    return (RET_ERROR);
+   }
+
+  for (i = 0; i < manifest->nb_chunks; i++)
+   total += manifest->chunks[i].size;
+
+  nCrc = 0xFFFFFFFFL;
+  old_crc[0] = '\0';
+
+  for (i = 0; (f_ok) && (i < manifest->nb_chunks); i++)
+   {
+    chunk = &manifest->chunks[i];
+    IMDBChunkName (fname, chunkname, chunk->id);
+    if (NULL == (chunk_buffer = IMDBOpenBuffer (fname, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE, ADV_BUFFER_SIZE)))
+     {
+      printf ("\b\b\b\b\b\b- Error: Can't open %s\n", fname);
+      f_ok = FALSE;
+      break;
+     }
+
+    size = chunk_buffer->filesize;
+    crc  = 0xFFFFFFFFL;
+    while ((f_ok) && (0 == IMDBReadBufferLine (chunk_buffer, &p_line, ADV_MAX_LINESIZE)))
+     {
+      show_progress (done + chunk_buffer->filepos, total, &progress);
+
+      if (0 == lines++)
+       {
+        strncpy (old_crc, p_line, 15);
+        old_crc[15] = '\0';
+       }
+      else
+       calc_crc (p_line, &nCrc);
+      calc_crc (p_line, &crc);
+
+      if ((out) && ((IMDBWriteBuffer (out, p_line, strlen (p_line))) || (IMDBWriteBuffer (out, "\n", 1))))
+       {
+        printf ("\b\b\b\b\b\b- Error: Can't write %s\n", p_export);
+        f_ok = FALSE;
+       }
+     }
+    IMDBCloseBuffer (chunk_buffer);
+    done += size;
+
+    if ((f_ok) && ((size != chunk->size) || ((crc & 0xFFFFFFFFL) != chunk->crc) || (lines != chunk->first + chunk->lines - 1)))
+     {
+      printf ("\b\b\b\b\b\b- Chunk damaged: %s (lines %li-%li)\n", fname, chunk->first, chunk->first + chunk->lines - 1);
+      f_ok = FALSE;
+     }
+   }
+
+  if ((out) && (IMDBCloseBuffer (out)) && (f_ok))
+   {
+    printf ("\b\b\b\b\b\b- Error: Can't write %s\n", p_export);
+    f_ok = FALSE;
+   }
+
+  if (f_ok)
+   {
+    sprintf (new_crc, "CRC: 0x%08lX", (ULONG) (nCrc & 0xFFFFFFFFL));
+    if (0 != strcmp (old_crc, new_crc))
+     {
+      printf ("\b\b\b\b\b\b- CRC Error\n");
+      f_ok = FALSE;
+     }
+    else
+    if (!ad_cmds.f_quiet)
+     printf ("\b\b\b\b\b\b- CRC O.K., %li lines in %li chunks\n", lines, manifest->nb_chunks);
+   }
+
+  /* the listfile is plain again: the chunks are not needed anymore */
+  if ((f_ok) && (f_rejoin))
+   {
+    if ((IMDBSyncFile (outname)) || (rename (outname, chunkname)))
+     {
+      printf ("\b\b\b\b\b\b- Error: Can't write %s\n", p_export);
+      f_ok = FALSE;
+     }
+    else
+     {
+      remove_chunks (manifest, chunkname);
+      sprintf (fname, "%.240s" IMDBV_CHUNKS_EXT, chunkname);
+      remove (fname);
+     }
+   }
+  if ((!f_ok) && (p_export))
+   remove (outname);
+
+  IMDBFreeManifest (manifest);
+  return ((f_ok) ? RET_OK : RET_WARNING);
+ }
+
+/******************************************************************************
+ *  Main - Procedure
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   main
+ *
+ * Parameters:  nb_args, filename
+ *
+ * Returns:
+ *
+ * Comments:    A plain listfile is split, a chunked listfile is checked
+ *              or exported.
+ *-----------------------------------------------------------------------------
+ */
+
+int main(int argc, char *argv[])
+ {
+  static char chunkname[256];
+  LONG        chunk_lines    = ADV_CHUNK_LINES;
+  int         ret_val        = RET_OK;
+
+  printf (VERSION" - part of the DiffTools; (c) 1996-2001 IMDb Ltd.\n");
+
+  /* Parse command line parameters */
+#ifdef SYS_AMIGA
+  {
+   static const char Template[]    = "LIST/A,EXPORT/K,LINES/K/N,QUIET/S";
+   AD_Commands       cmdlineparams = {NULL, NULL, NULL, FALSE};
+   struct RDArgs    *rda;
+
+   rda = ReadArgs((char*) Template, (LONG *) &cmdlineparams, NULL);
+
+   /* Get values */
+   if (cmdlineparams.p_list)
+    if (ad_cmds.p_list = IMDBAllocMemory (1+ strlen(cmdlineparams.p_list)))
+     strcpy(ad_cmds.p_list, cmdlineparams.p_list);
+
+   if (cmdlineparams.p_export)
+    if (ad_cmds.p_export = IMDBAllocMemory (1+ strlen(cmdlineparams.p_export)))
+     strcpy(ad_cmds.p_export, cmdlineparams.p_export);
+
+   if (cmdlineparams.p_lines)
+    chunk_lines = *cmdlineparams.p_lines;
+
+   ad_cmds.f_quiet    = cmdlineparams.f_quiet   ;
+
+   /* Free ReadArgs parameters */
+   if (NULL == rda)
+    {
+     printf ("Template: %s\n",Template);
+     exit (RET_ERROR);
+    }
+   else
+    FreeArgs(rda);
+  }
+#endif
+
+#ifdef SYS_UNIX
+  {
+   static const char Template[] = "usage: ChunkList <list> [-export <filename>][-lines <n>][-quiet]";
+   LONG              i;
+
+   if (argc <2)
+    {
+     puts (Template);
+     exit (10);
+    }
+
+   /* listfile */
+   if (ad_cmds.p_list = IMDBAllocMemory (1 + strlen(argv[1])))
+    strcpy(ad_cmds.p_list, argv[1]);
+
+   /* Parse Command Line Parameters */
+   for (i=2; i < argc; i++)
+    {
+     if (!strcmp(argv[i], "-quiet"))
+      ad_cmds.f_quiet    = TRUE;
+     else
+     if ((!strcmp(argv[i], "-export")) && (i+1 < argc))
+      {
+       if (ad_cmds.p_export = IMDBAllocMemory (1 + strlen(argv[++i])))
+        strcpy(ad_cmds.p_export, argv[i]);
+      }
+     else
+     if ((!strcmp(argv[i], "-lines")) && (i+1 < argc))
+      chunk_lines = strtol (argv[++i], NULL, 10);
+     else
+      {
+       puts (Template);
+       exit (10);
+      }
+    }
+
+   if (NULL == ad_cmds.p_list)
+    {
+     puts (Template);
+     exit (10);
+    }
+  }
+#endif
+
+  /* Check Syntax */
+  if (chunk_lines < 100)
+   {
+    printf("Error: A chunk must have at least 100 lines!\n");
+    exit (RET_ERROR);
+   }
+
+  /* the chunks of movies.list.gz are named like those of movies.list */
+  strncpy (chunkname, ad_cmds.p_list, 240);
+  if ((GzipFlag (chunkname)) && (StrHasSuffix (chunkname, ".list.gz")))
+   chunkname[strlen(chunkname)-3] = '\0';
+  if (!StrHasSuffix (chunkname, ".list"))
+   {
+    printf("Error: %s is no listfile!\n", ad_cmds.p_list);
+    exit (RET_ERROR);
+   }
+
+  /* Create CRC-Table */
+  if (!(pCrcTab = InitCRC()))
+   {
+    printf("Can't Create CRC-Table!\n");
+    exit (RET_ERROR);
+   }
+
+  printf ("\n");
+
+  /* plain listfile: split it, chunked listfile: check or export it */
+  if (IMDBExistFile (ad_cmds.p_list))
+   {
+    if (ad_cmds.p_export)
+     {
+      printf("Error: %s is not chunked!\n", ad_cmds.p_list);
+      ret_val = RET_ERROR;
+     }
+    else
+     {
+      if (!ad_cmds.f_quiet)
+       {
+        printf ("Split File %s (000%%)", ad_cmds.p_list);
+        fflush (stdout);
+       }
+      ret_val = SplitList (ad_cmds.p_list, chunkname, chunk_lines);
+     }
+   }
+  else
+   {
+    if (!ad_cmds.f_quiet)
+     {
+      printf ("%s File %s (000%%)", (ad_cmds.p_export) ? "Export" : "Check", chunkname);
+      fflush (stdout);
+     }
+    ret_val = ExportList (chunkname, ad_cmds.p_export);
+   }
+
+  /* Free CRC-Tab */
+  IMDBFreeMemory(pCrcTab);
+
+  /* Free memory */
+  if (ad_cmds.p_list) IMDBFreeMemory(ad_cmds.p_list);
+  if (ad_cmds.p_export) IMDBFreeMemory(ad_cmds.p_export);
+
+  if (RET_OK != ret_val)
+   printf ("\nWARNING: ChunkList encountered errors.\n");
+
+  exit (ret_val);
+ }
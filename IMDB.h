@@ -94,6 +94,10 @@
 #include <stdlib.h>
 #include <time.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*-----------------------------------------------------------------------------
  * Some typedefs & defines to make our life easier
  *-----------------------------------------------------------------------------
@@ -159,6 +163,9 @@
 #define IMDBE_FILE_EXIST            85 /* File does not exist */
 #define IMDBE_FILE_EOF              86 /* End of file */
 
+/* Format-Errors */
+#define IMDBE_SYNTAX                90 /* file has a wrong format */
+
 /* System-Errors */
 #define IMDBE_MEMORY                100
 
@@ -216,9 +223,21 @@ extern void IMDBResetError (IMDB_Error *error);
  * Memory is supposed to be allocated via these functions. 
  * These functions will be enhanced in the future by automatically using 
  * memory pools to prevent fragmentation of memory
+ *
+ * A memory budget limits the memory of all file-buffers and read-ahead/
+ * write-behind threads of the program together. With a budget a buffer
+ * gets at most half of the memory left (but IMDBV_BUDGET_MIN_BUFFER at
+ * least), a read-ahead thread is only started if its segments fit, and
+ * a schedule starts a new job only if IMDBV_BUDGET_JOB is left. So the
+ * program slows down instead of running out of memory. Without a budget
+ * the buffers have the size asked for. Buffers of plain files that are
+ * read are never bigger than the file.
  *-----------------------------------------------------------------------------
  */
 
+#define IMDBV_BUDGET_MIN_BUFFER (64*1024)    /* smallest buffer with a budget */
+#define IMDBV_BUDGET_JOB        (1024*1024)  /* memory left to start a job */
+
 #ifndef IMDB_RESOURCES_C
 
 /* Procedure:  IMDBAllocMemory
@@ -237,6 +256,22 @@ extern APTR IMDBAllocMemory (LONG size);
  */
 extern void IMDBFreeMemory  (APTR mem);
 
+/* Procedure:  IMDBSetMemoryBudget
+ * Purpose:    set the memory budget of the file-buffers
+ * Comment:    set it before any buffer is opened
+ * Parameters: size in bytes, 0: no budget
+ * Returns:    nothing
+ */
+extern void IMDBSetMemoryBudget (LONG size);
+
+/* Procedure:  IMDBMemoryLeft
+ * Purpose:    memory of the budget not used by buffers
+ * Comment:    may be less than 0, buffers are never refused
+ * Parameters: -
+ * Returns:    bytes left or 0x7FFFFFFF (no budget)
+ */
+extern LONG IMDBMemoryLeft (void);
+
 #endif
 
 
@@ -254,6 +289,12 @@ extern void IMDBFreeMemory  (APTR mem);
                                        /* max 3 */
 
 #define IMDBV_FILE_GETSIZE     (1<<4)  /* Get size of File */
+#define IMDBV_FILE_NULL        (1<<5)  /* write only: discard data, no file is created */
+#define IMDBV_FILE_GZIP        (1<<6)  /* file is gzip-compressed (IMDB_ZLIB), not with APPEND */
+#define IMDBV_FILE_CHUNKS      (1<<7)  /* read only: chunked listfile, fname without IMDBV_CHUNKS_EXT */
+#define IMDBV_FILE_THREAD      (1<<8)  /* plain file: read ahead/write behind by a thread (IMDB_THREADS) */
+
+#define IMDBV_FILE_INDEX_EXT   ".idx"  /* block-index of a compressed file (IMDB_THREADS) */
 
 /*-----------------------------------------------------------------------------
  * Functions for Filehandling (These functions are part of the library)
@@ -270,6 +311,52 @@ extern void IMDBFreeMemory  (APTR mem);
  */
 extern BOOL IMDBExistFile (char *fname);
 
+/* Procedure:  IMDBSyncFile
+ * Purpose:    write all data of a file or directory to the disk (fsync)
+ * Comment:
+ * Parameters: fname    filename
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ */
+extern LONG IMDBSyncFile (char *fname);
+
+/* Procedure:  IMDBSyncFileSystem
+ * Purpose:    write all data of a filesystem to the disk (syncfs)
+ * Comment:    returns IMDBE_NOTFOUND if not supported
+ * Parameters: path     any file or directory on the filesystem
+ * Returns:    IMDBE_NO_ERROR, IMDBE_NOTFOUND or IMDBE_FILE_WRITE
+ */
+extern LONG IMDBSyncFileSystem (char *path);
+
+/* Procedure:  IMDBTruncateFile
+ * Purpose:    cut a file to the given size
+ * Comment:    returns IMDBE_FILE_WRITE if not supported
+ * Parameters: fname    filename
+ *             size     new size in bytes
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ */
+extern LONG IMDBTruncateFile (char *fname, LONG size);
+
+/* Procedure:  IMDBCheckFrames
+ * Purpose:    check the CRC32 of every frame of a compressed file
+ * Comment:    needs the block-index (IMDB_THREADS), returns IMDBE_NOTFOUND
+ *             otherwise
+ * Parameters: fname    filename
+ *             p_size   uncompressed size of the file
+ *             p_pos    uncompressed position of the first damaged frame
+ * Returns:    IMDBE_NO_ERROR, IMDBE_NOTFOUND or IMDBE_FILE_READ
+ */
+extern LONG IMDBCheckFrames (char *fname, LONG *p_size, LONG *p_pos);
+
+/* Procedure:  IMDBHashLine
+ * Purpose:    calculate a 64-bit hash of a line
+ * Comment:    used for the deleted lines of hashed diffs
+ * Parameters: p_line   line
+ *             len      length of line
+ *             p_hash   array of two ULONGs
+ * Returns:    nothing
+ */
+extern void IMDBHashLine (char *p_line, LONG len, ULONG *p_hash);
+
 #endif
 
 /*-----------------------------------------------------------------------------
@@ -293,7 +380,7 @@ extern BOOL IMDBExistFile (char *fname);
  *-----------------------------------------------------------------------------
  */
 
-typedef struct
+typedef struct IMDB_BUFFER
  {
   IMDB_Error  error;             /* Error-Status */
   LONG  filesize;                /* total size of file in bytes */
@@ -305,6 +392,15 @@ typedef struct
   LONG  bufferpos;               /* actual position in buffer */
   LONG  nb_bytes_in_buffer;      /* Number of bytes in buffer */
   char *buffer;                  /* buffer  */
+  APTR  gzstream;                /* zlib-stream (IMDBV_FILE_GZIP) or NULL */
+  APTR  deflater;                /* parallel gzip-writer (IMDB_THREADS) or NULL */
+  APTR  inflater;                /* parallel gzip-reader (IMDB_THREADS) or NULL */
+  LONG  streampos;               /* position of stream (uncompressed) */
+  struct IMDB_BUFFER *archive;   /* section: buffer that owns the stream */
+  LONG  section_start;           /* section: start of section in archive */
+  LONG  section_pos;             /* section: position of next read */
+  APTR  chunks;                  /* reader of a chunked listfile (IMDBV_FILE_CHUNKS) or NULL */
+  APTR  pipe;                    /* read-ahead/write-behind thread (IMDBV_FILE_THREAD) or NULL */
  } IMDB_Buffer;
 
 /*-----------------------------------------------------------------------------
@@ -386,7 +482,515 @@ extern LONG IMDBReadBufferLine (IMDB_Buffer *p_buffer, APTR p_mem, LONG max_size
  */
 extern LONG IMDBWriteBuffer (IMDB_Buffer *p_buffer, APTR p_mem, LONG size);
 
+/* Procedure:  IMDBOpenBufferSection
+ * Purpose:    open a part of another buffer (e.g. a file in a tar-archive)
+ *             for reading
+ * Comment:    The archive must stay open while the section is used. It
+ *             must not be read directly anymore, only through sections.
+ * Parameters: archive  buffer that holds the section
+ *             start    position of the section in archive
+ *             size     size of the section
+ *             buffsize size of buffer
+ * Returns:    pointer to buffer or NULL if failed
+ */
+extern IMDB_Buffer *IMDBOpenBufferSection (IMDB_Buffer *p_archive, LONG start, LONG size, LONG buffsize);
+
+/* Procedure:  IMDBFlushBuffer
+ * Purpose:    write all data of the buffer to the file
+ * Comment:    Buffer needs to be in IMDB_FILE_WRITE mode
+ * Parameters: buffer  pointer to buffer
+ * Returns:    error-code
+ */
+extern LONG IMDBFlushBuffer (IMDB_Buffer *p_buffer);
+
+/* Procedure:  IMDBReserveBuffer
+ * Purpose:    reserve the disk space of a new file of known size
+ * Comment:    needs posix_fallocate() (IMDB_FALLOCATE), only for files
+ *             just opened with IMDBV_FILE_WRITE and not compressed
+ * Parameters: buffer  pointer to buffer
+ *             size    final size of the file in bytes
+ * Returns:    IMDBE_NO_ERROR, IMDBE_NOTFOUND or IMDBE_FILE_WRITE
+ */
+extern LONG IMDBReserveBuffer (IMDB_Buffer *p_buffer, LONG size);
+
+#endif
+
+/*-----------------------------------------------------------------------------
+ * General Information on chunked Listfiles
+ *-----------------------------------------------------------------------------
+ *
+ * A listfile can be stored as a number of chunk-files (movies.list.000001,
+ * ...) and a manifest (movies.list.chunks), that lists the chunks in order
+ * with their line-range, size and CRC. A changed chunk is written to a new
+ * chunk-file, so a listfile is changed by writing the manifest again.
+ *
+ * Manifest:   IMDB-Chunks 1
+ *             chunklines <lines per chunk when the listfile was split>
+ *             next <number of the next new chunk-file>
+ *             chunk <number> <first line> <lines> <size> <CRC>
+ *             ...
+ *             end <lines of the listfile>
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#define IMDBV_CHUNKS_EXT      ".chunks" /* manifest of a chunked listfile */
+#define IMDBV_CHUNKS_MAGIC    "IMDB-Chunks 1"
+
+typedef struct
+ {
+  LONG  id;                      /* number of the chunk-file */
+  LONG  first;                   /* number of the first line in the listfile */
+  LONG  lines;                   /* number of lines */
+  LONG  size;                    /* size in bytes */
+  ULONG crc;                     /* CRC of the lines (like the CRC-line) */
+ } IMDB_Chunk;
+
+typedef struct
+ {
+  LONG        chunk_lines;       /* lines per chunk when split */
+  LONG        next_id;           /* number of the next new chunk-file */
+  LONG        nb_chunks;         /* number of chunks */
+  LONG        max_chunks;        /* size of chunks */
+  IMDB_Chunk *chunks;            /* chunks in the order of the listfile */
+ } IMDB_Manifest;
+
+#ifndef IMDB_RESOURCES_C
+
+/* Procedure:  IMDBChunkName
+ * Purpose:    build the filename of a chunk-file
+ * Comment:    listfile.000001 ...
+ * Parameters: p_name   buffer (256 bytes)
+ *             listfile name of the listfile
+ *             id       number of the chunk-file
+ * Returns:    nothing
+ */
+extern void IMDBChunkName (char *p_name, char *listfile, LONG id);
+
+/* Procedure:  IMDBCreateManifest
+ * Purpose:    create an empty manifest
+ * Comment:
+ * Parameters: chunk_lines  lines per chunk
+ *             next_id      number of the first new chunk-file
+ * Returns:    pointer to manifest or NULL
+ */
+extern IMDB_Manifest *IMDBCreateManifest (LONG chunk_lines, LONG next_id);
+
+/* Procedure:  IMDBReadManifest
+ * Purpose:    read the manifest of a chunked listfile
+ * Comment:    the line-ranges are checked
+ * Parameters: fname    filename of the manifest
+ * Returns:    pointer to manifest or NULL if missing or damaged
+ */
+extern IMDB_Manifest *IMDBReadManifest (char *fname);
+
+/* Procedure:  IMDBAddChunk
+ * Purpose:    append a chunk to a manifest
+ * Comment:    the first line follows the previous chunk
+ * Parameters: manifest, id, lines, size, crc
+ * Returns:    IMDBE_NO_ERROR or IMDBE_MEMORY
+ */
+extern LONG IMDBAddChunk (IMDB_Manifest *manifest, LONG id, LONG lines, LONG size, ULONG crc);
+
+/* Procedure:  IMDBFindChunk
+ * Purpose:    TRUE, if a manifest uses a chunk-file
+ * Comment:
+ * Parameters: manifest (may be NULL), id
+ * Returns:    TRUE or FALSE
+ */
+extern BOOL IMDBFindChunk (IMDB_Manifest *manifest, LONG id);
+
+/* Procedure:  IMDBWriteManifest
+ * Purpose:    write a manifest and flush it to the disk
+ * Comment:    write it to a temporary name and rename it, so the old
+ *             manifest is replaced in one step
+ * Parameters: manifest, fname
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ */
+extern LONG IMDBWriteManifest (IMDB_Manifest *manifest, char *fname);
+
+/* Procedure:  IMDBFreeManifest
+ * Purpose:    free a manifest
+ * Comment:
+ * Parameters: manifest (may be NULL)
+ * Returns:    nothing
+ */
+extern void IMDBFreeManifest (IMDB_Manifest *manifest);
+
 #endif
 
 
+/*-----------------------------------------------------------------------------
+ * General Information on Delta-Files
+ *-----------------------------------------------------------------------------
+ *
+ * A delta-file (*.delta, ApplyDiffs option DELTA) describes the patched
+ * listfile by its bytes: ranges copied from the old listfile and the added
+ * lines, which follow each range as they are. Every range starts behind
+ * the previous one, so the old listfile is read only once (ReplayDelta).
+ *
+ * Delta-file: IMDB-Delta 1\n                 magic
+ *             <old size><size><lines><crc>  size of the old listfile, size,
+ *                                           lines and CRC of the patched
+ *                                           listfile, 4 bytes each, most
+ *                                           significant byte first
+ *             <offset><copy><bytes>         range: copy <copy> bytes of the
+ *                                           old listfile from <offset>, then
+ *             <added lines>                 <bytes> bytes of added lines
+ *             ...
+ *             <0><0><0>                     end of ranges
+ *
+ * The numbers of the ranges are varints: 7 bits per byte, lowest first,
+ * the highest bit is set if another byte follows. Ranges hold whole lines.
+ *-----------------------------------------------------------------------------
+ */
+
+#define IMDBV_DELTA_EXT       ".delta"
+#define IMDBV_DELTA_MAGIC     "IMDB-Delta 1"
+
+/*-----------------------------------------------------------------------------
+ * General Information on Diffs in Memory
+ *-----------------------------------------------------------------------------
+ *
+ * A diff-file (original or stripped) is translated into a list of
+ * edit-operations on the old listfile. The texts of the lines point into
+ * the contents of the diff-file, which is kept by the diff. The diffs of
+ * successive weeks are combined with IMDBComposeDiffs.
+ *-----------------------------------------------------------------------------
+ */
+
+/* types of diff-files (IMDBLoadDiff) */
+#define IMDBV_DIFF_ORIGINAL    1       /* deleted lines with "< ", added lines with "> " */
+#define IMDBV_DIFF_STRIPPED    2       /* "Apply on: <first line>", only added lines */
+
+/* edit-operations */
+#define IMDBV_OP_COPY          0       /* copy <count> lines of the old listfile */
+#define IMDBV_OP_DELETE        1       /* delete one line of the old listfile, text may be NULL */
+#define IMDBV_OP_INSERT        2       /* insert one line */
+#define IMDBV_OP_REST          3       /* copy all remaining lines of the old listfile */
+
+#define IMDBV_DIFF_BUFFER_SIZE (512*1024)
+
+typedef struct
+ {
+  LONG  cmd;                     /* IMDBV_OP_... */
+  LONG  count;                   /* number of lines (IMDBV_OP_COPY) */
+  char *text;                    /* line (IMDBV_OP_INSERT/DELETE) */
+ } IMDB_DiffOp;
+
+typedef struct
+ {
+  char        *memory;           /* contents of the diff-file or NULL */
+  IMDB_DiffOp *ops;
+  LONG         nb_ops;
+  LONG         max_ops;
+  BOOL         f_new;            /* diff introduces a new listfile */
+  char        *header;           /* first line of the old listfile or NULL */
+  char        *crc_line;         /* first line of the new listfile or NULL */
+ } IMDB_Diff;
+
+#ifndef IMDB_RESOURCES_C
+
+/* Procedure:  IMDBAllocDiff
+ * Purpose:    create an empty diff
+ * Comment:
+ * Parameters: max_ops  expected number of operations
+ * Returns:    diff or NULL
+ */
+extern IMDB_Diff *IMDBAllocDiff (LONG max_ops);
+
+/* Procedure:  IMDBFreeDiff
+ * Purpose:    free a diff and the contents of its diff-file
+ * Comment:
+ * Parameters: diff (may be NULL)
+ * Returns:    nothing
+ */
+extern void IMDBFreeDiff (IMDB_Diff *diff);
+
+/* Procedure:  IMDBAddDiffOp
+ * Purpose:    append an edit-operation, successive copies are merged
+ * Comment:
+ * Parameters: diff, cmd, count, text
+ * Returns:    FALSE if out of memory
+ */
+extern BOOL IMDBAddDiffOp (IMDB_Diff *diff, LONG cmd, LONG count, char *text);
+
+/* Procedure:  IMDBLoadDiff
+ * Purpose:    read a diff-file and translate it into edit-operations
+ * Comment:
+ * Parameters: diffile  filename
+ *             flags    IMDBV_DIFF_ORIGINAL or IMDBV_DIFF_STRIPPED, may be
+ *                      combined with IMDBV_FILE_GZIP
+ *             p_error  IMDBE_FILE_READ, IMDBE_MEMORY or IMDBE_SYNTAX
+ * Returns:    diff or NULL
+ */
+extern IMDB_Diff *IMDBLoadDiff (char *diffile, LONG flags, LONG *p_error);
+
+/* Procedure:  IMDBComposeDiffs
+ * Purpose:    combine the diffs of two successive weeks
+ * Comment:    the texts are not copied, keep both diffs as long as the
+ *             result is used
+ * Parameters: first, second
+ * Returns:    diff or NULL if out of memory
+ */
+extern IMDB_Diff *IMDBComposeDiffs (IMDB_Diff *first, IMDB_Diff *second);
+
+/* Procedure:  IMDBCalcCRC
+ * Purpose:    add a line to the CRC-sum of a listfile (adds '\n')
+ * Comment:    start with 0xFFFFFFFF, the CRC-line holds the CRC-sum of
+ *             all lines but the first
+ * Parameters: p_line, p_crc
+ * Returns:    nothing
+ */
+extern void IMDBCalcCRC (char *p_line, ULONG *p_crc);
+
+#endif
+
+/*-----------------------------------------------------------------------------
+ * General Information on Patched Listfiles (Views)
+ *-----------------------------------------------------------------------------
+ *
+ * A view shows the listfile that results from applying a diff to the old
+ * listfile, without writing it: a table of pieces, each either a run of
+ * lines of the old listfile or a line added by the diff. Any line can be
+ * read by its number or one after the other. The old listfile is read
+ * once when the view is opened, to note the position of every
+ * IMDBV_VIEW_STEP-th line. The patched listfile can be written by a
+ * thread of its own (IMDB_THREADS) while the view is used.
+ *-----------------------------------------------------------------------------
+ */
+
+#define IMDBV_VIEW_STEP        256     /* lines of the old listfile per index entry */
+#define IMDBV_VIEW_BUFFER_SIZE (512*1024)
+#define IMDBV_VIEW_LINE_SIZE   (8*1024)
+
+typedef struct
+ {
+  LONG  first;                   /* first line in the patched listfile */
+  LONG  old_first;               /* first line in the old listfile, 0: added line */
+  LONG  lines;                   /* number of lines */
+  char *text;                    /* added line */
+ } IMDB_Piece;
+
+typedef struct
+ {
+  char        *fname;            /* old listfile or NULL */
+  LONG         flags;            /* IMDBV_FILE_GZIP/CHUNKS of the old listfile */
+  IMDB_Buffer *list;             /* old listfile */
+  LONG        *index;            /* position of every IMDBV_VIEW_STEP-th line */
+  LONG         nb_old_lines;     /* lines of the old listfile */
+  IMDB_Piece  *pieces;
+  LONG         nb_pieces;
+  LONG         nb_lines;         /* lines of the patched listfile */
+  LONG         next_old;         /* line of the old listfile read next */
+  LONG         piece;            /* piece of the last line read */
+  LONG         line;             /* last line read */
+  APTR         writer;           /* background-writer (IMDB_THREADS) or NULL */
+  LONG         write_error;      /* result of the writer */
+  ULONG        write_crc;        /* CRC-sum of the written listfile */
+ } IMDB_View;
+
+#ifndef IMDB_RESOURCES_C
+
+/* Procedure:  IMDBOpenView
+ * Purpose:    open a view of the listfile patched by a diff
+ * Comment:    keep the diff until the view is closed
+ * Parameters: listfile  old listfile or NULL (diff introduces a new one)
+ *             flags     IMDBV_FILE_GZIP or IMDBV_FILE_CHUNKS or 0
+ *             diff      diff (see IMDBComposeDiffs for several weeks)
+ *             p_error   IMDBE_FILE_OPEN, IMDBE_FILE_READ, IMDBE_MEMORY or
+ *                       IMDBE_SYNTAX (diff doesn't fit the listfile)
+ * Returns:    view or NULL
+ */
+extern IMDB_View *IMDBOpenView (char *listfile, LONG flags, IMDB_Diff *diff, LONG *p_error);
+
+/* Procedure:  IMDBViewLine
+ * Purpose:    read a line of the patched listfile by its number (1 ...)
+ * Comment:    the line is valid up to the next call, don't change it
+ * Parameters: view, line, pp_line
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_EOF or IMDBE_FILE_READ
+ */
+extern LONG IMDBViewLine (IMDB_View *view, LONG line, char **pp_line);
+
+/* Procedure:  IMDBNextViewLine
+ * Purpose:    read the line following the last one read
+ * Comment:    starts with the first line
+ * Parameters: view, pp_line
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_EOF or IMDBE_FILE_READ
+ */
+extern LONG IMDBNextViewLine (IMDB_View *view, char **pp_line);
+
+/* Procedure:  IMDBViewCRC
+ * Purpose:    calculate the CRC-sum of the patched listfile
+ * Comment:    compare it with the CRC-line (line 1)
+ * Parameters: view, p_crc
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_READ
+ */
+extern LONG IMDBViewCRC (IMDB_View *view, ULONG *p_crc);
+
+/* Procedure:  IMDBStartWriteView
+ * Purpose:    write the patched listfile (in the background with
+ *             IMDB_THREADS)
+ * Comment:    finish with IMDBWaitWriteView
+ * Parameters: view, fname, flags (IMDBV_FILE_GZIP or 0)
+ * Returns:    IMDBE_NO_ERROR or IMDBE_MEMORY
+ */
+extern LONG IMDBStartWriteView (IMDB_View *view, char *fname, LONG flags);
+
+/* Procedure:  IMDBWaitWriteView
+ * Purpose:    wait until the patched listfile is written
+ * Comment:    an incomplete file is removed
+ * Parameters: view, p_crc (CRC-sum of the written listfile or NULL)
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_OPEN, IMDBE_FILE_READ,
+ *             IMDBE_FILE_WRITE or IMDBE_NOTFOUND
+ */
+extern LONG IMDBWaitWriteView (IMDB_View *view, ULONG *p_crc);
+
+/* Procedure:  IMDBCloseView
+ * Purpose:    close a view, waits for the writer
+ * Comment:
+ * Parameters: view (may be NULL)
+ * Returns:    nothing
+ */
+extern void IMDBCloseView (IMDB_View *view);
+
+#endif
+
+
+/*-----------------------------------------------------------------------------
+ * General Information on Applying Diffs (libimdbdiff)
+ *-----------------------------------------------------------------------------
+ *
+ * IMDB_Resources is built as the library libimdbdiff.a as well, so other
+ * programs can read, patch and check listfiles without calling the tools.
+ * IMDBApplyDiff patches a listfile in one pass and calls a hook for every
+ * copied, deleted and added line, e.g. to update an index of the listfile
+ * while it is patched. The line passed to the hook is only valid until
+ * the hook returns.
+ *-----------------------------------------------------------------------------
+ */
+
+/* events of the line-hook */
+#define IMDBV_LINE_COPY        IMDBV_OP_COPY    /* line of the old listfile is kept */
+#define IMDBV_LINE_DELETE      IMDBV_OP_DELETE  /* line of the old listfile is deleted */
+#define IMDBV_LINE_INSERT      IMDBV_OP_INSERT  /* line is added */
+
+#define IMDBV_APPLY_BUFFER_SIZE (512*1024)
+#define IMDBV_APPLY_LINE_SIZE   (8*1024)
+
+/* old_line: line of the old listfile (0 if added), new_line: line of the
+ * patched listfile (line after which it was deleted for IMDBV_LINE_DELETE).
+ * Any other result than 0 interrupts IMDBApplyDiff. */
+typedef LONG (*IMDB_LineHook) (APTR user_data, LONG event, LONG old_line, LONG new_line, char *p_line);
+
+#ifndef IMDB_RESOURCES_C
+
+/* Procedure:  IMDBApplyDiff
+ * Purpose:    patch a listfile, calls the hook for every line
+ * Comment:    deleted lines of original diffs are compared with the old
+ *             listfile, an incomplete listfile is removed
+ * Parameters: listfile   old listfile or NULL (new listfile)
+ *             flags      IMDBV_FILE_GZIP or IMDBV_FILE_CHUNKS or 0
+ *             diff       diff
+ *             outfile    patched listfile or NULL (not written)
+ *             out_flags  IMDBV_FILE_GZIP or 0
+ *             hook       line-hook or NULL
+ *             user_data  passed to the hook
+ *             p_crc      CRC-sum of the patched listfile or NULL
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_OPEN, IMDBE_FILE_READ,
+ *             IMDBE_FILE_WRITE, IMDBE_SYNTAX (diff doesn't fit the
+ *             listfile) or IMDBE_INTERRUPT (by the hook)
+ */
+extern LONG IMDBApplyDiff (char *listfile, LONG flags, IMDB_Diff *diff, char *outfile, LONG out_flags,
+                           IMDB_LineHook hook, APTR user_data, ULONG *p_crc);
+
+#endif
+
+
+/*-----------------------------------------------------------------------------
+ * General Information on Scheduling
+ *-----------------------------------------------------------------------------
+ *
+ * Several listfiles can be checked at the same time, but a spinning disk
+ * gets slower when it has to read several files at once, while an SSD
+ * gets faster. A schedule puts every job to the device of its file and
+ * limits the number of jobs running on one device at the same time. The
+ * limit is found for every device (Linux only: 1 for spinning disks,
+ * IMDBV_SCHEDULE_FAST for SSDs, IMDBV_SCHEDULE_OTHER if not known) or
+ * given by the caller. On every device the biggest files are done first,
+ * so a big file doesn't keep a worker busy when all others are finished.
+ *-----------------------------------------------------------------------------
+ */
+
+#define IMDBV_SCHEDULE_FAST    8       /* jobs per SSD */
+#define IMDBV_SCHEDULE_OTHER   2       /* jobs per device of unknown type */
+
+#define IMDBV_JOB_WAITING      0
+#define IMDBV_JOB_RUNNING      1
+#define IMDBV_JOB_DONE         2
+
+typedef struct
+ {
+  LONG  device;                  /* index of the device, -1: not scheduled */
+  LONG  size;                    /* size of the file */
+  LONG  state;                   /* IMDBV_JOB_... */
+ } IMDB_Job;
+
+/* Do not access directly! */
+typedef struct
+ {
+  LONG      nb_jobs;
+  IMDB_Job *jobs;
+  LONG      nb_devices;
+  LONG      dev_limit;           /* 0: limit depends on the device */
+  APTR      devices;
+  APTR      lock;                /* mutex and condition (IMDB_THREADS) */
+ } IMDB_Schedule;
+
+/* called by a worker for every job */
+typedef void (*IMDB_JobHook) (APTR user_data, LONG job);
+
+#ifndef IMDB_RESOURCES_C
+
+/* Procedure:  IMDBOpenSchedule
+ * Purpose:    open a schedule for nb_jobs jobs (0 ... nb_jobs-1)
+ * Comment:
+ * Parameters: nb_jobs, dev_limit (jobs per device at the same time,
+ *             0: depends on the device)
+ * Returns:    schedule or NULL
+ */
+extern IMDB_Schedule *IMDBOpenSchedule (LONG nb_jobs, LONG dev_limit);
+
+/* Procedure:  IMDBScheduleJob
+ * Purpose:    put a job to the device of its file
+ * Comment:    uses the directory if the file doesn't exist, jobs that are
+ *             not scheduled are done in the order of their numbers
+ * Parameters: schedule, job, fname
+ * Returns:    nothing
+ */
+extern void IMDBScheduleJob (IMDB_Schedule *schedule, LONG job, char *fname);
+
+/* Procedure:  IMDBRunSchedule
+ * Purpose:    do all jobs with nb_workers workers at the same time
+ * Comment:    the caller is one of the workers, the hook is called by
+ *             several threads at the same time (IMDB_THREADS)
+ * Parameters: schedule, nb_workers, hook, user_data (passed to the hook)
+ * Returns:    nothing
+ */
+extern void IMDBRunSchedule (IMDB_Schedule *schedule, LONG nb_workers, IMDB_JobHook hook, APTR user_data);
+
+/* Procedure:  IMDBCloseSchedule
+ * Purpose:    free a schedule
+ * Comment:
+ * Parameters: schedule (may be NULL)
+ * Returns:    nothing
+ */
+extern void IMDBCloseSchedule (IMDB_Schedule *schedule);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
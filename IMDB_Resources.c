@@ -1,6 +1,10 @@
 #define IMDB_RESOURCES_C
 #define IMDB_INTERNAL
 
+#ifdef IMDB_SYNCFS
+#define _GNU_SOURCE                 /* syncfs() */
+#endif
+
 /*=============================================================================
  *
  *  Program:   IMDB_Resources
@@ -61,6 +65,12 @@
 #endif /* SYS_AMIGA */
 
 #ifdef SYS_UNIX
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
 #ifndef NEXT
 #include <unistd.h>
 
@@ -71,6 +81,17 @@
 #endif /* NEXT */
 #endif /* SYS_UNIX */
 
+#ifdef IMDB_FALLOCATE
+#include <errno.h>
+#endif
+
+#ifdef IMDB_ZLIB
+#include <zlib.h>
+#ifdef IMDB_THREADS
+#include <pthread.h>
+#endif
+#endif
+
 /*-----------------------------------------------------------------------------
  * Procedure:   IMDBSetError
  *
@@ -162,408 +183,4441 @@ void IMDBFreeMemory (APTR mem)
 
 
 /******************************************************************************
- *  File-Handling
+ *  Memory Budget
+ *
+ *  The file-buffers take their memory from the budget and give it back
+ *  when they are closed. A buffer is never refused, it only gets smaller
+ *  (see IMDB.h). Without a budget only the bytes used are counted.
  ******************************************************************************
  */
 
-#define IMDB_BUFFER_SIZE 2048
+static LONG budget_size = 0;             /* 0: no budget */
+static LONG budget_used = 0;
+#ifdef IMDB_THREADS
+static pthread_mutex_t budget_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
 
 /*-----------------------------------------------------------------------------
- * Procedure:  IMDBExistFile
- *
- * Purpose:    
+ * Procedure:   IMDBSetMemoryBudget
  *
- * Comment:    
+ * Purpose:     set the memory budget of the file-buffers
  *
- * Parameters: fname Filename
+ * Parameters:  size    bytes, 0: no budget
  *
- * Returns:    TRUE or FALSE
+ * Return:      nothing
  *-----------------------------------------------------------------------------
  */
 
-BOOL IMDBExistFile (char *fname)
+void IMDBSetMemoryBudget (LONG size)
  {
-  FILE *fp;
-
-  if (fp = fopen (fname, "r"))
-   {
-    fclose(fp);
-    return (TRUE);
-   }
-  return (FALSE);
+#ifdef IMDB_THREADS
+  pthread_mutex_lock (&budget_lock);
+#endif
+  budget_size = (size > 0) ? size : 0;
+#ifdef IMDB_THREADS
+  pthread_mutex_unlock (&budget_lock);
+#endif
  }
 
-/******************************************************************************
- *  Buffer-Handling
- ******************************************************************************
+/*-----------------------------------------------------------------------------
+ * Procedure:   IMDBMemoryLeft
+ *
+ * Return:      bytes of the budget not used, 0x7FFFFFFF without a budget
+ *-----------------------------------------------------------------------------
  */
 
+LONG IMDBMemoryLeft (void)
+ {
+  LONG left = 0x7FFFFFFFL;
+
+#ifdef IMDB_THREADS
+  pthread_mutex_lock (&budget_lock);
+#endif
+  if (budget_size)
+   left = budget_size - budget_used;
+#ifdef IMDB_THREADS
+  pthread_mutex_unlock (&budget_lock);
+#endif
+  return (left);
+ }
+
 /*-----------------------------------------------------------------------------
- * Procedure:  IMDBOpenBuffer
+ * Procedure:   budget_take
  *
- * Purpose:    open buffer
+ * Purpose:     take memory from the budget
  *
- * Comment:
+ * Comment:     With a budget at most half of what is left is given, but
+ *              min_size at least (even if the budget is used up). With
+ *              f_all the full size or nothing (0) is given.
  *
- * Parameters: fname    filename
- *             mode     IMDBV_FILE_READ, IMDBV_FILE_WRITE or IMDBV_FILE_APPEND
- *             size     of buffer
- * Returns:    pointer to file-info or NULL if failed
+ * Parameters:  size, min_size, f_all
+ *
+ * Return:      bytes taken
  *-----------------------------------------------------------------------------
  */
 
-IMDB_Buffer *IMDBOpenBuffer (char *fname, LONG flags, LONG size)
+static LONG budget_take (LONG size, LONG min_size, BOOL f_all)
  {
-  IMDB_Buffer *p_buffer;
-  char modestr[5];
-  LONG mode;
-
-  mode = (flags & 3);
-
-  switch (mode)
-   {
-    case IMDBV_FILE_READ:
-      strcpy (modestr,"rb");
-      break;
-    case IMDBV_FILE_WRITE:
-      strcpy (modestr,"wb");
-      break;
-    case IMDBV_FILE_APPEND:
-      strcpy (modestr,"ab");
-      break;
-    default:
-     modestr[0] = '\0';
-   }
+  LONG left;
 
-  if (p_buffer = IMDBAllocMemory (sizeof (IMDB_Buffer)))
+#ifdef IMDB_THREADS
+  pthread_mutex_lock (&budget_lock);
+#endif
+  if (budget_size)
    {
-    IMDBResetError(&p_buffer->error);
-    p_buffer->filesize           = 0;
-    p_buffer->filepos            = 0;
-    if (p_buffer->fname = IMDBAllocMemory(strlen(fname)+1))
-     strcpy (p_buffer->fname, fname);
-    p_buffer->mode               = mode;
-    p_buffer->stream             = fopen(p_buffer->fname, modestr);
-/*    p_buffer->status             = IMDBE_NO_ERROR;*/
-    p_buffer->buffersize         = size;
-    p_buffer->bufferpos          = 0;
-    p_buffer->nb_bytes_in_buffer = 0;
-    p_buffer->buffer             = NULL;
-
-    if (NULL == p_buffer->stream)
+    left = (budget_size - budget_used) / 2;
+    if (f_all)
      {
-      if (p_buffer->fname) IMDBFreeMemory(p_buffer->fname);
-      IMDBFreeMemory(p_buffer);
-      return (NULL);
+      if (size > left)
+       size = 0;
      }
     else
      {
-      if (NULL == (p_buffer->buffer = IMDBAllocMemory(p_buffer->buffersize+2)))
-       {
-        fclose(p_buffer->stream);
-        if (p_buffer->fname) IMDBFreeMemory(p_buffer->fname);
-        IMDBFreeMemory(p_buffer);
-        return (NULL);
-       }
-      p_buffer->buffer[p_buffer->buffersize+0] = '\n';
-      p_buffer->buffer[p_buffer->buffersize+1] = '\0';
-
-      if ((IMDBV_FILE_READ == mode) && (flags & IMDBV_FILE_GETSIZE))
-       { /* get size of file */       
-        if(fseek (p_buffer->stream, 0, SEEK_END))
-         IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_POSITION, p_buffer->fname);
-        else 
-         {
-          p_buffer->filesize = ftell(p_buffer->stream);
-          if(fseek (p_buffer->stream, 0, SEEK_SET))
-           IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_POSITION, p_buffer->fname);
-         }
-       }
+      if (size > left)
+       size = left;
+      if (size < min_size)
+       size = min_size;
      }
    }
+  budget_used += size;
+#ifdef IMDB_THREADS
+  pthread_mutex_unlock (&budget_lock);
+#endif
+  return (size);
+ }
 
-  return (p_buffer);
+static void budget_give (LONG size)
+ {
+#ifdef IMDB_THREADS
+  pthread_mutex_lock (&budget_lock);
+#endif
+  budget_used -= size;
+#ifdef IMDB_THREADS
+  pthread_mutex_unlock (&budget_lock);
+#endif
  }
 
 
+/******************************************************************************
+ *  File-Handling
+ ******************************************************************************
+ */
+
+#define IMDB_BUFFER_SIZE 2048
+
 /*-----------------------------------------------------------------------------
- * Procedure:  IMDBCloseBuffer
+ * Procedure:  IMDBExistFile
  *
- * Purpose:    Close Buffer
+ * Purpose:    
  *
  * Comment:    
  *
- * Parameters: file  pointer to file struct
+ * Parameters: fname Filename
  *
- * Returns:    nothing    
+ * Returns:    TRUE or FALSE
  *-----------------------------------------------------------------------------
  */
 
-LONG IMDBCloseBuffer (IMDB_Buffer *p_buffer)
+BOOL IMDBExistFile (char *fname)
  {
-  LONG error_code = IMDBE_NO_ERROR;
-
-  if (NULL == p_buffer)
-   return (1);
-
-  /* Flush Buffer */
-  if (IMDBV_FILE_WRITE == p_buffer->mode)
-   if (p_buffer->nb_bytes_in_buffer != fwrite(p_buffer->buffer, 1, p_buffer->nb_bytes_in_buffer, p_buffer->stream))
-    {
-     IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_WRITE, p_buffer->fname);
-     error_code = IMDBE_FILE_WRITE;
-    }
-
-  fclose(p_buffer->stream);
-  if (p_buffer->fname) IMDBFreeMemory(p_buffer->fname);
-  if (p_buffer->buffer) IMDBFreeMemory(p_buffer->buffer);
-  IMDBFreeMemory(p_buffer);
+  FILE *fp;
 
-  return (error_code);
+  if (fp = fopen (fname, "r"))
+   {
+    fclose(fp);
+    return (TRUE);
+   }
+  return (FALSE);
  }
 
-
 /*-----------------------------------------------------------------------------
- * Procedure:  IMDBPositionBufer
+ * Procedure:  IMDBSyncFile
  *
- * Purpose:    Position in file
+ * Purpose:    write all data of a file (or directory) to the disk
  *
- * Comment:    Buffer needs to be in IMDBV_FILE_READ mode
+ * Comment:    Only available for SYS_UNIX, on other systems the data is
+ *             already on the disk when the file has been closed.
  *
- * Parameters: file    pointer to file
- *             pos     position where to go to
+ * Parameters: fname Filename
  *
- * Returns:    NULL or IMDB_IO_ERROR if failed
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_WRITE
  *-----------------------------------------------------------------------------
  */
 
-LONG IMDBPositionBuffer (IMDB_Buffer *p_buffer, LONG pos)
+LONG IMDBSyncFile (char *fname)
  {
+#ifdef SYS_UNIX
+  int  fd;
+  LONG ret = IMDBE_NO_ERROR;
 
-  /*first check, if the position is already within the buffer */
-  if ((pos < (p_buffer->filepos - p_buffer->bufferpos))
-    ||(pos > (p_buffer->filepos - p_buffer->bufferpos + p_buffer->nb_bytes_in_buffer)))
-   {/* ausserhalb des Buffers, also neu positionieren */
-    if(fseek (p_buffer->stream, pos, SEEK_SET))
-     {
-      IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_POSITION, p_buffer->fname);
-      return (IMDBE_FILE_POSITION);
-     }
-    p_buffer->bufferpos = 0;
-    p_buffer->filepos = pos;
-    p_buffer->nb_bytes_in_buffer = fread(p_buffer->buffer, 1, p_buffer->buffersize, p_buffer->stream);
-    return (IMDBE_NO_ERROR);
-   }
-  else
-   {/* position ist innerhalb des Buffers */
-    p_buffer->bufferpos = p_buffer->bufferpos + (pos - p_buffer->filepos);
-    p_buffer->filepos = pos;
-    return (IMDBE_NO_ERROR);
-   }
-
-  p_buffer->filepos = pos;
-  return (0);
+  if (-1 == (fd = open (fname, O_RDONLY)))
+   return (IMDBE_FILE_WRITE);
+  if (fsync (fd))
+   ret = IMDBE_FILE_WRITE;
+  close (fd);
+  return (ret);
+#else
+  return (IMDBE_NO_ERROR);
+#endif
  }
 
 /*-----------------------------------------------------------------------------
- * Procedure:  IMDBReadBuffer
+ * Procedure:  IMDBSyncFileSystem
  *
- * Purpose:    Read data from file
+ * Purpose:    write all data of the filesystem containing path to the disk
  *
- * Comment:    
- *             Buffer needs to be in IMDB_FILE_READ mode
+ * Comment:    Needs syncfs() (compile with IMDB_SYNCFS). If it is not
+ *             available IMDBE_NOTFOUND is returned and the caller has to
+ *             use IMDBSyncFile for every file.
  *
- * Parameters: file    pointer to file
- *             mem     pointer to memory where to store the data
- *             size    number of bytes to read from file
+ * Parameters: path  any file or directory on the filesystem
  *
- * Returns:    number of bytes read or IMDB_IO_ERROR
+ * Returns:    IMDBE_NO_ERROR, IMDBE_NOTFOUND or IMDBE_FILE_WRITE
  *-----------------------------------------------------------------------------
  */
 
-LONG IMDBReadBuffer (IMDB_Buffer *p_buffer, char **p_mem, LONG size)
+LONG IMDBSyncFileSystem (char *path)
  {
-/*  LONG streampos;*/
-  LONG i;
-
-/*
-printf ("%i %i %i\n", p_buffer->nb_bytes_in_buffer, p_buffer->filepos, p_buffer->bufferpos);
-*/
-
-  if (p_buffer->nb_bytes_in_buffer - p_buffer->bufferpos - size >= 0)
-   {/* O.K. Ist alles im Speicher */
-    *p_mem = &p_buffer->buffer[p_buffer->bufferpos];
-    p_buffer->bufferpos += size;
-    p_buffer->filepos += size;   
-    return (size);
-   }
+#ifdef IMDB_SYNCFS
+  int  fd;
+  LONG ret = IMDBE_NO_ERROR;
 
-  /* Move the last bits of memory  */
-  i = p_buffer->nb_bytes_in_buffer - p_buffer->bufferpos;
-  if ((i<0) || (i>p_buffer->buffersize))
-   {
-#ifdef IMDB_DEBUG
-    printf ("Fatal error in IMDBReadBuffer!!!\n Remaining bytes: %i\nBytes in Buffer %i\n", i, p_buffer->buffersize);
+  if (-1 == (fd = open (path, O_RDONLY)))
+   return (IMDBE_NOTFOUND);
+  if (syncfs (fd))
+   ret = IMDBE_FILE_WRITE;
+  close (fd);
+  return (ret);
+#else
+  return (IMDBE_NOTFOUND);
 #endif
-    return (0);
-   }
-  if (i > 0)
-   memmove(p_buffer->buffer, &p_buffer->buffer[p_buffer->bufferpos], i);
+ }
 
-  /* Load new segment in memory */
-  p_buffer->nb_bytes_in_buffer = i + fread(&p_buffer->buffer[i], 1, p_buffer->buffersize - i, p_buffer->stream);
-  *p_mem = p_buffer->buffer;
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBTruncateFile
+ *
+ * Purpose:    cut a file to the given size
+ *
+ * Comment:    Only available for SYS_UNIX
+ *
+ * Parameters: fname Filename
+ *             size  new size of file in bytes
+ *
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ *-----------------------------------------------------------------------------
+ */
 
-  if (p_buffer->nb_bytes_in_buffer > size)
-   {
-    p_buffer->bufferpos = size;
-    p_buffer->filepos  += size;
-    return (size);
-   }
-  else
-   {
-    p_buffer->bufferpos = p_buffer->nb_bytes_in_buffer;
-    p_buffer->filepos  += p_buffer->nb_bytes_in_buffer;
-    return (p_buffer->nb_bytes_in_buffer);
-   }
+LONG IMDBTruncateFile (char *fname, LONG size)
+ {
+#ifdef SYS_UNIX
+  if (0 == truncate (fname, (off_t) size))
+   return (IMDBE_NO_ERROR);
+#endif
+  return (IMDBE_FILE_WRITE);
  }
 
 /*-----------------------------------------------------------------------------
- * Procedure:  IMDBReadBufferLine
+ * Procedure:  IMDBReserveBuffer
  *
- * Purpose:    Read data from file
+ * Purpose:    reserve the disk space of a new file whose final size is
+ *             known in advance, so it is not fragmented and a full disk
+ *             is noticed before anything is written
  *
- * Comment:    
- *             Buffer needs to be in IMDB_FILE_READ mode
+ * Comment:    Needs posix_fallocate() (compile with IMDB_FALLOCATE). Only
+ *             for uncompressed files that have just been opened with
+ *             IMDBV_FILE_WRITE. The file has the given size afterwards.
  *
- * Parameters: file    pointer to file
- *             mem     pointer to memory where to store the data
- *             size    number of bytes to read from file
+ * Parameters: buffer  pointer to buffer
+ *             size    final size of the file in bytes
  *
- * Returns:    error_code
+ * Returns:    IMDBE_NO_ERROR, IMDBE_NOTFOUND (not possible) or
+ *             IMDBE_FILE_WRITE (not enough space)
  *-----------------------------------------------------------------------------
  */
 
-LONG IMDBReadBufferLine (IMDB_Buffer *p_buffer, char **p_mem, LONG size)
+LONG IMDBReserveBuffer (IMDB_Buffer *p_buffer, LONG size)
+ {
+#ifdef IMDB_FALLOCATE
+  int ret;
+
+  if ((IMDBV_FILE_WRITE == p_buffer->mode) && (p_buffer->stream) && (0 == p_buffer->filepos)
+    &&(NULL == p_buffer->gzstream) && (NULL == p_buffer->deflater) && (size > 0))
+   {
+    if (0 == (ret = posix_fallocate (fileno (p_buffer->stream), 0, (off_t) size)))
+     return (IMDBE_NO_ERROR);
+    if (ENOSPC == ret)
+     return (IMDBE_FILE_WRITE);
+   }
+#endif
+  return (IMDBE_NOTFOUND);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBHashLine
+ *
+ * Purpose:    calculate a 64-bit hash of a line (hashed diffs)
+ *
+ * Comment:    Two independent 32-bit hashes (FNV-1a and sdbm), so no 64-bit
+ *             type is needed.
+ *
+ * Parameters: p_line  line
+ *             len     length of line
+ *             p_hash  array of two ULONGs for the hash
+ *
+ * Returns:    nothing
+ *-----------------------------------------------------------------------------
+ */
+
+void IMDBHashLine (char *p_line, LONG len, ULONG *p_hash)
+ {
+  ULONG  fnv  = 0x811C9DC5L;
+  ULONG  sdbm = 0;
+  UBYTE *p_c  = (UBYTE *) p_line;
+
+  while (len-- > 0)
+   {
+    fnv  = ((fnv ^ *p_c) * 0x01000193L) & 0xFFFFFFFFL;
+    sdbm = (*p_c + (sdbm << 6) + (sdbm << 16) - sdbm) & 0xFFFFFFFFL;
+    p_c++;
+   }
+  p_hash[0] = fnv;
+  p_hash[1] = sdbm;
+ }
+
+/******************************************************************************
+ *  Parallel gzip-Writer (IMDB_THREADS)
+ *
+ *  The data is cut into blocks of DEFLATE_BLOCK_SIZE bytes which are
+ *  compressed by one thread per slot (raw deflate, primed with the last
+ *  32K of the previous block as dictionary, ended with a sync-flush).
+ *  The compressed blocks are written in order behind one gzip-header, the
+ *  CRC32 of the blocks is combined for the gzip-trailer. So the result is
+ *  one ordinary gzip-stream, and the caller goes on with its work while
+ *  the blocks are compressed.
+ *
+ *  Every DEFLATE_INDEX_BLOCKS blocks a block is compressed without
+ *  dictionary. From there up to the next such block the data forms a
+ *  frame that can be uncompressed on its own. Position and CRC32 of every
+ *  frame are written to an index (<file>.idx), so the file can be
+ *  uncompressed by several threads and every frame can be checked.
+ ******************************************************************************
+ */
+
+#ifdef IMDB_THREADS
+
+#ifndef IMDB_DEFLATE_THREADS
+#define IMDB_DEFLATE_THREADS  0          /* 0: one thread per cpu */
+#endif
+#define DEFLATE_MAX_THREADS   16
+#define DEFLATE_BLOCK_SIZE    (128*1024)
+#define DEFLATE_DICT_SIZE     (32*1024)
+#define DEFLATE_LEVEL         4          /* same as "gzip -4" */
+#define DEFLATE_INDEX_BLOCKS  8          /* one index-point per 1MB */
+#define DEFLATE_INDEX_MAGIC   "IMDB-GzipIndex 2"
+
+#define SLOT_FREE    0                   /* slot can be filled */
+#define SLOT_PENDING 1                   /* block waits for/is compressed */
+#define SLOT_DONE    2                   /* compressed block can be written */
+#define SLOT_QUIT    3                   /* thread has to exit */
+
+typedef struct
+ {
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  LONG            state;
+  z_stream        strm;
+  UBYTE          *in;                    /* uncompressed block */
+  LONG            nb_in;
+  UBYTE          *dict;                  /* end of the previous block */
+  LONG            nb_dict;
+  UBYTE          *out;                   /* compressed block */
+  LONG            nb_out;
+  LONG            outsize;
+  BOOL            f_last;                /* last block: Z_FINISH */
+  BOOL            f_point;               /* block starts an index-point */
+  BOOL            f_error;
+  ULONG           crc;                   /* CRC32 of this block */
+ } DeflateSlot;
+
+typedef struct
+ {
+  FILE        *stream;
+  FILE        *index;                    /* index-points or NULL */
+  char        *idxname;
+  LONG         nb_blocks;                /* blocks given away */
+  LONG         c_pos;                    /* compressed size written */
+  LONG         u_pos;                    /* uncompressed size written */
+  LONG         frame_c;                  /* start of the current frame */
+  LONG         frame_u;
+  ULONG        frame_crc;                /* CRC32 of the current frame */
+  LONG         nb_slots;
+  LONG         current;                  /* slot that is being filled */
+  DeflateSlot *slot;
+  UBYTE       *dict;                     /* end of the last block given away */
+  LONG         nb_dict;
+  ULONG        crc;                      /* CRC32 of all written blocks */
+  ULONG        isize;                    /* uncompressed size mod 2^32 */
+  BOOL         f_error;
+ } Deflater;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  deflate_thread
+ *
+ * Purpose:    compress the blocks of one slot
+ *-----------------------------------------------------------------------------
+ */
+
+static void *deflate_thread (void *p_arg)
+ {
+  DeflateSlot *slot = (DeflateSlot *) p_arg;
+
+  pthread_mutex_lock (&slot->lock);
+  for (;;)
+   {
+    while (SLOT_PENDING != slot->state)
+     {
+      if (SLOT_QUIT == slot->state)
+       {
+        pthread_mutex_unlock (&slot->lock);
+        return (NULL);
+       }
+      pthread_cond_wait (&slot->cond, &slot->lock);
+     }
+    pthread_mutex_unlock (&slot->lock);
+
+    slot->f_error = FALSE;
+    slot->crc = crc32 (crc32 (0L, Z_NULL, 0), slot->in, (uInt) slot->nb_in);
+    if ((Z_OK != deflateReset (&slot->strm))
+      ||((slot->nb_dict) && (Z_OK != deflateSetDictionary (&slot->strm, slot->dict, (uInt) slot->nb_dict))))
+     slot->f_error = TRUE;
+    else
+     {
+      int ret;
+
+      slot->strm.next_in   = slot->in;
+      slot->strm.avail_in  = (uInt) slot->nb_in;
+      slot->strm.next_out  = slot->out;
+      slot->strm.avail_out = (uInt) slot->outsize;
+      ret = deflate (&slot->strm, (slot->f_last) ? Z_FINISH : Z_SYNC_FLUSH);
+      if ((slot->strm.avail_in) || ((slot->f_last) ? (Z_STREAM_END != ret) : (Z_OK != ret)))
+       slot->f_error = TRUE;
+      slot->nb_out = slot->outsize - slot->strm.avail_out;
+     }
+
+    pthread_mutex_lock (&slot->lock);
+    slot->state = SLOT_DONE;
+    pthread_cond_signal (&slot->cond);
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  deflate_frame
+ *
+ * Purpose:    write the finished frame to the index
+ *-----------------------------------------------------------------------------
+ */
+
+static void deflate_frame (Deflater *deflater)
+ {
+  if ((deflater->index) && (0 <= deflater->frame_c)
+    &&(0 > fprintf (deflater->index, "point %ld %ld %08lX\n", deflater->frame_c, deflater->frame_u, (ULONG) deflater->frame_crc)))
+   deflater->f_error = TRUE;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  deflate_state
+ *
+ * Purpose:    state of a slot (SLOT_xxx), read under its lock like every
+ *             other access of the state
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG deflate_state (DeflateSlot *slot)
+ {
+  LONG state;
+
+  pthread_mutex_lock (&slot->lock);
+  state = slot->state;
+  pthread_mutex_unlock (&slot->lock);
+  return (state);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  deflate_collect
+ *
+ * Purpose:    wait until the block of a slot is compressed and write it
+ *-----------------------------------------------------------------------------
+ */
+
+static void deflate_collect (Deflater *deflater, DeflateSlot *slot)
+ {
+  LONG state;
+
+  pthread_mutex_lock (&slot->lock);
+  while (SLOT_PENDING == slot->state)
+   pthread_cond_wait (&slot->cond, &slot->lock);
+  state = slot->state;
+  pthread_mutex_unlock (&slot->lock);
+
+  if (SLOT_DONE == state)
+   {
+    if (slot->f_point)
+     {
+      deflate_frame (deflater);
+      deflater->frame_c   = deflater->c_pos;
+      deflater->frame_u   = deflater->u_pos;
+      deflater->frame_crc = crc32 (0L, Z_NULL, 0);
+     }
+    deflater->frame_crc = crc32_combine (deflater->frame_crc, slot->crc, (z_off_t) slot->nb_in);
+    if ((slot->f_error)
+      ||(slot->nb_out != fwrite (slot->out, 1, slot->nb_out, deflater->stream)))
+     deflater->f_error = TRUE;
+    deflater->crc = crc32_combine (deflater->crc, slot->crc, (z_off_t) slot->nb_in);
+    deflater->isize += slot->nb_in;
+    deflater->c_pos += slot->nb_out;
+    deflater->u_pos += slot->nb_in;
+    slot->nb_in = 0;
+    pthread_mutex_lock (&slot->lock);
+    slot->state = SLOT_FREE;
+    pthread_mutex_unlock (&slot->lock);
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  deflate_submit
+ *
+ * Purpose:    give the block of the current slot to its thread and take
+ *             the next slot
+ *-----------------------------------------------------------------------------
+ */
+
+static void deflate_submit (Deflater *deflater, BOOL f_last)
+ {
+  DeflateSlot *slot = &deflater->slot[deflater->current];
+  LONG         nb;
+
+  /* dictionary: the last 32K of the data before this block */
+  memcpy (slot->dict, deflater->dict, deflater->nb_dict);
+  slot->nb_dict = deflater->nb_dict;
+  if (slot->nb_in >= DEFLATE_DICT_SIZE)
+   {
+    memcpy (deflater->dict, &slot->in[slot->nb_in - DEFLATE_DICT_SIZE], DEFLATE_DICT_SIZE);
+    deflater->nb_dict = DEFLATE_DICT_SIZE;
+   }
+  else
+   {
+    nb = deflater->nb_dict + slot->nb_in - DEFLATE_DICT_SIZE;
+    if (nb > 0)
+     {
+      memmove (deflater->dict, &deflater->dict[nb], deflater->nb_dict - nb);
+      deflater->nb_dict -= nb;
+     }
+    memcpy (&deflater->dict[deflater->nb_dict], slot->in, slot->nb_in);
+    deflater->nb_dict += slot->nb_in;
+   }
+
+  /* index-point: this block does not depend on the blocks before */
+  slot->f_point = (0 == (deflater->nb_blocks++ % DEFLATE_INDEX_BLOCKS));
+  if (slot->f_point)
+   slot->nb_dict = 0;
+
+  slot->f_last = f_last;
+  pthread_mutex_lock (&slot->lock);
+  slot->state = SLOT_PENDING;
+  pthread_cond_signal (&slot->cond);
+  pthread_mutex_unlock (&slot->lock);
+
+  deflater->current = (deflater->current + 1) % deflater->nb_slots;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  deflate_drain
+ *
+ * Purpose:    write all blocks given away so far, oldest first
+ *-----------------------------------------------------------------------------
+ */
+
+static void deflate_drain (Deflater *deflater)
  {
-/*  LONG streampos;*/
   LONG i;
-  char c;
 
-/*
-printf ("%i %i %i\n", p_buffer->nb_bytes_in_buffer, p_buffer->filepos, p_buffer->bufferpos);
-*/
+  for (i = 0; i < deflater->nb_slots; i++)
+   deflate_collect (deflater, &deflater->slot[(deflater->current + i) % deflater->nb_slots]);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  deflate_write
+ *
+ * Purpose:    compress data
+ *
+ * Returns:    number of bytes written
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG deflate_write (Deflater *deflater, char *p_mem, LONG size)
+ {
+  DeflateSlot *slot;
+  LONG         nb;
+  LONG         done = 0;
+
+  while ((done < size) && (!deflater->f_error))
+   {
+    slot = &deflater->slot[deflater->current];
+    if (SLOT_FREE != deflate_state (slot))
+     deflate_collect (deflater, slot);
+
+    nb = DEFLATE_BLOCK_SIZE - slot->nb_in;
+    if (nb > size - done)
+     nb = size - done;
+    memcpy (&slot->in[slot->nb_in], &p_mem[done], nb);
+    slot->nb_in += nb;
+    done        += nb;
+
+    if (DEFLATE_BLOCK_SIZE == slot->nb_in)
+     deflate_submit (deflater, FALSE);
+   }
+
+  return ((deflater->f_error) ? 0 : done);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  deflate_flush
+ *
+ * Purpose:    write everything given to the deflater so far to the file
+ *
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG deflate_flush (Deflater *deflater)
+ {
+  DeflateSlot *slot = &deflater->slot[deflater->current];
+
+  if ((slot->nb_in) && (SLOT_FREE == deflate_state (slot)))
+   deflate_submit (deflater, FALSE);
+  deflate_drain (deflater);
+
+  return ((deflater->f_error) ? IMDBE_FILE_WRITE : IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  deflate_close
+ *
+ * Purpose:    write the last block and the gzip-trailer, stop the threads
+ *             and free the deflater. The stream is not closed.
+ *
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG deflate_close (Deflater *deflater)
+ {
+  DeflateSlot *slot;
+  UBYTE        trailer[8];
+  LONG         i;
+
+  /* the last block (may be empty) ends the deflate-stream */
+  slot = &deflater->slot[deflater->current];
+  if (SLOT_FREE != deflate_state (slot))
+   deflate_collect (deflater, slot);
+  deflate_submit (deflater, TRUE);
+  deflate_drain (deflater);
+
+  for (i = 0; i < 4; i++)
+   {
+    trailer[i]   = (UBYTE) (deflater->crc   >> (8*i));
+    trailer[i+4] = (UBYTE) (deflater->isize >> (8*i));
+   }
+  if (8 != fwrite (trailer, 1, 8, deflater->stream))
+   deflater->f_error = TRUE;
+
+  /* the index is only kept if the file is complete */
+  deflate_frame (deflater);
+  if (deflater->index)
+   {
+    if ((0 > fprintf (deflater->index, "end %ld %ld %08lX\n", deflater->c_pos + 8, deflater->u_pos, (ULONG) deflater->crc))
+      ||(fclose (deflater->index)) || (deflater->f_error))
+     remove (deflater->idxname);
+   }
+  if (deflater->idxname)
+   IMDBFreeMemory (deflater->idxname);
+
+  for (i = 0; i < deflater->nb_slots; i++)
+   {
+    slot = &deflater->slot[i];
+    pthread_mutex_lock (&slot->lock);
+    slot->state = SLOT_QUIT;
+    pthread_cond_signal (&slot->cond);
+    pthread_mutex_unlock (&slot->lock);
+    pthread_join (slot->thread, NULL);
+    pthread_mutex_destroy (&slot->lock);
+    pthread_cond_destroy (&slot->cond);
+    deflateEnd (&slot->strm);
+    IMDBFreeMemory (slot->in);
+   }
+
+  i = ((deflater->f_error) ? IMDBE_FILE_WRITE : IMDBE_NO_ERROR);
+  IMDBFreeMemory (deflater->slot);
+  IMDBFreeMemory (deflater->dict);
+  IMDBFreeMemory (deflater);
+  return (i);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  deflate_open
+ *
+ * Purpose:    start the threads of a deflater and write the gzip-header
+ *
+ * Parameters: stream   file opened for writing
+ *             fname    name of the file (for the index)
+ *
+ * Returns:    deflater or NULL if not possible (one cpu, no memory, ...)
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG nb_threads (void)
+ {
+  LONG nb = IMDB_DEFLATE_THREADS;
+
+#ifdef _SC_NPROCESSORS_ONLN
+  if (0 >= nb)
+   nb = (LONG) sysconf (_SC_NPROCESSORS_ONLN);
+#endif
+  if (nb > DEFLATE_MAX_THREADS)
+   nb = DEFLATE_MAX_THREADS;
+  return (nb);
+ }
+
+static Deflater *deflate_open (FILE *stream, char *fname)
+ {
+  static UBYTE header[10] = {0x1f, 0x8b, Z_DEFLATED, 0, 0, 0, 0, 0, 0, 3};
+  Deflater    *deflater;
+  DeflateSlot *slot;
+  LONG         nb_slots = nb_threads ();
+  LONG         outsize;
+
+  if (nb_slots < 2)
+   return (NULL);
+
+  if (NULL == (deflater = IMDBAllocMemory (sizeof (Deflater))))
+   return (NULL);
+  deflater->stream   = stream;
+  deflater->index    = NULL;
+  deflater->nb_blocks = 0;
+  deflater->c_pos    = 10;
+  deflater->u_pos    = 0;
+  deflater->frame_c  = -1;             /* no frame yet */
+  if (deflater->idxname = IMDBAllocMemory (strlen (fname) + strlen (IMDBV_FILE_INDEX_EXT) + 1))
+   {
+    strcpy (deflater->idxname, fname);
+    strcat (deflater->idxname, IMDBV_FILE_INDEX_EXT);
+    if (deflater->index = fopen (deflater->idxname, "w"))
+     fprintf (deflater->index, "%s\n", DEFLATE_INDEX_MAGIC);
+   }
+  deflater->current  = 0;
+  deflater->nb_dict  = 0;
+  deflater->crc      = crc32 (0L, Z_NULL, 0);
+  deflater->isize    = 0;
+  deflater->f_error  = FALSE;
+  deflater->nb_slots = 0;
+  deflater->slot     = IMDBAllocMemory (nb_slots * sizeof (DeflateSlot));
+  deflater->dict     = IMDBAllocMemory (DEFLATE_DICT_SIZE);
+
+  /* every slot: in, dict and out in one piece of memory */
+  outsize = (LONG) compressBound (DEFLATE_BLOCK_SIZE) + 64;
+  while ((deflater->slot) && (deflater->dict) && (deflater->nb_slots < nb_slots))
+   {
+    slot = &deflater->slot[deflater->nb_slots];
+    if (NULL == (slot->in = IMDBAllocMemory (DEFLATE_BLOCK_SIZE + DEFLATE_DICT_SIZE + outsize)))
+     break;
+    slot->dict    = &slot->in[DEFLATE_BLOCK_SIZE];
+    slot->out     = &slot->dict[DEFLATE_DICT_SIZE];
+    slot->outsize = outsize;
+    slot->nb_in   = 0;
+    slot->state   = SLOT_FREE;
+    slot->strm.zalloc = Z_NULL;
+    slot->strm.zfree  = Z_NULL;
+    slot->strm.opaque = Z_NULL;
+    if (Z_OK != deflateInit2 (&slot->strm, DEFLATE_LEVEL, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY))
+     {
+      IMDBFreeMemory (slot->in);
+      break;
+     }
+    pthread_mutex_init (&slot->lock, NULL);
+    pthread_cond_init (&slot->cond, NULL);
+    if (pthread_create (&slot->thread, NULL, deflate_thread, slot))
+     {
+      pthread_mutex_destroy (&slot->lock);
+      pthread_cond_destroy (&slot->cond);
+      deflateEnd (&slot->strm);
+      IMDBFreeMemory (slot->in);
+      break;
+     }
+    deflater->nb_slots++;
+   }
+
+  /* not a single thread: give up */
+  if ((0 == deflater->nb_slots) || (10 != fwrite (header, 1, 10, stream)))
+   {
+    deflater->f_error = TRUE;
+    if (deflater->nb_slots)
+     deflate_close (deflater);
+    else
+     {
+      if (deflater->index)
+       {
+        fclose (deflater->index);
+        remove (deflater->idxname);
+       }
+      if (deflater->idxname) IMDBFreeMemory (deflater->idxname);
+      if (deflater->slot) IMDBFreeMemory (deflater->slot);
+      if (deflater->dict) IMDBFreeMemory (deflater->dict);
+      IMDBFreeMemory (deflater);
+     }
+    return (NULL);
+   }
+
+  return (deflater);
+ }
+
+/******************************************************************************
+ *  Parallel gzip-Reader (IMDB_THREADS)
+ *
+ *  Needs the index (<file>.idx) written by the parallel gzip-writer. The
+ *  file is cut at the index-points into chunks that can be inflated
+ *  without knowing the data before. The main thread reads the compressed
+ *  chunks, one thread per slot inflates them, and the caller gets the
+ *  data in order. Files without (valid) index are read by zlib as usual.
+ ******************************************************************************
+ */
+
+typedef struct
+ {
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  LONG            state;
+  z_stream        strm;
+  LONG            chunk;                 /* chunk in this slot or -1 */
+  UBYTE          *in;                    /* compressed chunk */
+  LONG            nb_in;
+  UBYTE          *out;                   /* uncompressed chunk */
+  LONG            nb_out;
+  LONG            outsize;               /* expected size of the chunk */
+  ULONG           frame_crc;             /* expected CRC32 of the chunk */
+  BOOL            f_last;                /* last chunk: end of stream */
+  BOOL            f_error;
+  ULONG           crc;                   /* CRC32 of this chunk */
+ } InflateSlot;
+
+typedef struct
+ {
+  FILE        *stream;
+  LONG         nb_chunks;
+  LONG        *c_point;                  /* compressed start of the chunks */
+  LONG        *u_point;                  /* uncompressed start of the chunks */
+  ULONG       *frame_crc;                /* CRC32 of the chunks */
+  LONG         size;                     /* uncompressed size */
+  ULONG        crc;                      /* CRC32 from the gzip-trailer */
+  LONG         nb_slots;
+  InflateSlot *slot;
+  LONG         current;                  /* slot that is being read */
+  LONG         outpos;                   /* position in this slot */
+  LONG         next_chunk;               /* next chunk to give away */
+  ULONG        crc_sum;                  /* CRC32 of the chunks read so far */
+  BOOL         f_crc;                    /* read from the start: check CRC */
+  BOOL         f_error;
+ } Inflater;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  inflate_thread
+ *
+ * Purpose:    uncompress the chunks of one slot
+ *-----------------------------------------------------------------------------
+ */
+
+static void *inflate_thread (void *p_arg)
+ {
+  InflateSlot *slot = (InflateSlot *) p_arg;
+  int          ret;
+
+  pthread_mutex_lock (&slot->lock);
+  for (;;)
+   {
+    while (SLOT_PENDING != slot->state)
+     {
+      if (SLOT_QUIT == slot->state)
+       {
+        pthread_mutex_unlock (&slot->lock);
+        return (NULL);
+       }
+      pthread_cond_wait (&slot->cond, &slot->lock);
+     }
+    pthread_mutex_unlock (&slot->lock);
+
+    slot->f_error = TRUE;
+    slot->nb_out  = 0;
+    if (Z_OK == inflateReset (&slot->strm))
+     {
+      slot->strm.next_in   = slot->in;
+      slot->strm.avail_in  = (uInt) slot->nb_in;
+      slot->strm.next_out  = slot->out;
+      slot->strm.avail_out = (uInt) slot->outsize;
+      ret = inflate (&slot->strm, Z_SYNC_FLUSH);
+      slot->nb_out = slot->outsize - slot->strm.avail_out;
+      if ((0 == slot->strm.avail_in) && (slot->nb_out == slot->outsize)
+        &&((slot->f_last) ? (Z_STREAM_END == ret) : ((Z_OK == ret) || (Z_BUF_ERROR == ret))))
+       slot->f_error = FALSE;
+      slot->crc = crc32 (crc32 (0L, Z_NULL, 0), slot->out, (uInt) slot->nb_out);
+      if (slot->crc != slot->frame_crc)
+       slot->f_error = TRUE;
+     }
+
+    pthread_mutex_lock (&slot->lock);
+    slot->state = SLOT_DONE;
+    pthread_cond_signal (&slot->cond);
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  inflate_wait, inflate_submit
+ *
+ * Purpose:    wait until a slot is not busy anymore / read the next chunk
+ *             into a slot and give it to its thread
+ *-----------------------------------------------------------------------------
+ */
+
+static void inflate_wait (InflateSlot *slot)
+ {
+  pthread_mutex_lock (&slot->lock);
+  while (SLOT_PENDING == slot->state)
+   pthread_cond_wait (&slot->cond, &slot->lock);
+  pthread_mutex_unlock (&slot->lock);
+ }
+
+static void inflate_submit (Inflater *inflater, InflateSlot *slot)
+ {
+  LONG chunk = inflater->next_chunk;
+  LONG state = SLOT_FREE;
+
+  slot->chunk = -1;
+  if (chunk < inflater->nb_chunks)
+   {
+    inflater->next_chunk++;
+    slot->chunk   = chunk;
+    slot->nb_in   = inflater->c_point[chunk+1] - inflater->c_point[chunk];
+    slot->outsize = inflater->u_point[chunk+1] - inflater->u_point[chunk];
+    slot->frame_crc = inflater->frame_crc[chunk];
+    slot->f_last  = (chunk + 1 == inflater->nb_chunks);
+    if ((fseek (inflater->stream, inflater->c_point[chunk], SEEK_SET))
+      ||(slot->nb_in != fread (slot->in, 1, slot->nb_in, inflater->stream)))
+     inflater->f_error = TRUE;
+    else
+     state = SLOT_PENDING;
+   }
+
+  pthread_mutex_lock (&slot->lock);
+  slot->state = state;
+  pthread_cond_signal (&slot->cond);
+  pthread_mutex_unlock (&slot->lock);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  inflate_start
+ *
+ * Purpose:    (re)start reading at an uncompressed position
+ *-----------------------------------------------------------------------------
+ */
+
+static void inflate_start (Inflater *inflater, LONG pos)
+ {
+  LONG chunk = 0;
+  LONG i;
+
+  for (i = 0; i < inflater->nb_slots; i++)
+   inflate_wait (&inflater->slot[i]);
+
+  while ((chunk + 1 < inflater->nb_chunks) && (inflater->u_point[chunk+1] <= pos))
+   chunk++;
+
+  inflater->f_crc      = (0 == pos);
+  inflater->crc_sum    = crc32 (0L, Z_NULL, 0);
+  inflater->next_chunk = chunk;
+  inflater->current    = 0;
+  inflater->outpos     = pos - inflater->u_point[chunk];
+  for (i = 0; i < inflater->nb_slots; i++)
+   inflate_submit (inflater, &inflater->slot[i]);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  inflate_read
+ *
+ * Purpose:    get uncompressed data
+ *
+ * Returns:    number of bytes read (0: end of file or error)
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG inflate_read (Inflater *inflater, char *p_mem, LONG size)
+ {
+  InflateSlot *slot;
+  LONG         nb;
+  LONG         done = 0;
+
+  while ((done < size) && (!inflater->f_error))
+   {
+    slot = &inflater->slot[inflater->current];
+    inflate_wait (slot);
+    if (-1 == slot->chunk)
+     break;  /* end of file */
+    if (slot->f_error)
+     {
+      inflater->f_error = TRUE;
+      break;
+     }
+
+    nb = slot->nb_out - inflater->outpos;
+    if (nb > size - done)
+     nb = size - done;
+    if (nb < 0)
+     nb = 0;
+    memcpy (&p_mem[done], &slot->out[inflater->outpos], nb);
+    inflater->outpos += nb;
+    done             += nb;
+
+    /* chunk finished: check CRC at the end, give the slot the next chunk */
+    if (inflater->outpos >= slot->nb_out)
+     {
+      inflater->crc_sum = crc32_combine (inflater->crc_sum, slot->crc, (z_off_t) slot->nb_out);
+      if ((slot->f_last) && (inflater->f_crc) && (inflater->crc_sum != inflater->crc))
+       inflater->f_error = TRUE;
+      inflate_submit (inflater, slot);
+      inflater->current = (inflater->current + 1) % inflater->nb_slots;
+      inflater->outpos  = 0;
+     }
+   }
+
+  return ((inflater->f_error) ? 0 : done);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  inflate_close
+ *
+ * Purpose:    stop the threads and free the inflater. The stream is not
+ *             closed.
+ *-----------------------------------------------------------------------------
+ */
+
+static void inflate_close (Inflater *inflater)
+ {
+  InflateSlot *slot;
+  LONG         i;
+
+  for (i = 0; i < inflater->nb_slots; i++)
+   {
+    slot = &inflater->slot[i];
+    pthread_mutex_lock (&slot->lock);
+    while (SLOT_PENDING == slot->state)
+     pthread_cond_wait (&slot->cond, &slot->lock);
+    slot->state = SLOT_QUIT;
+    pthread_cond_signal (&slot->cond);
+    pthread_mutex_unlock (&slot->lock);
+    pthread_join (slot->thread, NULL);
+    pthread_mutex_destroy (&slot->lock);
+    pthread_cond_destroy (&slot->cond);
+    inflateEnd (&slot->strm);
+    IMDBFreeMemory (slot->in);
+   }
+
+  if (inflater->slot) IMDBFreeMemory (inflater->slot);
+  if (inflater->c_point) IMDBFreeMemory (inflater->c_point);
+  if (inflater->frame_crc) IMDBFreeMemory (inflater->frame_crc);
+  IMDBFreeMemory (inflater);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  inflate_index
+ *
+ * Purpose:    read the index of a compressed file. The index must match
+ *             the file (size and gzip-trailer), otherwise it is ignored.
+ *
+ * Returns:    TRUE if the index can be used
+ *-----------------------------------------------------------------------------
+ */
+
+static BOOL inflate_index (Inflater *inflater, char *fname)
+ {
+  FILE  *index;
+  char  *idxname;
+  char   line[80];
+  LONG   nb_points = 0;
+  LONG   c_size    = -1;
+  LONG   i         = 0;
+  ULONG  crc;
+  UBYTE  trailer[8];
+  BOOL   f_ok      = FALSE;
+
+  if (NULL == (idxname = IMDBAllocMemory (strlen (fname) + strlen (IMDBV_FILE_INDEX_EXT) + 1)))
+   return (FALSE);
+  strcpy (idxname, fname);
+  strcat (idxname, IMDBV_FILE_INDEX_EXT);
+  index = fopen (idxname, "r");
+  IMDBFreeMemory (idxname);
+  if (NULL == index)
+   return (FALSE);
+
+  /* count the points */
+  if ((fgets (line, sizeof (line), index)) && (0 == strncmp (line, DEFLATE_INDEX_MAGIC, strlen (DEFLATE_INDEX_MAGIC))))
+   while (fgets (line, sizeof (line), index))
+    if (0 == strncmp (line, "point ", 6))
+     nb_points++;
+
+  /* one more for the end of the file */
+  if ((nb_points)
+    &&(inflater->frame_crc = IMDBAllocMemory (nb_points * sizeof (ULONG)))
+    &&(inflater->c_point = IMDBAllocMemory (2 * (nb_points + 1) * sizeof (LONG))))
+   {
+    inflater->u_point = &inflater->c_point[nb_points + 1];
+    rewind (index);
+    fgets (line, sizeof (line), index);
+    while ((fgets (line, sizeof (line), index)) && (i <= nb_points))
+     {
+      if ((i < nb_points)
+        &&(3 == sscanf (line, "point %ld %ld %lX", &inflater->c_point[i], &inflater->u_point[i], &inflater->frame_crc[i])))
+       i++;
+      else
+      if (3 == sscanf (line, "end %ld %ld %lX", &c_size, &inflater->size, &crc))
+       break;
+     }
+   }
+  fclose (index);
+
+  /* does the index belong to this file? */
+  if ((i == nb_points) && (0 < c_size)
+    &&(0 == fseek (inflater->stream, -8, SEEK_END)) && (8 == fread (trailer, 1, 8, inflater->stream))
+    &&(c_size == ftell (inflater->stream)))
+   {
+    inflater->crc = (ULONG) trailer[0] | ((ULONG) trailer[1] << 8) | ((ULONG) trailer[2] << 16) | ((ULONG) trailer[3] << 24);
+    inflater->c_point[nb_points] = c_size - 8;
+    inflater->u_point[nb_points] = inflater->size;
+    f_ok = ((crc == inflater->crc)
+          &&((ULONG) (inflater->size & 0xFFFFFFFFL) == ((ULONG) trailer[4] | ((ULONG) trailer[5] << 8) | ((ULONG) trailer[6] << 16) | ((ULONG) trailer[7] << 24))));
+    for (i = 0; (f_ok) && (i < nb_points); i++)
+     if ((inflater->c_point[i] >= inflater->c_point[i+1]) || (inflater->u_point[i] > inflater->u_point[i+1]))
+      f_ok = FALSE;
+   }
+
+  inflater->nb_chunks = nb_points;
+  return (f_ok);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  inflate_open
+ *
+ * Purpose:    start the threads of an inflater
+ *
+ * Parameters: stream    compressed file opened for reading
+ *             fname     name of the file (for the index)
+ *             min_slots less threads are not worth it
+ *
+ * Returns:    inflater or NULL if not possible (no index, one cpu, ...)
+ *-----------------------------------------------------------------------------
+ */
+
+static Inflater *inflate_open (FILE *stream, char *fname, LONG min_slots)
+ {
+  Inflater    *inflater;
+  InflateSlot *slot;
+  LONG         nb_slots = nb_threads ();
+  LONG         insize   = 0;
+  LONG         outsize  = 0;
+  LONG         i;
+
+  if (nb_slots < min_slots)
+   return (NULL);
+  if (nb_slots < 1)
+   nb_slots = 1;
+
+  if (NULL == (inflater = IMDBAllocMemory (sizeof (Inflater))))
+   return (NULL);
+  inflater->stream   = stream;
+  inflater->c_point  = NULL;
+  inflater->frame_crc = NULL;
+  inflater->nb_slots = 0;
+  inflater->f_error  = FALSE;
+  inflater->slot     = NULL;
+
+  if (inflate_index (inflater, fname))
+   {
+    /* the slots need room for the biggest chunk */
+    for (i = 0; i < inflater->nb_chunks; i++)
+     {
+      if (insize < inflater->c_point[i+1] - inflater->c_point[i])
+       insize = inflater->c_point[i+1] - inflater->c_point[i];
+      if (outsize < inflater->u_point[i+1] - inflater->u_point[i])
+       outsize = inflater->u_point[i+1] - inflater->u_point[i];
+     }
+    if (nb_slots > inflater->nb_chunks)
+     nb_slots = inflater->nb_chunks;
+    inflater->slot = IMDBAllocMemory (nb_slots * sizeof (InflateSlot));
+   }
+
+  while ((inflater->slot) && (inflater->nb_slots < nb_slots))
+   {
+    slot = &inflater->slot[inflater->nb_slots];
+    if (NULL == (slot->in = IMDBAllocMemory (insize + outsize + 1)))
+     break;
+    slot->out   = &slot->in[insize];
+    slot->state = SLOT_FREE;
+    slot->chunk = -1;
+    slot->strm.zalloc   = Z_NULL;
+    slot->strm.zfree    = Z_NULL;
+    slot->strm.opaque   = Z_NULL;
+    slot->strm.next_in  = Z_NULL;
+    slot->strm.avail_in = 0;
+    if (Z_OK != inflateInit2 (&slot->strm, -15))
+     {
+      IMDBFreeMemory (slot->in);
+      break;
+     }
+    pthread_mutex_init (&slot->lock, NULL);
+    pthread_cond_init (&slot->cond, NULL);
+    if (pthread_create (&slot->thread, NULL, inflate_thread, slot))
+     {
+      pthread_mutex_destroy (&slot->lock);
+      pthread_cond_destroy (&slot->cond);
+      inflateEnd (&slot->strm);
+      IMDBFreeMemory (slot->in);
+      break;
+     }
+    inflater->nb_slots++;
+   }
+
+  /* not enough threads: zlib does the job just as well */
+  if ((inflater->nb_slots < min_slots) || (0 == inflater->nb_slots))
+   {
+    inflate_close (inflater);
+    return (NULL);
+   }
+
+  inflate_start (inflater, 0);
+  return (inflater);
+ }
+
+/******************************************************************************
+ *  Read-ahead and Write-behind (IMDB_THREADS)
+ *
+ *  Plain files opened with IMDBV_FILE_THREAD get a thread of their own
+ *  that does the fread()/fwrite(). It is connected to the caller by a ring
+ *  of PIPE_SEGMENTS segments with one producer and one consumer: while
+ *  the caller patches the data of one segment, the thread already reads
+ *  the next ones (or writes the last ones). So the disk is kept busy and
+ *  the waiting for it overlaps with the work of the caller.
+ ******************************************************************************
+ */
+
+#define PIPE_SEGMENTS      4
+#define PIPE_SEGMENT_SIZE  (256*1024)
+
+typedef struct
+ {
+  FILE           *stream;
+  pthread_t       thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  BOOL            f_write;               /* write-behind, else read-ahead */
+  char           *seg[PIPE_SEGMENTS];
+  LONG            nb[PIPE_SEGMENTS];     /* bytes in the segments */
+  LONG            head;                  /* segments filled (read: by thread) */
+  LONG            tail;                  /* segments emptied (write: by thread) */
+  LONG            pos;                   /* read: in seg tail, write: in seg head */
+  BOOL            f_busy;                /* thread does I/O on the stream */
+  BOOL            f_eof;
+  BOOL            f_error;
+  BOOL            f_quit;
+ } Pipe;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  pipe_thread
+ *
+ * Purpose:    read segments ahead / write filled segments. The segment in
+ *             work is used without lock, the ring is only changed with it.
+ *-----------------------------------------------------------------------------
+ */
+
+static void *pipe_thread (void *p_arg)
+ {
+  Pipe *pipe = (Pipe *) p_arg;
+  LONG  i;
+  LONG  nb;
+
+  pthread_mutex_lock (&pipe->lock);
+  while (!pipe->f_quit)
+   {
+    if ((pipe->f_write) ? (pipe->head == pipe->tail)
+                        : ((pipe->f_eof) || (pipe->f_error) || (pipe->head - pipe->tail == PIPE_SEGMENTS)))
+     {
+      pthread_cond_wait (&pipe->cond, &pipe->lock);
+      continue;
+     }
+
+    pipe->f_busy = TRUE;
+    pthread_mutex_unlock (&pipe->lock);
+    if (pipe->f_write)
+     {
+      i  = pipe->tail % PIPE_SEGMENTS;
+      nb = fwrite (pipe->seg[i], 1, pipe->nb[i], pipe->stream);
+     }
+    else
+     {
+      i  = pipe->head % PIPE_SEGMENTS;
+      nb = fread (pipe->seg[i], 1, PIPE_SEGMENT_SIZE, pipe->stream);
+     }
+    pthread_mutex_lock (&pipe->lock);
+    pipe->f_busy = FALSE;
+
+    if (pipe->f_write)
+     {
+      if (nb != pipe->nb[i])
+       pipe->f_error = TRUE;
+      pipe->tail++;
+     }
+    else
+     {
+      pipe->nb[i] = nb;
+      if (nb < PIPE_SEGMENT_SIZE)
+       {
+        pipe->f_eof = TRUE;
+        if (ferror (pipe->stream))
+         pipe->f_error = TRUE;
+       }
+      if (nb > 0)
+       pipe->head++;
+     }
+    pthread_cond_broadcast (&pipe->cond);
+   }
+  pthread_mutex_unlock (&pipe->lock);
+  return (NULL);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  pipe_read
+ *
+ * Purpose:    get the data read ahead
+ *
+ * Returns:    number of bytes read (0: end of file or error)
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG pipe_read (Pipe *pipe, char *p_mem, LONG size)
+ {
+  LONG i;
+  LONG nb;
+  LONG done = 0;
+
+  pthread_mutex_lock (&pipe->lock);
+  while (done < size)
+   {
+    while ((pipe->head == pipe->tail) && (!pipe->f_eof) && (!pipe->f_error))
+     pthread_cond_wait (&pipe->cond, &pipe->lock);
+    if (pipe->head == pipe->tail)
+     break;  /* end of file */
+
+    /* the thread does not touch this segment until it is given back */
+    i = pipe->tail % PIPE_SEGMENTS;
+    pthread_mutex_unlock (&pipe->lock);
+    nb = pipe->nb[i] - pipe->pos;
+    if (nb > size - done)
+     nb = size - done;
+    memcpy (&p_mem[done], &pipe->seg[i][pipe->pos], nb);
+    pipe->pos += nb;
+    done      += nb;
+    pthread_mutex_lock (&pipe->lock);
+
+    if (pipe->pos >= pipe->nb[i])
+     {
+      pipe->tail++;
+      pipe->pos = 0;
+      pthread_cond_broadcast (&pipe->cond);
+     }
+   }
+  if (pipe->f_error)
+   done = 0;
+  pthread_mutex_unlock (&pipe->lock);
+
+  return (done);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  pipe_seek
+ *
+ * Purpose:    throw away the data read ahead and go on reading at pos
+ *
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_POSITION
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG pipe_seek (Pipe *pipe, LONG pos)
+ {
+  LONG ret = IMDBE_NO_ERROR;
+
+  pthread_mutex_lock (&pipe->lock);
+  while (pipe->f_busy)
+   pthread_cond_wait (&pipe->cond, &pipe->lock);
+
+  clearerr (pipe->stream);
+  if (fseek (pipe->stream, pos, SEEK_SET))
+   ret = IMDBE_FILE_POSITION;
+  pipe->head    = 0;
+  pipe->tail    = 0;
+  pipe->pos     = 0;
+  pipe->f_eof   = FALSE;
+  pipe->f_error = (IMDBE_NO_ERROR != ret);
+  pthread_cond_broadcast (&pipe->cond);
+  pthread_mutex_unlock (&pipe->lock);
+
+  return (ret);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  pipe_write, pipe_flush
+ *
+ * Purpose:    give data to the thread / wait until all of it is written
+ *
+ * Returns:    number of bytes taken (0: write error) /
+ *             IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG pipe_write (Pipe *pipe, char *p_mem, LONG size)
+ {
+  LONG i;
+  LONG nb;
+  LONG done = 0;
+  BOOL f_error;
+
+  while (done < size)
+   {
+    pthread_mutex_lock (&pipe->lock);
+    while (pipe->head - pipe->tail == PIPE_SEGMENTS)
+     pthread_cond_wait (&pipe->cond, &pipe->lock);
+    f_error = pipe->f_error;
+    pthread_mutex_unlock (&pipe->lock);
+    if (f_error)
+     return (0);
+
+    /* the segment head belongs to the caller until it is given away */
+    i  = pipe->head % PIPE_SEGMENTS;
+    nb = PIPE_SEGMENT_SIZE - pipe->pos;
+    if (nb > size - done)
+     nb = size - done;
+    memcpy (&pipe->seg[i][pipe->pos], &p_mem[done], nb);
+    pipe->pos += nb;
+    done      += nb;
+
+    if (PIPE_SEGMENT_SIZE == pipe->pos)
+     {
+      pthread_mutex_lock (&pipe->lock);
+      pipe->nb[i] = pipe->pos;
+      pipe->pos   = 0;
+      pipe->head++;
+      pthread_cond_broadcast (&pipe->cond);
+      pthread_mutex_unlock (&pipe->lock);
+     }
+   }
+
+  return (done);
+ }
+
+static LONG pipe_flush (Pipe *pipe)
+ {
+  BOOL f_error;
+
+  pthread_mutex_lock (&pipe->lock);
+  if (pipe->pos > 0)
+   {
+    pipe->nb[pipe->head % PIPE_SEGMENTS] = pipe->pos;
+    pipe->pos = 0;
+    pipe->head++;
+    pthread_cond_broadcast (&pipe->cond);
+   }
+  while (pipe->head != pipe->tail)
+   pthread_cond_wait (&pipe->cond, &pipe->lock);
+  f_error = pipe->f_error;
+  pthread_mutex_unlock (&pipe->lock);
+
+  return ((f_error) ? IMDBE_FILE_WRITE : IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  pipe_close
+ *
+ * Purpose:    write the rest, stop the thread and free the pipe. The stream
+ *             is not closed.
+ *
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG pipe_close (Pipe *pipe)
+ {
+  LONG ret = IMDBE_NO_ERROR;
+
+  if (pipe->f_write)
+   ret = pipe_flush (pipe);
+
+  pthread_mutex_lock (&pipe->lock);
+  pipe->f_quit = TRUE;
+  pthread_cond_broadcast (&pipe->cond);
+  pthread_mutex_unlock (&pipe->lock);
+  pthread_join (pipe->thread, NULL);
+  pthread_mutex_destroy (&pipe->lock);
+  pthread_cond_destroy (&pipe->cond);
+
+  budget_give (PIPE_SEGMENTS * PIPE_SEGMENT_SIZE);
+  IMDBFreeMemory (pipe->seg[0]);
+  IMDBFreeMemory (pipe);
+  return (ret);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  pipe_open
+ *
+ * Purpose:    start the thread of a plain file at the current position
+ *
+ * Returns:    pipe or NULL (one cpu only or no memory: read/write directly)
+ *-----------------------------------------------------------------------------
+ */
+
+static Pipe *pipe_open (FILE *stream, BOOL f_write)
+ {
+  Pipe *pipe;
+  LONG  i;
+
+  if (nb_threads () < 2)
+   return (NULL);
+
+  /* memory budget: all segments or no thread */
+  if (0 == budget_take (PIPE_SEGMENTS * PIPE_SEGMENT_SIZE, 0, TRUE))
+   return (NULL);
+
+  if (NULL == (pipe = IMDBAllocMemory (sizeof (Pipe))))
+   {
+    budget_give (PIPE_SEGMENTS * PIPE_SEGMENT_SIZE);
+    return (NULL);
+   }
+  if (NULL == (pipe->seg[0] = IMDBAllocMemory (PIPE_SEGMENTS * PIPE_SEGMENT_SIZE)))
+   {
+    budget_give (PIPE_SEGMENTS * PIPE_SEGMENT_SIZE);
+    IMDBFreeMemory (pipe);
+    return (NULL);
+   }
+  for (i = 0; i < PIPE_SEGMENTS; i++)
+   {
+    pipe->seg[i] = &pipe->seg[0][i * PIPE_SEGMENT_SIZE];
+    pipe->nb[i]  = 0;
+   }
+  pipe->stream  = stream;
+  pipe->f_write = f_write;
+  pipe->head    = 0;
+  pipe->tail    = 0;
+  pipe->pos     = 0;
+  pipe->f_busy  = FALSE;
+  pipe->f_eof   = FALSE;
+  pipe->f_error = FALSE;
+  pipe->f_quit  = FALSE;
+
+  pthread_mutex_init (&pipe->lock, NULL);
+  pthread_cond_init (&pipe->cond, NULL);
+  if (pthread_create (&pipe->thread, NULL, pipe_thread, pipe))
+   {
+    pthread_mutex_destroy (&pipe->lock);
+    pthread_cond_destroy (&pipe->cond);
+    budget_give (PIPE_SEGMENTS * PIPE_SEGMENT_SIZE);
+    IMDBFreeMemory (pipe->seg[0]);
+    IMDBFreeMemory (pipe);
+    return (NULL);
+   }
+
+  return (pipe);
+ }
+
+#endif /* IMDB_THREADS */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBCheckFrames
+ *
+ * Purpose:    check the CRC32 of every frame of a compressed file that has
+ *             a block-index, without reading it line by line
+ *
+ * Comment:    Only available with IMDB_THREADS
+ *
+ * Parameters: fname   Filename
+ *             p_size  uncompressed size of the file
+ *             p_pos   uncompressed position of the first damaged frame
+ *
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_READ if a frame is damaged or
+ *             IMDBE_NOTFOUND if the file has no (valid) index
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBCheckFrames (char *fname, LONG *p_size, LONG *p_pos)
+ {
+  LONG ret = IMDBE_NOTFOUND;
+#ifdef IMDB_THREADS
+  FILE        *stream;
+  Inflater    *inflater;
+  InflateSlot *slot;
+
+  if (stream = fopen (fname, "rb"))
+   {
+    if (inflater = inflate_open (stream, fname, 1))
+     {
+      *p_size = inflater->size;
+      ret = IMDBE_NO_ERROR;
+      for (;;)
+       {
+        slot = &inflater->slot[inflater->current];
+        inflate_wait (slot);
+        if (-1 == slot->chunk)
+         break;
+        if ((slot->f_error) || (inflater->f_error))
+         {
+          *p_pos = inflater->u_point[slot->chunk];
+          ret = IMDBE_FILE_READ;
+          break;
+         }
+        inflate_submit (inflater, slot);
+        inflater->current = (inflater->current + 1) % inflater->nb_slots;
+       }
+      inflate_close (inflater);
+     }
+    fclose (stream);
+   }
+#endif
+  return (ret);
+ }
+
+/******************************************************************************
+ *  Chunked Listfiles
+ ******************************************************************************
+ *
+ * The manifest is a small text-file like the block-index. A chunked
+ * listfile is read through IMDBOpenBuffer (IMDBV_FILE_CHUNKS): the
+ * chunk-files are opened one after the other and look like one stream.
+ *
+ ******************************************************************************
+ */
+
+typedef struct
+ {
+  IMDB_Manifest *manifest;       /* manifest of the listfile */
+  LONG           chunk;          /* index of the current chunk */
+  LONG           chunk_pos;      /* position in the current chunk */
+ } ChunkReader;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBChunkName
+ *
+ * Purpose:    build the filename of a chunk-file: movies.list.000001
+ *-----------------------------------------------------------------------------
+ */
+
+void IMDBChunkName (char *p_name, char *listfile, LONG id)
+ {
+  sprintf (p_name, "%.240s.%06ld", listfile, id);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBCreateManifest, IMDBFreeManifest
+ *
+ * Purpose:    create an empty manifest / free a manifest
+ *
+ * Parameters: chunk_lines  lines per chunk
+ *             next_id      number of the first new chunk-file
+ *
+ * Returns:    pointer to manifest or NULL
+ *-----------------------------------------------------------------------------
+ */
+
+IMDB_Manifest *IMDBCreateManifest (LONG chunk_lines, LONG next_id)
+ {
+  IMDB_Manifest *manifest;
+
+  if (manifest = IMDBAllocMemory (sizeof (IMDB_Manifest)))
+   {
+    manifest->chunk_lines = chunk_lines;
+    manifest->next_id     = next_id;
+    manifest->nb_chunks   = 0;
+    manifest->max_chunks  = 64;
+    if (NULL == (manifest->chunks = IMDBAllocMemory (manifest->max_chunks * sizeof (IMDB_Chunk))))
+     {
+      IMDBFreeMemory (manifest);
+      return (NULL);
+     }
+   }
+  return (manifest);
+ }
+
+void IMDBFreeManifest (IMDB_Manifest *manifest)
+ {
+  if (manifest)
+   {
+    IMDBFreeMemory (manifest->chunks);
+    IMDBFreeMemory (manifest);
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBAddChunk
+ *
+ * Purpose:    append a chunk to a manifest, its first line follows the
+ *             previous chunk
+ *
+ * Returns:    IMDBE_NO_ERROR or IMDBE_MEMORY
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBAddChunk (IMDB_Manifest *manifest, LONG id, LONG lines, LONG size, ULONG crc)
+ {
+  IMDB_Chunk *chunks;
+  IMDB_Chunk *chunk;
+
+  if (manifest->nb_chunks == manifest->max_chunks)
+   {
+    if (NULL == (chunks = IMDBAllocMemory (2 * manifest->max_chunks * sizeof (IMDB_Chunk))))
+     return (IMDBE_MEMORY);
+    memcpy (chunks, manifest->chunks, manifest->nb_chunks * sizeof (IMDB_Chunk));
+    IMDBFreeMemory (manifest->chunks);
+    manifest->chunks      = chunks;
+    manifest->max_chunks *= 2;
+   }
+
+  chunk = &manifest->chunks[manifest->nb_chunks];
+  chunk->id    = id;
+  chunk->first = (manifest->nb_chunks) ? chunk[-1].first + chunk[-1].lines : 1;
+  chunk->lines = lines;
+  chunk->size  = size;
+  chunk->crc   = crc & 0xFFFFFFFFL;
+  manifest->nb_chunks++;
+  if (id >= manifest->next_id)
+   manifest->next_id = id + 1;
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBFindChunk
+ *
+ * Returns:    TRUE, if the manifest uses chunk-file id
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL IMDBFindChunk (IMDB_Manifest *manifest, LONG id)
+ {
+  LONG i;
+
+  if (manifest)
+   for (i = 0; i < manifest->nb_chunks; i++)
+    if (manifest->chunks[i].id == id)
+     return (TRUE);
+  return (FALSE);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBReadManifest
+ *
+ * Purpose:    read the manifest of a chunked listfile
+ *
+ * Comment:    The chunks must follow each other without a gap and end
+ *             with the number of lines of the end-line, otherwise the
+ *             manifest is taken as damaged.
+ *
+ * Parameters: fname  filename of the manifest
+ *
+ * Returns:    pointer to manifest or NULL
+ *-----------------------------------------------------------------------------
+ */
+
+IMDB_Manifest *IMDBReadManifest (char *fname)
+ {
+  IMDB_Manifest *manifest = NULL;
+  FILE          *stream;
+  char           line[120];
+  LONG           chunk_lines = 0;
+  LONG           next_id     = 0;
+  LONG           id, first, lines, size;
+  ULONG          crc;
+  BOOL           f_ok        = FALSE;
+
+  if (NULL == (stream = fopen (fname, "r")))
+   return (NULL);
+
+  if ((fgets (line, sizeof (line), stream)) && (0 == strncmp (line, IMDBV_CHUNKS_MAGIC, strlen (IMDBV_CHUNKS_MAGIC)))
+    &&(fgets (line, sizeof (line), stream)) && (1 == sscanf (line, "chunklines %ld", &chunk_lines))
+    &&(fgets (line, sizeof (line), stream)) && (1 == sscanf (line, "next %ld", &next_id))
+    &&(manifest = IMDBCreateManifest (chunk_lines, next_id)))
+   {
+    while (fgets (line, sizeof (line), stream))
+     {
+      if (5 == sscanf (line, "chunk %ld %ld %ld %ld %lX", &id, &first, &lines, &size, &crc))
+       {
+        if ((first != ((manifest->nb_chunks) ? manifest->chunks[manifest->nb_chunks-1].first + manifest->chunks[manifest->nb_chunks-1].lines : 1))
+          ||(lines <= 0) || (size < lines) || (id < 0)
+          ||(IMDBAddChunk (manifest, id, lines, size, crc)))
+         break;
+       }
+      else
+       {
+        if (1 == sscanf (line, "end %ld", &lines))
+         f_ok = (lines == ((manifest->nb_chunks) ? manifest->chunks[manifest->nb_chunks-1].first + manifest->chunks[manifest->nb_chunks-1].lines - 1 : 0));
+        break;
+       }
+     }
+   }
+  fclose (stream);
+
+  if ((manifest) && (!f_ok))
+   {
+    IMDBFreeManifest (manifest);
+    manifest = NULL;
+   }
+  return (manifest);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBWriteManifest
+ *
+ * Purpose:    write a manifest and flush it to the disk
+ *
+ * Comment:    The manifest should be written to a temporary name and be
+ *             renamed, so the listfile is changed in one step. The
+ *             chunk-files must be on the disk before (IMDBSyncFile).
+ *
+ * Parameters: manifest, fname
+ *
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBWriteManifest (IMDB_Manifest *manifest, char *fname)
+ {
+  FILE       *stream;
+  IMDB_Chunk *chunk;
+  LONG        lines = 0;
+  LONG        i;
+  BOOL        f_ok;
+
+  if (NULL == (stream = fopen (fname, "w")))
+   return (IMDBE_FILE_WRITE);
+
+  f_ok = ((0 <= fprintf (stream, IMDBV_CHUNKS_MAGIC "\n"))
+        &&(0 <= fprintf (stream, "chunklines %ld\nnext %ld\n", manifest->chunk_lines, manifest->next_id)));
+  for (i = 0; (f_ok) && (i < manifest->nb_chunks); i++)
+   {
+    chunk = &manifest->chunks[i];
+    f_ok  = (0 <= fprintf (stream, "chunk %ld %ld %ld %ld %08lX\n", chunk->id, chunk->first, chunk->lines, chunk->size, (ULONG) chunk->crc));
+    lines = chunk->first + chunk->lines - 1;
+   }
+  if (f_ok)
+   f_ok = (0 <= fprintf (stream, "end %ld\n", lines));
+
+  if ((fclose (stream)) || (!f_ok) || (IMDBSyncFile (fname)))
+   {
+    remove (fname);
+    return (IMDBE_FILE_WRITE);
+   }
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  chunk_open, chunk_close
+ *
+ * Purpose:    start/stop reading a chunked listfile
+ *
+ * Parameters: listfile  name of the listfile (without IMDBV_CHUNKS_EXT)
+ *
+ * Returns:    reader or NULL if the manifest can't be read
+ *-----------------------------------------------------------------------------
+ */
+
+static ChunkReader *chunk_open (char *listfile)
+ {
+  ChunkReader *reader;
+  char         fname[256];
+
+  if (reader = IMDBAllocMemory (sizeof (ChunkReader)))
+   {
+    sprintf (fname, "%.240s" IMDBV_CHUNKS_EXT, listfile);
+    reader->chunk     = 0;
+    reader->chunk_pos = 0;
+    if (NULL == (reader->manifest = IMDBReadManifest (fname)))
+     {
+      IMDBFreeMemory (reader);
+      return (NULL);
+     }
+   }
+  return (reader);
+ }
+
+static void chunk_close (ChunkReader *reader)
+ {
+  IMDBFreeManifest (reader->manifest);
+  IMDBFreeMemory (reader);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  chunk_read, chunk_seek
+ *
+ * Purpose:    read from/position a chunked listfile. The stream of the
+ *             buffer is the current chunk-file, it is opened when the
+ *             first byte is needed. Of every chunk-file only the size
+ *             from the manifest is read. A missing or short chunk-file
+ *             ends the listfile (the CRC will tell).
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG chunk_read (IMDB_Buffer *p_buffer, char *p_mem, LONG size)
+ {
+  ChunkReader *reader = (ChunkReader *) p_buffer->chunks;
+  IMDB_Chunk  *chunk;
+  char         fname[256];
+  LONG         nb     = 0;
+  LONG         t_nb;
+
+  while ((nb < size) && (reader->chunk < reader->manifest->nb_chunks))
+   {
+    chunk = &reader->manifest->chunks[reader->chunk];
+    if (NULL == p_buffer->stream)
+     {
+      IMDBChunkName (fname, p_buffer->fname, chunk->id);
+      if ((NULL == (p_buffer->stream = fopen (fname, "rb")))
+        ||((reader->chunk_pos) && (fseek (p_buffer->stream, reader->chunk_pos, SEEK_SET))))
+       break;
+     }
+
+    t_nb = size - nb;
+    if (t_nb > chunk->size - reader->chunk_pos)
+     t_nb = chunk->size - reader->chunk_pos;
+    if (0 == (t_nb = fread (&p_mem[nb], 1, t_nb, p_buffer->stream)))
+     break;
+    nb                += t_nb;
+    reader->chunk_pos += t_nb;
+
+    /* next chunk */
+    if (reader->chunk_pos == chunk->size)
+     {
+      fclose (p_buffer->stream);
+      p_buffer->stream  = NULL;
+      reader->chunk_pos = 0;
+      reader->chunk++;
+     }
+   }
+
+  if (nb < size)
+   {
+    if (reader->chunk < reader->manifest->nb_chunks)
+     IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_READ, p_buffer->fname);
+    reader->chunk = reader->manifest->nb_chunks;
+   }
+  return (nb);
+ }
+
+static LONG chunk_seek (IMDB_Buffer *p_buffer, LONG pos)
+ {
+  ChunkReader *reader = (ChunkReader *) p_buffer->chunks;
+  LONG         i;
+
+  if (p_buffer->stream)
+   fclose (p_buffer->stream);
+  p_buffer->stream = NULL;
+
+  for (i = 0; (i < reader->manifest->nb_chunks) && (pos >= reader->manifest->chunks[i].size); i++)
+   pos -= reader->manifest->chunks[i].size;
+  if ((pos) && (i == reader->manifest->nb_chunks))
+   return (IMDBE_FILE_POSITION);
+
+  reader->chunk     = i;
+  reader->chunk_pos = pos;
+  return (IMDBE_NO_ERROR);
+ }
+
+/******************************************************************************
+ *  Buffer-Handling
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  stream_read, stream_write, stream_seek
+ *
+ * Purpose:    read from/write to/position the stream of a buffer
+ *             (file, zlib, chunked listfile or read-ahead/write-behind
+ *             thread)
+ *
+ * Comment:    streampos holds the (uncompressed) position of the stream
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG stream_read (IMDB_Buffer *p_buffer, char *p_mem, LONG size)
+ {
+  LONG nb;
+
+  if (p_buffer->chunks)
+   nb = chunk_read (p_buffer, p_mem, size);
+  else
+#ifdef IMDB_THREADS
+  if (p_buffer->inflater)
+   nb = inflate_read ((Inflater *) p_buffer->inflater, p_mem, size);
+  else
+#endif
+#ifdef IMDB_ZLIB
+  if (p_buffer->gzstream)
+   {
+    if (0 > (nb = gzread ((gzFile) p_buffer->gzstream, p_mem, (unsigned) size)))
+     nb = 0;
+   }
+  else
+#endif
+#ifdef IMDB_THREADS
+  if (p_buffer->pipe)
+   nb = pipe_read ((Pipe *) p_buffer->pipe, p_mem, size);
+  else
+#endif
+  nb = fread (p_mem, 1, size, p_buffer->stream);
+
+  p_buffer->streampos += nb;
+  return (nb);
+ }
+
+static LONG stream_write (IMDB_Buffer *p_buffer, char *p_mem, LONG size)
+ {
+  LONG nb;
+
+  if (0 == size)
+   return (0);
+
+#ifdef IMDB_THREADS
+  if (p_buffer->deflater)
+   nb = deflate_write ((Deflater *) p_buffer->deflater, p_mem, size);
+  else
+#endif
+#ifdef IMDB_ZLIB
+  if (p_buffer->gzstream)
+   {
+    if (0 > (nb = gzwrite ((gzFile) p_buffer->gzstream, p_mem, (unsigned) size)))
+     nb = 0;
+   }
+  else
+#endif
+#ifdef IMDB_THREADS
+  if (p_buffer->pipe)
+   nb = pipe_write ((Pipe *) p_buffer->pipe, p_mem, size);
+  else
+#endif
+  nb = fwrite (p_mem, 1, size, p_buffer->stream);
+
+  p_buffer->streampos += nb;
+  return (nb);
+ }
+
+static LONG stream_seek (IMDB_Buffer *p_buffer, LONG pos)
+ {
+  if (p_buffer->chunks)
+   {
+    if (chunk_seek (p_buffer, pos))
+     return (IMDBE_FILE_POSITION);
+   }
+  else
+#ifdef IMDB_THREADS
+  if (p_buffer->inflater)
+   {
+    if (pos != p_buffer->streampos)
+     inflate_start ((Inflater *) p_buffer->inflater, pos);
+   }
+  else
+  if (p_buffer->pipe)
+   {
+    if (pipe_seek ((Pipe *) p_buffer->pipe, pos))
+     return (IMDBE_FILE_POSITION);
+   }
+  else
+#endif
+#ifdef IMDB_ZLIB
+  if (p_buffer->gzstream)
+   {
+    if (pos != gzseek ((gzFile) p_buffer->gzstream, (z_off_t) pos, SEEK_SET))
+     return (IMDBE_FILE_POSITION);
+   }
+  else
+#endif
+  if (fseek (p_buffer->stream, pos, SEEK_SET))
+   return (IMDBE_FILE_POSITION);
+
+  p_buffer->streampos = pos;
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  buffer_read, buffer_seek
+ *
+ * Purpose:    read from/position a buffer. Sections are read from the
+ *             stream of their archive.
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG buffer_read (IMDB_Buffer *p_buffer, char *p_mem, LONG size)
+ {
+  IMDB_Buffer *p_archive = p_buffer->archive;
+  LONG         nb;
+
+  if (NULL == p_archive)
+   return (stream_read (p_buffer, p_mem, size));
+
+  /* don't read beyond the end of the section */
+  if (size > p_buffer->filesize - p_buffer->section_pos)
+   size = p_buffer->filesize - p_buffer->section_pos;
+  if (size <= 0)
+   return (0);
+
+  if (p_archive->streampos != p_buffer->section_start + p_buffer->section_pos)
+   if (stream_seek (p_archive, p_buffer->section_start + p_buffer->section_pos))
+    return (0);
+
+  nb = stream_read (p_archive, p_mem, size);
+  p_buffer->section_pos += nb;
+  return (nb);
+ }
+
+static LONG buffer_seek (IMDB_Buffer *p_buffer, LONG pos)
+ {
+  if (NULL == p_buffer->archive)
+   return (stream_seek (p_buffer, pos));
+
+  if ((pos < 0) || (pos > p_buffer->filesize))
+   return (IMDBE_FILE_POSITION);
+  p_buffer->section_pos = pos;
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBOpenBuffer
+ *
+ * Purpose:    open buffer
+ *
+ * Comment:
+ *
+ * Parameters: fname    filename
+ *             mode     IMDBV_FILE_READ, IMDBV_FILE_WRITE or IMDBV_FILE_APPEND
+ *                      IMDBV_FILE_NULL: all data written is discarded, only
+ *                      the position is counted (null sink)
+ *                      IMDBV_FILE_GZIP: read or write a gzip-compressed
+ *                      file, filesize is the uncompressed size. Not
+ *                      possible in IMDBV_FILE_APPEND mode.
+ *                      IMDBV_FILE_CHUNKS: read a chunked listfile, fname
+ *                      is the name of the listfile without the manifest-
+ *                      extension
+ *                      IMDBV_FILE_THREAD: a plain file is read ahead or
+ *                      written behind by a thread of its own
+ *                      (IMDB_THREADS), ignored otherwise
+ *             size     of buffer
+ * Returns:    pointer to file-info or NULL if failed
+ *-----------------------------------------------------------------------------
+ */
+
+IMDB_Buffer *IMDBOpenBuffer (char *fname, LONG flags, LONG size)
+ {
+  IMDB_Buffer *p_buffer;
+  char modestr[5];
+  LONG mode;
+  BOOL f_whole = FALSE;                  /* buffer holds the whole file */
+
+  mode = (flags & 3);
+
+  switch (mode)
+   {
+    case IMDBV_FILE_READ:
+      strcpy (modestr,"rb");
+      break;
+    case IMDBV_FILE_WRITE:
+      strcpy (modestr,"wb");
+      break;
+    case IMDBV_FILE_APPEND:
+      strcpy (modestr,"ab");
+      break;
+    default:
+     modestr[0] = '\0';
+   }
+
+  if (p_buffer = IMDBAllocMemory (sizeof (IMDB_Buffer)))
+   {
+    IMDBResetError(&p_buffer->error);
+    p_buffer->filesize           = 0;
+    p_buffer->filepos            = 0;
+    if (p_buffer->fname = IMDBAllocMemory(strlen(fname)+1))
+     strcpy (p_buffer->fname, fname);
+    p_buffer->mode               = mode;
+    p_buffer->stream             = NULL;
+/*    p_buffer->status             = IMDBE_NO_ERROR;*/
+    p_buffer->buffersize         = size;
+    p_buffer->bufferpos          = 0;
+    p_buffer->nb_bytes_in_buffer = 0;
+    p_buffer->buffer             = NULL;
+    p_buffer->gzstream           = NULL;
+    p_buffer->deflater           = NULL;
+    p_buffer->inflater           = NULL;
+    p_buffer->streampos          = 0;
+    p_buffer->archive            = NULL;
+    p_buffer->section_start      = 0;
+    p_buffer->section_pos        = 0;
+    p_buffer->chunks             = NULL;
+    p_buffer->pipe               = NULL;
+
+    /* null sink: neither file nor buffer */
+    if ((flags & IMDBV_FILE_NULL) && (IMDBV_FILE_READ != mode))
+     return (p_buffer);
+
+#ifdef IMDB_ZLIB
+    /* compressed file: the size is found at the end of the gzip-stream */
+    if ((flags & IMDBV_FILE_GZIP) && (IMDBV_FILE_READ == mode))
+     {
+      if (p_buffer->stream = fopen(p_buffer->fname, modestr))
+       {
+        UBYTE isize[4];
+
+        if ((flags & IMDBV_FILE_GETSIZE)
+          &&(0 == fseek (p_buffer->stream, -4, SEEK_END)) && (4 == fread (isize, 1, 4, p_buffer->stream)))
+         p_buffer->filesize = ((LONG)isize[3] << 24) | ((LONG)isize[2] << 16) | ((LONG)isize[1] << 8) | (LONG)isize[0];
+#ifdef IMDB_THREADS
+        /* with a block-index the file is uncompressed by several threads */
+        if (p_buffer->inflater = (APTR) inflate_open (p_buffer->stream, p_buffer->fname, 2))
+         {
+          if (flags & IMDBV_FILE_GETSIZE)
+           p_buffer->filesize = ((Inflater *) p_buffer->inflater)->size;
+         }
+        else
+#endif
+         {
+          fclose (p_buffer->stream);
+          p_buffer->stream = NULL;
+          p_buffer->gzstream = (APTR) gzopen (p_buffer->fname, modestr);
+         }
+       }
+      if ((NULL == p_buffer->gzstream) && (NULL == p_buffer->inflater))
+       {
+        if (p_buffer->fname) IMDBFreeMemory(p_buffer->fname);
+        IMDBFreeMemory(p_buffer);
+        return (NULL);
+       }
+      if (p_buffer->gzstream)
+       gzbuffer ((gzFile) p_buffer->gzstream, 128 * 1024);
+      flags &= ~IMDBV_FILE_GETSIZE;
+     }
+#endif
+
+    /* chunked listfile: the size is the sum of the chunks */
+    if ((flags & IMDBV_FILE_CHUNKS) && (IMDBV_FILE_READ == mode))
+     {
+      if (NULL == (p_buffer->chunks = (APTR) chunk_open (p_buffer->fname)))
+       {
+        if (p_buffer->fname) IMDBFreeMemory(p_buffer->fname);
+        IMDBFreeMemory(p_buffer);
+        return (NULL);
+       }
+      if (flags & IMDBV_FILE_GETSIZE)
+       {
+        ChunkReader *reader = (ChunkReader *) p_buffer->chunks;
+        LONG         i;
+
+        for (i = 0; i < reader->manifest->nb_chunks; i++)
+         p_buffer->filesize += reader->manifest->chunks[i].size;
+       }
+      flags &= ~IMDBV_FILE_GETSIZE;
+     }
+
+#ifdef IMDB_ZLIB
+    /* compressed output: same level as the old "gzip -4" */
+    if ((flags & IMDBV_FILE_GZIP) && (IMDBV_FILE_WRITE == mode))
+     {
+#ifdef IMDB_THREADS
+      /* compressed by several threads if there is more than one cpu */
+      if (p_buffer->stream = fopen(p_buffer->fname, modestr))
+       if (NULL == (p_buffer->deflater = (APTR) deflate_open (p_buffer->stream, p_buffer->fname)))
+        {
+         fclose (p_buffer->stream);
+         p_buffer->stream = NULL;
+        }
+#endif
+      if ((NULL == p_buffer->deflater) && (NULL == (p_buffer->gzstream = (APTR) gzopen (p_buffer->fname, "wb4"))))
+       {
+        if (p_buffer->fname) IMDBFreeMemory(p_buffer->fname);
+        IMDBFreeMemory(p_buffer);
+        return (NULL);
+       }
+      if (p_buffer->gzstream)
+       gzbuffer ((gzFile) p_buffer->gzstream, 128 * 1024);
+     }
+#endif
+
+    if ((NULL == p_buffer->gzstream) && (NULL == p_buffer->stream) && (NULL == p_buffer->chunks) && (NULL == (p_buffer->stream = fopen(p_buffer->fname, modestr))))
+     {
+      if (p_buffer->fname) IMDBFreeMemory(p_buffer->fname);
+      IMDBFreeMemory(p_buffer);
+      return (NULL);
+     }
+    else
+     {
+      if ((IMDBV_FILE_READ == mode) && (flags & IMDBV_FILE_GETSIZE))
+       { /* get size of file */       
+        if(fseek (p_buffer->stream, 0, SEEK_END))
+         IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_POSITION, p_buffer->fname);
+        else 
+         {
+          p_buffer->filesize = ftell(p_buffer->stream);
+          if(fseek (p_buffer->stream, 0, SEEK_SET))
+           IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_POSITION, p_buffer->fname);
+          /* the buffer is never bigger than the file */
+          if (f_whole = (p_buffer->filesize < p_buffer->buffersize))
+           p_buffer->buffersize = (p_buffer->filesize < IMDBV_SIZE_DEFAULT) ? IMDBV_SIZE_DEFAULT : p_buffer->filesize + 1;
+         }
+       }
+
+      /* memory budget: smaller buffer if there is not much left */
+      p_buffer->buffersize = budget_take (p_buffer->buffersize, (p_buffer->buffersize < IMDBV_BUDGET_MIN_BUFFER) ? p_buffer->buffersize : IMDBV_BUDGET_MIN_BUFFER, FALSE);
+      if (NULL == (p_buffer->buffer = IMDBAllocMemory(p_buffer->buffersize+2)))
+       {
+        budget_give (p_buffer->buffersize);
+#ifdef IMDB_THREADS
+        if (p_buffer->deflater)
+         deflate_close ((Deflater *) p_buffer->deflater);
+        if (p_buffer->inflater)
+         inflate_close ((Inflater *) p_buffer->inflater);
+#endif
+        if (p_buffer->chunks)
+         chunk_close ((ChunkReader *) p_buffer->chunks);
+        else
+#ifdef IMDB_ZLIB
+        if (p_buffer->gzstream)
+         gzclose ((gzFile) p_buffer->gzstream);
+        else
+#endif
+        fclose(p_buffer->stream);
+        if (p_buffer->fname) IMDBFreeMemory(p_buffer->fname);
+        IMDBFreeMemory(p_buffer);
+        return (NULL);
+       }
+      p_buffer->buffer[p_buffer->buffersize+0] = '\n';
+      p_buffer->buffer[p_buffer->buffersize+1] = '\0';
+#ifdef IMDB_THREADS
+      /* plain file: read ahead/write behind by a thread of its own */
+      if ((flags & IMDBV_FILE_THREAD) && (p_buffer->stream) && (NULL == p_buffer->deflater) && (NULL == p_buffer->inflater)
+        &&(!f_whole))
+       p_buffer->pipe = (APTR) pipe_open (p_buffer->stream, (IMDBV_FILE_READ != mode));
+#endif
+     }
+   }
+
+  return (p_buffer);
+ }
+
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBOpenBufferSection
+ *
+ * Purpose:    open a part of another buffer for reading, e.g. a file in a
+ *             tar-archive
+ *
+ * Comment:    The section reads from the stream of the archive, which
+ *             must stay open as long as the section is used. The archive
+ *             itself must not be read anymore. Sections of the same
+ *             archive are read fastest in the order of the archive.
+ *
+ * Parameters: archive  buffer (IMDBV_FILE_READ) that holds the section
+ *             start    position of the section in archive
+ *             size     size of the section (= filesize of the section)
+ *             buffsize size of buffer
+ *
+ * Returns:    pointer to buffer or NULL if failed
+ *-----------------------------------------------------------------------------
+ */
+
+IMDB_Buffer *IMDBOpenBufferSection (IMDB_Buffer *p_archive, LONG start, LONG size, LONG buffsize)
+ {
+  IMDB_Buffer *p_buffer;
+
+  if (p_buffer = IMDBAllocMemory (sizeof (IMDB_Buffer)))
+   {
+    IMDBResetError(&p_buffer->error);
+    p_buffer->filesize           = size;
+    p_buffer->filepos            = 0;
+    if (p_buffer->fname = IMDBAllocMemory(strlen(p_archive->fname)+1))
+     strcpy (p_buffer->fname, p_archive->fname);
+    p_buffer->mode               = IMDBV_FILE_READ;
+    p_buffer->stream             = NULL;
+    p_buffer->buffersize         = buffsize;
+    p_buffer->bufferpos          = 0;
+    p_buffer->nb_bytes_in_buffer = 0;
+    p_buffer->gzstream           = NULL;
+    p_buffer->deflater           = NULL;
+    p_buffer->inflater           = NULL;
+    p_buffer->streampos          = 0;
+    p_buffer->archive            = p_archive;
+    p_buffer->section_start      = start;
+    p_buffer->section_pos        = 0;
+    p_buffer->chunks             = NULL;
+    p_buffer->pipe               = NULL;
+
+    /* the buffer is never bigger than the section */
+    if (size < p_buffer->buffersize)
+     p_buffer->buffersize = (size < IMDBV_SIZE_DEFAULT) ? IMDBV_SIZE_DEFAULT : size + 1;
+
+    /* memory budget: smaller buffer if there is not much left */
+    p_buffer->buffersize = budget_take (p_buffer->buffersize, (p_buffer->buffersize < IMDBV_BUDGET_MIN_BUFFER) ? p_buffer->buffersize : IMDBV_BUDGET_MIN_BUFFER, FALSE);
+    if (NULL == (p_buffer->buffer = IMDBAllocMemory(p_buffer->buffersize+2)))
+     {
+      budget_give (p_buffer->buffersize);
+      if (p_buffer->fname) IMDBFreeMemory(p_buffer->fname);
+      IMDBFreeMemory(p_buffer);
+      return (NULL);
+     }
+    p_buffer->buffer[p_buffer->buffersize+0] = '\n';
+    p_buffer->buffer[p_buffer->buffersize+1] = '\0';
+   }
+
+  return (p_buffer);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBCloseBuffer
+ *
+ * Purpose:    Close Buffer
+ *
+ * Comment:    
+ *
+ * Parameters: file  pointer to file struct
+ *
+ * Returns:    nothing    
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBCloseBuffer (IMDB_Buffer *p_buffer)
+ {
+  LONG error_code = IMDBE_NO_ERROR;
+
+  if (NULL == p_buffer)
+   return (1);
+
+  /* Flush Buffer */
+  if ((p_buffer->stream) || (p_buffer->gzstream))
+   {
+    if ((IMDBV_FILE_WRITE == p_buffer->mode) || (IMDBV_FILE_APPEND == p_buffer->mode))
+     if (p_buffer->nb_bytes_in_buffer != stream_write(p_buffer, p_buffer->buffer, p_buffer->nb_bytes_in_buffer))
+      {
+       IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_WRITE, p_buffer->fname);
+       error_code = IMDBE_FILE_WRITE;
+      }
+   }
+#ifdef IMDB_THREADS
+  /* the segments still waiting for the disk */
+  if ((p_buffer->pipe) && (pipe_close ((Pipe *) p_buffer->pipe)))
+   {
+    IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_WRITE, p_buffer->fname);
+    error_code = IMDBE_FILE_WRITE;
+   }
+  /* last block and gzip-trailer */
+  if ((p_buffer->deflater) && (deflate_close ((Deflater *) p_buffer->deflater)))
+   {
+    IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_WRITE, p_buffer->fname);
+    error_code = IMDBE_FILE_WRITE;
+   }
+  if (p_buffer->inflater)
+   inflate_close ((Inflater *) p_buffer->inflater);
+#endif
+  if (p_buffer->chunks)
+   chunk_close ((ChunkReader *) p_buffer->chunks);
+  if (p_buffer->stream)
+   if ((fclose(p_buffer->stream)) && (IMDBV_FILE_READ != p_buffer->mode))
+    {
+     IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_WRITE, p_buffer->fname);
+     error_code = IMDBE_FILE_WRITE;
+    }
+#ifdef IMDB_ZLIB
+  /* the gzip-trailer is written here, so errors count */
+  if (p_buffer->gzstream)
+   if ((Z_OK != gzclose ((gzFile) p_buffer->gzstream)) && (IMDBV_FILE_READ != p_buffer->mode))
+    {
+     IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_WRITE, p_buffer->fname);
+     error_code = IMDBE_FILE_WRITE;
+    }
+#endif
+  if (p_buffer->fname) IMDBFreeMemory(p_buffer->fname);
+  if (p_buffer->buffer)
+   {
+    budget_give (p_buffer->buffersize);
+    IMDBFreeMemory(p_buffer->buffer);
+   }
+  IMDBFreeMemory(p_buffer);
+
+  return (error_code);
+ }
+
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBPositionBufer
+ *
+ * Purpose:    Position in file
+ *
+ * Comment:    Buffer needs to be in IMDBV_FILE_READ mode
+ *
+ * Parameters: file    pointer to file
+ *             pos     position where to go to
+ *
+ * Returns:    NULL or IMDB_IO_ERROR if failed
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBPositionBuffer (IMDB_Buffer *p_buffer, LONG pos)
+ {
+
+  /*first check, if the position is already within the buffer */
+  if ((pos < (p_buffer->filepos - p_buffer->bufferpos))
+    ||(pos > (p_buffer->filepos - p_buffer->bufferpos + p_buffer->nb_bytes_in_buffer)))
+   {/* ausserhalb des Buffers, also neu positionieren */
+    if (buffer_seek (p_buffer, pos))
+     {
+      IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_POSITION, p_buffer->fname);
+      return (IMDBE_FILE_POSITION);
+     }
+    p_buffer->bufferpos = 0;
+    p_buffer->filepos = pos;
+    p_buffer->nb_bytes_in_buffer = buffer_read (p_buffer, p_buffer->buffer, p_buffer->buffersize);
+    return (IMDBE_NO_ERROR);
+   }
+  else
+   {/* position ist innerhalb des Buffers */
+    p_buffer->bufferpos = p_buffer->bufferpos + (pos - p_buffer->filepos);
+    p_buffer->filepos = pos;
+    return (IMDBE_NO_ERROR);
+   }
+
+  p_buffer->filepos = pos;
+  return (0);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBReadBuffer
+ *
+ * Purpose:    Read data from file
+ *
+ * Comment:    
+ *             Buffer needs to be in IMDB_FILE_READ mode
+ *
+ * Parameters: file    pointer to file
+ *             mem     pointer to memory where to store the data
+ *             size    number of bytes to read from file
+ *
+ * Returns:    number of bytes read or IMDB_IO_ERROR
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBReadBuffer (IMDB_Buffer *p_buffer, char **p_mem, LONG size)
+ {
+/*  LONG streampos;*/
+  LONG i;
+
+/*
+printf ("%i %i %i\n", p_buffer->nb_bytes_in_buffer, p_buffer->filepos, p_buffer->bufferpos);
+*/
+
+  if (p_buffer->nb_bytes_in_buffer - p_buffer->bufferpos - size >= 0)
+   {/* O.K. Ist alles im Speicher */
+    *p_mem = &p_buffer->buffer[p_buffer->bufferpos];
+    p_buffer->bufferpos += size;
+    p_buffer->filepos += size;   
+    return (size);
+   }
+
+  /* Move the last bits of memory  */
+  i = p_buffer->nb_bytes_in_buffer - p_buffer->bufferpos;
+  if ((i<0) || (i>p_buffer->buffersize))
+   {
+#ifdef IMDB_DEBUG
+    printf ("Fatal error in IMDBReadBuffer!!!\n Remaining bytes: %i\nBytes in Buffer %i\n", i, p_buffer->buffersize);
+#endif
+    return (0);
+   }
+  if (i > 0)
+   memmove(p_buffer->buffer, &p_buffer->buffer[p_buffer->bufferpos], i);
+
+  /* Load new segment in memory */
+  p_buffer->nb_bytes_in_buffer = i + buffer_read (p_buffer, &p_buffer->buffer[i], p_buffer->buffersize - i);
+  *p_mem = p_buffer->buffer;
+
+  if (p_buffer->nb_bytes_in_buffer > size)
+   {
+    p_buffer->bufferpos = size;
+    p_buffer->filepos  += size;
+    return (size);
+   }
+  else
+   {
+    p_buffer->bufferpos = p_buffer->nb_bytes_in_buffer;
+    p_buffer->filepos  += p_buffer->nb_bytes_in_buffer;
+    return (p_buffer->nb_bytes_in_buffer);
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBReadBufferLine
+ *
+ * Purpose:    Read data from file
+ *
+ * Comment:    
+ *             Buffer needs to be in IMDB_FILE_READ mode
+ *
+ * Parameters: file    pointer to file
+ *             mem     pointer to memory where to store the data
+ *             size    number of bytes to read from file
+ *
+ * Returns:    error_code
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBReadBufferLine (IMDB_Buffer *p_buffer, char **p_mem, LONG size)
+ {
+/*  LONG streampos;*/
+  LONG i;
+  char c;
+
+/*
+printf ("%i %i %i\n", p_buffer->nb_bytes_in_buffer, p_buffer->filepos, p_buffer->bufferpos);
+*/
+
+  if (p_buffer->nb_bytes_in_buffer - p_buffer->bufferpos - size >= 0)
+   {/* O.K. Ist alles im Speicher */
+    *p_mem = &p_buffer->buffer[p_buffer->bufferpos];
+    /* find EOL */
+    i = 0;
+    while ((c = p_buffer->buffer[p_buffer->bufferpos + i]) && ('\n' != c))
+     i++;
+    if (i >= size)
+     return (IMDBE_FILE_READ);
+    p_buffer->buffer[p_buffer->bufferpos + i] = '\0';
+    /* correct position */
+    p_buffer->bufferpos += (i + 1);
+    p_buffer->filepos += (i + 1);   
+    return (IMDBE_NO_ERROR);
+   }
+
+  /* Move the last bits of memory  */
+  i = p_buffer->nb_bytes_in_buffer - p_buffer->bufferpos;
+  if ((i<0) || (i>p_buffer->buffersize))
+   {
+#ifdef IMDB_DEBUG
+    printf ("Fatal error in IMDBReadBufferLine!!!\n Remaining bytes: %i\nBytes in Buffer %i\n", i, p_buffer->buffersize);
+#endif
+    return (IMDBE_FILE_READ);
+   }
+  if (i > 0)
+   memmove(p_buffer->buffer, &p_buffer->buffer[p_buffer->bufferpos], i);
+
+  /* Load new segment in memory */
+  p_buffer->nb_bytes_in_buffer = i + buffer_read (p_buffer, &p_buffer->buffer[i], p_buffer->buffersize - i);
+  *p_mem = p_buffer->buffer;
+
+  /* end of file? */
+  if (0 == p_buffer->nb_bytes_in_buffer)
+   {
+    *p_mem = NULL;
+    return (IMDBE_FILE_EOF);
+   }
+
+  /* find EOL */
+  i = 0;
+  while ((c = p_buffer->buffer[i]) && ('\n' != c))
+   i++;
+  if ((i >= size) || (i >= p_buffer->nb_bytes_in_buffer))
+   return (IMDBE_FILE_READ);
+  p_buffer->buffer[i] = '\0';
+
+  /* correct position */
+  p_buffer->bufferpos = (i + 1);
+  p_buffer->filepos  += (i + 1);
+
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBFlushBuffer
+ *
+ * Purpose:    write all data of the buffer to the file
+ *
+ * Comment:
+ *             Buffer needs to be in IMDB_FILE_WRITE or IMDB_FILE_APPEND mode
+ *
+ * Parameters: buffer  pointer to buffer
+ *
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBFlushBuffer (IMDB_Buffer *p_buffer)
+ {
+  if ((NULL == p_buffer->stream) && (NULL == p_buffer->gzstream))
+   return (IMDBE_NO_ERROR); /* null sink */
+
+  if ((p_buffer->nb_bytes_in_buffer != stream_write(p_buffer, p_buffer->buffer, p_buffer->nb_bytes_in_buffer))
+#ifdef IMDB_THREADS
+    ||((p_buffer->deflater) && (deflate_flush ((Deflater *) p_buffer->deflater)))
+    ||((p_buffer->pipe) && (pipe_flush ((Pipe *) p_buffer->pipe)))
+#endif
+#ifdef IMDB_ZLIB
+    ||((p_buffer->gzstream) && (Z_OK != gzflush ((gzFile) p_buffer->gzstream, Z_SYNC_FLUSH)))
+#endif
+    ||((p_buffer->stream) && (fflush (p_buffer->stream))))
+   {
+    IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_WRITE, p_buffer->fname);
+    return (IMDBE_FILE_WRITE);
+   }
+  p_buffer->bufferpos = 0;
+  p_buffer->nb_bytes_in_buffer = 0;
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBWriteBuffer
+ *
+ * Purpose:    write some data to file
+ *
+ * Comment:    
+ *             Buffer needs to be in IMDB_FILE_WRITE or IMDB_FILE_APPEND mode
+ *
+ * Parameters: buffer  pointer to buffer
+ *             data    pointer to data
+ *             size    number of bytes to write
+ *
+ * Returns:    NULL if successful, IMDB_IO_ERROR otherwise
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBWriteBuffer (IMDB_Buffer *p_buffer, APTR p_mem, LONG size)
+ {
+  if ((NULL == p_buffer->stream) && (NULL == p_buffer->gzstream))
+   {/* null sink */
+    p_buffer->filepos += size;
+    return (IMDBE_NO_ERROR);
+   }
+
+  if (size <= (p_buffer->buffersize - p_buffer->nb_bytes_in_buffer))
+   {/* save in memory */ 
+    memcpy(&p_buffer->buffer[p_buffer->nb_bytes_in_buffer], p_mem, size);
+    p_buffer->nb_bytes_in_buffer += size;
+    p_buffer->bufferpos = p_buffer->nb_bytes_in_buffer;
+    p_buffer->filepos  += size;
+    return (IMDBE_NO_ERROR);
+   }
+
+  /* Flush Buffer */
+  if (p_buffer->nb_bytes_in_buffer != stream_write(p_buffer, p_buffer->buffer, p_buffer->nb_bytes_in_buffer))
+   {
+    IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_WRITE, p_buffer->fname);
+    return (IMDBE_FILE_WRITE);
+   }
+  p_buffer->bufferpos = 0;
+  p_buffer->nb_bytes_in_buffer = 0;
+
+  /* is buffer too small for this block? */
+  if (size > p_buffer->buffersize)
+   {/* save immediately */
+    if (size != stream_write(p_buffer, p_mem, size))
+     {
+      IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_WRITE, p_buffer->fname);
+      return (IMDBE_FILE_WRITE);
+     }
+    p_buffer->filepos += size;
+   }
+  else
+   {/* save in memory */ 
+    memcpy(p_buffer->buffer, p_mem, size);
+    p_buffer->nb_bytes_in_buffer = size;
+    p_buffer->bufferpos = size;
+    p_buffer->filepos  += size;
+    return (IMDBE_NO_ERROR);
+   }
+
+  return (IMDBE_NO_ERROR);
+ }
+
+
+/******************************************************************************
+ *  Diffs in Memory
+ *
+ *  A diff is kept in memory as a list of edit-operations on the old
+ *  listfile. The texts of the lines point into the contents of the
+ *  diff-file, which is kept together with the operations.
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  diff_get_patch
+ *
+ * Purpose:    Parse a patchline
+ *-----------------------------------------------------------------------------
+ */
+
+ struct TypPatch
+  {
+   char cmd;
+   LONG i_start;
+   LONG i_end;
+   LONG o_start;
+   LONG o_end;
+  };
+
+static void diff_get_patch (struct TypPatch *patch, char *buffer)
+ {
+  char *c;
+  char cmd;
+
+  patch -> cmd     = '\0';
+  patch -> i_start = 0;
+  patch -> i_end   = 0;
+  patch -> o_start = 0;
+  patch -> o_end   = 0;
+
+  if (buffer)
+   {
+    /* erster Teil */
+    c = buffer;
+    while (isdigit(*buffer)) buffer ++;
+    cmd = *buffer;
+    *buffer = '\0';
+    patch -> i_start = patch -> i_end = strtol (c, NULL, 10);
+    if (cmd == ',')
+     {/* parse toline */
+      buffer ++;
+      c = buffer;
+      while (isdigit(*buffer)) buffer++;
+      cmd = *buffer;
+      *buffer = '\0';
+      patch -> i_end = strtol (c, NULL, 10);
+     }
+
+    patch -> cmd = cmd;
+
+    /* 2ter Teil */
+    buffer ++;
+    c = buffer;
+    while (isdigit(*buffer)) buffer ++;
+    cmd = *buffer;
+    *buffer = '\0';
+    patch -> o_start = patch -> o_end = strtol (c, NULL, 10);
+    if (cmd == ',')
+     {/* parse toline */
+      buffer ++;
+      c = buffer;
+      while (isdigit(*buffer)) buffer++;
+      *buffer = '\0';
+      patch -> o_end = strtol (c, NULL, 10);
+     }
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBAllocDiff / IMDBFreeDiff
+ *
+ * Purpose:    Create an empty diff / free a diff
+ *-----------------------------------------------------------------------------
+ */
+
+IMDB_Diff *IMDBAllocDiff (LONG max_ops)
+ {
+  IMDB_Diff *diff;
+
+  if (NULL == (diff = IMDBAllocMemory (sizeof (IMDB_Diff))))
+   return (NULL);
+
+  diff->memory   = NULL;
+  diff->nb_ops   = 0;
+  diff->max_ops  = (max_ops > 16) ? max_ops : 16;
+  diff->f_new    = FALSE;
+  diff->header   = NULL;
+  diff->crc_line = NULL;
+  if (NULL == (diff->ops = IMDBAllocMemory (diff->max_ops * sizeof (IMDB_DiffOp))))
+   {
+    IMDBFreeMemory (diff);
+    return (NULL);
+   }
+  return (diff);
+ }
+
+void IMDBFreeDiff (IMDB_Diff *diff)
+ {
+  if (diff)
+   {
+    if (diff->memory)
+     IMDBFreeMemory (diff->memory);
+    IMDBFreeMemory (diff->ops);
+    IMDBFreeMemory (diff);
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBAddDiffOp
+ *
+ * Purpose:    Append an edit-operation to a diff. Successive copies are
+ *             merged, the list of operations grows if necessary.
+ *
+ * Returns:    FALSE if out of memory
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL IMDBAddDiffOp (IMDB_Diff *diff, LONG cmd, LONG count, char *text)
+ {
+  IMDB_DiffOp *op;
+
+  if (IMDBV_OP_COPY == cmd)
+   {
+    if (count <= 0)
+     return (TRUE);
+    if ((diff->nb_ops > 0) && (IMDBV_OP_COPY == diff->ops[diff->nb_ops-1].cmd))
+     {
+      diff->ops[diff->nb_ops-1].count += count;
+      return (TRUE);
+     }
+   }
+
+  if (diff->nb_ops >= diff->max_ops)
+   {
+    if (NULL == (op = IMDBAllocMemory (2 * diff->max_ops * sizeof (IMDB_DiffOp))))
+     return (FALSE);
+    memcpy (op, diff->ops, diff->nb_ops * sizeof (IMDB_DiffOp));
+    IMDBFreeMemory (diff->ops);
+    diff->ops      = op;
+    diff->max_ops *= 2;
+   }
+
+  op = &diff->ops[diff->nb_ops++];
+  op->cmd   = cmd;
+  op->count = count;
+  op->text  = text;
+  return (TRUE);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  diff_next_line
+ *
+ * Purpose:    Split the next line off the memory of a diff-file
+ *
+ * Returns:    line or NULL at the end of the file
+ *-----------------------------------------------------------------------------
+ */
+
+static char *diff_next_line (char **pp_pos)
+ {
+  char *p_line = *pp_pos;
+  char *c;
+
+  if ('\0' == *p_line)
+   return (NULL);
+
+  for (c = p_line; (*c) && ('\n' != *c); c++);
+  if (*c)
+   *c++ = '\0';
+  *pp_pos = c;
+  return (p_line);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBLoadDiff
+ *
+ * Purpose:    Read a diff-file (original or stripped) and translate it
+ *             into edit-operations
+ *
+ * Parameters: diffile  filename
+ *             flags    IMDBV_DIFF_ORIGINAL or IMDBV_DIFF_STRIPPED, may be
+ *                      combined with IMDBV_FILE_GZIP
+ *             p_error  IMDBE_FILE_READ, IMDBE_MEMORY or IMDBE_SYNTAX in
+ *                      case of an error
+ *
+ * Returns:    diff or NULL
+ *-----------------------------------------------------------------------------
+ */
+
+IMDB_Diff *IMDBLoadDiff (char *diffile, LONG flags, LONG *p_error)
+ {
+  IMDB_Buffer     *diff_buffer;
+  IMDB_Diff       *diff;
+  struct TypPatch  patch;
+  char            *p_pos;
+  char            *p_line;
+  char            *p_mem;
+  LONG             type = flags & (IMDBV_DIFF_ORIGINAL|IMDBV_DIFF_STRIPPED);
+  LONG             size = 0;
+  LONG             filesize;
+  LONG             len;
+  LONG             cur;
+  LONG             i;
+  BOOL             f_delete = FALSE;
+  BOOL             f_syntax = FALSE;
+
+  *p_error = IMDBE_FILE_READ;
+
+  /* read the whole diff-file */
+  if (NULL == (diff_buffer = IMDBOpenBuffer (diffile, IMDBV_FILE_READ | IMDBV_FILE_GETSIZE | (flags & IMDBV_FILE_GZIP), IMDBV_DIFF_BUFFER_SIZE)))
+   return (NULL);
+  filesize = imdb_buffer_filesize(diff_buffer);
+
+  if ((NULL == (diff = IMDBAllocDiff (filesize / 64)))
+   || (NULL == (diff->memory = IMDBAllocMemory (filesize + 2))))
+   {
+    *p_error = IMDBE_MEMORY;
+    IMDBCloseBuffer (diff_buffer);
+    IMDBFreeDiff (diff);
+    return (NULL);
+   }
+  while ((size < filesize) && ((len = IMDBReadBuffer (diff_buffer, &p_mem, IMDBV_DIFF_BUFFER_SIZE)) > 0))
+   {
+    if (len > filesize - size)
+     len = filesize - size;
+    memcpy (&diff->memory[size], p_mem, len);
+    size += len;
+   }
+  diff->memory[size] = '\0';
+  IMDBCloseBuffer (diff_buffer);
+
+  if (size != filesize)
+   {
+    IMDBFreeDiff (diff);
+    return (NULL);
+   }
+
+  *p_error = IMDBE_SYNTAX;
+  p_pos = diff->memory;
+
+  if (IMDBV_DIFF_STRIPPED == type)
+   {/* "Apply on: <first line of old listfile>" or "Apply on: ---" */
+    if ((NULL == (p_line = diff_next_line (&p_pos))) || (strncmp (p_line, "Apply on: ", 10)))
+     {
+      IMDBFreeDiff (diff);
+      return (NULL);
+     }
+    if (0 == strncmp (&p_line[10], "---", 3))
+     diff->f_new = TRUE;
+    else
+     diff->header = &p_line[10];
+   }
+
+  cur = 1;
+  while ((FALSE == f_syntax) && (p_line = diff_next_line (&p_pos)))
+   {
+    f_syntax = TRUE;
+    if (!isdigit (*p_line))
+     break;
+    diff_get_patch (&patch, p_line);
+
+    /* copy unchanged lines */
+    if (('a' == patch.cmd) && (0 == patch.i_start))
+     i = 1;
+    else
+    if ('a' == patch.cmd)
+     i = patch.i_start + 1;
+    else
+     i = patch.i_start;
+    if ((i < cur) || (patch.i_end < patch.i_start) || (patch.o_end < patch.o_start))
+     break;
+    if (!IMDBAddDiffOp (diff, IMDBV_OP_COPY, i - cur, NULL))
+     break;
+    cur = i;
+
+    /* delete lines */
+    if (('d' == patch.cmd) || ('c' == patch.cmd))
+     {
+      for (i = patch.i_start; i <= patch.i_end; i++)
+       {
+        p_line = NULL;
+        if (IMDBV_DIFF_ORIGINAL == type)
+         {
+          if ((NULL == (p_line = diff_next_line (&p_pos))) || ('<' != p_line[0]))
+           break;
+          p_line = &p_line[2];
+          if (1 == cur)
+           diff->header = p_line;
+         }
+        if (!IMDBAddDiffOp (diff, IMDBV_OP_DELETE, 1, p_line))
+         break;
+        f_delete = TRUE;
+        cur++;
+       }
+      if (i <= patch.i_end)
+       break;
+     }
+
+    /* separator */
+    if (('c' == patch.cmd) && (IMDBV_DIFF_ORIGINAL == type))
+     if ((NULL == (p_line = diff_next_line (&p_pos))) || (strncmp (p_line, "---", 3)))
+      break;
+
+    /* add lines */
+    if (('a' == patch.cmd) || ('c' == patch.cmd))
+     {
+      for (i = patch.o_start; i <= patch.o_end; i++)
+       {
+        if (NULL == (p_line = diff_next_line (&p_pos)))
+         break;
+        if (IMDBV_DIFF_ORIGINAL == type)
+         {
+          if ('>' != p_line[0])
+           break;
+          p_line = &p_line[2];
+         }
+        if (1 == i)
+         diff->crc_line = p_line;
+        if (!IMDBAddDiffOp (diff, IMDBV_OP_INSERT, 1, p_line))
+         break;
+       }
+      if (i <= patch.o_end)
+       break;
+     }
+    else
+    if ('d' != patch.cmd)
+     break;
+
+    f_syntax = FALSE;
+   }
+
+  if (f_syntax)
+   {
+    IMDBFreeDiff (diff);
+    return (NULL);
+   }
+
+  /* an original diff without deleted lines introduces a new listfile */
+  if ((IMDBV_DIFF_ORIGINAL == type) && (FALSE == f_delete))
+   diff->f_new = TRUE;
+
+  if (!IMDBAddDiffOp (diff, IMDBV_OP_REST, 0, NULL))
+   {
+    *p_error = IMDBE_MEMORY;
+    IMDBFreeDiff (diff);
+    return (NULL);
+   }
+
+  *p_error = IMDBE_NO_ERROR;
+  return (diff);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBComposeDiffs
+ *
+ * Purpose:    Combine two diffs: the result transforms the old listfile of
+ *             <first> directly into the new listfile of <second>.
+ *
+ * Comments:   The lines produced by <first> are consumed by the operations
+ *             of <second>. Lines inserted by <first> and deleted again by
+ *             <second> vanish. The texts are not copied, so both diffs must
+ *             be kept until the result is not needed anymore.
+ *
+ * Returns:    diff or NULL if out of memory
+ *-----------------------------------------------------------------------------
+ */
+
+IMDB_Diff *IMDBComposeDiffs (IMDB_Diff *first, IMDB_Diff *second)
+ {
+  IMDB_Diff   *diff;
+  IMDB_DiffOp *a_op;
+  IMDB_DiffOp *b_op;
+  LONG         ia    = 0;          /* actual operation of <first> */
+  LONG         used  = 0;          /* lines already used of a IMDBV_OP_COPY of <first> */
+  LONG         ib;
+  LONG         n;
+  LONG         k;
+  BOOL         ok    = TRUE;
+
+  if (NULL == (diff = IMDBAllocDiff (first->nb_ops + second->nb_ops)))
+   return (NULL);
+
+  diff->f_new    = first->f_new;
+  diff->header   = first->header;
+  diff->crc_line = (second->crc_line) ? second->crc_line : first->crc_line;
+
+  for (ib = 0; (ib < second->nb_ops) && (ok); ib++)
+   {
+    b_op = &second->ops[ib];
+    switch (b_op->cmd)
+     {
+      case IMDBV_OP_COPY:
+      case IMDBV_OP_REST:
+       /* pass the lines produced by <first> */
+       n = b_op->count;
+       while (((n > 0) || (IMDBV_OP_REST == b_op->cmd)) && (ok))
+        {
+         a_op = &first->ops[ia];
+         if (IMDBV_OP_DELETE == a_op->cmd)
+          {
+           ok = IMDBAddDiffOp (diff, IMDBV_OP_DELETE, 1, a_op->text);
+           ia++;
+          }
+         else
+         if (IMDBV_OP_INSERT == a_op->cmd)
+          {
+           ok = IMDBAddDiffOp (diff, IMDBV_OP_INSERT, 1, a_op->text);
+           ia++;
+           n--;
+          }
+         else
+         if (IMDBV_OP_COPY == a_op->cmd)
+          {
+           k = a_op->count - used;
+           if ((IMDBV_OP_COPY == b_op->cmd) && (k > n))
+            k = n;
+           ok = IMDBAddDiffOp (diff, IMDBV_OP_COPY, k, NULL);
+           n    -= k;
+           used += k;
+           if (used == a_op->count)
+            {
+             ia++;
+             used = 0;
+            }
+          }
+         else
+          {/* IMDBV_OP_REST */
+           if (IMDBV_OP_REST == b_op->cmd)
+            ok = IMDBAddDiffOp (diff, IMDBV_OP_REST, 0, NULL);
+           else
+            ok = IMDBAddDiffOp (diff, IMDBV_OP_COPY, n, NULL);
+           break;
+          }
+        }
+       break;
+
+      case IMDBV_OP_DELETE:
+       /* remove the next line produced by <first> */
+       while (ok)
+        {
+         a_op = &first->ops[ia];
+         if (IMDBV_OP_DELETE == a_op->cmd)
+          {
+           ok = IMDBAddDiffOp (diff, IMDBV_OP_DELETE, 1, a_op->text);
+           ia++;
+           continue;
+          }
+         if (IMDBV_OP_INSERT == a_op->cmd)
+          ia++;
+         else
+          {
+           ok = IMDBAddDiffOp (diff, IMDBV_OP_DELETE, 1, b_op->text);
+           if ((IMDBV_OP_COPY == a_op->cmd) && (++used == a_op->count))
+            {
+             ia++;
+             used = 0;
+            }
+          }
+         break;
+        }
+       break;
+
+      case IMDBV_OP_INSERT:
+       ok = IMDBAddDiffOp (diff, IMDBV_OP_INSERT, 1, b_op->text);
+       break;
+     }
+   }
+
+  if (!ok)
+   {
+    IMDBFreeDiff (diff);
+    return (NULL);
+   }
+  return (diff);
+ }
+
+
+/******************************************************************************
+ *  CRC-sum of Listfiles
+ *
+ *  The same CRC-32 as ApplyDiffs and CheckCRC use for the CRC-line. The
+ *  table is created by the first call of IMDBCalcCRC (or IMDBOpenView).
+ ******************************************************************************
+ */
+
+static ULONG *crc_tab = NULL;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  crc_init
+ *
+ * Purpose:    create the table of the CRC-32 algorithm (see InitCRC)
+ *
+ * Returns:    FALSE if out of memory
+ *-----------------------------------------------------------------------------
+ */
+
+static BOOL crc_init (void)
+ {
+  ULONG *p_crc_tab;
+  int    i;
+  int    j;
+  UBYTE  ib[8];
+  UBYTE  lb[32];
+
+  if (crc_tab)
+   return (TRUE);
+  if (NULL == (p_crc_tab = IMDBAllocMemory (256 * sizeof (ULONG))))
+   return (FALSE);
+
+  for (i=0; i<256; i++)
+   {
+    for (j=0; j<8;j++)
+     ib[j]=(i>>(7-j))&1;
+    for (j=0; j<32;j++)
+     lb[j]=0;
+
+    lb[31]=      ib[1]                              ^ib[7];
+    lb[30]=ib[0]^ib[1]                        ^ib[6]^ib[7];
+    lb[29]=ib[0]^ib[1]                  ^ib[5]^ib[6]^ib[7];
+    lb[28]=ib[0]                  ^ib[4]^ib[5]^ib[6];
+    lb[27]=      ib[1]      ^ib[3]^ib[4]^ib[5]      ^ib[7];
+    lb[26]=ib[0]^ib[1]^ib[2]^ib[3]^ib[4]      ^ib[6]^ib[7];
+    lb[25]=ib[0]^ib[1]^ib[2]^ib[3]      ^ib[5]^ib[6];
+    lb[24]=ib[0]      ^ib[2]      ^ib[4]^ib[5]      ^ib[7];
+    lb[23]=                  ib[3]^ib[4]      ^ib[6]^ib[7];
+    lb[22]=            ib[2]^ib[3]      ^ib[5]^ib[6];
+    lb[21]=            ib[2]      ^ib[4]^ib[5]      ^ib[7];
+    lb[20]=                  ib[3]^ib[4]      ^ib[6]^ib[7];
+    lb[19]=      ib[1]^ib[2]^ib[3]      ^ib[5]^ib[6]^ib[7];
+    lb[18]=ib[0]^ib[1]^ib[2]      ^ib[4]^ib[5]^ib[6];
+    lb[17]=ib[0]^ib[1]      ^ib[3]^ib[4]^ib[5];
+    lb[16]=ib[0]      ^ib[2]^ib[3]^ib[4];
+    lb[15]=            ib[2]^ib[3]                  ^ib[7];
+    lb[14]=      ib[1]^ib[2]                  ^ib[6];
+    lb[13]=ib[0]^ib[1]                  ^ib[5];
+    lb[12]=ib[0]                  ^ib[4];
+    lb[11]=                  ib[3];
+    lb[10]=            ib[2];
+    lb[ 9]=                                          ib[7];
+    lb[ 8]=      ib[1]                        ^ib[6]^ib[7];
+    lb[ 7]=ib[0]                        ^ib[5]^ib[6];
+    lb[ 6]=                        ib[4]^ib[5];
+    lb[ 5]=      ib[1]      ^ib[3]^ib[4]            ^ib[7];
+    lb[ 4]=ib[0]      ^ib[2]^ib[3]            ^ib[6];
+    lb[ 3]=      ib[1]^ib[2]            ^ib[5];
+    lb[ 2]=ib[0]^ib[1]            ^ib[4];
+    lb[ 1]=ib[0]            ^ib[3];
+    lb[ 0]=            ib[2];
+
+    p_crc_tab[i]=0;
+    for (j=0; j<32;j++)
+     p_crc_tab[i]|=((ULONG) lb[j])<<(31-j);
+   }
+  crc_tab = p_crc_tab;
+  return (TRUE);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBCalcCRC
+ *
+ * Purpose:    add a line to a CRC-sum. Automatically adds the CRC for '\n'
+ *
+ * Comment:    start with 0xFFFFFFFF; the CRC-line of a listfile is
+ *             "CRC: 0x%08lX" of all lines but the first
+ *
+ * Parameters: p_line  line
+ *             p_crc   CRC-sum
+ *
+ * Returns:    nothing
+ *-----------------------------------------------------------------------------
+ */
+
+void IMDBCalcCRC (char *p_line, ULONG *p_crc)
+ {
+  ULONG crc = *p_crc;
+
+  if (!crc_init ())
+   return;
+
+  while (*p_line)
+   crc = ((crc >> 8) & 0x00FFFFFFL) ^ crc_tab[(crc ^ *p_line++) & 0x000000FFL];
+  crc = ((crc >> 8) & 0x00FFFFFFL) ^ crc_tab[(crc ^ '\n') & 0x000000FFL];
+
+  *p_crc = crc & 0xFFFFFFFFL;
+ }
+
+
+/******************************************************************************
+ *  Patched Listfiles (Views)
+ *
+ *  A view is a table of pieces: runs of lines of the old listfile and the
+ *  lines added by a diff. It shows the new listfile without writing it.
+ *  The old listfile is read once when the view is opened, to note the
+ *  position of every IMDBV_VIEW_STEP-th line; a line is then found by
+ *  positioning the buffer there and skipping the lines in front of it.
+ ******************************************************************************
+ */
+
+#ifdef IMDB_THREADS
+typedef struct
+ {
+  pthread_t  thread;
+  IMDB_View *view;
+  char       fname[256];
+  LONG       flags;
+ } ViewWriter;
+#endif
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  view_add_piece
+ *
+ * Purpose:    append a piece to the table of a view
+ *
+ * Returns:    FALSE if out of memory
+ *-----------------------------------------------------------------------------
+ */
+
+static BOOL view_add_piece (IMDB_View *view, LONG *p_max, LONG old_first, LONG lines, char *text)
+ {
+  IMDB_Piece *piece;
+
+  if (lines <= 0)
+   return (TRUE);
+
+  if (NULL == view->pieces)
+   {
+    if (NULL == (view->pieces = IMDBAllocMemory ((*p_max) * sizeof (IMDB_Piece))))
+     return (FALSE);
+   }
+  else
+  if (view->nb_pieces >= *p_max)
+   {
+    if (NULL == (piece = IMDBAllocMemory (2 * (*p_max) * sizeof (IMDB_Piece))))
+     return (FALSE);
+    memcpy (piece, view->pieces, view->nb_pieces * sizeof (IMDB_Piece));
+    IMDBFreeMemory (view->pieces);
+    view->pieces = piece;
+    *p_max *= 2;
+   }
+
+  piece = &view->pieces[view->nb_pieces++];
+  piece->first     = view->nb_lines + 1;
+  piece->old_first = old_first;
+  piece->lines     = lines;
+  piece->text      = text;
+  view->nb_lines  += lines;
+  return (TRUE);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  view_index
+ *
+ * Purpose:    read the old listfile and note the position of every
+ *             IMDBV_VIEW_STEP-th line
+ *
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_READ or IMDBE_MEMORY
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG view_index (IMDB_View *view)
+ {
+  LONG  max_index = 1024;
+  LONG  pos       = 0;
+  LONG *index;
+  char *p_line;
+
+  if (NULL == (view->index = IMDBAllocMemory (max_index * sizeof (LONG))))
+   return (IMDBE_MEMORY);
+
+  for (;;)
+   {
+    if (0 == (view->nb_old_lines % IMDBV_VIEW_STEP))
+     {
+      if (view->nb_old_lines / IMDBV_VIEW_STEP >= max_index)
+       {
+        if (NULL == (index = IMDBAllocMemory (2 * max_index * sizeof (LONG))))
+         return (IMDBE_MEMORY);
+        memcpy (index, view->index, max_index * sizeof (LONG));
+        IMDBFreeMemory (view->index);
+        view->index = index;
+        max_index *= 2;
+       }
+      view->index[view->nb_old_lines / IMDBV_VIEW_STEP] = pos;
+     }
+    if (IMDBReadBufferLine (view->list, &p_line, IMDBV_VIEW_LINE_SIZE))
+     break;
+    view->nb_old_lines++;
+    pos = view->list->filepos;
+   }
+
+  if (NULL != p_line)
+   return (IMDBE_FILE_READ);
+  view->next_old = view->nb_old_lines + 1;
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  view_write
+ *
+ * Purpose:    write the patched listfile. The old listfile is read with
+ *             an own buffer from start to end, so this may run while the
+ *             view is used.
+ *
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_OPEN, IMDBE_FILE_READ or
+ *             IMDBE_FILE_WRITE
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG view_write (IMDB_View *view, char *fname, LONG flags, ULONG *p_crc)
+ {
+  IMDB_Buffer *list = NULL;
+  IMDB_Buffer *out;
+  IMDB_Piece  *piece;
+  char        *p_line;
+  LONG         old  = 1;
+  LONG         line = 0;
+  LONG         i;
+  LONG         n;
+  LONG         ret  = IMDBE_NO_ERROR;
+
+  *p_crc = 0xFFFFFFFFL;
+  if ((view->fname)
+    &&(NULL == (list = IMDBOpenBuffer (view->fname, IMDBV_FILE_READ|view->flags, IMDBV_VIEW_BUFFER_SIZE))))
+   return (IMDBE_FILE_OPEN);
+  if (NULL == (out = IMDBOpenBuffer (fname, IMDBV_FILE_WRITE|(flags & IMDBV_FILE_GZIP), IMDBV_VIEW_BUFFER_SIZE)))
+   {
+    if (list)
+     IMDBCloseBuffer (list);
+    return (IMDBE_FILE_OPEN);
+   }
+
+  for (i = 0; (i < view->nb_pieces) && (IMDBE_NO_ERROR == ret); i++)
+   {
+    piece = &view->pieces[i];
+    for (n = 0; (n < piece->lines) && (IMDBE_NO_ERROR == ret); n++)
+     {
+      if (piece->old_first)
+       {/* skip the deleted lines */
+        for (; (old <= piece->old_first + n) && (IMDBE_NO_ERROR == ret); old++)
+         ret = IMDBReadBufferLine (list, &p_line, IMDBV_VIEW_LINE_SIZE);
+        if (IMDBE_NO_ERROR != ret)
+         {
+          ret = IMDBE_FILE_READ;
+          break;
+         }
+       }
+      else
+       p_line = piece->text;
+
+      if (++line > 1)
+       IMDBCalcCRC (p_line, p_crc);
+      if ((IMDBWriteBuffer (out, p_line, strlen (p_line))) || (IMDBWriteBuffer (out, "\n", 1)))
+       ret = IMDBE_FILE_WRITE;
+     }
+   }
+
+  if (list)
+   IMDBCloseBuffer (list);
+  if ((IMDBCloseBuffer (out)) && (IMDBE_NO_ERROR == ret))
+   ret = IMDBE_FILE_WRITE;
+  if (IMDBE_NO_ERROR != ret)
+   remove (fname);
+  return (ret);
+ }
+
+#ifdef IMDB_THREADS
+/*-----------------------------------------------------------------------------
+ * Procedure:  view_write_thread
+ *
+ * Purpose:    write the patched listfile in the background
+ *-----------------------------------------------------------------------------
+ */
+
+static void *view_write_thread (void *p_arg)
+ {
+  ViewWriter *writer = (ViewWriter *) p_arg;
+
+  writer->view->write_error = view_write (writer->view, writer->fname, writer->flags, &writer->view->write_crc);
+  return (NULL);
+ }
+#endif
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBStartWriteView
+ *
+ * Purpose:    write the patched listfile to a file
+ *
+ * Comment:    With IMDB_THREADS the file is written by a thread of its
+ *             own while the view can still be used; otherwise it is
+ *             written at once. Either way IMDBWaitWriteView has to be
+ *             called before the next IMDBStartWriteView or IMDBCloseView.
+ *
+ * Parameters: view   view
+ *             fname  filename
+ *             flags  IMDBV_FILE_GZIP or 0
+ *
+ * Returns:    IMDBE_NO_ERROR or IMDBE_MEMORY
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBStartWriteView (IMDB_View *view, char *fname, LONG flags)
+ {
+#ifdef IMDB_THREADS
+  ViewWriter *writer;
+
+  if ((view->writer) || (NULL == (writer = IMDBAllocMemory (sizeof (ViewWriter)))))
+   return (IMDBE_MEMORY);
+
+  writer->view  = view;
+  writer->flags = flags;
+  strncpy (writer->fname, fname, 255);
+  writer->fname[255] = '\0';
+  if (0 == pthread_create (&writer->thread, NULL, view_write_thread, writer))
+   {
+    view->writer = writer;
+    return (IMDBE_NO_ERROR);
+   }
+
+  /* no thread: write it now */
+  IMDBFreeMemory (writer);
+  view->write_error = view_write (view, fname, flags, &view->write_crc);
+  return (IMDBE_NO_ERROR);
+#else
+  view->write_error = view_write (view, fname, flags, &view->write_crc);
+  return (IMDBE_NO_ERROR);
+#endif
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBWaitWriteView
+ *
+ * Purpose:    wait until the patched listfile is written
+ *
+ * Comment:    The file is removed if it couldn't be written completely.
+ *
+ * Parameters: view   view
+ *             p_crc  CRC-sum of the written listfile (all lines but the
+ *                    first) or NULL
+ *
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_OPEN, IMDBE_FILE_READ,
+ *             IMDBE_FILE_WRITE or IMDBE_NOTFOUND (nothing written)
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBWaitWriteView (IMDB_View *view, ULONG *p_crc)
+ {
+#ifdef IMDB_THREADS
+  if (view->writer)
+   {
+    pthread_join (((ViewWriter *) view->writer)->thread, NULL);
+    IMDBFreeMemory (view->writer);
+    view->writer = NULL;
+   }
+#endif
+  if (p_crc)
+   *p_crc = view->write_crc;
+  return (view->write_error);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBCloseView
+ *
+ * Purpose:    close a view (waits for the writer)
+ *
+ * Parameters: view (may be NULL)
+ *
+ * Returns:    nothing
+ *-----------------------------------------------------------------------------
+ */
+
+void IMDBCloseView (IMDB_View *view)
+ {
+  if (view)
+   {
+    if (view->writer)
+     IMDBWaitWriteView (view, NULL);
+    if (view->list)
+     IMDBCloseBuffer (view->list);
+    if (view->index)
+     IMDBFreeMemory (view->index);
+    if (view->pieces)
+     IMDBFreeMemory (view->pieces);
+    if (view->fname)
+     IMDBFreeMemory (view->fname);
+    IMDBFreeMemory (view);
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBOpenView
+ *
+ * Purpose:    open a view of the listfile that results from applying a
+ *             diff to the old listfile
+ *
+ * Comment:    The diff has to be kept until the view is closed. Use
+ *             IMDBComposeDiffs for the diffs of several weeks. The diff
+ *             is not checked against the old listfile, only its number
+ *             of lines; use IMDBViewCRC to check the result.
+ *
+ * Parameters: listfile  old listfile or NULL, if the diff introduces a
+ *                       new listfile
+ *             flags     IMDBV_FILE_GZIP or IMDBV_FILE_CHUNKS for the old
+ *                       listfile
+ *             diff      diff of the listfile
+ *             p_error   IMDBE_FILE_OPEN, IMDBE_FILE_READ, IMDBE_MEMORY or
+ *                       IMDBE_SYNTAX (diff doesn't fit) in case of an error
+ *
+ * Returns:    view or NULL
+ *-----------------------------------------------------------------------------
+ */
+
+IMDB_View *IMDBOpenView (char *listfile, LONG flags, IMDB_Diff *diff, LONG *p_error)
+ {
+  IMDB_View   *view;
+  IMDB_DiffOp *op;
+  LONG         max_pieces = 64;
+  LONG         old        = 1;
+  LONG         i;
+  BOOL         f_ok       = TRUE;
+
+  *p_error = IMDBE_MEMORY;
+  if ((!crc_init ()) || (NULL == (view = IMDBAllocMemory (sizeof (IMDB_View)))))
+   return (NULL);
+
+  view->fname        = NULL;
+  view->flags        = flags & (IMDBV_FILE_GZIP|IMDBV_FILE_CHUNKS);
+  view->list         = NULL;
+  view->index        = NULL;
+  view->nb_old_lines = 0;
+  view->pieces       = NULL;
+  view->nb_pieces    = 0;
+  view->nb_lines     = 0;
+  view->next_old     = 1;
+  view->piece        = 0;
+  view->line         = 0;
+  view->writer       = NULL;
+  view->write_error  = IMDBE_NOTFOUND;
+  view->write_crc    = 0;
+
+  /* note the position of the lines of the old listfile */
+  if (listfile)
+   {
+    if ((NULL == (view->fname = IMDBAllocMemory (strlen (listfile) + 1)))
+      ||(NULL == (view->list = IMDBOpenBuffer (listfile, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE|view->flags, IMDBV_VIEW_BUFFER_SIZE))))
+     {
+      if (view->fname)
+       *p_error = IMDBE_FILE_OPEN;
+      IMDBCloseView (view);
+      return (NULL);
+     }
+    strcpy (view->fname, listfile);
+    if (*p_error = view_index (view))
+     {
+      IMDBCloseView (view);
+      return (NULL);
+     }
+   }
+
+  /* the pieces of the new listfile */
+  *p_error = IMDBE_MEMORY;
+  for (i = 0; (i < diff->nb_ops) && (f_ok); i++)
+   {
+    op = &diff->ops[i];
+    switch (op->cmd)
+     {
+      case IMDBV_OP_COPY:
+       f_ok = view_add_piece (view, &max_pieces, old, op->count, NULL);
+       old += op->count;
+       break;
+
+      case IMDBV_OP_DELETE:
+       old++;
+       break;
+
+      case IMDBV_OP_INSERT:
+       f_ok = view_add_piece (view, &max_pieces, 0, 1, op->text);
+       break;
+
+      case IMDBV_OP_REST:
+       f_ok = view_add_piece (view, &max_pieces, old, view->nb_old_lines + 1 - old, NULL);
+       break;
+     }
+   }
+
+  if (!f_ok)
+   {
+    IMDBCloseView (view);
+    return (NULL);
+   }
+  if (old > view->nb_old_lines + 1)
+   {/* the diff needs more lines than the old listfile has */
+    *p_error = IMDBE_SYNTAX;
+    IMDBCloseView (view);
+    return (NULL);
+   }
+
+  *p_error = IMDBE_NO_ERROR;
+  return (view);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  view_old_line
+ *
+ * Purpose:    read a line of the old listfile. Successive lines are read
+ *             without positioning the buffer.
+ *
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_POSITION or IMDBE_FILE_READ
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG view_old_line (IMDB_View *view, LONG old, char **pp_line)
+ {
+  LONG n;
+
+  if ((old < view->next_old) || (old - view->next_old > IMDBV_VIEW_STEP))
+   {
+    n = (old - 1) / IMDBV_VIEW_STEP;
+    if (IMDBPositionBuffer (view->list, view->index[n]))
+     return (IMDBE_FILE_POSITION);
+    view->next_old = n * IMDBV_VIEW_STEP + 1;
+   }
+
+  /* skip the lines in front of it */
+  for (; view->next_old <= old; view->next_old++)
+   if (IMDBReadBufferLine (view->list, pp_line, IMDBV_VIEW_LINE_SIZE))
+    {
+     view->next_old = view->nb_old_lines + 2;
+     return (IMDBE_FILE_READ);
+    }
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBViewLine
+ *
+ * Purpose:    read a line of the patched listfile
+ *
+ * Comment:    The line is valid up to the next call; don't change it.
+ *             IMDBNextViewLine continues with the following line.
+ *
+ * Parameters: view     view
+ *             line     number of the line (1 ...)
+ *             pp_line  pointer to the line
+ *
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_EOF (no such line) or
+ *             IMDBE_FILE_READ
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBViewLine (IMDB_View *view, LONG line, char **pp_line)
+ {
+  IMDB_Piece *piece;
+  LONG        low;
+  LONG        high;
+  LONG        ret;
+
+  *pp_line = NULL;
+  if ((line < 1) || (line > view->nb_lines))
+   return (IMDBE_FILE_EOF);
+
+  /* find the piece: usually the same or the next one */
+  piece = &view->pieces[view->piece];
+  if ((line < piece->first) || (line >= piece->first + piece->lines))
+   {
+    if ((view->piece + 1 < view->nb_pieces) && (line == piece->first + piece->lines))
+     view->piece++;
+    else
+     {
+      low  = 0;
+      high = view->nb_pieces - 1;
+      while (low < high)
+       {
+        view->piece = (low + high + 1) / 2;
+        if (view->pieces[view->piece].first > line)
+         high = view->piece - 1;
+        else
+         low  = view->piece;
+       }
+      view->piece = low;
+     }
+    piece = &view->pieces[view->piece];
+   }
 
-  if (p_buffer->nb_bytes_in_buffer - p_buffer->bufferpos - size >= 0)
-   {/* O.K. Ist alles im Speicher */
-    *p_mem = &p_buffer->buffer[p_buffer->bufferpos];
-    /* find EOL */
-    i = 0;
-    while ((c = p_buffer->buffer[p_buffer->bufferpos + i]) && ('\n' != c))
-     i++;
-    if (i >= size)
-     return (IMDBE_FILE_READ);
-    p_buffer->buffer[p_buffer->bufferpos + i] = '\0';
-    /* correct position */
-    p_buffer->bufferpos += (i + 1);
-    p_buffer->filepos += (i + 1);   
+  view->line = line;
+  if (0 == piece->old_first)
+   {
+    *pp_line = piece->text;
     return (IMDBE_NO_ERROR);
    }
+  if (ret = view_old_line (view, piece->old_first + line - piece->first, pp_line))
+   *pp_line = NULL;
+  return (ret);
+ }
 
-  /* Move the last bits of memory  */
-  i = p_buffer->nb_bytes_in_buffer - p_buffer->bufferpos;
-  if ((i<0) || (i>p_buffer->buffersize))
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBNextViewLine
+ *
+ * Purpose:    read the next line of the patched listfile (the first one
+ *             after IMDBOpenView)
+ *
+ * Returns:    see IMDBViewLine
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBNextViewLine (IMDB_View *view, char **pp_line)
+ {
+  return (IMDBViewLine (view, view->line + 1, pp_line));
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBViewCRC
+ *
+ * Purpose:    calculate the CRC-sum of the patched listfile (all lines
+ *             but the first), to be compared with its CRC-line
+ *
+ * Comment:    reads the whole view; IMDBNextViewLine starts again with
+ *             the first line afterwards
+ *
+ * Parameters: view   view
+ *             p_crc  CRC-sum
+ *
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_READ
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBViewCRC (IMDB_View *view, ULONG *p_crc)
+ {
+  char *p_line;
+  LONG  line;
+  LONG  ret = IMDBE_NO_ERROR;
+
+  *p_crc = 0xFFFFFFFFL;
+  for (line = 2; (line <= view->nb_lines) && (IMDBE_NO_ERROR == ret); line++)
+   if (IMDBE_NO_ERROR == (ret = IMDBViewLine (view, line, &p_line)))
+    IMDBCalcCRC (p_line, p_crc);
+  view->line = 0;
+  return (ret);
+ }
+
+/*=============================================================================
+ * Applying Diffs
+ *=============================================================================
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  apply_old_line
+ *
+ * Purpose:    read the next line of the old listfile
+ *
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_READ or IMDBE_SYNTAX (no more
+ *             lines)
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG apply_old_line (IMDB_Buffer *list, char **pp_line)
+ {
+  LONG ret;
+
+  if (NULL == list)
+   return (IMDBE_SYNTAX);
+  if (IMDBE_FILE_EOF == (ret = IMDBReadBufferLine (list, pp_line, IMDBV_APPLY_LINE_SIZE)))
+   return (IMDBE_SYNTAX);
+  return (ret ? IMDBE_FILE_READ : IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  apply_new_line
+ *
+ * Purpose:    write a line of the patched listfile
+ *
+ * Returns:    IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG apply_new_line (IMDB_Buffer *out, char *p_line, LONG line, ULONG *p_crc)
+ {
+  if (line > 1)
+   IMDBCalcCRC (p_line, p_crc);
+  if ((IMDBWriteBuffer (out, p_line, strlen (p_line))) || (IMDBWriteBuffer (out, "\n", 1)))
+   return (IMDBE_FILE_WRITE);
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBApplyDiff
+ *
+ * Purpose:    patch a listfile in one pass. The hook is called for every
+ *             line that is copied, deleted or added.
+ *
+ * Parameters: listfile   old listfile or NULL
+ *             flags      IMDBV_FILE_GZIP/CHUNKS of the old listfile
+ *             diff       diff
+ *             outfile    patched listfile or NULL
+ *             out_flags  IMDBV_FILE_GZIP or 0
+ *             hook       line-hook or NULL
+ *             user_data  passed to the hook
+ *             p_crc      CRC-sum of the patched listfile or NULL
+ *
+ * Returns:    IMDBE_NO_ERROR, IMDBE_FILE_OPEN, IMDBE_FILE_READ,
+ *             IMDBE_FILE_WRITE, IMDBE_SYNTAX or IMDBE_INTERRUPT
+ *-----------------------------------------------------------------------------
+ */
+
+LONG IMDBApplyDiff (char *listfile, LONG flags, IMDB_Diff *diff, char *outfile, LONG out_flags,
+                    IMDB_LineHook hook, APTR user_data, ULONG *p_crc)
+ {
+  IMDB_Buffer *list = NULL;
+  IMDB_Buffer *out;
+  IMDB_DiffOp *op;
+  char        *p_line;
+  ULONG        crc;
+  LONG         old  = 0;
+  LONG         line = 0;
+  LONG         i;
+  LONG         n;
+  LONG         ret  = IMDBE_NO_ERROR;
+
+  if (!crc_init ())
+   return (IMDBE_MEMORY);
+  crc = 0xFFFFFFFFL;
+  if ((listfile)
+    &&(NULL == (list = IMDBOpenBuffer (listfile, IMDBV_FILE_READ|IMDBV_FILE_THREAD|(flags & (IMDBV_FILE_GZIP|IMDBV_FILE_CHUNKS)), IMDBV_APPLY_BUFFER_SIZE))))
+   return (IMDBE_FILE_OPEN);
+  if (outfile)
+   out = IMDBOpenBuffer (outfile, IMDBV_FILE_WRITE|IMDBV_FILE_THREAD|(out_flags & IMDBV_FILE_GZIP), IMDBV_APPLY_BUFFER_SIZE);
+  else
+   out = IMDBOpenBuffer ("", IMDBV_FILE_WRITE|IMDBV_FILE_NULL, IMDBV_APPLY_BUFFER_SIZE);
+  if (NULL == out)
    {
-#ifdef IMDB_DEBUG
-    printf ("Fatal error in IMDBReadBufferLine!!!\n Remaining bytes: %i\nBytes in Buffer %i\n", i, p_buffer->buffersize);
+    if (list)
+     IMDBCloseBuffer (list);
+    return (IMDBE_FILE_OPEN);
+   }
+
+  for (i = 0; (i < diff->nb_ops) && (IMDBE_NO_ERROR == ret); i++)
+   {
+    op = &diff->ops[i];
+    switch (op->cmd)
+     {
+      case IMDBV_OP_COPY:
+      case IMDBV_OP_REST:
+       for (n = 0; ((IMDBV_OP_REST == op->cmd) || (n < op->count)) && (IMDBE_NO_ERROR == ret); n++)
+        {
+         if ((IMDBV_OP_REST == op->cmd) && (NULL == list))
+          break;
+         if (ret = apply_old_line (list, &p_line))
+          {
+           if ((IMDBV_OP_REST == op->cmd) && (IMDBE_SYNTAX == ret))
+            ret = IMDBE_NO_ERROR;
+           break;
+          }
+         if ((1 == ++old) && (diff->header) && (strcmp (p_line, diff->header)))
+          ret = IMDBE_SYNTAX;
+         else
+         if (IMDBE_NO_ERROR == (ret = apply_new_line (out, p_line, ++line, &crc)))
+          if ((hook) && ((*hook) (user_data, IMDBV_LINE_COPY, old, line, p_line)))
+           ret = IMDBE_INTERRUPT;
+        }
+       break;
+
+      case IMDBV_OP_DELETE:
+       if (IMDBE_NO_ERROR == (ret = apply_old_line (list, &p_line)))
+        {
+         old++;
+         if (((op->text) && (strcmp (p_line, op->text)))
+           ||((1 == old) && (diff->header) && (strcmp (p_line, diff->header))))
+          ret = IMDBE_SYNTAX;
+         else
+         if ((hook) && ((*hook) (user_data, IMDBV_LINE_DELETE, old, line, p_line)))
+          ret = IMDBE_INTERRUPT;
+        }
+       break;
+
+      case IMDBV_OP_INSERT:
+       if (IMDBE_NO_ERROR == (ret = apply_new_line (out, op->text, ++line, &crc)))
+        if ((hook) && ((*hook) (user_data, IMDBV_LINE_INSERT, 0, line, op->text)))
+         ret = IMDBE_INTERRUPT;
+       break;
+     }
+   }
+
+  if (list)
+   IMDBCloseBuffer (list);
+  if ((IMDBCloseBuffer (out)) && (IMDBE_NO_ERROR == ret))
+   ret = IMDBE_FILE_WRITE;
+  if ((IMDBE_NO_ERROR != ret) && (outfile))
+   remove (outfile);
+  if (p_crc)
+   *p_crc = crc & 0xFFFFFFFFL;
+  return (ret);
+ }
+
+/******************************************************************************
+ *  Jobs per Device
+ *
+ *  Every job (usually a listfile) is put to the device its file is on.
+ *  The workers take the jobs of the device with the fewest jobs running,
+ *  the biggest file first, but never more than the limit of a device at
+ *  the same time. So a spinning disk reads one file after the other while
+ *  an SSD is read by several workers.
+ ******************************************************************************
+ */
+
+typedef struct
+ {
+#ifdef SYS_UNIX
+  dev_t  dev;
 #endif
-    return (IMDBE_FILE_READ);
+  LONG   limit;                          /* jobs at the same time */
+  LONG   running;
+ } ScheduleDevice;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  device_limit
+ *
+ * Purpose:    find the number of jobs a device can do at the same time:
+ *             1 for spinning disks, IMDBV_SCHEDULE_FAST for SSDs and
+ *             IMDBV_SCHEDULE_OTHER if it is not known (network, ...)
+ *
+ * Comment:    Only Linux tells (/sys/dev/block)
+ *-----------------------------------------------------------------------------
+ */
+
+#ifdef SYS_UNIX
+static LONG device_limit (ScheduleDevice *device)
+ {
+  LONG limit = IMDBV_SCHEDULE_OTHER;
+#ifdef __linux__
+  char  fname[80];
+  FILE *fp;
+  int   c;
+
+  sprintf (fname, "/sys/dev/block/%u:%u/queue/rotational", (unsigned) major (device->dev), (unsigned) minor (device->dev));
+  if (NULL == (fp = fopen (fname, "r")))
+   {/* partition: the queue belongs to the disk */
+    sprintf (fname, "/sys/dev/block/%u:%u/../queue/rotational", (unsigned) major (device->dev), (unsigned) minor (device->dev));
+    fp = fopen (fname, "r");
    }
-  if (i > 0)
-   memmove(p_buffer->buffer, &p_buffer->buffer[p_buffer->bufferpos], i);
+  if (fp)
+   {
+    c = fgetc (fp);
+    if ('1' == c)
+     limit = 1;
+    else
+    if ('0' == c)
+     limit = IMDBV_SCHEDULE_FAST;
+    fclose (fp);
+   }
+#else
+  (void) device;
+#endif
+  return (limit);
+ }
+#endif
 
-  /* Load new segment in memory */
-  p_buffer->nb_bytes_in_buffer = i + fread(&p_buffer->buffer[i], 1, p_buffer->buffersize - i, p_buffer->stream);
-  *p_mem = p_buffer->buffer;
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBCloseSchedule
+ *
+ * Purpose:    free a schedule
+ *-----------------------------------------------------------------------------
+ */
 
-  /* end of file? */
-  if (0 == p_buffer->nb_bytes_in_buffer)
+void IMDBCloseSchedule (IMDB_Schedule *schedule)
+ {
+  if (NULL == schedule)
+   return;
+#ifdef IMDB_THREADS
+  if (schedule->lock)
    {
-    *p_mem = NULL;
-    return (IMDBE_FILE_EOF);
+    pthread_mutex_destroy ((pthread_mutex_t *) schedule->lock);
+    pthread_cond_destroy ((pthread_cond_t *) &((pthread_mutex_t *) schedule->lock)[1]);
+    IMDBFreeMemory (schedule->lock);
    }
+#endif
+  if (schedule->jobs) IMDBFreeMemory (schedule->jobs);
+  if (schedule->devices) IMDBFreeMemory (schedule->devices);
+  IMDBFreeMemory (schedule);
+ }
 
-  /* find EOL */
-  i = 0;
-  while ((c = p_buffer->buffer[i]) && ('\n' != c))
-   i++;
-  if ((i >= size) || (i >= p_buffer->nb_bytes_in_buffer))
-   return (IMDBE_FILE_READ);
-  p_buffer->buffer[i] = '\0';
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBOpenSchedule
+ *
+ * Purpose:    open a schedule for nb_jobs jobs
+ *
+ * Parameters: nb_jobs    number of jobs
+ *             dev_limit  jobs per device at the same time, 0: depends on
+ *                        the device
+ *
+ * Returns:    schedule or NULL (no memory)
+ *-----------------------------------------------------------------------------
+ */
 
-  /* correct position */
-  p_buffer->bufferpos = (i + 1);
-  p_buffer->filepos  += (i + 1);
+IMDB_Schedule *IMDBOpenSchedule (LONG nb_jobs, LONG dev_limit)
+ {
+  IMDB_Schedule *schedule;
+  LONG           i;
 
-  return (IMDBE_NO_ERROR);
+  if (NULL == (schedule = IMDBAllocMemory (sizeof (IMDB_Schedule))))
+   return (NULL);
+  schedule->nb_jobs    = nb_jobs;
+  schedule->nb_devices = 0;
+  schedule->dev_limit  = dev_limit;
+  schedule->jobs       = IMDBAllocMemory ((nb_jobs + 1) * sizeof (IMDB_Job));
+  schedule->devices    = IMDBAllocMemory ((nb_jobs + 1) * sizeof (ScheduleDevice));
+  schedule->lock       = NULL;
+#ifdef IMDB_THREADS
+  if (schedule->lock = IMDBAllocMemory (sizeof (pthread_mutex_t) + sizeof (pthread_cond_t)))
+   {
+    pthread_mutex_init ((pthread_mutex_t *) schedule->lock, NULL);
+    pthread_cond_init ((pthread_cond_t *) &((pthread_mutex_t *) schedule->lock)[1], NULL);
+   }
+#endif
+  if ((NULL == schedule->jobs) || (NULL == schedule->devices))
+   {
+    IMDBCloseSchedule (schedule);
+    return (NULL);
+   }
+
+  for (i = 0; i < nb_jobs; i++)
+   {
+    schedule->jobs[i].device = -1;
+    schedule->jobs[i].size   = 0;
+    schedule->jobs[i].state  = IMDBV_JOB_WAITING;
+   }
+  return (schedule);
  }
 
 /*-----------------------------------------------------------------------------
- * Procedure:  IMDBWriteBuffer
+ * Procedure:  IMDBScheduleJob
  *
- * Purpose:    write some data to file
+ * Purpose:    put a job to the device of its file
  *
- * Comment:    
- *             Buffer needs to be in IMDB_FILE_WRITE or IMDB_FILE_APPEND mode
+ * Comment:    If the file does not exist (yet), its directory is used.
+ *             Jobs that are not scheduled are done on a device of their
+ *             own, in the order of their numbers.
  *
- * Parameters: buffer  pointer to buffer
- *             data    pointer to data
- *             size    number of bytes to write
+ * Parameters: schedule, job (0 ... nb_jobs-1), fname
  *
- * Returns:    NULL if successful, IMDB_IO_ERROR otherwise
+ * Returns:    nothing
  *-----------------------------------------------------------------------------
  */
 
-LONG IMDBWriteBuffer (IMDB_Buffer *p_buffer, APTR p_mem, LONG size)
+void IMDBScheduleJob (IMDB_Schedule *schedule, LONG job, char *fname)
  {
-  if (size <= (p_buffer->buffersize - p_buffer->nb_bytes_in_buffer))
-   {/* save in memory */ 
-    memcpy(&p_buffer->buffer[p_buffer->nb_bytes_in_buffer], p_mem, size);
-    p_buffer->nb_bytes_in_buffer += size;
-    p_buffer->bufferpos = p_buffer->nb_bytes_in_buffer;
-    p_buffer->filepos  += size;
-    return (IMDBE_NO_ERROR);
+#ifdef SYS_UNIX
+  ScheduleDevice *devices = (ScheduleDevice *) schedule->devices;
+  struct stat     stbuf;
+  char            dirname[256];
+  char           *p_c;
+  LONG            i;
+
+  if ((job < 0) || (job >= schedule->nb_jobs))
+   return;
+
+  if (0 == stat (fname, &stbuf))
+   schedule->jobs[job].size = (LONG) stbuf.st_size;
+  else
+   {
+    strncpy (dirname, fname, 255);
+    dirname[255] = '\0';
+    if (p_c = strrchr (dirname, '/'))
+     p_c[1] = '\0';
+    else
+     strcpy (dirname, ".");
+    if (stat (dirname, &stbuf))
+     return;
    }
 
-  /* Flush Buffer */
-  if (p_buffer->nb_bytes_in_buffer != fwrite(p_buffer->buffer, 1, p_buffer->nb_bytes_in_buffer, p_buffer->stream))
+  for (i = 0; (i < schedule->nb_devices) && (devices[i].dev != stbuf.st_dev); i++)
+   ;
+  if (i == schedule->nb_devices)
    {
-    IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_WRITE, p_buffer->fname);
-    return (IMDBE_FILE_WRITE);
+    devices[i].dev     = stbuf.st_dev;
+    devices[i].running = 0;
+    devices[i].limit   = (schedule->dev_limit > 0) ? schedule->dev_limit : device_limit (&devices[i]);
+    schedule->nb_devices++;
    }
-  p_buffer->filepos = ftell(p_buffer->stream);
-  p_buffer->bufferpos = 0;
-  p_buffer->nb_bytes_in_buffer = 0;
+  schedule->jobs[job].device = i;
+#else
+  /* no devices: every job stays on a device of its own */
+  (void) schedule;
+  (void) job;
+  (void) fname;
+#endif
+ }
 
-  /* is buffer too small for this block? */
-  if (size > p_buffer->buffersize)
-   {/* save immediately */
-    if (size != fwrite(p_mem, 1, size, p_buffer->stream))
+/*-----------------------------------------------------------------------------
+ * Procedure:  schedule_next, schedule_done
+ *
+ * Purpose:    take the next job (wait until one of its device is
+ *             finished if necessary) / give the device back
+ *
+ * Returns:    schedule_next: job or -1 if there is none left
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG schedule_next (IMDB_Schedule *schedule)
+ {
+  ScheduleDevice *devices = (ScheduleDevice *) schedule->devices;
+  IMDB_Job       *jobs    = schedule->jobs;
+  LONG            job;
+  LONG            nb_running;
+  LONG            i;
+  BOOL            f_waiting;
+
+#ifdef IMDB_THREADS
+  if (schedule->lock)
+   pthread_mutex_lock ((pthread_mutex_t *) schedule->lock);
+#endif
+  for (;;)
+   {
+    job        = -1;
+    nb_running = 0;
+    f_waiting  = FALSE;
+    for (i = 0; i < schedule->nb_jobs; i++)
+     if (IMDBV_JOB_RUNNING == jobs[i].state)
+      nb_running++;
+    for (i = 0; i < schedule->nb_jobs; i++)
      {
-      IMDBSetError(&p_buffer->error, IMDB_PENALTY_HARMLESS, 0, IMDBE_FILE_WRITE, p_buffer->fname);
-      return (IMDBE_FILE_WRITE);
+      if (IMDBV_JOB_WAITING != jobs[i].state)
+       continue;
+      f_waiting = TRUE;
+
+      /* not scheduled: in the order of the numbers, nothing in between */
+      if (-1 == jobs[i].device)
+       {
+        job = i;
+        break;
+       }
+      if (devices[jobs[i].device].running >= devices[jobs[i].device].limit)
+       continue;
+
+      /* device with the fewest jobs running, there the biggest file */
+      if ((-1 == job)
+        ||(devices[jobs[i].device].running < devices[jobs[job].device].running)
+        ||((jobs[i].device == jobs[job].device) && (jobs[i].size > jobs[job].size)))
+       job = i;
+     }
+
+    /* memory budget: the next job waits until a running one is done */
+    if ((-1 != job) && (nb_running > 0) && (IMDBMemoryLeft () < IMDBV_BUDGET_JOB))
+     job = -1;
+    else
+    if ((-1 != job) || (!f_waiting))
+     break;
+#ifdef IMDB_THREADS
+    if (NULL == schedule->lock)
+#endif
+     {/* one worker only: ignore the limits */
+      for (i = 0; (i < schedule->nb_jobs) && (IMDBV_JOB_WAITING != jobs[i].state); i++)
+       ;
+      job = i;
+      break;
      }
-    p_buffer->filepos = ftell(p_buffer->stream);
+#ifdef IMDB_THREADS
+    pthread_cond_wait ((pthread_cond_t *) &((pthread_mutex_t *) schedule->lock)[1], (pthread_mutex_t *) schedule->lock);
+#endif
    }
-  else
-   {/* save in memory */ 
-    memcpy(p_buffer->buffer, p_mem, size);
-    p_buffer->nb_bytes_in_buffer = size;
-    p_buffer->bufferpos = size;
-    p_buffer->filepos  += size;
-    return (IMDBE_NO_ERROR);
+
+  if (-1 != job)
+   {
+    jobs[job].state = IMDBV_JOB_RUNNING;
+    if (-1 != jobs[job].device)
+     devices[jobs[job].device].running++;
    }
+#ifdef IMDB_THREADS
+  if (schedule->lock)
+   pthread_mutex_unlock ((pthread_mutex_t *) schedule->lock);
+#endif
+  return (job);
+ }
 
-  return (IMDBE_NO_ERROR);
+static void schedule_done (IMDB_Schedule *schedule, LONG job)
+ {
+  ScheduleDevice *devices = (ScheduleDevice *) schedule->devices;
+
+#ifdef IMDB_THREADS
+  if (schedule->lock)
+   pthread_mutex_lock ((pthread_mutex_t *) schedule->lock);
+#endif
+  schedule->jobs[job].state = IMDBV_JOB_DONE;
+  if (-1 != schedule->jobs[job].device)
+   devices[schedule->jobs[job].device].running--;
+#ifdef IMDB_THREADS
+  if (schedule->lock)
+   {
+    pthread_cond_broadcast ((pthread_cond_t *) &((pthread_mutex_t *) schedule->lock)[1]);
+    pthread_mutex_unlock ((pthread_mutex_t *) schedule->lock);
+   }
+#endif
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:  schedule_worker
+ *
+ * Purpose:    do jobs until there are none left
+ *-----------------------------------------------------------------------------
+ */
+
+typedef struct
+ {
+  IMDB_Schedule *schedule;
+  IMDB_JobHook   hook;
+  APTR           user_data;
+ } ScheduleWorker;
+
+static void *schedule_worker (void *p_arg)
+ {
+  ScheduleWorker *worker = (ScheduleWorker *) p_arg;
+  LONG            job;
+
+  while (-1 != (job = schedule_next (worker->schedule)))
+   {
+    worker->hook (worker->user_data, job);
+    schedule_done (worker->schedule, job);
+   }
+  return (NULL);
  }
 
+/*-----------------------------------------------------------------------------
+ * Procedure:  IMDBRunSchedule
+ *
+ * Purpose:    do all jobs with nb_workers workers at the same time
+ *
+ * Comment:    The caller is one of the workers, the others are threads
+ *             (IMDB_THREADS). Without threads the jobs are done one after
+ *             the other. Returns when all jobs are done.
+ *
+ * Parameters: schedule, nb_workers, hook (called for every job),
+ *             user_data (passed to the hook)
+ *
+ * Returns:    nothing
+ *-----------------------------------------------------------------------------
+ */
+
+void IMDBRunSchedule (IMDB_Schedule *schedule, LONG nb_workers, IMDB_JobHook hook, APTR user_data)
+ {
+  ScheduleWorker worker;
+#ifdef IMDB_THREADS
+  pthread_t     *threads    = NULL;
+  LONG           nb_threads = 0;
+  LONG           i;
+#endif
+
+  worker.schedule  = schedule;
+  worker.hook      = hook;
+  worker.user_data = user_data;
+
+#ifdef IMDB_THREADS
+  if (nb_workers > schedule->nb_jobs)
+   nb_workers = schedule->nb_jobs;
+  if ((schedule->lock) && (nb_workers > 1) && (threads = IMDBAllocMemory (nb_workers * sizeof (pthread_t))))
+   while ((nb_threads < nb_workers - 1) && (0 == pthread_create (&threads[nb_threads], NULL, schedule_worker, &worker)))
+    nb_threads++;
+#endif
+
+  schedule_worker (&worker);
+
+#ifdef IMDB_THREADS
+  for (i = 0; i < nb_threads; i++)
+   pthread_join (threads[i], NULL);
+  if (threads)
+   IMDBFreeMemory (threads);
+#else
+  (void) nb_workers;
+#endif
+ }
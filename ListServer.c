@@ -0,0 +1,1087 @@
+/*============================================================================
+ *
+ *  Program:      ListServer.c
+ *
+ *  Version:      1.0 (19.10.26)
+ *
+ *  Purpose:      Keeps the listfiles of a directory in memory and answers
+ *                requests on a local socket: diffs are applied to the
+ *                resident listfiles and written back to the disk in the
+ *                background, lines are read without touching the disk.
+ *                The listfiles are read from the disk only once.
+ *
+ *                UNIX only (sockets)
+ *
+ *                UNIX-Commandline-Options:
+ *
+ *                   <listdir>    path of the listfiles
+ *                   <socket>     filename of the socket
+ *                  optional:
+ *                   -quiet       don't log the requests
+ *
+ *                   -request <socket> <request>
+ *                                send a request to a running ListServer
+ *                                and show the answer
+ *
+ *                Requests:
+ *
+ *                   APPLY <diffdir>          apply the diffs of a directory
+ *                   VERIFY [<diffdir>]       check the diffs (or the CRC of
+ *                                            all listfiles), change nothing
+ *                   LINES <list> <from> <to> show lines of a listfile
+ *                   QUIT                     write back and stop the server
+ *
+ *
+ *  Copyright:    (c) Internet MovieDatabase Limited 1990 - 2001
+ *
+ *       This file is part of the Internet MovieDatabase project.
+ *
+ *  The  MovieDatabase  FAQ contains more information on the whole project.
+ *  For   a   copy   send  an  e-mail   with  the  subject  "HELP  FAQ"  to
+ *  <mail-server@imdb.com>.
+ *
+ *  Permission  is  granted  to make and distribute verbatim copies of this
+ *  package  provided  the  copyright notice and this permission notice are
+ *  preserved  on  all  copies  and the package is distributed in unaltered
+ *  archive  form only.  It is not allowed to modify the source code and/or
+ *  redistribute  modified  copies  of  it  and/or  the executables without
+ *  written permission of the author.
+ *
+ *  If  you need to make a change to the source-code in order to be able to
+ *  use the package, you have to notify the author.
+ *
+ *  No guarantee of any kind is given that the programs and scripts in this
+ *  package  are  100%  reliable.  You are using this material at your  own
+ *  risk.   The  author  cannot be made responsible for any damage which is
+ *  caused by using these programs.
+ *
+ *  This  package  is  freely  distributable,  but still copyright by  IMDb
+ *  Ltd.
+ *
+ *  None  of  the programs or scripts nor the source code (nor parts of it)
+ *  may  be  included  or  used  in  commercial  programs unless by written
+ *  permission from the author.
+ *
+ *============================================================================
+ */
+
+/* some defines (specified by the Makefile) */
+/*#define SYS_UNIX  */
+/*#define IMDB_DEBUG*/
+
+/* ************************* */
+
+#include "IMDB.h"
+
+#ifdef SYS_UNIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+
+#ifdef NEXT
+#include <sys/dir.h>
+#else
+#include "dirent.h"
+#endif /* NEXT */
+
+#endif /* SYS_UNIX*/
+
+#ifdef IMDB_THREADS
+#include <pthread.h>
+#endif
+
+#define VERSION "ListServer 1.0 (19.10.26)"
+static const char version[] ="$VER: "VERSION;
+
+/* Return values */
+#define RET_OK              0
+#define RET_WARNING        10
+#define RET_ERROR          20
+
+/* buffer sizes */
+#define ADV_BUFFER_SIZE    512 * 1024
+#define ADV_MAX_LINESIZE     8 * 1024
+
+/* max. number of resident listfiles */
+#define ADV_MAX_LISTS      256
+
+/* Status values (as in ApplyDiffs) */
+#define STATUS_OK       0  /* No error */
+#define STATUS_CRC      1  /* CRC-Checksum error */
+#define STATUS_IO       2  /* IO-Error */
+#define STATUS_VER      3  /* wrong file-diffile-combination */
+#define STATUS_SYN      4  /* Syntax-Error in Diff-File */
+#define STATUS_NEW      5  /* New file */
+#define STATUS_MISSING  6  /* listfile does not exist */
+
+typedef struct
+ {
+  char *p_listdir;
+  char *p_socket;
+  LONG  f_quiet;
+ } AD_Commands;
+
+AD_Commands ad_cmds = {NULL, NULL, FALSE};
+
+/******************************************************************************
+ *  Resident listfiles
+ ******************************************************************************
+ *
+ * The lines of a listfile are kept one after the other in one block of
+ * memory, each terminated by '\0', and an index holds where every line
+ * starts. A diff is applied by building the patched listfile as a second
+ * text next to the old one; only when the diffs of all listfiles fit and
+ * the CRC-sums are right, the patched texts replace the old ones and are
+ * written back (IMDB_THREADS: one thread per listfile).
+ *
+ ******************************************************************************
+ */
+
+typedef struct
+ {
+  char *memory;                    /* lines, terminated by '\0' */
+  LONG  size;                      /* bytes used of memory */
+  LONG  max_size;                  /* size of memory */
+  LONG *index;                     /* offset of every line in memory */
+  LONG  nb_lines;
+  LONG  max_lines;                 /* size of index */
+ } ListText;
+
+#define text_line(t,n) (&(t)->memory[(t)->index[n]])
+
+typedef struct
+ {
+  char      name[256];             /* filename in the list-directory */
+  LONG      gzip;                  /* IMDBV_FILE_GZIP or 0 */
+  ListText  text;                  /* resident listfile */
+  ListText  patched;               /* patched listfile, not yet taken */
+  IMDB_Diff *diff;                 /* diff of the current request or NULL */
+  LONG      status;                /* STATUS_xxx of the current request */
+  LONG      add;                   /* lines added by the current request */
+  LONG      delete;                /* lines deleted by the current request */
+  BOOL      f_new;                 /* listfile is introduced by the current request */
+  BOOL      f_writing;             /* write-back is running */
+  LONG      write_error;           /* result of the last write-back */
+#ifdef IMDB_THREADS
+  pthread_t writer;
+#endif
+ } ResidentList;
+
+ResidentList *lists[ADV_MAX_LISTS];
+LONG          nb_lists = 0;
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   StrHasSuffix
+ *
+ * Returns:     TRUE, if p_str ends with p_suffix
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL StrHasSuffix (char *p_str, char *p_suffix)
+ {
+  LONG len = strlen (p_str);
+  LONG len_suffix = strlen (p_suffix);
+
+  if (len <= len_suffix)
+   return (FALSE);
+  return ((BOOL) (0 == strncmp (&p_str[len-len_suffix], p_suffix, len_suffix)));
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   GzipFlag
+ *
+ * Returns:     IMDBV_FILE_GZIP for compressed files (with IMDB_ZLIB)
+ *-----------------------------------------------------------------------------
+ */
+
+LONG GzipFlag (char *p_name)
+ {
+#ifdef IMDB_ZLIB
+  if (StrHasSuffix (p_name, ".gz"))
+   return (IMDBV_FILE_GZIP);
+#endif
+  return (0);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   BaseName
+ *
+ * Purpose:     name of a listfile without .list(.gz) or of a diff-file
+ *              without .list/.diff(.gz), e.g. "movies"
+ *
+ * Returns:     IMDBV_DIFF_... (and IMDBV_FILE_GZIP) for diff-files, 0 if
+ *              the name has no known extension
+ *-----------------------------------------------------------------------------
+ */
+
+LONG BaseName (char *p_base, char *p_name)
+ {
+  LONG gzip = GzipFlag (p_name);
+  LONG len;
+
+  strncpy (p_base, p_name, 255);
+  p_base[255] = '\0';
+  if (gzip)
+   p_base[strlen(p_base)-3] = '\0';
+
+  len = strlen (p_base);
+  if (StrHasSuffix (p_base, ".list"))
+   {
+    p_base[len-5] = '\0';
+    return (IMDBV_DIFF_ORIGINAL|gzip);
+   }
+  if (StrHasSuffix (p_base, ".diff"))
+   {
+    p_base[len-5] = '\0';
+    return (IMDBV_DIFF_STRIPPED|gzip);
+   }
+  return (0);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   text_add_line
+ *
+ * Purpose:     append a line to a text, the memory grows as needed
+ *
+ * Returns:     FALSE if out of memory
+ *-----------------------------------------------------------------------------
+ */
+
+static BOOL text_add_line (ListText *text, char *p_line)
+ {
+  LONG  len = strlen (p_line) + 1;
+  char *p_mem;
+  LONG *p_index;
+
+  while (text->size + len > text->max_size)
+   {
+    if (NULL == (p_mem = IMDBAllocMemory (2 * text->max_size + len)))
+     return (FALSE);
+    if (text->memory)
+     {
+      memcpy (p_mem, text->memory, text->size);
+      IMDBFreeMemory (text->memory);
+     }
+    text->memory   = p_mem;
+    text->max_size = 2 * text->max_size + len;
+   }
+  if (text->nb_lines >= text->max_lines)
+   {
+    if (NULL == (p_index = IMDBAllocMemory ((2 * text->max_lines + 1024) * sizeof (LONG))))
+     return (FALSE);
+    if (text->index)
+     {
+      memcpy (p_index, text->index, text->nb_lines * sizeof (LONG));
+      IMDBFreeMemory (text->index);
+     }
+    text->index     = p_index;
+    text->max_lines = 2 * text->max_lines + 1024;
+   }
+
+  memcpy (&text->memory[text->size], p_line, len);
+  text->index[text->nb_lines++] = text->size;
+  text->size += len;
+  return (TRUE);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   text_free
+ *-----------------------------------------------------------------------------
+ */
+
+static void text_free (ListText *text)
+ {
+  if (text->memory)
+   IMDBFreeMemory (text->memory);
+  if (text->index)
+   IMDBFreeMemory (text->index);
+  memset (text, 0, sizeof (ListText));
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   text_crc
+ *
+ * Returns:     TRUE, if the CRC-line (first line) of the text is right
+ *-----------------------------------------------------------------------------
+ */
+
+static BOOL text_crc (ListText *text)
+ {
+  char  crc_line[16];
+  ULONG crc = 0xFFFFFFFFL;
+  LONG  n;
+
+  if (0 == text->nb_lines)
+   return (FALSE);
+  for (n = 1; n < text->nb_lines; n++)
+   IMDBCalcCRC (text_line (text, n), &crc);
+  sprintf (crc_line, "CRC: 0x%08lX", crc & 0xFFFFFFFFL);
+  return ((BOOL) (0 == strncmp (text_line (text, 0), crc_line, 15)));
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ListName
+ *
+ * Purpose:     build the full filename of a listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void ListName (char *p_name, ResidentList *list, char *p_ext)
+ {
+  sprintf (p_name, "%.200s%.40s%s", ad_cmds.p_listdir, list->name, p_ext);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   LoadList
+ *
+ * Purpose:     read a listfile into memory
+ *
+ * Returns:     resident listfile or NULL if failed
+ *-----------------------------------------------------------------------------
+ */
+
+ResidentList *LoadList (char *p_name)
+ {
+  ResidentList *list;
+  IMDB_Buffer  *buffer;
+  char          fname[256];
+  char         *p_line;
+  LONG          ret;
+
+  if (NULL == (list = IMDBAllocMemory (sizeof (ResidentList))))
+   return (NULL);
+  memset (list, 0, sizeof (ResidentList));
+  strncpy (list->name, p_name, 255);
+  list->gzip = GzipFlag (p_name);
+
+  ListName (fname, list, "");
+  if (NULL == (buffer = IMDBOpenBuffer (fname, IMDBV_FILE_READ|IMDBV_FILE_GETSIZE|list->gzip, ADV_BUFFER_SIZE)))
+   {
+    IMDBFreeMemory (list);
+    return (NULL);
+   }
+
+  /* plain listfiles: the memory is allocated at once */
+  if ((!list->gzip) && (buffer->filesize > 0)
+    &&(list->text.memory = IMDBAllocMemory (buffer->filesize + 1)))
+   list->text.max_size = buffer->filesize + 1;
+
+  while (IMDBE_NO_ERROR == (ret = IMDBReadBufferLine (buffer, &p_line, ADV_MAX_LINESIZE)))
+   if (!text_add_line (&list->text, p_line))
+    break;
+  IMDBCloseBuffer (buffer);
+
+  if (IMDBE_FILE_EOF != ret)
+   {
+    text_free (&list->text);
+    IMDBFreeMemory (list);
+    return (NULL);
+   }
+  return (list);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   FreeList
+ *-----------------------------------------------------------------------------
+ */
+
+void FreeList (ResidentList *list)
+ {
+  text_free (&list->text);
+  text_free (&list->patched);
+  if (list->diff)
+   IMDBFreeDiff (list->diff);
+  IMDBFreeMemory (list);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   FindList
+ *
+ * Returns:     resident listfile with this base name or NULL
+ *-----------------------------------------------------------------------------
+ */
+
+ResidentList *FindList (char *p_base)
+ {
+  char base[256];
+  LONG i;
+
+  for (i = 0; i < nb_lists; i++)
+   {
+    BaseName (base, lists[i]->name);
+    if (0 == strcmp (base, p_base))
+     return (lists[i]);
+   }
+  return (NULL);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   write_list
+ *
+ * Purpose:     write a resident listfile to <listfile>.new, then replace
+ *              the listfile (and its block-index)
+ *
+ * Returns:     IMDBE_NO_ERROR, IMDBE_FILE_OPEN or IMDBE_FILE_WRITE
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG write_list (ResidentList *list)
+ {
+  IMDB_Buffer *buffer;
+  char         fname[256];
+  char         newname[256];
+  char         idxname[256];
+  char         idxnew[256];
+  char        *p_line;
+  LONG         n;
+  LONG         ret = IMDBE_NO_ERROR;
+
+  ListName (fname, list, "");
+  ListName (newname, list, ".new");
+  if (NULL == (buffer = IMDBOpenBuffer (newname, IMDBV_FILE_WRITE|list->gzip, ADV_BUFFER_SIZE)))
+   return (IMDBE_FILE_OPEN);
+  for (n = 0; (n < list->text.nb_lines) && (IMDBE_NO_ERROR == ret); n++)
+   {
+    p_line = text_line (&list->text, n);
+    if ((IMDBWriteBuffer (buffer, p_line, strlen (p_line))) || (IMDBWriteBuffer (buffer, "\n", 1)))
+     ret = IMDBE_FILE_WRITE;
+   }
+  if ((IMDBCloseBuffer (buffer)) && (IMDBE_NO_ERROR == ret))
+   ret = IMDBE_FILE_WRITE;
+  if ((IMDBE_NO_ERROR == ret) && ((IMDBSyncFile (newname)) || (rename (newname, fname))))
+   ret = IMDBE_FILE_WRITE;
+
+  ListName (idxnew,  list, ".new" IMDBV_FILE_INDEX_EXT);
+  ListName (idxname, list, IMDBV_FILE_INDEX_EXT);
+  if (IMDBE_NO_ERROR == ret)
+   {
+    remove (idxname);
+    rename (idxnew, idxname);
+   }
+  else
+   {
+    remove (idxnew);
+    remove (newname);
+   }
+  return (ret);
+ }
+
+#ifdef IMDB_THREADS
+/*-----------------------------------------------------------------------------
+ * Procedure:   write_list_thread
+ *
+ * Purpose:     write a listfile back in the background
+ *-----------------------------------------------------------------------------
+ */
+
+static void *write_list_thread (void *p_arg)
+ {
+  ResidentList *list = (ResidentList *) p_arg;
+
+  list->write_error = write_list (list);
+  return (NULL);
+ }
+#endif
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   StartWriteList, WaitWriteList
+ *
+ * Purpose:     write a listfile back (IMDB_THREADS: in the background) and
+ *              wait until it is written. The text must not change while
+ *              it is written.
+ *-----------------------------------------------------------------------------
+ */
+
+void StartWriteList (ResidentList *list)
+ {
+#ifdef IMDB_THREADS
+  if (0 == pthread_create (&list->writer, NULL, write_list_thread, list))
+   {
+    list->f_writing = TRUE;
+    return;
+   }
+#endif
+  list->write_error = write_list (list);
+ }
+
+void WaitWriteList (ResidentList *list)
+ {
+#ifdef IMDB_THREADS
+  if (list->f_writing)
+   pthread_join (list->writer, NULL);
+#endif
+  list->f_writing = FALSE;
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   PatchList
+ *
+ * Purpose:     build the patched listfile from the resident one and the
+ *              diff. Deleted lines of original diffs are compared, the
+ *              CRC-sum of the result is checked.
+ *
+ * Returns:     STATUS_OK, STATUS_CRC, STATUS_IO (out of memory) or
+ *              STATUS_VER (diff doesn't fit)
+ *-----------------------------------------------------------------------------
+ */
+
+LONG PatchList (ResidentList *list)
+ {
+  ListText    *old     = &list->text;
+  ListText    *patched = &list->patched;
+  IMDB_Diff   *diff    = list->diff;
+  IMDB_DiffOp *op;
+  LONG         line    = 0;
+  LONG         i;
+  LONG         n;
+
+  text_free (patched);
+  list->add    = 0;
+  list->delete = 0;
+
+  /* stripped diffs name the first line of the old listfile */
+  if ((diff->header) && ((0 == old->nb_lines) || (strcmp (diff->header, text_line (old, 0)))))
+   return (STATUS_VER);
+
+  for (i = 0; i < diff->nb_ops; i++)
+   {
+    op = &diff->ops[i];
+    switch (op->cmd)
+     {
+      case IMDBV_OP_COPY:
+      case IMDBV_OP_REST:
+       n = (IMDBV_OP_REST == op->cmd) ? old->nb_lines - line : op->count;
+       if (line + n > old->nb_lines)
+        return (STATUS_VER);
+       for (; n > 0; n--)
+        if (!text_add_line (patched, text_line (old, line++)))
+         return (STATUS_IO);
+       break;
+
+      case IMDBV_OP_DELETE:
+       if ((line >= old->nb_lines) || ((op->text) && (strcmp (op->text, text_line (old, line)))))
+        return (STATUS_VER);
+       line++;
+       list->delete++;
+       break;
+
+      case IMDBV_OP_INSERT:
+       if (!text_add_line (patched, op->text))
+        return (STATUS_IO);
+       list->add++;
+       break;
+     }
+   }
+
+  if (!text_crc (patched))
+   return (STATUS_CRC);
+  return (STATUS_OK);
+ }
+
+/******************************************************************************
+ *  Requests
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   answer_status
+ *
+ * Purpose:     report the result of a listfile
+ *-----------------------------------------------------------------------------
+ */
+
+static void answer_status (FILE *out, ResidentList *list)
+ {
+  fprintf (out, "%s: ", list->name);
+  switch (list->status)
+   {
+    case STATUS_OK:  fprintf (out, "+%li -%li %s\n", list->add, list->delete, (list->f_new) ? "new file" : "CRC-Checksum O.K."); break;
+    case STATUS_CRC: fprintf (out, "CRC Error\n"); break;
+    case STATUS_IO:  fprintf (out, "IO-Error\n"); break;
+    case STATUS_VER: fprintf (out, "Wrong listfile-diffile-combination\n"); break;
+    case STATUS_SYN: fprintf (out, "Syntax Error in Diff-File\n"); break;
+    default:         fprintf (out, "Missing Listfile\n"); break;
+   }
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ApplyRequest
+ *
+ * Purpose:     apply (or only check) the diffs of a directory. The
+ *              listfiles are only changed if all diffs fit.
+ *
+ * Returns:     TRUE, if all diffs could be applied
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL ApplyRequest (FILE *out, char *p_diffdir, BOOL f_apply)
+ {
+  ResidentList  *list;
+  DIR           *dfd;
+#ifdef NEXT
+  struct direct *dp;
+#else
+  struct dirent *dp;
+#endif /* NEXT */
+  char           base[256];
+  char           fname[256];
+  LONG           first_new = nb_lists;
+  LONG           flags;
+  LONG           error;
+  LONG           i;
+  BOOL           f_ok = TRUE;
+
+  if (NULL == (dfd = opendir (p_diffdir)))
+   {
+    fprintf (out, "ERROR Can't open %s\n", p_diffdir);
+    return (FALSE);
+   }
+
+  /* load the diffs, a new listfile gets an empty resident listfile */
+  while (dp = readdir (dfd))
+   {
+    if (0 == (flags = BaseName (base, dp->d_name)))
+     continue;
+    sprintf (fname, "%.200s/%.50s", p_diffdir, dp->d_name);
+
+    if ((NULL == (list = FindList (base))) && (nb_lists < ADV_MAX_LISTS)
+      &&(list = IMDBAllocMemory (sizeof (ResidentList))))
+     {
+      memset (list, 0, sizeof (ResidentList));
+      sprintf (list->name, "%.240s.list", base);
+      list->f_new = TRUE;
+      lists[nb_lists++] = list;
+     }
+    if (NULL == list)
+     {
+      fprintf (out, "%s: Not enough memory\n", dp->d_name);
+      f_ok = FALSE;
+      continue;
+     }
+    if (list->diff)
+     {
+      fprintf (out, "%s: more than one diff-file\n", list->name);
+      f_ok = FALSE;
+      continue;
+     }
+
+    list->status = STATUS_OK;
+    if (NULL == (list->diff = IMDBLoadDiff (fname, flags, &error)))
+     list->status = (IMDBE_SYNTAX == error) ? STATUS_SYN : STATUS_IO;
+    else
+    if ((list->f_new) && (!list->diff->f_new))
+     list->status = STATUS_MISSING;
+    else
+     list->status = PatchList (list);
+    if (STATUS_OK != list->status)
+     f_ok = FALSE;
+    answer_status (out, list);
+   }
+  closedir (dfd);
+
+  /* take the patched listfiles and write them back */
+  for (i = 0; i < nb_lists; i++)
+   {
+    list = lists[i];
+    if (NULL == list->diff)
+     continue;
+    if ((f_ok) && (f_apply))
+     {
+      WaitWriteList (list);
+      text_free (&list->text);
+      list->text = list->patched;
+      memset (&list->patched, 0, sizeof (ListText));
+      StartWriteList (list);
+     }
+    text_free (&list->patched);
+    IMDBFreeDiff (list->diff);
+    list->diff  = NULL;
+    list->f_new = FALSE;
+   }
+
+  /* new listfiles that have not been taken */
+  if ((!f_ok) || (!f_apply))
+   {
+    while (nb_lists > first_new)
+     FreeList (lists[--nb_lists]);
+   }
+
+  if (f_ok)
+   fprintf (out, "OK\n");
+  else
+   fprintf (out, "ERROR The listfiles have not been changed\n");
+  return (f_ok);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   VerifyRequest
+ *
+ * Purpose:     check the CRC-sums of all resident listfiles
+ *-----------------------------------------------------------------------------
+ */
+
+void VerifyRequest (FILE *out)
+ {
+  LONG i;
+  BOOL f_ok = TRUE;
+
+  for (i = 0; i < nb_lists; i++)
+   {
+    if (text_crc (&lists[i]->text))
+     fprintf (out, "%s: %li lines, CRC-Checksum O.K.\n", lists[i]->name, lists[i]->text.nb_lines);
+    else
+     {
+      fprintf (out, "%s: CRC Error\n", lists[i]->name);
+      f_ok = FALSE;
+     }
+    if (IMDBE_NO_ERROR != lists[i]->write_error)
+     {
+      fprintf (out, "%s: Can't write listfile\n", lists[i]->name);
+      f_ok = FALSE;
+     }
+   }
+  fprintf (out, (f_ok) ? "OK\n" : "ERROR\n");
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   LinesRequest
+ *
+ * Purpose:     show the lines <from> to <to> (from 1) of a listfile
+ *-----------------------------------------------------------------------------
+ */
+
+void LinesRequest (FILE *out, char *p_name, LONG from, LONG to)
+ {
+  ResidentList *list = NULL;
+  LONG          i;
+
+  for (i = 0; (i < nb_lists) && (NULL == list); i++)
+   if (0 == strcmp (lists[i]->name, p_name))
+    list = lists[i];
+
+  if (NULL == list)
+   {
+    fprintf (out, "ERROR No listfile %s\n", p_name);
+    return;
+   }
+  if (to > list->text.nb_lines)
+   to = list->text.nb_lines;
+  for (i = (from < 1) ? 1 : from; i <= to; i++)
+   fprintf (out, "%s\n", text_line (&list->text, i - 1));
+  fprintf (out, "OK\n");
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   HandleRequest
+ *
+ * Purpose:     answer one request, the answer ends with a line "OK..." or
+ *              "ERROR..."
+ *
+ * Returns:     TRUE, if the server has to stop (QUIT)
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL HandleRequest (FILE *out, char *p_request)
+ {
+  char  cmd[16];
+  char  arg[256];
+  LONG  from = 0;
+  LONG  to   = 0;
+  LONG  nb_args;
+
+  arg[0] = '\0';
+  if ((nb_args = sscanf (p_request, "%15s %255s %li %li", cmd, arg, &from, &to)) < 1)
+   return (FALSE);
+  if (!ad_cmds.f_quiet)
+   printf ("%s\n", p_request);
+
+  if ((0 == strcmp (cmd, "APPLY")) && (nb_args >= 2))
+   ApplyRequest (out, arg, TRUE);
+  else
+  if ((0 == strcmp (cmd, "VERIFY")) && (nb_args >= 2))
+   ApplyRequest (out, arg, FALSE);
+  else
+  if (0 == strcmp (cmd, "VERIFY"))
+   VerifyRequest (out);
+  else
+  if ((0 == strcmp (cmd, "LINES")) && (nb_args >= 3))
+   LinesRequest (out, arg, from, (nb_args >= 4) ? to : from);
+  else
+  if (0 == strcmp (cmd, "QUIT"))
+   {
+    fprintf (out, "OK\n");
+    return (TRUE);
+   }
+  else
+   fprintf (out, "ERROR Unknown request: %s\n", p_request);
+  return (FALSE);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   OpenSocket
+ *
+ * Purpose:     create the socket of the server or connect to it
+ *
+ * Returns:     socket or -1
+ *-----------------------------------------------------------------------------
+ */
+
+int OpenSocket (char *p_socket, BOOL f_server)
+ {
+  struct sockaddr_un addr;
+  int                fd;
+
+  if (strlen (p_socket) >= sizeof (addr.sun_path))
+   return (-1);
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, p_socket);
+
+  if (-1 == (fd = socket (AF_UNIX, SOCK_STREAM, 0)))
+   return (-1);
+  if (f_server)
+   {
+    unlink (p_socket);
+    if ((-1 == bind (fd, (struct sockaddr *) &addr, sizeof (addr))) || (-1 == listen (fd, 5)))
+     {
+      close (fd);
+      return (-1);
+     }
+   }
+  else
+  if (-1 == connect (fd, (struct sockaddr *) &addr, sizeof (addr)))
+   {
+    close (fd);
+    return (-1);
+   }
+  return (fd);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   SendRequest
+ *
+ * Purpose:     send a request to the server and show the answer
+ *
+ * Returns:     RET_OK, RET_WARNING (answer is an error) or RET_ERROR
+ *-----------------------------------------------------------------------------
+ */
+
+int SendRequest (char *p_socket, int argc, char *argv[])
+ {
+  FILE *in;
+  FILE *out;
+  char  line[ADV_MAX_LINESIZE];
+  int   fd;
+  int   i;
+  int   ret_val = RET_ERROR;
+
+  if ((-1 == (fd = OpenSocket (p_socket, FALSE)))
+    ||(NULL == (in = fdopen (fd, "r")))
+    ||(NULL == (out = fdopen (dup (fd), "w"))))
+   {
+    printf ("Error: Can't connect to %s\n", p_socket);
+    return (RET_ERROR);
+   }
+
+  for (i = 0; i < argc; i++)
+   fprintf (out, (i + 1 < argc) ? "%s " : "%s\n", argv[i]);
+  fflush (out);
+
+  /* the answer ends with OK or ERROR */
+  while (fgets (line, sizeof (line), in))
+   {
+    fputs (line, stdout);
+    if (0 == strncmp (line, "OK", 2))
+     ret_val = RET_OK;
+    else
+    if (0 == strncmp (line, "ERROR", 5))
+     ret_val = RET_WARNING;
+    else
+     continue;
+    break;
+   }
+
+  fclose (out);
+  fclose (in);
+  return (ret_val);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ListServer
+ *
+ * Purpose:     load the listfiles and answer requests until QUIT
+ *
+ * Returns:     RET_OK or RET_ERROR
+ *-----------------------------------------------------------------------------
+ */
+
+int ListServer (void)
+ {
+  ResidentList  *list;
+  DIR           *dfd;
+#ifdef NEXT
+  struct direct *dp;
+#else
+  struct dirent *dp;
+#endif /* NEXT */
+  FILE          *in;
+  FILE          *out;
+  char           request[1024];
+  char           base[256];
+  int            server;
+  int            fd;
+  LONG           i;
+  BOOL           f_quit = FALSE;
+
+  /* load all listfiles (*.list, *.list.gz) */
+  if (NULL == (dfd = opendir (ad_cmds.p_listdir)))
+   {
+    printf ("Error: Can't open %s\n", ad_cmds.p_listdir);
+    return (RET_ERROR);
+   }
+  while ((dp = readdir (dfd)) && (nb_lists < ADV_MAX_LISTS))
+   {
+    if (IMDBV_DIFF_ORIGINAL != (BaseName (base, dp->d_name) & ~IMDBV_FILE_GZIP))
+     continue;
+    if (NULL == (list = LoadList (dp->d_name)))
+     {
+      printf ("Error: Can't load %s\n", dp->d_name);
+      continue;
+     }
+    if (!ad_cmds.f_quiet)
+     printf ("%s: %li lines\n", list->name, list->text.nb_lines);
+    lists[nb_lists++] = list;
+   }
+  closedir (dfd);
+
+  if (-1 == (server = OpenSocket (ad_cmds.p_socket, TRUE)))
+   {
+    printf ("Error: Can't create socket %s\n", ad_cmds.p_socket);
+    return (RET_ERROR);
+   }
+  signal (SIGPIPE, SIG_IGN);
+  if (!ad_cmds.f_quiet)
+   printf ("%li listfiles resident, waiting on %s\n", nb_lists, ad_cmds.p_socket);
+  fflush (stdout);
+
+  /* one client after the other, a client may send several requests */
+  while (!f_quit)
+   {
+    if (-1 == (fd = accept (server, NULL, NULL)))
+     {
+      if (EINTR == errno)
+       continue;
+      break;
+     }
+    if ((NULL == (in = fdopen (fd, "r"))) || (NULL == (out = fdopen (dup (fd), "w"))))
+     {
+      if (in)
+       fclose (in);
+      else
+       close (fd);
+      continue;
+     }
+    while ((!f_quit) && (fgets (request, sizeof (request), in)))
+     {
+      request[strcspn (request, "\r\n")] = '\0';
+      f_quit = HandleRequest (out, request);
+      fflush (out);
+      fflush (stdout);
+     }
+    fclose (out);
+    fclose (in);
+   }
+
+  close (server);
+  unlink (ad_cmds.p_socket);
+
+  /* wait for the write-back */
+  for (i = 0; i < nb_lists; i++)
+   {
+    WaitWriteList (lists[i]);
+    if (IMDBE_NO_ERROR != lists[i]->write_error)
+     printf ("Error: Can't write %s\n", lists[i]->name);
+    FreeList (lists[i]);
+   }
+  return (RET_OK);
+ }
+
+/******************************************************************************
+ *  Main - Procedure
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   main
+ *
+ * Parameters:  nb_args, filename
+ *
+ * Returns:
+ *-----------------------------------------------------------------------------
+ */
+
+int main(int argc, char *argv[])
+ {
+  int ret_val = RET_OK;
+  int i;
+
+#ifdef SYS_UNIX
+  {
+   static const char Template[] = "usage: ListServer <listpath> <socket> [-quiet]\n       ListServer -request <socket> <request>";
+
+   /* client: send one request */
+   if ((argc >= 4) && (!strcmp(argv[1], "-request")))
+    exit (SendRequest (argv[2], argc - 3, &argv[3]));
+
+   if (argc <3)
+    {
+     puts (Template);
+     exit (10);
+    }
+
+   /* list-path */
+   if (ad_cmds.p_listdir = IMDBAllocMemory (2 + strlen(argv[1])))
+    {
+     strcpy(ad_cmds.p_listdir, argv[1]);
+     if ('/' != ad_cmds.p_listdir[strlen(ad_cmds.p_listdir)-1])
+      strcat (ad_cmds.p_listdir,"/");
+    }
+   if (ad_cmds.p_socket = IMDBAllocMemory (1 + strlen(argv[2])))
+    strcpy(ad_cmds.p_socket, argv[2]);
+
+   /* Parse Command Line Parameters */
+   for (i=3; i < argc; i++)
+    {
+     if (!strcmp(argv[i], "-quiet"))
+      ad_cmds.f_quiet    = TRUE;
+     else
+      {
+       puts (Template);
+       exit (10);
+      }
+    }
+  }
+#endif
+
+  /* Check Syntax */
+  if ((NULL == ad_cmds.p_listdir) || (NULL == ad_cmds.p_socket))
+   {
+    printf("Error: List-directory and socket needed!\n");
+    exit (RET_ERROR);
+   }
+
+  if (!ad_cmds.f_quiet)
+   printf (VERSION" - part of the DiffTools; (c) 1996-2001 IMDb Ltd.\n\n");
+
+  ret_val = ListServer ();
+
+  /* Free memory */
+  if (ad_cmds.p_listdir) IMDBFreeMemory(ad_cmds.p_listdir);
+  if (ad_cmds.p_socket) IMDBFreeMemory(ad_cmds.p_socket);
+
+  exit (ret_val);
+ }
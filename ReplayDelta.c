@@ -0,0 +1,489 @@
+/*============================================================================
+ *
+ *  Program:      ReplayDelta.c
+ *
+ *  Version:      1.0 (19.10.26)
+ *
+ *  Purpose:      Rebuilds a patched listfile from the old listfile and a
+ *                delta-file (written by ApplyDiffs, option DELTA): the
+ *                ranges are copied from the old listfile, the added lines
+ *                are taken from the delta-file. Size and CRC of the result
+ *                are checked.
+ *
+ *                #define either SYS_AMIGA or SYS_UNIX (see below)
+ *
+ *                AMIGA-Commandline-Options:
+ *
+ *                   LIST/A       filename of the old listfile (with zlib
+ *                                also *.list.gz)
+ *                   DELTA/A      delta-file of this listfile
+ *                   OUTPUT/K     write the patched listfile to this file
+ *                                instead of replacing the listfile
+ *                   QUIET/S      be quiet
+ *
+ *
+ *                UNIX-Commandline-Options:
+ *
+ *                   <list>       filename of the old listfile
+ *                   <deltafile>  delta-file of this listfile
+ *                  optional:
+ *                   -output      write the patched listfile to this file
+ *                   -quiet       be quiet
+ *
+ *
+ *  Copyright:    (c) Internet MovieDatabase Limited 1990 - 2001
+ *
+ *       This file is part of the Internet MovieDatabase project.
+ *
+ *  The  MovieDatabase  FAQ contains more information on the whole project.
+ *  For   a   copy   send  an  e-mail   with  the  subject  "HELP  FAQ"  to
+ *  <mail-server@imdb.com>.
+ *
+ *  Permission  is  granted  to make and distribute verbatim copies of this
+ *  package  provided  the  copyright notice and this permission notice are
+ *  preserved  on  all  copies  and the package is distributed in unaltered
+ *  archive  form only.  It is not allowed to modify the source code and/or
+ *  redistribute  modified  copies  of  it  and/or  the executables without
+ *  written permission of the author.
+ *
+ *  If  you need to make a change to the source-code in order to be able to
+ *  use the package, you have to notify the author.
+ *
+ *  No guarantee of any kind is given that the programs and scripts in this
+ *  package  are  100%  reliable.  You are using this material at your  own
+ *  risk.   The  author  cannot be made responsible for any damage which is
+ *  caused by using these programs.
+ *
+ *  This  package  is  freely  distributable,  but still copyright by  IMDb
+ *  Ltd.
+ *
+ *  None  of  the programs or scripts nor the source code (nor parts of it)
+ *  may  be  included  or  used  in  commercial  programs unless by written
+ *  permission from the author.
+ *
+ *============================================================================
+ */
+
+/* some defines (specified by the Makefile) */
+/*#define SYS_AMIGA */
+/*#define SYS_UNIX  */
+/*#define IMDB_DEBUG*/
+
+/* ************************* */
+
+#include "IMDB.h"
+
+#ifdef SYS_AMIGA
+#include <clib/exec_protos.h>
+#include <dos/dos.h>
+#include <clib/dos_protos.h>
+#include <Exec/Memory.h>
+#endif /* SYS_AMIGA */
+
+#define VERSION "ReplayDelta 1.0 (19.10.26)"
+static const char version[] ="$VER: "VERSION;
+
+/* Return values */
+#define RET_OK              0
+#define RET_WARNING        10
+#define RET_ERROR          20
+
+/* buffer sizes */
+#define ADV_BUFFER_SIZE    512 * 1024
+#define ADV_MAX_LINESIZE     8 * 1024
+
+typedef struct
+ {
+  char *p_list;
+  char *p_delta;
+  char *p_output;
+  LONG  f_quiet;
+ } AD_Commands;
+
+AD_Commands ad_cmds = {NULL, NULL, NULL, FALSE};
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   StrHasSuffix
+ *
+ * Returns:     TRUE, if p_str ends with p_suffix
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL StrHasSuffix (char *p_str, char *p_suffix)
+ {
+  LONG len = strlen (p_str);
+  LONG len_suffix = strlen (p_suffix);
+
+  if (len <= len_suffix)
+   return (FALSE);
+#ifdef SYS_AMIGA
+  return ((BOOL) (0 == strnicmp (&p_str[len-len_suffix], p_suffix, len_suffix)));
+#else
+  return ((BOOL) (0 == strncmp (&p_str[len-len_suffix], p_suffix, len_suffix)));
+#endif
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   GzipFlag
+ *
+ * Returns:     IMDBV_FILE_GZIP for compressed files (with IMDB_ZLIB)
+ *-----------------------------------------------------------------------------
+ */
+
+LONG GzipFlag (char *p_name)
+ {
+#ifdef IMDB_ZLIB
+  if (StrHasSuffix (p_name, ".gz"))
+   return (IMDBV_FILE_GZIP);
+#endif
+  return (0);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   get_ulong, ReadVarint
+ *
+ * Purpose:     fetch the numbers of a delta-file (see IMDB.h)
+ *
+ * Returns:     ReadVarint: IMDBE_NO_ERROR or IMDBE_FILE_READ
+ *-----------------------------------------------------------------------------
+ */
+
+static ULONG get_ulong (UBYTE *p_mem)
+ {
+  return (((ULONG) p_mem[0] << 24) | ((ULONG) p_mem[1] << 16) | ((ULONG) p_mem[2] << 8) | (ULONG) p_mem[3]);
+ }
+
+LONG ReadVarint (IMDB_Buffer *delta_buffer, LONG *p_value)
+ {
+  UBYTE *p_byte;
+  ULONG  value = 0;
+  LONG   shift;
+
+  for (shift = 0; shift < 32; shift += 7)
+   {
+    if (1 != IMDBReadBuffer (delta_buffer, &p_byte, 1))
+     return (IMDBE_FILE_READ);
+    value |= ((ULONG) (*p_byte & 0x7F)) << shift;
+    if (0 == (*p_byte & 0x80))
+     {
+      if (value > 0x7FFFFFFFL)
+       return (IMDBE_FILE_READ);
+      *p_value = (LONG) value;
+      return (IMDBE_NO_ERROR);
+     }
+   }
+  return (IMDBE_FILE_READ);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   write_line
+ *
+ * Purpose:     write a line of the patched listfile and add it to the CRC
+ *
+ * Returns:     IMDBE_NO_ERROR or IMDBE_FILE_WRITE
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG write_line (IMDB_Buffer *out, char *p_line, LONG *p_size, LONG *p_lines, ULONG *p_crc)
+ {
+  *p_size += strlen (p_line) + 1;
+  if (++(*p_lines) > 1)
+   IMDBCalcCRC (p_line, p_crc);
+  if ((IMDBWriteBuffer (out, p_line, strlen (p_line))) || (IMDBWriteBuffer (out, "\n", 1)))
+   return (IMDBE_FILE_WRITE);
+  return (IMDBE_NO_ERROR);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ReplayDelta
+ *
+ * Purpose:     rebuild the patched listfile, check its size, lines and CRC
+ *              and replace the listfile (or write OUTPUT)
+ *
+ * Returns:     RET_OK, RET_WARNING or RET_ERROR
+ *-----------------------------------------------------------------------------
+ */
+
+int ReplayDelta (void)
+ {
+  IMDB_Buffer *delta_buffer;
+  IMDB_Buffer *list_buffer = NULL;
+  IMDB_Buffer *out_buffer;
+  char         outname[256];
+  char         idxname[256];
+  char         idxnew[256];
+  char        *p_line;
+  UBYTE       *p_data;
+  LONG         old_size;
+  LONG         size;
+  LONG         lines;
+  ULONG        crc;
+  LONG         old_pos   = 0;
+  LONG         out_size  = 0;
+  LONG         out_lines = 0;
+  LONG         offset;
+  LONG         copy;
+  LONG         bytes;
+  LONG         n;
+  LONG         error     = IMDBE_NO_ERROR;
+  ULONG        out_crc   = 0xFFFFFFFFL;
+  BOOL         f_fit     = TRUE;
+
+  if (NULL == (delta_buffer = IMDBOpenBuffer (ad_cmds.p_delta, IMDBV_FILE_READ|GzipFlag (ad_cmds.p_delta), ADV_BUFFER_SIZE)))
+   {
+    printf ("Error: Can't open %s\n", ad_cmds.p_delta);
+    return (RET_ERROR);
+   }
+  if ((IMDBReadBufferLine (delta_buffer, &p_line, ADV_MAX_LINESIZE))
+    ||(0 != strcmp (p_line, IMDBV_DELTA_MAGIC))
+    ||(16 != IMDBReadBuffer (delta_buffer, &p_data, 16)))
+   {
+    printf ("Error: %s is no delta-file\n", ad_cmds.p_delta);
+    IMDBCloseBuffer (delta_buffer);
+    return (RET_ERROR);
+   }
+  old_size = (LONG) get_ulong (p_data);
+  size     = (LONG) get_ulong (p_data + 4);
+  lines    = (LONG) get_ulong (p_data + 8);
+  crc      = get_ulong (p_data + 12);
+
+  /* the listfile is replaced by <list>.new, unless there is an OUTPUT */
+  if (ad_cmds.p_output)
+   strcpy (outname, ad_cmds.p_output);
+  else
+   sprintf (outname, "%.250s.new", ad_cmds.p_list);
+
+  /* a new listfile is all added lines */
+  if ((old_size) || (IMDBExistFile (ad_cmds.p_list)))
+   if (NULL == (list_buffer = IMDBOpenBuffer (ad_cmds.p_list, IMDBV_FILE_READ|GzipFlag (ad_cmds.p_list), ADV_BUFFER_SIZE)))
+    {
+     printf ("Error: Can't open %s\n", ad_cmds.p_list);
+     IMDBCloseBuffer (delta_buffer);
+     return (RET_ERROR);
+    }
+  if (NULL == (out_buffer = IMDBOpenBuffer (outname, IMDBV_FILE_WRITE|GzipFlag ((ad_cmds.p_output) ? outname : ad_cmds.p_list), ADV_BUFFER_SIZE)))
+   {
+    printf ("Error: Can't write %s\n", outname);
+    IMDBCloseBuffer (list_buffer);
+    IMDBCloseBuffer (delta_buffer);
+    return (RET_ERROR);
+   }
+
+  /* the ranges, until <0><0><0> */
+  while ((IMDBE_NO_ERROR == error) && (f_fit))
+   {
+    if ((ReadVarint (delta_buffer, &offset)) || (ReadVarint (delta_buffer, &copy))
+      ||(ReadVarint (delta_buffer, &bytes)))
+     {
+      error = IMDBE_FILE_READ;
+      break;
+     }
+    if ((0 == copy) && (0 == bytes))
+     break;
+
+    /* skip the removed lines, then copy the lines of the range */
+    if (copy)
+     {
+      if ((offset < old_pos) || (NULL == list_buffer))
+       f_fit = FALSE;
+      while ((f_fit) && (IMDBE_NO_ERROR == error) && (old_pos < offset + copy))
+       {
+        /* the old listfile ends before the range */
+        if (IMDBReadBufferLine (list_buffer, &p_line, ADV_MAX_LINESIZE))
+         {
+          f_fit = FALSE;
+          break;
+         }
+        if (old_pos >= offset)
+         error = write_line (out_buffer, p_line, &out_size, &out_lines, &out_crc);
+        else
+        if (old_pos + (LONG) strlen (p_line) + 1 > offset)
+         f_fit = FALSE;                    /* the range starts within a line */
+        old_pos += strlen (p_line) + 1;
+       }
+      if (old_pos != offset + copy)
+       f_fit = FALSE;
+     }
+
+    /* the added lines */
+    for (n = 0; (n < bytes) && (f_fit) && (IMDBE_NO_ERROR == error); )
+     {
+      if (IMDBReadBufferLine (delta_buffer, &p_line, ADV_MAX_LINESIZE))
+       error = IMDBE_FILE_READ;
+      else
+       {
+        error = write_line (out_buffer, p_line, &out_size, &out_lines, &out_crc);
+        n += strlen (p_line) + 1;
+       }
+     }
+    if ((IMDBE_NO_ERROR == error) && (n != bytes))
+     error = IMDBE_FILE_READ;
+   }
+
+  /* the rest of the old listfile must have been removed */
+  if (list_buffer)
+   {
+    while ((f_fit) && (IMDBE_NO_ERROR == error) && (IMDBE_NO_ERROR == IMDBReadBufferLine (list_buffer, &p_line, ADV_MAX_LINESIZE)))
+     old_pos += strlen (p_line) + 1;
+    IMDBCloseBuffer (list_buffer);
+   }
+  if (old_pos != old_size)
+   f_fit = FALSE;
+  IMDBCloseBuffer (delta_buffer);
+
+  if ((IMDBCloseBuffer (out_buffer)) && (IMDBE_NO_ERROR == error))
+   error = IMDBE_FILE_WRITE;
+
+  if ((IMDBE_NO_ERROR == error) && (f_fit)
+    &&((out_size != size) || (out_lines != lines) || ((out_crc & 0xFFFFFFFFL) != crc)))
+   error = IMDBE_SYNTAX;
+
+  if ((IMDBE_NO_ERROR != error) || (!f_fit))
+   {
+    if (!f_fit)
+     printf ("Error: %s doesn't fit %s\n", ad_cmds.p_delta, ad_cmds.p_list);
+    else
+    if (IMDBE_SYNTAX == error)
+     printf ("- CRC Error\n");
+    else
+    if (IMDBE_FILE_READ == error)
+     printf ("Error: Can't read %s\n", ad_cmds.p_delta);
+    else
+     printf ("Error: Can't write %s\n", outname);
+    sprintf (idxname, "%.250s" IMDBV_FILE_INDEX_EXT, outname);
+    remove (idxname);
+    remove (outname);
+    return ((f_fit) ? RET_WARNING : RET_ERROR);
+   }
+
+  /* replace the listfile and its block-index */
+  if (NULL == ad_cmds.p_output)
+   {
+    sprintf (idxnew,  "%.250s" IMDBV_FILE_INDEX_EXT, outname);
+    sprintf (idxname, "%.250s" IMDBV_FILE_INDEX_EXT, ad_cmds.p_list);
+    if ((IMDBSyncFile (outname)) || (rename (outname, ad_cmds.p_list)))
+     {
+      printf ("Error: Can't replace %s\n", ad_cmds.p_list);
+      return (RET_WARNING);
+     }
+    remove (idxname);
+    rename (idxnew, idxname);
+   }
+
+  if (!ad_cmds.f_quiet)
+   printf ("%s: %li lines, CRC-Checksum O.K.\n", (ad_cmds.p_output) ? ad_cmds.p_output : ad_cmds.p_list, out_lines);
+  return (RET_OK);
+ }
+
+/******************************************************************************
+ *  Main - Procedure
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   main
+ *
+ * Parameters:  nb_args, filename
+ *
+ * Returns:
+ *-----------------------------------------------------------------------------
+ */
+
+int main(int argc, char *argv[])
+ {
+  int ret_val = RET_OK;
+  int i;
+
+  /* Parse command line parameters */
+#ifdef SYS_AMIGA
+  {
+   static const char Template[]    = "LIST/A,DELTA/A,OUTPUT/K,QUIET/S";
+   AD_Commands       cmdlineparams = {NULL, NULL, NULL, FALSE};
+   struct RDArgs    *rda;
+
+   rda = ReadArgs((char*) Template, (LONG *) &cmdlineparams, NULL);
+
+   /* Get values */
+   if (cmdlineparams.p_list)
+    if (ad_cmds.p_list = IMDBAllocMemory (1+ strlen(cmdlineparams.p_list)))
+     strcpy(ad_cmds.p_list, cmdlineparams.p_list);
+
+   if (cmdlineparams.p_delta)
+    if (ad_cmds.p_delta = IMDBAllocMemory (1+ strlen(cmdlineparams.p_delta)))
+     strcpy(ad_cmds.p_delta, cmdlineparams.p_delta);
+
+   if (cmdlineparams.p_output)
+    if (ad_cmds.p_output = IMDBAllocMemory (1+ strlen(cmdlineparams.p_output)))
+     strcpy(ad_cmds.p_output, cmdlineparams.p_output);
+
+   ad_cmds.f_quiet    = cmdlineparams.f_quiet   ;
+
+   /* Free ReadArgs parameters */
+   if (NULL == rda)
+    {
+     printf ("Template: %s\n",Template);
+     exit (RET_ERROR);
+    }
+   else
+    FreeArgs(rda);
+  }
+#endif
+
+#ifdef SYS_UNIX
+  {
+   static const char Template[] = "usage: ReplayDelta <list> <deltafile> [-output <filename>][-quiet]";
+
+   if (argc <3)
+    {
+     puts (Template);
+     exit (10);
+    }
+
+   /* listfile and delta-file */
+   if (ad_cmds.p_list = IMDBAllocMemory (1 + strlen(argv[1])))
+    strcpy(ad_cmds.p_list, argv[1]);
+   if (ad_cmds.p_delta = IMDBAllocMemory (1 + strlen(argv[2])))
+    strcpy(ad_cmds.p_delta, argv[2]);
+
+   /* Parse Command Line Parameters */
+   for (i=3; i < argc; i++)
+    {
+     if (!strcmp(argv[i], "-quiet"))
+      ad_cmds.f_quiet    = TRUE;
+     else
+     if ((!strcmp(argv[i], "-output")) && (i+1 < argc))
+      {
+       if (ad_cmds.p_output = IMDBAllocMemory (1 + strlen(argv[++i])))
+        strcpy(ad_cmds.p_output, argv[i]);
+      }
+     else
+      {
+       puts (Template);
+       exit (10);
+      }
+    }
+  }
+#endif
+
+  /* Check Syntax */
+  if ((NULL == ad_cmds.p_list) || (NULL == ad_cmds.p_delta))
+   {
+    printf("Error: Listfile and delta-file needed!\n");
+    exit (RET_ERROR);
+   }
+
+  if (!ad_cmds.f_quiet)
+   printf (VERSION" - part of the DiffTools; (c) 1996-2001 IMDb Ltd.\n\n");
+
+  ret_val = ReplayDelta ();
+
+  /* Free memory */
+  if (ad_cmds.p_list) IMDBFreeMemory(ad_cmds.p_list);
+  if (ad_cmds.p_delta) IMDBFreeMemory(ad_cmds.p_delta);
+  if (ad_cmds.p_output) IMDBFreeMemory(ad_cmds.p_output);
+
+  if ((RET_OK != ret_val) && (!ad_cmds.f_quiet))
+   printf ("\nWARNING: ReplayDelta encountered errors.\n");
+
+  exit (ret_val);
+ }
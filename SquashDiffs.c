@@ -0,0 +1,884 @@
+/*============================================================================
+ *
+ *  Program:      SquashDiffs.c
+ *
+ *  Version:      1.0 (19.10.26)
+ *
+ *  Purpose:      Combines the diffs of several weeks into one cumulative
+ *                diff per listfile, that can be applied by ApplyDiffs on
+ *                the listfile of the oldest week. Only the diffs are needed,
+ *                the listfiles are not read.
+ *
+ *                #define either SYS_AMIGA or SYS_UNIX (see below)
+ *
+ *                AMIGA-Commandline-Options:
+ *
+ *                   OUTDIR/A     path where the combined diffs are written to
+ *                   DIFFDIR/A/M  paths of the diffiles, oldest week first
+ *                   STRIPPED/S   write stripped diffs
+ *                   CRCS/K       name of file where the CRC-lines of all
+ *                                weeks are written to
+ *                   QUIET/S      don't show progress
+ *                   HASHED/S     write hashed diffs (*.hdiff): stripped
+ *                                diffs with a hash of every deleted line
+ *
+ *
+ *                UNIX-Commandline-Options:
+ *
+ *                   <outpath>    path where the combined diffs are written to
+ *                   <diffpath>   paths of the diffiles, oldest week first
+ *                  optional:
+ *                   -stripped    write stripped diffs
+ *                   -crcs        name of file for the CRC-lines of all weeks
+ *                   -quiet       don't show progress
+ *                   -hashed      write hashed diffs (*.hdiff)
+ *
+ *
+ *  Copyright:    (c) Internet MovieDatabase Limited 1990 - 2001
+ *
+ *       This file is part of the Internet MovieDatabase project.
+ *
+ *  The  MovieDatabase  FAQ contains more information on the whole project.
+ *  For   a   copy   send  an  e-mail   with  the  subject  "HELP  FAQ"  to
+ *  <mail-server@imdb.com>.
+ *
+ *  Permission  is  granted  to make and distribute verbatim copies of this
+ *  package  provided  the  copyright notice and this permission notice are
+ *  preserved  on  all  copies  and the package is distributed in unaltered
+ *  archive  form only.  It is not allowed to modify the source code and/or
+ *  redistribute  modified  copies  of  it  and/or  the executables without
+ *  written permission of the author.
+ *
+ *  If  you need to make a change to the source-code in order to be able to
+ *  use the package, you have to notify the author.
+ *
+ *  No guarantee of any kind is given that the programs and scripts in this
+ *  package  are  100%  reliable.  You are using this material at your  own
+ *  risk.   The  author  cannot be made responsible for any damage which is
+ *  caused by using these programs.
+ *
+ *  This  package  is  freely  distributable,  but still copyright by  IMDb
+ *  Ltd.
+ *
+ *  None  of  the programs or scripts nor the source code (nor parts of it)
+ *  may  be  included  or  used  in  commercial  programs unless by written
+ *  permission from the author.
+ *
+ *============================================================================
+ */
+
+/* some defines (specified by the Makefile) */
+/*#define SYS_AMIGA */
+/*#define SYS_UNIX  */
+/*#define IMDB_DEBUG*/
+
+/* ************************* */
+
+#include "IMDB.h"
+
+#ifdef SYS_AMIGA
+#include <clib/exec_protos.h>
+#include <dos/dos.h>
+#include <clib/dos_protos.h>
+#include <Exec/Memory.h>
+#endif /* SYS_AMIGA */
+
+#ifdef SYS_UNIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#ifdef NEXT
+#include <sys/dir.h>
+#else
+#include "dirent.h"
+#endif /* NEXT */
+
+#endif /* SYS_UNIX*/
+
+#define VERSION "SquashDiffs 1.0 (19.10.26)"
+static const char version[] ="$VER: "VERSION;
+
+/* Return values */
+#define RET_OK              0
+#define RET_WARNING        10
+#define RET_ERROR          20
+
+/* buffer sizes */
+#define ADV_BUFFER_SIZE    512 * 1024
+#define ADV_MAX_LINESIZE     8 * 1024
+
+/* max. number of diff-directories (weeks) */
+#define ADV_MAX_WEEKS       52
+
+/* Information on a diff */
+#define STATUS_OK       0  /* No error */
+#define STATUS_IO       2  /* IO-Error */
+#define STATUS_VER      3  /* diffs of the weeks don't fit together */
+#define STATUS_SYN      4  /* Syntax-Error in Diff-File */
+#define STATUS_NEW      5  /* New file */
+#define STATUS_NOTEXT   7  /* deleted lines are unknown (stripped diffs) */
+
+/* types */
+#define DIFF_TYPE_UNKNOWN     0
+#define DIFF_TYPE_ORIGINAL    IMDBV_DIFF_ORIGINAL
+#define DIFF_TYPE_STRIPPED    IMDBV_DIFF_STRIPPED
+#define DIFF_TYPE_HASHED      4     /* as in ApplyDiffs, only written */
+
+typedef struct DIFFINFO
+ {
+  struct DIFFINFO *next;
+  char  fname_list[256];           /* filename */
+  char  fname_diff[256];           /* filename */
+  LONG  type;
+  LONG  status;
+  LONG  add;
+  LONG  delete;
+  LONG  week;                      /* index of diff-directory */
+  struct DIFFINFO *next_week;      /* diffs of the same listfile for the following week */
+ } DiffInfo;
+
+typedef struct
+ {
+  char *p_outdir;
+  char *p_diffdir;
+  LONG  f_stripped;
+  char *p_crcfile;
+  LONG  f_quiet;
+  LONG  f_hashed;
+  /* not part of the AMIGA-template */
+  LONG  nb_diffdirs;
+  char *p_diffdirs[ADV_MAX_WEEKS];
+ } AD_Commands;
+
+AD_Commands ad_cmds = {NULL, NULL, FALSE, NULL, FALSE, FALSE, 0};
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   sprint_range
+ *
+ * Purpose:     Print a range of lines in diff-notation ("8" or "8,10")
+ *-----------------------------------------------------------------------------
+ */
+
+static char *sprint_range (char *p_str, LONG from, LONG to)
+ {
+  if (to > from)
+   sprintf (p_str, "%li,%li", from, to);
+  else
+   sprintf (p_str, "%li", from);
+  return (p_str);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   write_line
+ *
+ * Purpose:     Write a line with an optional prefix ("< ", "> ")
+ *-----------------------------------------------------------------------------
+ */
+
+static LONG write_line (IMDB_Buffer *buffer, char *p_prefix, char *p_line)
+ {
+  LONG ret = IMDBE_NO_ERROR;
+
+  if (p_prefix)
+   ret = IMDBWriteBuffer (buffer, p_prefix, strlen (p_prefix));
+  if ((IMDBE_NO_ERROR == ret) && (*p_line))
+   ret = IMDBWriteBuffer (buffer, p_line, strlen (p_line));
+  if (IMDBE_NO_ERROR == ret)
+   ret = IMDBWriteBuffer (buffer, "\n", 1);
+  return (ret);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   WriteDiff
+ *
+ * Purpose:     Write a diff as original, stripped or hashed diff-file
+ *
+ * Parameters:  diff        the combined diff
+ *              diffile     filename
+ *              type        DIFF_TYPE_ORIGINAL, DIFF_TYPE_STRIPPED or
+ *                          DIFF_TYPE_HASHED
+ *              diffinfo    number of added/deleted lines are stored here
+ *
+ * Returns:     STATUS_OK, STATUS_IO or STATUS_NOTEXT
+ *-----------------------------------------------------------------------------
+ */
+
+int WriteDiff (IMDB_Diff *diff, char *diffile, LONG type, DiffInfo *diffinfo)
+ {
+  IMDB_Buffer *out_buffer;
+  LONG         i_line = 0;         /* lines of the old listfile passed */
+  LONG         o_line = 0;         /* lines of the new listfile passed */
+  LONG         first;
+  LONG         last;
+  LONG         nb_delete;
+  LONG         nb_insert;
+  LONG         i;
+  LONG         ret = IMDBE_NO_ERROR;
+  char         range_i[40];
+  char         range_o[40];
+  char         patch[100];
+  ULONG        a_hash[2];
+
+  diffinfo->add    = 0;
+  diffinfo->delete = 0;
+
+  /* original and hashed diffs need the text of every deleted line */
+  if (DIFF_TYPE_STRIPPED != type)
+   {
+    for (i = 0; i < diff->nb_ops; i++)
+     if ((IMDBV_OP_DELETE == diff->ops[i].cmd) && (NULL == diff->ops[i].text))
+      return (STATUS_NOTEXT);
+   }
+  if ((DIFF_TYPE_ORIGINAL != type) && (FALSE == diff->f_new) && (NULL == diff->header))
+   return (STATUS_NOTEXT);
+
+  if (NULL == (out_buffer = IMDBOpenBuffer (diffile, IMDBV_FILE_WRITE, ADV_BUFFER_SIZE)))
+   return (STATUS_IO);
+
+  if (DIFF_TYPE_ORIGINAL != type)
+   ret = write_line (out_buffer, "Apply on: ", (diff->f_new) ? "---" : diff->header);
+
+  first = 0;
+  while ((first < diff->nb_ops) && (IMDBE_NO_ERROR == ret))
+   {
+    if (IMDBV_OP_COPY == diff->ops[first].cmd)
+     {
+      i_line += diff->ops[first].count;
+      o_line += diff->ops[first].count;
+      first++;
+      continue;
+     }
+    if (IMDBV_OP_REST == diff->ops[first].cmd)
+     break;
+
+    /* collect all changes up to the next unchanged line */
+    nb_delete = nb_insert = 0;
+    for (last = first; (last < diff->nb_ops) && ((IMDBV_OP_DELETE == diff->ops[last].cmd) || (IMDBV_OP_INSERT == diff->ops[last].cmd)); last++)
+     if (IMDBV_OP_DELETE == diff->ops[last].cmd)
+      nb_delete++;
+     else
+      nb_insert++;
+
+    if ((nb_delete) && (nb_insert))
+     sprintf (patch, "%sc%s", sprint_range (range_i, i_line + 1, i_line + nb_delete), sprint_range (range_o, o_line + 1, o_line + nb_insert));
+    else
+    if (nb_delete)
+     sprintf (patch, "%sd%li", sprint_range (range_i, i_line + 1, i_line + nb_delete), o_line);
+    else
+     sprintf (patch, "%lia%s", i_line, sprint_range (range_o, o_line + 1, o_line + nb_insert));
+    ret = write_line (out_buffer, NULL, patch);
+
+    if (DIFF_TYPE_ORIGINAL == type)
+     {
+      for (i = first; (i < last) && (IMDBE_NO_ERROR == ret); i++)
+       if (IMDBV_OP_DELETE == diff->ops[i].cmd)
+        ret = write_line (out_buffer, "< ", diff->ops[i].text);
+      if ((nb_delete) && (nb_insert) && (IMDBE_NO_ERROR == ret))
+       ret = write_line (out_buffer, NULL, "---");
+     }
+    else
+    if (DIFF_TYPE_HASHED == type)
+     {/* "<length>:<hash>" for every deleted line */
+      for (i = first; (i < last) && (IMDBE_NO_ERROR == ret); i++)
+       if (IMDBV_OP_DELETE == diff->ops[i].cmd)
+        {
+         IMDBHashLine (diff->ops[i].text, strlen (diff->ops[i].text), a_hash);
+         sprintf (patch, "%lX:%08lX%08lX", (LONG) strlen (diff->ops[i].text), a_hash[0], a_hash[1]);
+         ret = write_line (out_buffer, NULL, patch);
+        }
+     }
+    for (i = first; (i < last) && (IMDBE_NO_ERROR == ret); i++)
+     if (IMDBV_OP_INSERT == diff->ops[i].cmd)
+      ret = write_line (out_buffer, (DIFF_TYPE_ORIGINAL == type) ? "> " : NULL, diff->ops[i].text);
+
+    i_line += nb_delete;
+    o_line += nb_insert;
+    diffinfo->delete += nb_delete;
+    diffinfo->add    += nb_insert;
+    first = last;
+   }
+
+  if (IMDBE_NO_ERROR != IMDBCloseBuffer (out_buffer))
+   ret = IMDBE_FILE_WRITE;
+
+  if (IMDBE_NO_ERROR != ret)
+   {
+    remove (diffile);
+    return (STATUS_IO);
+   }
+  return (STATUS_OK);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   squashfile
+ *
+ * Purpose:     Combine the diffs of all weeks for a listfile
+ *
+ * Parameters:  diffinfo    DiffInfo of the oldest week
+ *              p_crcfile   CRC-lines of all weeks are written here (or NULL)
+ *              flag_verbose
+ *
+ * Returns:     RET_OK, RET_WARNING or RET_ERROR
+ *-----------------------------------------------------------------------------
+ */
+
+int squashfile (DiffInfo *diffinfo, FILE *p_crcfile, BOOL flag_verbose)
+ {
+  IMDB_Diff *diffs[ADV_MAX_WEEKS];
+  IMDB_Diff *result = NULL;
+  IMDB_Diff *t_diff;
+  DiffInfo *t_diffinfo;
+  LONG      nb_diffs = 0;
+  LONG      status = STATUS_OK;
+  LONG      error;
+  LONG      type;
+  LONG      i;
+  char      diffname[256];
+  char      outname[256];
+
+  /* load diffs of all weeks */
+  for (t_diffinfo = diffinfo; (t_diffinfo) && (STATUS_OK == status); t_diffinfo = t_diffinfo->next_week)
+   {
+    strcpy (diffname, ad_cmds.p_diffdirs[t_diffinfo->week]);
+    strncat(diffname, t_diffinfo->fname_diff, 255-strlen(diffname));
+    if (flag_verbose)
+     printf ("Loading %s\n", diffname);
+    if (NULL == (diffs[nb_diffs] = IMDBLoadDiff (diffname, t_diffinfo->type, &error)))
+     {
+      status = (IMDBE_SYNTAX == error) ? STATUS_SYN : STATUS_IO;
+      printf ("Can't load %s\n", diffname);
+      break;
+     }
+
+    /* a new listfile can only be introduced by the oldest diff */
+    if ((nb_diffs > 0) && (diffs[nb_diffs]->f_new))
+     {
+      printf ("%s introduces %s again\n", diffname, t_diffinfo->fname_list);
+      status = STATUS_VER;
+     }
+
+    if ((p_crcfile) && (diffs[nb_diffs]->crc_line))
+     fprintf (p_crcfile, "%s %s\n", ad_cmds.p_diffdirs[t_diffinfo->week], diffs[nb_diffs]->crc_line);
+    nb_diffs++;
+   }
+
+  /* combine them */
+  if (STATUS_OK == status)
+   {
+    result = diffs[0];
+    for (i = 1; (i < nb_diffs) && (result); i++)
+     {
+      t_diff = IMDBComposeDiffs (result, diffs[i]);
+      if (result != diffs[0])
+       IMDBFreeDiff (result);
+      result = t_diff;
+     }
+    if (NULL == result)
+     {
+      printf ("Can't combine diffs of %s - not enough memory\n", diffinfo->fname_list);
+      status = STATUS_IO;
+     }
+   }
+
+  /* write the combined diff */
+  if (STATUS_OK == status)
+   {
+    type = (ad_cmds.f_hashed) ? DIFF_TYPE_HASHED : ((ad_cmds.f_stripped) ? DIFF_TYPE_STRIPPED : DIFF_TYPE_ORIGINAL);
+    strcpy (outname, ad_cmds.p_outdir);
+    strncat(outname, diffinfo->fname_list, 255-strlen(outname));
+    if (DIFF_TYPE_STRIPPED == type)
+     strcpy (&outname[strlen(outname)-4], "diff");
+    if (DIFF_TYPE_HASHED == type)
+     strcpy (&outname[strlen(outname)-4], "hdiff");
+    if (flag_verbose)
+     printf ("Writing %s (%li weeks)\n", outname, nb_diffs);
+
+    if (STATUS_NOTEXT == (status = WriteDiff (result, outname, type, diffinfo)))
+     {
+      if (DIFF_TYPE_STRIPPED != type)
+       printf ("%s: deleted lines are unknown (stripped diffs) - use option STRIPPED\n", diffinfo->fname_list);
+      else
+       printf ("%s: first line of the old listfile is unknown\n", diffinfo->fname_list);
+     }
+    else
+    if (STATUS_IO == status)
+     printf ("Can't write %s\n", outname);
+    else
+    if (result->f_new)
+     status = STATUS_NEW;
+   }
+
+  diffinfo->status = status;
+
+  if ((result) && (result != diffs[0]))
+   IMDBFreeDiff (result);
+  for (i = 0; i < nb_diffs; i++)
+   IMDBFreeDiff (diffs[i]);
+
+  return (((STATUS_OK == status) || (STATUS_NEW == status)) ? RET_OK : RET_WARNING);
+ }
+
+/******************************************************************************
+ *
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   AddDiffInfo
+ *
+ * Purpose:     Create and initialize DiffInfo for a diff-file. If diffs for
+ *              the same listfile have been found in the diff-directory of a
+ *              previous week, the new DiffInfo is appended to their chain.
+ *
+ * Parameters:  pp_diffinfo  pointer to the first DiffInfo
+ *              p_fname      filename of the diff-file
+ *              week         index of the diff-directory
+ *
+ * Returns:     RET_OK or RET_ERROR
+ *-----------------------------------------------------------------------------
+ */
+
+int AddDiffInfo (DiffInfo **pp_diffinfo, char *p_fname, LONG week)
+ {
+  DiffInfo *a_diffinfo;
+  DiffInfo *t_diffinfo;
+  LONG      len;
+
+  /* Create and initialize DiffInfo */
+  if (NULL == (a_diffinfo = IMDBAllocMemory (sizeof (DiffInfo))))
+   {
+    printf("Can't allocate memory for DiffInfo\n");
+    return (RET_ERROR);
+   }
+
+  a_diffinfo->next = NULL;
+  strcpy (a_diffinfo->fname_list, p_fname);
+  strcpy (a_diffinfo->fname_diff, p_fname);
+  len = strlen(a_diffinfo->fname_list);
+#ifdef SYS_AMIGA
+  if (0 == strnicmp(&a_diffinfo->fname_list[len-5], ".list", 5))
+#else
+  if (0 == strncmp(&a_diffinfo->fname_list[len-5], ".list", 5))
+#endif
+   a_diffinfo->type = DIFF_TYPE_ORIGINAL;
+  else
+   {
+    a_diffinfo->type = DIFF_TYPE_STRIPPED;
+    a_diffinfo->fname_list[len-4] = '\0';
+    strcat(a_diffinfo->fname_list, "list");
+   }
+  a_diffinfo->status = STATUS_OK;
+  a_diffinfo->add = 0;
+  a_diffinfo->delete = 0;
+  a_diffinfo->week = week;
+  a_diffinfo->next_week = NULL;
+
+  /* diffs of a previous week for this listfile? */
+  for (t_diffinfo = *pp_diffinfo; t_diffinfo; t_diffinfo = t_diffinfo->next)
+   if (0 == strcmp(t_diffinfo->fname_list, a_diffinfo->fname_list))
+    {
+     while (t_diffinfo->next_week)
+      t_diffinfo = t_diffinfo->next_week;
+     if (t_diffinfo->week < week)
+      {
+       t_diffinfo->next_week = a_diffinfo;
+       return (RET_OK);
+      }
+     break;
+    }
+
+  /* append to list */
+  if (t_diffinfo = *pp_diffinfo)
+   {
+    while (t_diffinfo->next)
+     t_diffinfo = t_diffinfo->next;
+    t_diffinfo->next = a_diffinfo;
+   }
+  else
+   *pp_diffinfo = a_diffinfo;
+
+  return (RET_OK);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   FreeDiffInfo
+ *
+ * Purpose:     Free DiffInfo together with the diffs of the following weeks
+ *-----------------------------------------------------------------------------
+ */
+
+void FreeDiffInfo (DiffInfo *diffinfo)
+ {
+  DiffInfo *t_diffinfo;
+
+  while (diffinfo)
+   {
+    t_diffinfo = diffinfo->next_week;
+    IMDBFreeMemory (diffinfo);
+    diffinfo = t_diffinfo;
+   }
+ }
+
+/******************************************************************************
+ *  Main - Procedure
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   main
+ *
+ * Parameters:  nb_args, filename
+ *
+ * Returns:
+ *
+ * Comments:
+ *-----------------------------------------------------------------------------
+ */
+
+int main(int argc, char *argv[])
+ {
+  DiffInfo    *diffinfo = NULL;
+  DiffInfo    *t_diffinfo = NULL;
+  DiffInfo    *a_diffinfo = NULL;
+  FILE        *p_crcfile = NULL;
+
+  int  ret_val        = RET_OK;
+  int  ret            = RET_OK;
+
+  printf (VERSION" - part of the DiffTools; (c) 1996-2001 IMDb Ltd.\n");
+
+  /* Parse command line parameters */
+#ifdef SYS_AMIGA
+  {
+   static const char Template[]    = "OUTDIR/A,DIFFDIR/A/M,STRIPPED/S,CRCS/K,QUIET/S,HASHED/S";
+   AD_Commands       cmdlineparams = {NULL, NULL, FALSE, NULL, FALSE, FALSE, 0};
+   char            **pp_diffdir;
+   struct RDArgs    *rda;
+   LONG              len;
+   char              c;
+
+   rda = ReadArgs((char*) Template, (LONG *) &cmdlineparams, NULL);
+
+   /* Get values */
+   if (cmdlineparams.p_outdir)
+    if (ad_cmds.p_outdir = IMDBAllocMemory (2+(len = strlen(cmdlineparams.p_outdir))))
+     {
+      strcpy(ad_cmds.p_outdir, cmdlineparams.p_outdir);
+      c = ad_cmds.p_outdir[len-1];
+      if ((c != ':') && (c != '/'))
+       strcat (ad_cmds.p_outdir,"/");
+     }
+
+   /* DIFFDIR/M delivers an array of strings */
+   if (pp_diffdir = (char **) cmdlineparams.p_diffdir)
+    for (; (*pp_diffdir) && (ad_cmds.nb_diffdirs < ADV_MAX_WEEKS); pp_diffdir++)
+     if (ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs] = IMDBAllocMemory (2+(len = strlen(*pp_diffdir))))
+      {
+       strcpy(ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs], *pp_diffdir);
+       c = ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs][len-1];
+       if ((c != ':') && (c != '/'))
+        strcat (ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs],"/");
+       ad_cmds.nb_diffdirs++;
+      }
+   ad_cmds.p_diffdir = ad_cmds.p_diffdirs[0];
+
+   ad_cmds.f_stripped = cmdlineparams.f_stripped;
+   ad_cmds.f_quiet    = cmdlineparams.f_quiet   ;
+   ad_cmds.f_hashed   = cmdlineparams.f_hashed  ;
+
+   if (cmdlineparams.p_crcfile)
+    if (ad_cmds.p_crcfile = IMDBAllocMemory (1+ strlen(cmdlineparams.p_crcfile)))
+     strcpy(ad_cmds.p_crcfile, cmdlineparams.p_crcfile);
+
+   /* Free ReadArgs parameters */
+   if (NULL == rda)
+    {
+     printf ("Template: %s\n",Template);
+     exit (RET_ERROR);
+    }
+   else
+    FreeArgs(rda);
+  }
+#endif
+
+#ifdef SYS_UNIX
+  {
+   static const char Template[] = "usage: SquashDiffs <outpath> <diffpath> [<diffpath> ...] [-stripped][-crcs <filename>][-quiet][-hashed]";
+   LONG              i;
+
+   if (argc <3)
+    {
+     puts (Template);
+     exit (10);
+    }
+
+   /* out-path */
+   if (ad_cmds.p_outdir = IMDBAllocMemory (2 + strlen(argv[1])))
+    {
+     strcpy(ad_cmds.p_outdir, argv[1]);
+     if ('/' != ad_cmds.p_outdir[strlen(ad_cmds.p_outdir)-1])
+      strcat (ad_cmds.p_outdir,"/");
+    }
+
+   /* Parse Command Line Parameters */
+   for (i=2; i < argc; i++)
+    {
+     if ('-' != argv[i][0])
+      {/* diff-path, one for each week */
+       if (ad_cmds.nb_diffdirs >= ADV_MAX_WEEKS)
+        {
+         printf ("Error: Too many diff-directories (max. %i)!\n", ADV_MAX_WEEKS);
+         exit (RET_ERROR);
+        }
+       if (ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs] = IMDBAllocMemory (2 + strlen(argv[i])))
+        {
+         strcpy(ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs], argv[i]);
+         if ('/' != argv[i][strlen(argv[i])-1])
+          strcat (ad_cmds.p_diffdirs[ad_cmds.nb_diffdirs],"/");
+         ad_cmds.nb_diffdirs++;
+        }
+      }
+     else
+     if (!strcmp(argv[i], "-stripped"))
+      ad_cmds.f_stripped = TRUE;
+     else
+     if (!strcmp(argv[i], "-quiet"))
+      ad_cmds.f_quiet    = TRUE;
+     else
+     if (!strcmp(argv[i], "-hashed"))
+      ad_cmds.f_hashed   = TRUE;
+     else
+     if ((!strcmp(argv[i], "-crcs")) && (i+1 < argc))
+      {
+       if (ad_cmds.p_crcfile = IMDBAllocMemory (2 + strlen(argv[++i])))
+        strcpy(ad_cmds.p_crcfile, argv[i]);
+      }
+     else
+      {
+       puts (Template);
+       exit (10);
+      }
+    }
+   ad_cmds.p_diffdir = ad_cmds.p_diffdirs[0];
+
+   if ((NULL == ad_cmds.p_outdir) || (NULL == ad_cmds.p_diffdir))
+    {
+     puts (Template);
+     exit (10);
+    }
+  }
+#endif
+
+  /* Check Syntax */
+  {
+   LONG week;
+
+   for (week = 0; week < ad_cmds.nb_diffdirs; week++)
+    if (0 == strcmp(ad_cmds.p_outdir, ad_cmds.p_diffdirs[week]))
+     {
+      printf("Error: Output- and Diffs-Directory must be different!\n");
+      exit (RET_ERROR);
+     }
+  }
+
+  /* get all filenames in the diff-files-directories */
+#ifdef SYS_AMIGA
+  {
+   BPTR                  lock;
+   struct FileInfoBlock *fib;
+   LONG                  week;
+
+   if (fib = (struct FileInfoBlock *)AllocMem(sizeof(struct FileInfoBlock), MEMF_PUBLIC))
+    {
+     for (week = 0; (week < ad_cmds.nb_diffdirs) && (ret_val != RET_ERROR); week++)
+      {
+       if (lock = Lock(ad_cmds.p_diffdirs[week],SHARED_LOCK))
+        {
+         if ((Examine(lock,fib))&&(fib->fib_DirEntryType > 0))
+          {
+           while ((ExNext(lock,fib)) && (ret_val != RET_ERROR))
+            {
+             if ((fib->fib_DirEntryType <= 0) && (strlen(fib->fib_FileName) > 5)
+              && ((0 == strnicmp(&fib->fib_FileName[strlen(fib->fib_FileName)-5], ".list", 5))
+                ||(0 == strnicmp(&fib->fib_FileName[strlen(fib->fib_FileName)-5], ".diff", 5))))
+              {
+               if (ret = AddDiffInfo (&diffinfo, fib->fib_FileName, week))
+                ret_val = ret;
+              }
+            }
+          }
+         else
+          {
+           printf("%s is no directory!\n", ad_cmds.p_diffdirs[week]);
+           ret_val = RET_ERROR;
+          }
+         UnLock(lock);
+        }
+       else
+        {
+         printf("Can't get shared lock on %s\n", ad_cmds.p_diffdirs[week]);
+         ret_val = RET_ERROR;
+        }
+      }
+     FreeMem(fib,sizeof(struct FileInfoBlock));
+    }
+   else
+    {
+     printf("Can't allocate memory for FileInfoBlock\n");
+     ret_val = RET_ERROR;
+    }
+  }
+#endif
+
+#ifdef SYS_UNIX
+  {
+   struct stat stbuf;
+   LONG        week;
+
+   for (week = 0; (week < ad_cmds.nb_diffdirs) && (ret_val != RET_ERROR); week++)
+    {
+     if (-1 == stat(ad_cmds.p_diffdirs[week], &stbuf))
+      {
+       printf("Can't access %s\n", ad_cmds.p_diffdirs[week]);
+       ret_val = RET_ERROR;
+      }
+     else
+     if (S_IFDIR != (stbuf.st_mode & S_IFMT))
+      {
+       printf("%s is no directory.\n", ad_cmds.p_diffdirs[week]);
+       ret_val = RET_ERROR;
+      }
+     else
+      {
+#ifdef NEXT
+       struct direct *dp;
+#else
+       struct dirent *dp;
+#endif /* NEXT */
+       DIR *dfd;
+
+       if (NULL == (dfd = opendir(ad_cmds.p_diffdirs[week])))
+        {
+         printf("Can't open %s\n", ad_cmds.p_diffdirs[week]);
+         ret_val = RET_ERROR;
+        }
+       else
+        {
+         while (dp = readdir(dfd))
+          {
+           if ((strlen (dp->d_name) <=8 ) || ((0 != strncmp(&dp->d_name[strlen(dp->d_name)-5], ".list", 5))
+                                            &&(0 != strncmp(&dp->d_name[strlen(dp->d_name)-5], ".diff", 5))))
+            continue;
+
+           if (ret = AddDiffInfo (&diffinfo, dp->d_name, week))
+            ret_val = ret;
+          }
+         closedir(dfd);
+        }
+      }
+    }
+  }
+#endif
+
+  /* Sort the list */
+  {
+   char      t_fname[256];
+   LONG      t_type;
+   DiffInfo *t_next_week;
+
+   t_diffinfo = diffinfo;
+   while (t_diffinfo)
+    {
+     a_diffinfo = t_diffinfo->next;
+     while (a_diffinfo)
+      {
+       if (strcmp(t_diffinfo->fname_list, a_diffinfo->fname_list) > 0)
+        {
+         strcpy(t_fname               , t_diffinfo->fname_list);
+         strcpy(t_diffinfo->fname_list, a_diffinfo->fname_list);
+         strcpy(a_diffinfo->fname_list, t_fname);
+         strcpy(t_fname               , t_diffinfo->fname_diff);
+         strcpy(t_diffinfo->fname_diff, a_diffinfo->fname_diff);
+         strcpy(a_diffinfo->fname_diff, t_fname);
+         t_type           = t_diffinfo->type;
+         t_diffinfo->type = a_diffinfo->type;
+         a_diffinfo->type = t_type;
+         t_type           = t_diffinfo->week;
+         t_diffinfo->week = a_diffinfo->week;
+         a_diffinfo->week = t_type;
+         t_next_week           = t_diffinfo->next_week;
+         t_diffinfo->next_week = a_diffinfo->next_week;
+         a_diffinfo->next_week = t_next_week;
+        }
+       a_diffinfo = a_diffinfo->next;
+      }
+     t_diffinfo = t_diffinfo->next;
+    }
+  }
+
+  if (ad_cmds.p_crcfile)
+   if (NULL == (p_crcfile = fopen(ad_cmds.p_crcfile, "wb")))
+    {
+     printf ("Can't open %s\n", ad_cmds.p_crcfile);
+     ret_val = RET_ERROR;
+    }
+
+  /* combine the diffs of every listfile */
+  for (t_diffinfo = diffinfo; (t_diffinfo) && (RET_ERROR != ret_val); t_diffinfo = t_diffinfo->next)
+   if (RET_OK != (ret = squashfile (t_diffinfo, p_crcfile, !ad_cmds.f_quiet)))
+    ret_val = ret;
+
+  if (p_crcfile)
+   fclose (p_crcfile);
+
+  /* Print statistic */
+  printf ("\n            Lines    Lines\n");
+  printf ("Status      Removed  Added Listfile\n");
+  printf ("------------------------------------------------------------\n");
+  while (diffinfo)
+   {
+    switch (diffinfo->status)
+     {
+      case STATUS_OK:
+       printf ("OK          ");
+       break;
+      case STATUS_IO:
+       printf ("IO-Error    ");
+       break;
+      case STATUS_VER:
+       printf ("Wrong Diffs ");
+       break;
+      case STATUS_SYN:
+       printf ("Syntax Error");
+       break;
+      case STATUS_NEW:
+       printf ("New File    ");
+       break;
+      case STATUS_NOTEXT:
+       printf ("Incomplete  ");
+       break;
+      default:
+       printf ("%li", diffinfo->status);
+       break;
+     }
+    printf (" %6li %6li %s\n", diffinfo->delete, diffinfo->add, diffinfo->fname_list);
+    t_diffinfo = diffinfo->next;
+    FreeDiffInfo (diffinfo);
+    diffinfo = t_diffinfo;
+   }
+
+  /* Free memory */
+  {
+   LONG week;
+
+   for (week = 0; week < ad_cmds.nb_diffdirs; week++)
+    IMDBFreeMemory(ad_cmds.p_diffdirs[week]);
+  }
+  if (ad_cmds.p_outdir)
+   IMDBFreeMemory(ad_cmds.p_outdir);
+  if (ad_cmds.p_crcfile)
+   IMDBFreeMemory(ad_cmds.p_crcfile);
+
+  return (ret_val);
+ }
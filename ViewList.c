@@ -0,0 +1,566 @@
+/*============================================================================
+ *
+ *  Program:      ViewList.c
+ *
+ *  Version:      1.0 (19.10.26)
+ *
+ *  Purpose:      Shows lines of the listfile that results from applying
+ *                the diffs of one or more weeks, without writing it. The
+ *                patched listfile can be checked (CRC) and written while
+ *                the lines are shown.
+ *
+ *                #define either SYS_AMIGA or SYS_UNIX (see below)
+ *
+ *                AMIGA-Commandline-Options:
+ *
+ *                   LIST/A       filename of the old listfile (also
+ *                                chunked or, with zlib, *.list.gz)
+ *                   DIFF/A/M     diff-files of this listfile (original
+ *                                *.list or stripped *.diff), oldest first
+ *                   LINES/K      lines to show: <from> or <from>-<to>
+ *                   CRC/S        check the CRC of the patched listfile
+ *                   OUTPUT/K     write the patched listfile to this file
+ *                   QUIET/S      only show the lines
+ *
+ *
+ *                UNIX-Commandline-Options:
+ *
+ *                   <list>       filename of the old listfile
+ *                   <diffile>    diff-files, oldest first
+ *                  optional:
+ *                   -lines       lines to show: <from> or <from>-<to>
+ *                   -crc         check the CRC of the patched listfile
+ *                   -output      write the patched listfile to this file
+ *                   -quiet       only show the lines
+ *
+ *
+ *  Copyright:    (c) Internet MovieDatabase Limited 1990 - 2001
+ *
+ *       This file is part of the Internet MovieDatabase project.
+ *
+ *  The  MovieDatabase  FAQ contains more information on the whole project.
+ *  For   a   copy   send  an  e-mail   with  the  subject  "HELP  FAQ"  to
+ *  <mail-server@imdb.com>.
+ *
+ *  Permission  is  granted  to make and distribute verbatim copies of this
+ *  package  provided  the  copyright notice and this permission notice are
+ *  preserved  on  all  copies  and the package is distributed in unaltered
+ *  archive  form only.  It is not allowed to modify the source code and/or
+ *  redistribute  modified  copies  of  it  and/or  the executables without
+ *  written permission of the author.
+ *
+ *  If  you need to make a change to the source-code in order to be able to
+ *  use the package, you have to notify the author.
+ *
+ *  No guarantee of any kind is given that the programs and scripts in this
+ *  package  are  100%  reliable.  You are using this material at your  own
+ *  risk.   The  author  cannot be made responsible for any damage which is
+ *  caused by using these programs.
+ *
+ *  This  package  is  freely  distributable,  but still copyright by  IMDb
+ *  Ltd.
+ *
+ *  None  of  the programs or scripts nor the source code (nor parts of it)
+ *  may  be  included  or  used  in  commercial  programs unless by written
+ *  permission from the author.
+ *
+ *============================================================================
+ */
+
+/* some defines (specified by the Makefile) */
+/*#define SYS_AMIGA */
+/*#define SYS_UNIX  */
+/*#define IMDB_DEBUG*/
+
+/* ************************* */
+
+#include "IMDB.h"
+
+#ifdef SYS_AMIGA
+#include <clib/exec_protos.h>
+#include <dos/dos.h>
+#include <clib/dos_protos.h>
+#include <Exec/Memory.h>
+#endif /* SYS_AMIGA */
+
+#define VERSION "ViewList 1.0 (19.10.26)"
+static const char version[] ="$VER: "VERSION;
+
+/* Return values */
+#define RET_OK              0
+#define RET_WARNING        10
+#define RET_ERROR          20
+
+/* max. number of diff-files (weeks) */
+#define ADV_MAX_WEEKS       52
+
+typedef struct
+ {
+  char *p_list;
+  char *p_diffile;
+  char *p_lines;
+  LONG  f_crc;
+  char *p_output;
+  LONG  f_quiet;
+  /* not part of the AMIGA-template */
+  LONG  nb_diffiles;
+  char *p_diffiles[ADV_MAX_WEEKS];
+  LONG  from;                      /* LINES: first line to show */
+  LONG  to;                        /* LINES: last line to show */
+ } AD_Commands;
+
+AD_Commands ad_cmds = {NULL, NULL, NULL, FALSE, NULL, FALSE, 0};
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   StrHasSuffix
+ *
+ * Returns:     TRUE, if p_str ends with p_suffix
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL StrHasSuffix (char *p_str, char *p_suffix)
+ {
+  LONG len = strlen (p_str);
+  LONG len_suffix = strlen (p_suffix);
+
+  if (len <= len_suffix)
+   return (FALSE);
+#ifdef SYS_AMIGA
+  return ((BOOL) (0 == strnicmp (&p_str[len-len_suffix], p_suffix, len_suffix)));
+#else
+  return ((BOOL) (0 == strncmp (&p_str[len-len_suffix], p_suffix, len_suffix)));
+#endif
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ParseLines
+ *
+ * Purpose:     read the range of the LINES option: <from> or <from>-<to>
+ *
+ * Parameters:  p_lines, p_from, p_to
+ *
+ * Returns:     FALSE, if it is no range of line numbers (1 ...)
+ *-----------------------------------------------------------------------------
+ */
+
+BOOL ParseLines (char *p_lines, LONG *p_from, LONG *p_to)
+ {
+  char *c;
+
+  if (!isdigit ((unsigned char) *p_lines))
+   return (FALSE);
+  *p_from = *p_to = strtol (p_lines, &c, 10);
+  if ('-' == *c)
+   {
+    if (!isdigit ((unsigned char) c[1]))
+     return (FALSE);
+    *p_to = strtol (&c[1], &c, 10);
+   }
+
+  return ((BOOL) (('\0' == *c) && (*p_from >= 1) && (*p_to >= *p_from)));
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   GzipFlag
+ *
+ * Returns:     IMDBV_FILE_GZIP for compressed files (with IMDB_ZLIB)
+ *-----------------------------------------------------------------------------
+ */
+
+LONG GzipFlag (char *p_name)
+ {
+#ifdef IMDB_ZLIB
+  if (StrHasSuffix (p_name, ".gz"))
+   return (IMDBV_FILE_GZIP);
+#endif
+  return (0);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   DiffFlags
+ *
+ * Purpose:     type of a diff-file by its name: movies.list (original),
+ *              movies.diff (stripped), also *.gz with zlib
+ *
+ * Returns:     IMDBV_DIFF_... (and IMDBV_FILE_GZIP) or 0 if unknown
+ *-----------------------------------------------------------------------------
+ */
+
+LONG DiffFlags (char *p_name)
+ {
+  char name[256];
+  LONG gzip = GzipFlag (p_name);
+
+  strncpy (name, p_name, 255);
+  name[255] = '\0';
+  if (gzip)
+   name[strlen(name)-3] = '\0';
+
+  if (StrHasSuffix (name, ".list"))
+   return (IMDBV_DIFF_ORIGINAL|gzip);
+  if (StrHasSuffix (name, ".diff"))
+   return (IMDBV_DIFF_STRIPPED|gzip);
+  return (0);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   LoadDiffs
+ *
+ * Purpose:     load the diff-files of all weeks and combine them
+ *
+ * Parameters:  diffs     array for the diffs of all weeks
+ *              p_result  combined diff (may be diffs[0])
+ *
+ * Returns:     number of diffs loaded, -1 if an error occurred
+ *-----------------------------------------------------------------------------
+ */
+
+LONG LoadDiffs (IMDB_Diff **diffs, IMDB_Diff **p_result)
+ {
+  IMDB_Diff *t_diff;
+  LONG       nb_diffs;
+  LONG       flags;
+  LONG       error;
+
+  *p_result = NULL;
+  for (nb_diffs = 0; nb_diffs < ad_cmds.nb_diffiles; nb_diffs++)
+   {
+    if (0 == (flags = DiffFlags (ad_cmds.p_diffiles[nb_diffs])))
+     {
+      printf ("Error: %s is no original or stripped diff-file\n", ad_cmds.p_diffiles[nb_diffs]);
+      break;
+     }
+    if (NULL == (diffs[nb_diffs] = IMDBLoadDiff (ad_cmds.p_diffiles[nb_diffs], flags, &error)))
+     {
+      printf ("Error: %s %s\n", (IMDBE_SYNTAX == error) ? "Syntax Error in" : "Can't load", ad_cmds.p_diffiles[nb_diffs]);
+      break;
+     }
+
+    /* a new listfile can only be introduced by the oldest diff */
+    if ((nb_diffs > 0) && (diffs[nb_diffs]->f_new))
+     {
+      printf ("Error: %s introduces the listfile again\n", ad_cmds.p_diffiles[nb_diffs]);
+      nb_diffs++;
+      break;
+     }
+
+    /* combine them */
+    if (0 == nb_diffs)
+     *p_result = diffs[0];
+    else
+     {
+      t_diff = IMDBComposeDiffs (*p_result, diffs[nb_diffs]);
+      if (*p_result != diffs[0])
+       IMDBFreeDiff (*p_result);
+      if (NULL == (*p_result = t_diff))
+       {
+        printf ("Error: Not enough memory\n");
+        nb_diffs++;
+        break;
+       }
+     }
+   }
+
+  if (nb_diffs < ad_cmds.nb_diffiles)
+   {
+    if ((*p_result) && (*p_result != diffs[0]))
+     IMDBFreeDiff (*p_result);
+    *p_result = NULL;
+    while (nb_diffs-- > 0)
+     IMDBFreeDiff (diffs[nb_diffs]);
+    return (-1);
+   }
+  return (nb_diffs);
+ }
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   ViewList
+ *
+ * Purpose:     show lines of the patched listfile, check its CRC and write
+ *              it (in the background, while the lines are shown)
+ *
+ * Returns:     RET_OK, RET_WARNING or RET_ERROR
+ *-----------------------------------------------------------------------------
+ */
+
+int ViewList (void)
+ {
+  IMDB_Diff *diffs[ADV_MAX_WEEKS];
+  IMDB_Diff *diff;
+  IMDB_View *view;
+  char       manifest[256];
+  char       crc_line[16];
+  char       new_crc[16];
+  char      *p_listfile = ad_cmds.p_list;
+  char      *p_line;
+  LONG       nb_diffs;
+  LONG       flags = 0;
+  LONG       from  = ad_cmds.from;
+  LONG       to    = ad_cmds.to;
+  LONG       error;
+  ULONG      crc;
+  int        ret_val = RET_OK;
+
+  if (0 > (nb_diffs = LoadDiffs (diffs, &diff)))
+   return (RET_ERROR);
+
+  /* the old listfile: plain, compressed or chunked */
+  sprintf (manifest, "%.240s" IMDBV_CHUNKS_EXT, p_listfile);
+  if (IMDBExistFile (p_listfile))
+   flags = GzipFlag (p_listfile);
+  else
+  if (IMDBExistFile (manifest))
+   flags = IMDBV_FILE_CHUNKS;
+  else
+  if (diff->f_new)
+   p_listfile = NULL;
+
+  if (NULL == (view = IMDBOpenView (p_listfile, flags, diff, &error)))
+   {
+    if (IMDBE_SYNTAX == error)
+     printf ("Error: The diffs don't fit %s\n", ad_cmds.p_list);
+    else
+    if (IMDBE_MEMORY == error)
+     printf ("Error: Not enough memory\n");
+    else
+     printf ("Error: Can't read %s\n", ad_cmds.p_list);
+    ret_val = RET_ERROR;
+   }
+  else
+   {
+    if (!ad_cmds.f_quiet)
+     printf ("%s: %li lines in %li pieces (%li weeks)\n", ad_cmds.p_list, view->nb_lines, view->nb_pieces, nb_diffs);
+
+    /* the CRC-line */
+    crc_line[0] = '\0';
+    if (IMDBE_NO_ERROR == IMDBViewLine (view, 1, &p_line))
+     {
+      strncpy (crc_line, p_line, 15);
+      crc_line[15] = '\0';
+     }
+
+    /* write it while the lines are shown */
+    if ((ad_cmds.p_output) && (IMDBStartWriteView (view, ad_cmds.p_output, GzipFlag (ad_cmds.p_output))))
+     {
+      printf ("Error: Can't write %s\n", ad_cmds.p_output);
+      ret_val = RET_ERROR;
+     }
+
+    if (ad_cmds.p_lines)
+     {
+      if (to > view->nb_lines)
+       to = view->nb_lines;
+
+      error = IMDBE_NO_ERROR;
+      if (from <= to)
+       error = IMDBViewLine (view, from, &p_line);
+      while ((from <= to) && (IMDBE_NO_ERROR == error))
+       {
+        puts (p_line);
+        if (from++ < to)
+         error = IMDBNextViewLine (view, &p_line);
+       }
+      if (IMDBE_NO_ERROR != error)
+       {
+        printf ("Error: Can't read %s\n", ad_cmds.p_list);
+        ret_val = RET_WARNING;
+       }
+     }
+
+    if ((ad_cmds.f_crc) && (RET_OK == ret_val))
+     {
+      error = IMDBViewCRC (view, &crc);
+      sprintf (new_crc, "CRC: 0x%08lX", crc);
+      if (error)
+       {
+        printf ("Error: Can't read %s\n", ad_cmds.p_list);
+        ret_val = RET_WARNING;
+       }
+      else
+      if (strcmp (crc_line, new_crc))
+       {
+        printf ("- CRC Error\n");
+        ret_val = RET_WARNING;
+       }
+      else
+      if (!ad_cmds.f_quiet)
+       printf ("- CRC-Checksum O.K.\n");
+     }
+
+    if ((ad_cmds.p_output) && (RET_ERROR != ret_val))
+     {
+      error = IMDBWaitWriteView (view, &crc);
+      sprintf (new_crc, "CRC: 0x%08lX", crc);
+      if (error)
+       {
+        printf ("Error: Can't write %s\n", ad_cmds.p_output);
+        ret_val = RET_WARNING;
+       }
+      else
+      if (strcmp (crc_line, new_crc))
+       {
+        printf ("- CRC Error, %s removed\n", ad_cmds.p_output);
+        remove (ad_cmds.p_output);
+        ret_val = RET_WARNING;
+       }
+      else
+      if (!ad_cmds.f_quiet)
+       printf ("- %s written, CRC-Checksum O.K.\n", ad_cmds.p_output);
+     }
+
+    IMDBCloseView (view);
+   }
+
+  if (diff != diffs[0])
+   IMDBFreeDiff (diff);
+  while (nb_diffs-- > 0)
+   IMDBFreeDiff (diffs[nb_diffs]);
+  return (ret_val);
+ }
+
+/******************************************************************************
+ *  Main - Procedure
+ ******************************************************************************
+ */
+
+/*-----------------------------------------------------------------------------
+ * Procedure:   main
+ *
+ * Parameters:  nb_args, filename
+ *
+ * Returns:
+ *-----------------------------------------------------------------------------
+ */
+
+int main(int argc, char *argv[])
+ {
+  int ret_val = RET_OK;
+  int i;
+
+  /* Parse command line parameters */
+#ifdef SYS_AMIGA
+  {
+   static const char Template[]    = "LIST/A,DIFF/A/M,LINES/K,CRC/S,OUTPUT/K,QUIET/S";
+   AD_Commands       cmdlineparams = {NULL, NULL, NULL, FALSE, NULL, FALSE, 0};
+   char            **pp_diffile;
+   struct RDArgs    *rda;
+
+   rda = ReadArgs((char*) Template, (LONG *) &cmdlineparams, NULL);
+
+   /* Get values */
+   if (cmdlineparams.p_list)
+    if (ad_cmds.p_list = IMDBAllocMemory (1+ strlen(cmdlineparams.p_list)))
+     strcpy(ad_cmds.p_list, cmdlineparams.p_list);
+
+   /* DIFF/M delivers an array of strings */
+   if (pp_diffile = (char **) cmdlineparams.p_diffile)
+    for (; (*pp_diffile) && (ad_cmds.nb_diffiles < ADV_MAX_WEEKS); pp_diffile++)
+     if (ad_cmds.p_diffiles[ad_cmds.nb_diffiles] = IMDBAllocMemory (1+ strlen(*pp_diffile)))
+      strcpy(ad_cmds.p_diffiles[ad_cmds.nb_diffiles++], *pp_diffile);
+
+   if (cmdlineparams.p_lines)
+    if (ad_cmds.p_lines = IMDBAllocMemory (1+ strlen(cmdlineparams.p_lines)))
+     strcpy(ad_cmds.p_lines, cmdlineparams.p_lines);
+
+   if (cmdlineparams.p_output)
+    if (ad_cmds.p_output = IMDBAllocMemory (1+ strlen(cmdlineparams.p_output)))
+     strcpy(ad_cmds.p_output, cmdlineparams.p_output);
+
+   ad_cmds.f_crc      = cmdlineparams.f_crc     ;
+   ad_cmds.f_quiet    = cmdlineparams.f_quiet   ;
+
+   /* Free ReadArgs parameters */
+   if (NULL == rda)
+    {
+     printf ("Template: %s\n",Template);
+     exit (RET_ERROR);
+    }
+   else
+    FreeArgs(rda);
+  }
+#endif
+
+#ifdef SYS_UNIX
+  {
+   static const char Template[] = "usage: ViewList <list> <diffile> [<diffile> ...] [-lines <from>[-<to>]][-crc][-output <filename>][-quiet]";
+
+   if (argc <3)
+    {
+     puts (Template);
+     exit (10);
+    }
+
+   /* listfile */
+   if (ad_cmds.p_list = IMDBAllocMemory (1 + strlen(argv[1])))
+    strcpy(ad_cmds.p_list, argv[1]);
+
+   /* Parse Command Line Parameters */
+   for (i=2; i < argc; i++)
+    {
+     if ('-' != argv[i][0])
+      {/* diff-file, one for each week */
+       if (ad_cmds.nb_diffiles >= ADV_MAX_WEEKS)
+        {
+         printf ("Error: Too many diff-files (max. %i)!\n", ADV_MAX_WEEKS);
+         exit (RET_ERROR);
+        }
+       if (ad_cmds.p_diffiles[ad_cmds.nb_diffiles] = IMDBAllocMemory (1 + strlen(argv[i])))
+        strcpy(ad_cmds.p_diffiles[ad_cmds.nb_diffiles++], argv[i]);
+      }
+     else
+     if (!strcmp(argv[i], "-crc"))
+      ad_cmds.f_crc      = TRUE;
+     else
+     if (!strcmp(argv[i], "-quiet"))
+      ad_cmds.f_quiet    = TRUE;
+     else
+     if ((!strcmp(argv[i], "-lines")) && (i+1 < argc))
+      {
+       if (ad_cmds.p_lines = IMDBAllocMemory (1 + strlen(argv[++i])))
+        strcpy(ad_cmds.p_lines, argv[i]);
+      }
+     else
+     if ((!strcmp(argv[i], "-output")) && (i+1 < argc))
+      {
+       if (ad_cmds.p_output = IMDBAllocMemory (1 + strlen(argv[++i])))
+        strcpy(ad_cmds.p_output, argv[i]);
+      }
+     else
+      {
+       puts (Template);
+       exit (10);
+      }
+    }
+  }
+#endif
+
+  /* Check Syntax */
+  if ((NULL == ad_cmds.p_list) || (0 == ad_cmds.nb_diffiles))
+   {
+    printf("Error: Listfile and diff-files needed!\n");
+    exit (RET_ERROR);
+   }
+  if ((ad_cmds.p_lines) && (!ParseLines (ad_cmds.p_lines, &ad_cmds.from, &ad_cmds.to)))
+   {
+    printf("Error: Invalid range of lines: %s (<from> or <from>-<to>, from 1 on)\n", ad_cmds.p_lines);
+    exit (RET_ERROR);
+   }
+
+  /* the lines are shown on stdout, so the title only without QUIET */
+  if (!ad_cmds.f_quiet)
+   printf (VERSION" - part of the DiffTools; (c) 1996-2001 IMDb Ltd.\n\n");
+
+  ret_val = ViewList ();
+
+  /* Free memory */
+  if (ad_cmds.p_list) IMDBFreeMemory(ad_cmds.p_list);
+  if (ad_cmds.p_lines) IMDBFreeMemory(ad_cmds.p_lines);
+  if (ad_cmds.p_output) IMDBFreeMemory(ad_cmds.p_output);
+  for (i = 0; i < ad_cmds.nb_diffiles; i++)
+   IMDBFreeMemory(ad_cmds.p_diffiles[i]);
+
+  if ((RET_OK != ret_val) && (!ad_cmds.f_quiet))
+   printf ("\nWARNING: ViewList encountered errors.\n");
+
+  exit (ret_val);
+ }
@@ -0,0 +1,259 @@
+/*-----------------------------------------------------------------------------
+ * imdbdiff.hpp
+ *
+ * A thin C++ layer over libimdbdiff (IMDB.h), only compiled by C++
+ * programs. Nothing here is built into the library.
+ *
+ * - Buffer, Diff and View own an IMDB_Buffer, IMDB_Diff or IMDB_View and
+ *   close or free it when they go out of scope.
+ * - View::lines() is a range of the lines of the patched listfile
+ *   (IMDBNextViewLine), to be used with an iterator-loop.
+ * - Apply() calls IMDBApplyDiff with any function object as line-hook.
+ *
+ * Errors are reported as in the C functions (IMDBE_xxx), there are no
+ * exceptions. All of it is C++98.
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef IMDBDIFF_HPP
+#define IMDBDIFF_HPP
+
+#include "IMDB.h"
+
+namespace imdbdiff
+ {
+
+/*-----------------------------------------------------------------------------
+ * Buffer: owns an IMDB_Buffer (IMDBOpenBuffer/IMDBCloseBuffer)
+ *-----------------------------------------------------------------------------
+ */
+
+class Buffer
+ {
+  public:
+   explicit Buffer (IMDB_Buffer *p_buffer = NULL) : p_buffer_ (p_buffer) {}
+   Buffer (const char *fname, LONG flags, LONG size = IMDBV_APPLY_BUFFER_SIZE)
+    : p_buffer_ (IMDBOpenBuffer (const_cast<char *> (fname), flags, size)) {}
+   ~Buffer () { close (); }
+
+   IMDB_Buffer *get () const { return (p_buffer_); }
+   bool ok () const { return (NULL != p_buffer_); }
+
+   /* IMDBE_NO_ERROR, IMDBE_FILE_EOF or IMDBE_FILE_READ; the line is valid
+    * up to the next read */
+   LONG readLine (char **pp_line, LONG max_size = IMDBV_APPLY_LINE_SIZE)
+    { return (IMDBReadBufferLine (p_buffer_, pp_line, max_size)); }
+
+   /* close it now, to see the error of the last write */
+   LONG close ()
+    {
+     LONG error = IMDBE_NO_ERROR;
+
+     if (p_buffer_)
+      error = IMDBCloseBuffer (p_buffer_);
+     p_buffer_ = NULL;
+     return (error);
+    }
+
+   IMDB_Buffer *release ()
+    {
+     IMDB_Buffer *p_buffer = p_buffer_;
+
+     p_buffer_ = NULL;
+     return (p_buffer);
+    }
+
+  private:
+   Buffer (const Buffer &);
+   Buffer &operator= (const Buffer &);
+
+   IMDB_Buffer *p_buffer_;
+ };
+
+/*-----------------------------------------------------------------------------
+ * Diff: owns an IMDB_Diff (IMDBLoadDiff/IMDBComposeDiffs/IMDBFreeDiff)
+ *
+ * A composed diff points to the texts of both diffs, so keep them as long
+ * as it is used.
+ *-----------------------------------------------------------------------------
+ */
+
+class Diff
+ {
+  public:
+   explicit Diff (IMDB_Diff *diff = NULL) : diff_ (diff) {}
+   Diff (const char *diffile, LONG flags, LONG *p_error)
+    : diff_ (IMDBLoadDiff (const_cast<char *> (diffile), flags, p_error)) {}
+   Diff (const Diff &first, const Diff &second)
+    : diff_ (IMDBComposeDiffs (first.diff_, second.diff_)) {}
+   ~Diff () { IMDBFreeDiff (diff_); }
+
+   IMDB_Diff *get () const { return (diff_); }
+   bool ok () const { return (NULL != diff_); }
+
+   IMDB_Diff *release ()
+    {
+     IMDB_Diff *diff = diff_;
+
+     diff_ = NULL;
+     return (diff);
+    }
+
+  private:
+   Diff (const Diff &);
+   Diff &operator= (const Diff &);
+
+   IMDB_Diff *diff_;
+ };
+
+/*-----------------------------------------------------------------------------
+ * LineRange: the lines of a view from the first one on
+ *
+ *   imdbdiff::LineRange lines = view.lines ();
+ *   for (imdbdiff::LineRange::iterator it = lines.begin (); it != lines.end (); ++it)
+ *    puts (*it);
+ *
+ * An input range: a line is valid up to the next step, and a view has only
+ * one position, so don't use two ranges of the same view at once. The
+ * iteration also ends on a read error, error() tells it afterwards.
+ *-----------------------------------------------------------------------------
+ */
+
+class LineRange
+ {
+  public:
+   class iterator
+    {
+     public:
+      iterator () : range_ (NULL), p_line_ (NULL), line_ (0) {}
+
+      char *operator* () const { return (p_line_); }
+      LONG  number () const { return (line_); }   /* number of the line (1 ...) */
+
+      iterator &operator++ ()
+       {
+        if (IMDBE_NO_ERROR == range_->next (&p_line_))
+         line_++;
+        else
+         {
+          range_  = NULL;
+          p_line_ = NULL;
+         }
+        return (*this);
+       }
+
+      bool operator== (const iterator &other) const { return (range_ == other.range_); }
+      bool operator!= (const iterator &other) const { return (range_ != other.range_); }
+
+     private:
+      friend class LineRange;
+
+      LineRange *range_;                   /* NULL: end of the range */
+      char      *p_line_;
+      LONG       line_;
+    };
+
+   explicit LineRange (IMDB_View *view) : view_ (view), error_ (IMDBE_NO_ERROR) {}
+
+   /* starts with the first line again */
+   iterator begin ()
+    {
+     iterator it;
+
+     error_ = IMDBViewLine (view_, 1, &it.p_line_);
+     if (IMDBE_NO_ERROR == error_)
+      {
+       it.range_ = this;
+       it.line_  = 1;
+      }
+     else
+     if (IMDBE_FILE_EOF == error_)
+      error_ = IMDBE_NO_ERROR;
+     return (it);
+    }
+   iterator end () { return (iterator ()); }
+
+   /* IMDBE_NO_ERROR or IMDBE_FILE_READ */
+   LONG error () const { return (error_); }
+
+  private:
+   LONG next (char **pp_line)
+    {
+     LONG ret = IMDBNextViewLine (view_, pp_line);
+
+     if (IMDBE_FILE_EOF != ret)
+      error_ = ret;
+     return (ret);
+    }
+
+   IMDB_View *view_;
+   LONG       error_;
+ };
+
+/*-----------------------------------------------------------------------------
+ * View: owns an IMDB_View (IMDBOpenView/IMDBCloseView)
+ *
+ * Keep the diff as long as the view is used.
+ *-----------------------------------------------------------------------------
+ */
+
+class View
+ {
+  public:
+   explicit View (IMDB_View *view = NULL) : view_ (view) {}
+   View (const char *listfile, LONG flags, const Diff &diff, LONG *p_error)
+    : view_ (IMDBOpenView (const_cast<char *> (listfile), flags, diff.get (), p_error)) {}
+   ~View () { IMDBCloseView (view_); }
+
+   IMDB_View *get () const { return (view_); }
+   bool ok () const { return (NULL != view_); }
+
+   LONG line (LONG line, char **pp_line) { return (IMDBViewLine (view_, line, pp_line)); }
+   LONG crc (ULONG *p_crc) { return (IMDBViewCRC (view_, p_crc)); }
+   LineRange lines () { return (LineRange (view_)); }
+
+   IMDB_View *release ()
+    {
+     IMDB_View *view = view_;
+
+     view_ = NULL;
+     return (view);
+    }
+
+  private:
+   View (const View &);
+   View &operator= (const View &);
+
+   IMDB_View *view_;
+ };
+
+/*-----------------------------------------------------------------------------
+ * Apply: IMDBApplyDiff with a function object as line-hook
+ *
+ *   struct Indexer
+ *    {
+ *     LONG operator() (LONG event, LONG old_line, LONG new_line, char *p_line);
+ *    };
+ *
+ * Its result is that of the hook: anything but 0 interrupts. Exceptions
+ * must not leave it, the C code in between can't pass them on.
+ *-----------------------------------------------------------------------------
+ */
+
+template <class Hook>
+LONG apply_hook (APTR user_data, LONG event, LONG old_line, LONG new_line, char *p_line)
+ {
+  return ((*static_cast<Hook *> (user_data)) (event, old_line, new_line, p_line));
+ }
+
+template <class Hook>
+LONG Apply (const char *listfile, LONG flags, const Diff &diff, const char *outfile, LONG out_flags,
+            Hook &hook, ULONG *p_crc = NULL)
+ {
+  return (IMDBApplyDiff (const_cast<char *> (listfile), flags, diff.get (), const_cast<char *> (outfile), out_flags,
+                         &apply_hook<Hook>, static_cast<APTR> (&hook), p_crc));
+ }
+
+ } /* namespace imdbdiff */
+
+#endif /* IMDBDIFF_HPP */
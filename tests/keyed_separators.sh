@@ -0,0 +1,47 @@
+#!/bin/sh
+# Key-addressed diffs of a list with equal lines between the records
+# (biographies.list: "-----" after every record).
+#
+# A line is inserted after the 30th separator. KEYED must not take the
+# separator as key of that hunk, or the hunk is applied after the first
+# one. The converted diff has to give the same listfile as the original.
+#
+# usage: tests/keyed_separators.sh [directory of ApplyDiffs]
+
+BIN=${1:-.}
+TMP=${TMPDIR:-/tmp}/keyed_separators.$$
+SEP=-------------------------------------------------------------------------------
+
+trap 'rm -rf $TMP' 0
+mkdir -p $TMP/lists $TMP/diffs $TMP/kdiffs $TMP/expect || exit 1
+
+records ()
+ {
+  i=0
+  while [ $i -lt 60 ]
+   do
+    printf 'Name%03d, Person\n\nBG: biography of %d\n\n%s\n' $i $i $SEP
+    if [ -n "$1" ] && [ $i -eq 29 ]
+     then
+      echo "Inserted line"
+     fi
+    i=`expr $i + 1`
+   done
+ }
+
+OLD="CRC: 0x8EF388E4  File: biographies.list  Date: Fri Oct 16 2026"
+NEW="CRC: 0xA788CFE1  File: biographies.list  Date: Sat Oct 17 2026"
+{ echo "$OLD"; records; }        > $TMP/lists/biographies.list
+{ echo "$NEW"; records insert; } > $TMP/expect/biographies.list
+printf '1c1\n< %s\n---\n> %s\n151a152\n> Inserted line\n' "$OLD" "$NEW" > $TMP/diffs/biographies.list
+
+$BIN/ApplyDiffs $TMP/lists $TMP/diffs -verify -keyed $TMP/kdiffs -quiet -nostats > $TMP/out.txt || { cat $TMP/out.txt; echo "FAILED: KEYED"; exit 1; }
+if grep -q -- "^@.* $SEP" $TMP/kdiffs/biographies.kdiff
+ then
+  cat $TMP/kdiffs/biographies.kdiff
+  echo "FAILED: separator used as key"
+  exit 1
+ fi
+$BIN/ApplyDiffs $TMP/lists $TMP/kdiffs -quiet -nostats > $TMP/out.txt || { cat $TMP/out.txt; echo "FAILED: applying the key-addressed diff"; exit 1; }
+cmp -s $TMP/lists/biographies.list $TMP/expect/biographies.list || { echo "FAILED: wrong listfile"; exit 1; }
+echo "keyed_separators: OK"